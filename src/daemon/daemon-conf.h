@@ -69,6 +69,7 @@ typedef struct pa_daemon_conf {
         disable_shm,
         disable_remixing,
         disable_lfe_remixing,
+        float_mixing,
         load_default_script_file,
         disallow_exit,
         log_meta,
@@ -128,6 +129,7 @@ typedef struct pa_daemon_conf {
     pa_sample_spec default_sample_spec;
     pa_channel_map default_channel_map;
     size_t shm_size;
+    unsigned object_cache_size;
 } pa_daemon_conf;
 
 /* Allocate a new structure and fill it with sane defaults */
@@ -90,6 +90,7 @@
 #include <pulsecore/once.h>
 #include <pulsecore/shm.h>
 #include <pulsecore/memtrap.h>
+#include <pulsecore/flist.h>
 #ifdef HAVE_DBUS
 #include <pulsecore/dbus-shared.h>
 #endif
@@ -873,6 +874,7 @@ int main(int argc, char *argv[]) {
     }
 
     pa_memtrap_install();
+    pa_flist_set_magazine_max(conf->object_cache_size);
 
     if (!getenv("PULSE_NO_SIMD")) {
         pa_cpu_init_x86();
@@ -897,6 +899,7 @@ int main(int argc, char *argv[]) {
     c->realtime_scheduling = !!conf->realtime_scheduling;
     c->disable_remixing = !!conf->disable_remixing;
     c->disable_lfe_remixing = !!conf->disable_lfe_remixing;
+    c->float_mixing = !!conf->float_mixing;
     c->running_as_daemon = !!conf->daemonize;
     c->disallow_exit = conf->disallow_exit;
     c->flat_volumes = conf->flat_volumes;
@@ -25,6 +25,7 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 
 #include <asoundlib.h>
 
@@ -89,6 +90,8 @@
 
 #define VOLUME_ACCURACY (PA_VOLUME_NORM/100)  /* don't require volume adjustments to be perfectly correct. don't necessarily extend granularity in software unless the differences get greater than this level */
 
+#define RENDER_CHAIN_MAX 8                                         /* Max. number of blocks we copy into the DMA area per mmap_begin() */
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -474,6 +477,36 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, pa_bool_t o
     return left_to_play;
 }
 
+/* Called from IO thread context */
+static void render_chain_into(struct userdata *u, uint8_t *p, size_t length) {
+    pa_memchunk chunks[RENDER_CHAIN_MAX];
+    unsigned n, k;
+
+    /* The sink input's blocks are passed through by reference, so the
+     * copy into the DMA area is the only one they ever see. Unlike
+     * rendering into a fixed memblock this also hands the monitor source
+     * references it may keep, instead of forcing pa_memblock_unref_fixed()
+     * to copy the DMA area out again. */
+    n = pa_sink_render_full_chain(u->sink, length, chunks, RENDER_CHAIN_MAX);
+
+    for (k = 0; k < n; k++) {
+
+        /* No need to read the silence, just fill the DMA area */
+        if (pa_memblock_is_silence(chunks[k].memblock))
+            pa_silence_memory(p, chunks[k].length, &u->sink->sample_spec);
+        else {
+            void *q;
+
+            q = pa_memblock_acquire(chunks[k].memblock);
+            memcpy(p, (uint8_t*) q + chunks[k].index, chunks[k].length);
+            pa_memblock_release(chunks[k].memblock);
+        }
+
+        p += chunks[k].length;
+        pa_memblock_unref(chunks[k].memblock);
+    }
+}
+
 static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled, pa_bool_t on_timeout) {
     pa_bool_t work_done = TRUE;
     pa_usec_t max_sleep_usec = 0, process_usec = 0;
@@ -604,12 +637,16 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polle
 
             p = (uint8_t*) areas[0].addr + (offset * u->frame_size);
 
-            chunk.memblock = pa_memblock_new_fixed(u->core->mempool, p, frames * u->frame_size, TRUE);
-            chunk.length = pa_memblock_get_length(chunk.memblock);
-            chunk.index = 0;
+            if (pa_sink_render_is_zero_copy(u->sink))
+                render_chain_into(u, p, frames * u->frame_size);
+            else {
+                chunk.memblock = pa_memblock_new_fixed(u->core->mempool, p, frames * u->frame_size, TRUE);
+                chunk.length = pa_memblock_get_length(chunk.memblock);
+                chunk.index = 0;
 
-            pa_sink_render_into_full(u->sink, &chunk);
-            pa_memblock_unref_fixed(chunk.memblock);
+                pa_sink_render_into_full(u->sink, &chunk);
+                pa_memblock_unref_fixed(chunk.memblock);
+            }
 
             if (PA_UNLIKELY((sframes = snd_pcm_mmap_commit(u->pcm_handle, offset, frames)) < 0)) {
 
@@ -1677,7 +1714,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     uint32_t nfrags, frag_size, buffer_size, tsched_size, tsched_watermark;
     snd_pcm_uframes_t period_frames, buffer_frames, tsched_frames;
     size_t frame_size;
-    pa_bool_t use_mmap = TRUE, b, use_tsched = TRUE, d, ignore_dB = FALSE;
+    pa_bool_t use_mmap = TRUE, b, use_tsched = TRUE, d, ignore_dB = FALSE, float_mixing;
     pa_sink_new_data data;
     pa_alsa_profile_set *profile_set = NULL;
 
@@ -1730,6 +1767,12 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    float_mixing = m->core->float_mixing;
+    if (pa_modargs_get_value_boolean(ma, "float_mixing", &float_mixing) < 0) {
+        pa_log("Failed to parse float_mixing argument.");
+        goto fail;
+    }
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -1847,6 +1890,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     set_sink_name(&data, ma, dev_id, u->device_name, mapping);
     pa_sink_new_data_set_sample_spec(&data, &ss);
     pa_sink_new_data_set_channel_map(&data, &map);
+    pa_sink_new_data_set_float_mixing(&data, float_mixing);
 
     pa_alsa_init_proplist_pcm(m->core, data.proplist, u->pcm_handle);
     pa_proplist_sets(data.proplist, PA_PROP_DEVICE_STRING, u->device_name);
@@ -54,6 +54,7 @@ PA_MODULE_USAGE(
         "tsched_buffer_size=<buffer size when using timer based scheduling> "
         "tsched_buffer_watermark=<lower fill watermark> "
         "ignore_dB=<ignore dB information from the device?> "
+        "float_mixing=<mix streams in floating point?> "
         "control=<name of mixer control>");
 
 static const char* const valid_modargs[] = {
@@ -73,6 +74,7 @@ static const char* const valid_modargs[] = {
     "tsched_buffer_size",
     "tsched_buffer_watermark",
     "ignore_dB",
+    "float_mixing",
     "control",
     NULL
 };
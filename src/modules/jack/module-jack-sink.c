@@ -128,20 +128,35 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             /* Handle the request from the JACK thread */
 
             if (u->sink->thread_info.state == PA_SINK_RUNNING) {
-                pa_memchunk chunk;
-                size_t nbytes;
-                void *p;
+                pa_memchunk chunks[8];
+                void *buffer[PA_CHANNELS_MAX];
+                size_t nbytes, frame_size;
+                unsigned n, k, c;
 
                 pa_assert(offset > 0);
-                nbytes = (size_t) offset * pa_frame_size(&u->sink->sample_spec);
+                frame_size = pa_frame_size(&u->sink->sample_spec);
+                nbytes = (size_t) offset * frame_size;
 
-                pa_sink_render_full(u->sink, nbytes, &chunk);
+                /* Deinterleave each rendered block on its own instead of
+                 * merging them into one block first */
+                n = pa_sink_render_full_chain(u->sink, nbytes, chunks, PA_ELEMENTSOF(chunks));
 
-                p = (uint8_t*) pa_memblock_acquire(chunk.memblock) + chunk.index;
-                pa_deinterleave(p, u->buffer, u->channels, sizeof(float), (unsigned) offset);
-                pa_memblock_release(chunk.memblock);
+                for (c = 0; c < u->channels; c++)
+                    buffer[c] = u->buffer[c];
+
+                for (k = 0; k < n; k++) {
+                    unsigned frames = (unsigned) (chunks[k].length / frame_size);
+                    void *p;
+
+                    p = (uint8_t*) pa_memblock_acquire(chunks[k].memblock) + chunks[k].index;
+                    pa_deinterleave(p, buffer, u->channels, sizeof(float), frames);
+                    pa_memblock_release(chunks[k].memblock);
+
+                    pa_memblock_unref(chunks[k].memblock);
 
-                pa_memblock_unref(chunk.memblock);
+                    for (c = 0; c < u->channels; c++)
+                        buffer[c] = (float*) buffer[c] + frames;
+                }
             } else {
                 unsigned c;
                 pa_sample_spec ss;
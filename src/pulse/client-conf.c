@@ -59,6 +59,8 @@ static const pa_client_conf default_conf = {
     .default_server = NULL,
     .autospawn = TRUE,
     .disable_shm = FALSE,
+    .disable_memfd = FALSE,
+    .disable_srbchannel = FALSE,
     .cookie_file = NULL,
     .cookie_valid = FALSE,
     .shm_size = 0
@@ -101,6 +103,8 @@ int pa_client_conf_load(pa_client_conf *c, const char *filename) {
         { "cookie-file",            pa_config_parse_string,   &c->cookie_file, NULL },
         { "disable-shm",            pa_config_parse_bool,     &c->disable_shm, NULL },
         { "enable-shm",             pa_config_parse_not_bool, &c->disable_shm, NULL },
+        { "enable-memfd",           pa_config_parse_not_bool, &c->disable_memfd, NULL },
+        { "enable-srbchannel",      pa_config_parse_not_bool, &c->disable_srbchannel, NULL },
         { "shm-size-bytes",         pa_config_parse_size,     &c->shm_size, NULL },
         { NULL,                     NULL,                     NULL, NULL },
     };
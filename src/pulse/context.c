@@ -125,6 +125,9 @@ static void reset_callbacks(pa_context *c) {
     c->subscribe_callback = NULL;
     c->subscribe_userdata = NULL;
 
+    c->subscribe_info_callback = NULL;
+    c->subscribe_info_userdata = NULL;
+
     c->event_callback = NULL;
     c->event_userdata = NULL;
 
@@ -180,6 +183,8 @@ pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *
     c->server = NULL;
 
     c->do_shm = FALSE;
+    c->timing_pages = FALSE;
+    c->subscribe_info = FALSE;
 
     c->server_specified = FALSE;
     c->no_fail = FALSE;
@@ -199,7 +204,10 @@ pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *
 #endif
     pa_client_conf_env(c->conf);
 
-    if (!(c->mempool = pa_mempool_new(!c->conf->disable_shm, c->conf->shm_size))) {
+    if (!c->conf->disable_shm && !c->conf->disable_memfd)
+        c->mempool = pa_mempool_new_memfd(c->conf->shm_size);
+
+    if (!c->mempool && !(c->mempool = pa_mempool_new(!c->conf->disable_shm, c->conf->shm_size))) {
 
         if (!c->conf->disable_shm)
             c->mempool = pa_mempool_new(FALSE, c->conf->shm_size);
@@ -450,7 +458,8 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
     switch(c->state) {
         case PA_CONTEXT_AUTHORIZING: {
             pa_tagstruct *reply;
-            pa_bool_t shm_on_remote = FALSE;
+            pa_bool_t shm_on_remote = FALSE, memfd_on_remote = FALSE, srb_on_remote = FALSE, timing_on_remote = FALSE;
+            pa_bool_t subscribe_info_on_remote = FALSE;
 
             if (pa_tagstruct_getu32(t, &c->version) < 0 ||
                 !pa_tagstruct_eof(t)) {
@@ -472,8 +481,23 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
                 c->version &= 0x7FFFFFFFU;
             }
 
+            /* Starting with protocol version 17 the second and third
+             * MSB tell us if it agreed to exchange memfd segments and
+             * to set up a ring buffer, the fourth one if it publishes
+             * playback timing there and the fifth one if it can send
+             * object info with subscription events */
+            if ((c->version & 0x07FFFFFFU) >= 17) {
+                memfd_on_remote = !!(c->version & 0x40000000U);
+                srb_on_remote = !!(c->version & 0x20000000U);
+                timing_on_remote = !!(c->version & 0x10000000U);
+                subscribe_info_on_remote = !!(c->version & 0x08000000U);
+                c->version &= 0x07FFFFFFU;
+            }
+
             pa_log_debug("Protocol version: remote %u, local %u", c->version, PA_PROTOCOL_VERSION);
 
+            c->subscribe_info = subscribe_info_on_remote;
+
             /* Enable shared memory support if possible */
             if (c->do_shm)
                 if (c->version < 10 || (c->version >= 13 && !shm_on_remote))
@@ -493,8 +517,17 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
             }
 
             pa_log_debug("Negotiated SHM: %s", pa_yes_no(c->do_shm));
+
+            if (c->do_shm && memfd_on_remote)
+                pa_pstream_enable_memfd(c->pstream, NULL);
+
             pa_pstream_enable_shm(c->pstream, c->do_shm);
 
+            if (c->do_shm && memfd_on_remote && srb_on_remote) {
+                pa_pstream_enable_srbchannel(c->pstream, FALSE);
+                c->timing_pages = timing_on_remote;
+            }
+
             reply = pa_tagstruct_command(c, PA_COMMAND_SET_CLIENT_NAME, &tag);
 
             if (c->version >= 13) {
@@ -561,8 +594,15 @@ static void setup_context(pa_context *c, pa_iochannel *io) {
     pa_log_debug("SHM possible: %s", pa_yes_no(c->do_shm));
 
     /* Starting with protocol version 13 we use the MSB of the version
-     * tag for informing the other side if we could do SHM or not */
-    pa_tagstruct_putu32(t, PA_PROTOCOL_VERSION | (c->do_shm ? 0x80000000U : 0));
+     * tag for informing the other side if we could do SHM or not.
+     * Starting with version 17 the second MSB says that our segments
+     * are memfds, the third one that we can take a ring buffer, the
+     * fourth one that we can read our timing from it and the fifth
+     * one that we understand subscription events with object info. */
+    if (c->do_shm && pa_mempool_is_memfd_backed(c->mempool))
+        pa_tagstruct_putu32(t, PA_PROTOCOL_VERSION | 0x80000000U | 0x40000000U | (c->conf->disable_srbchannel ? 0 : 0x30000000U) | 0x08000000U);
+    else
+        pa_tagstruct_putu32(t, PA_PROTOCOL_VERSION | (c->do_shm ? 0x80000000U : 0) | 0x08000000U);
     pa_tagstruct_put_arbitrary(t, c->conf->cookie, sizeof(c->conf->cookie));
 
 #ifdef HAVE_CREDS
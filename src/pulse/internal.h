@@ -80,6 +80,8 @@ struct pa_context {
     void *state_userdata;
     pa_context_subscribe_cb_t subscribe_callback;
     void *subscribe_userdata;
+    pa_context_subscribe_info_cb_t subscribe_info_callback;
+    void *subscribe_info_userdata;
     pa_context_event_cb_t event_callback;
     void *event_userdata;
 
@@ -91,6 +93,8 @@ struct pa_context {
     pa_bool_t no_fail:1;
     pa_bool_t do_autospawn:1;
     pa_bool_t use_rtclock:1;
+    pa_bool_t timing_pages:1;
+    pa_bool_t subscribe_info:1;
     pa_spawn_api spawn_api;
 
     pa_strlist *server_list;
@@ -185,6 +189,11 @@ struct pa_stream {
 
     pa_smoother *smoother;
 
+    /* Published by the server in the ring buffer segment, and the
+     * tag of the last timing reply we got */
+    pa_timing_page *timing_page;
+    uint32_t timing_info_tag;
+
     /* Callbacks */
     pa_stream_notify_cb_t state_callback;
     void *state_userdata;
@@ -230,6 +239,7 @@ struct pa_operation {
 void pa_command_request(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 void pa_command_stream_killed(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+void pa_context_dispatch_subscribe_info(pa_context *c, pa_pdispatch *pd, pa_subscription_event_type_t e, pa_tagstruct *t);
 void pa_command_overflow_or_underflow(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 void pa_command_stream_suspended(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 void pa_command_stream_moved(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
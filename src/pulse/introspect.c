@@ -1877,3 +1877,114 @@ pa_operation* pa_context_suspend_source_by_index(pa_context *c, uint32_t idx, in
 
     return o;
 }
+
+/*** Subscription info ***/
+
+static void subscribe_info(pa_context *c, void *userdata, uint32_t idx, const void *info) {
+    if (c->subscribe_info_callback)
+        c->subscribe_info_callback(c, (pa_subscription_event_type_t) PA_PTR_TO_UINT32(userdata), idx, info, c->subscribe_info_userdata);
+}
+
+static void subscribe_sink_info_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    if (i)
+        subscribe_info(c, userdata, i->index, i);
+}
+
+static void subscribe_source_info_cb(pa_context *c, const pa_source_info *i, int eol, void *userdata) {
+    if (i)
+        subscribe_info(c, userdata, i->index, i);
+}
+
+static void subscribe_sink_input_info_cb(pa_context *c, const pa_sink_input_info *i, int eol, void *userdata) {
+    if (i)
+        subscribe_info(c, userdata, i->index, i);
+}
+
+static void subscribe_source_output_info_cb(pa_context *c, const pa_source_output_info *i, int eol, void *userdata) {
+    if (i)
+        subscribe_info(c, userdata, i->index, i);
+}
+
+static void subscribe_module_info_cb(pa_context *c, const pa_module_info *i, int eol, void *userdata) {
+    if (i)
+        subscribe_info(c, userdata, i->index, i);
+}
+
+static void subscribe_client_info_cb(pa_context *c, const pa_client_info *i, int eol, void *userdata) {
+    if (i)
+        subscribe_info(c, userdata, i->index, i);
+}
+
+static void subscribe_sample_info_cb(pa_context *c, const pa_sample_info *i, int eol, void *userdata) {
+    if (i)
+        subscribe_info(c, userdata, i->index, i);
+}
+
+static void subscribe_card_info_cb(pa_context *c, const pa_card_info *i, int eol, void *userdata) {
+    if (i)
+        subscribe_info(c, userdata, i->index, i);
+}
+
+/* Hands the object info that came with a subscription event to the
+ * reply callback of the matching info request, which passes it on to
+ * the subscribe info callback */
+void pa_context_dispatch_subscribe_info(pa_context *c, pa_pdispatch *pd, pa_subscription_event_type_t e, pa_tagstruct *t) {
+    pa_pdispatch_cb_t parse;
+    pa_operation_cb_t cb;
+    pa_operation *o;
+
+    pa_assert(c);
+    pa_assert(pd);
+    pa_assert(t);
+
+    switch (e & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) {
+
+        case PA_SUBSCRIPTION_EVENT_SINK:
+            parse = context_get_sink_info_callback;
+            cb = (pa_operation_cb_t) subscribe_sink_info_cb;
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE:
+            parse = context_get_source_info_callback;
+            cb = (pa_operation_cb_t) subscribe_source_info_cb;
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+            parse = context_get_sink_input_info_callback;
+            cb = (pa_operation_cb_t) subscribe_sink_input_info_cb;
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT:
+            parse = context_get_source_output_info_callback;
+            cb = (pa_operation_cb_t) subscribe_source_output_info_cb;
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_MODULE:
+            parse = context_get_module_info_callback;
+            cb = (pa_operation_cb_t) subscribe_module_info_cb;
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_CLIENT:
+            parse = context_get_client_info_callback;
+            cb = (pa_operation_cb_t) subscribe_client_info_cb;
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE:
+            parse = context_get_sample_info_callback;
+            cb = (pa_operation_cb_t) subscribe_sample_info_cb;
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_CARD:
+            parse = context_get_card_info_callback;
+            cb = (pa_operation_cb_t) subscribe_card_info_cb;
+            break;
+
+        default:
+            pa_context_fail(c, PA_ERR_PROTOCOL);
+            return;
+    }
+
+    /* The parser consumes the reference */
+    o = pa_operation_new(c, NULL, cb, PA_UINT32_TO_PTR(e));
+    parse(pd, PA_COMMAND_REPLY, (uint32_t) -1, t, o);
+}
@@ -42,6 +42,10 @@
 #include <pulsecore/pipe.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #include <pulse/i18n.h>
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -54,6 +58,7 @@
 #include <pulsecore/core-error.h>
 #include <pulsecore/winsock.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/prioq.h>
 
 #include "mainloop.h"
 #include "internal.h"
@@ -62,6 +67,9 @@ struct pa_io_event {
     pa_mainloop *mainloop;
     pa_bool_t dead:1;
 
+    /* Whether the fd is registered with epoll, otherwise it is polled */
+    pa_bool_t epoll:1;
+
     int fd;
     pa_io_event_flags_t events;
     struct pollfd *pollfd;
@@ -73,14 +81,27 @@ struct pa_io_event {
     PA_LLIST_FIELDS(pa_io_event);
 };
 
+#ifdef HAVE_SYS_EPOLL_H
+/* How many events we take from the kernel at once, the rest is
+ * picked up in the next iteration */
+#define EPOLL_EVENTS_MAX 64
+#endif
+
 struct pa_time_event {
     pa_mainloop *mainloop;
     pa_bool_t dead:1;
 
     pa_bool_t enabled:1;
     pa_bool_t use_rtclock:1;
+    pa_bool_t due:1;
     pa_usec_t time;
 
+    /* Our place in the heap while enabled */
+    pa_prioq_item *item;
+
+    /* Link in the list of events that are due in this iteration */
+    pa_time_event *next_due;
+
     pa_time_event_cb_t callback;
     void *userdata;
     pa_time_event_destroy_cb_t destroy_callback;
@@ -113,8 +134,19 @@ struct pa_mainloop {
     struct pollfd *pollfds;
     unsigned max_pollfds, n_pollfds;
 
+#ifdef HAVE_SYS_EPOLL_H
+    /* The io events live in an epoll set, whose fd is polled together
+     * with the wakeup pipe and the few fds epoll cannot handle */
+    int epoll_fd;
+    struct pollfd *epoll_pollfd;
+    struct epoll_event epoll_events[EPOLL_EVENTS_MAX];
+    int n_epoll_events;
+#endif
+    unsigned n_polled_io_events;
+
     pa_usec_t prepared_timeout;
-    pa_time_event *cached_next_time_event;
+    /* The enabled time events, ordered by their deadline */
+    pa_prioq *time_event_queue;
 
     pa_mainloop_api api;
 
@@ -154,6 +186,79 @@ static pa_io_event_flags_t map_flags_from_libc(short flags) {
         (flags & POLLHUP ? PA_IO_EVENT_HANGUP : 0);
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+static uint32_t map_flags_to_epoll(pa_io_event_flags_t flags) {
+    return
+        (flags & PA_IO_EVENT_INPUT ? EPOLLIN : 0) |
+        (flags & PA_IO_EVENT_OUTPUT ? EPOLLOUT : 0) |
+        (flags & PA_IO_EVENT_ERROR ? EPOLLERR : 0) |
+        (flags & PA_IO_EVENT_HANGUP ? EPOLLHUP : 0);
+}
+
+static pa_io_event_flags_t map_flags_from_epoll(uint32_t flags) {
+    return
+        (flags & EPOLLIN ? PA_IO_EVENT_INPUT : 0) |
+        (flags & EPOLLOUT ? PA_IO_EVENT_OUTPUT : 0) |
+        (flags & EPOLLERR ? PA_IO_EVENT_ERROR : 0) |
+        (flags & EPOLLHUP ? PA_IO_EVENT_HANGUP : 0);
+}
+
+static void epoll_watch(pa_io_event *e) {
+    pa_mainloop *m = e->mainloop;
+    struct epoll_event ev;
+
+    if (m->epoll_fd < 0)
+        return;
+
+    pa_zero(ev);
+    ev.events = map_flags_to_epoll(e->events);
+    ev.data.ptr = e;
+
+    /* Regular files and the like, as well as fds that are watched
+     * twice are left to poll() */
+    e->epoll = epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, e->fd, &ev) >= 0;
+}
+
+static void epoll_rebuild(pa_mainloop *m);
+
+static void epoll_unwatch(pa_io_event *e) {
+    pa_mainloop *m = e->mainloop;
+
+    if (!e->epoll)
+        return;
+
+    e->epoll = FALSE;
+
+    /* If the fd was closed before the event was freed it might still
+     * be known to the kernel under a dup()ed fd, and would come back
+     * with a dangling pointer. So start over in that case. */
+    if (epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, e->fd, NULL) < 0)
+        epoll_rebuild(m);
+}
+
+static void epoll_rebuild(pa_mainloop *m) {
+    pa_io_event *e;
+
+    pa_close(m->epoll_fd);
+
+    if ((m->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        pa_log_warn("epoll_create1() failed, falling back to poll(): %s", pa_cstrerror(errno));
+
+    m->n_epoll_events = 0;
+
+    PA_LLIST_FOREACH(e, m->io_events) {
+
+        if (e->dead)
+            continue;
+
+        e->epoll = FALSE;
+        epoll_watch(e);
+    }
+
+    m->rebuild_pollfds = TRUE;
+}
+#endif
+
 /* IO events */
 static pa_io_event* mainloop_io_new(
         pa_mainloop_api*a,
@@ -203,9 +308,16 @@ static pa_io_event* mainloop_io_new(
 #endif
 
     PA_LLIST_PREPEND(pa_io_event, m->io_events, e);
-    m->rebuild_pollfds = TRUE;
     m->n_io_events ++;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (!e->dead)
+        epoll_watch(e);
+#endif
+
+    if (!e->epoll)
+        m->rebuild_pollfds = TRUE;
+
     pa_mainloop_wakeup(m);
 
     return e;
@@ -220,6 +332,25 @@ static void mainloop_io_enable(pa_io_event *e, pa_io_event_flags_t events) {
 
     e->events = events;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (e->epoll) {
+        struct epoll_event ev;
+
+        pa_zero(ev);
+        ev.events = map_flags_to_epoll(events);
+        ev.data.ptr = e;
+
+        if (epoll_ctl(e->mainloop->epoll_fd, EPOLL_CTL_MOD, e->fd, &ev) >= 0)
+            return;
+
+        /* Leave it to poll() from now on */
+        epoll_unwatch(e);
+
+        if (e->epoll)
+            return;
+    }
+#endif
+
     if (e->pollfd)
         e->pollfd->events = map_flags_to_libc(events);
     else
@@ -236,7 +367,14 @@ static void mainloop_io_free(pa_io_event *e) {
     e->mainloop->io_events_please_scan ++;
 
     e->mainloop->n_io_events --;
-    e->mainloop->rebuild_pollfds = TRUE;
+
+#ifdef HAVE_SYS_EPOLL_H
+    /* Right away, while the fd is most likely still open */
+    if (e->epoll)
+        epoll_unwatch(e);
+    else
+#endif
+        e->mainloop->rebuild_pollfds = TRUE;
 
     pa_mainloop_wakeup(e->mainloop);
 }
@@ -335,6 +473,41 @@ static pa_usec_t make_rt(const struct timeval *tv, pa_bool_t *use_rtclock) {
     return pa_timeval_load(&ttv);
 }
 
+static int time_event_compare(const void *a, const void *b) {
+    const pa_time_event *x = a, *y = b;
+
+    return x->time < y->time ? -1 : (x->time > y->time ? 1 : 0);
+}
+
+static void time_event_enable(pa_time_event *e, pa_usec_t t, pa_bool_t use_rtclock) {
+    pa_mainloop *m = e->mainloop;
+
+    e->time = t;
+    e->use_rtclock = use_rtclock;
+
+    if (e->enabled)
+        pa_prioq_reshuffle(m->time_event_queue, e->item);
+    else {
+        e->enabled = TRUE;
+        e->item = pa_prioq_put(m->time_event_queue, e);
+        m->n_enabled_time_events++;
+    }
+}
+
+static void time_event_disable(pa_time_event *e) {
+    pa_mainloop *m = e->mainloop;
+
+    if (!e->enabled)
+        return;
+
+    pa_prioq_remove(m->time_event_queue, e->item);
+    e->item = NULL;
+    e->enabled = FALSE;
+
+    pa_assert(m->n_enabled_time_events > 0);
+    m->n_enabled_time_events--;
+}
+
 static pa_time_event* mainloop_time_new(
         pa_mainloop_api*a,
         const struct timeval *tv,
@@ -358,19 +531,8 @@ static pa_time_event* mainloop_time_new(
     e = pa_xnew0(pa_time_event, 1);
     e->mainloop = m;
 
-    if ((e->enabled = (t != PA_USEC_INVALID))) {
-        e->time = t;
-        e->use_rtclock= use_rtclock;
-
-        m->n_enabled_time_events++;
-
-        if (m->cached_next_time_event) {
-            pa_assert(m->cached_next_time_event->enabled);
-
-            if (t < m->cached_next_time_event->time)
-                m->cached_next_time_event = e;
-        }
-    }
+    if (t != PA_USEC_INVALID)
+        time_event_enable(e, t, use_rtclock);
 
     e->callback = callback;
     e->userdata = userdata;
@@ -384,7 +546,6 @@ static pa_time_event* mainloop_time_new(
 }
 
 static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
-    pa_bool_t valid;
     pa_usec_t t;
     pa_bool_t use_rtclock = FALSE;
 
@@ -393,26 +554,14 @@ static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
 
     t = make_rt(tv, &use_rtclock);
 
-    valid = (t != PA_USEC_INVALID);
-    if (e->enabled && !valid) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
-    } else if (!e->enabled && valid)
-        e->mainloop->n_enabled_time_events++;
+    /* Restarting an event that is about to be dispatched cancels that */
+    e->due = FALSE;
 
-    if ((e->enabled = valid)) {
-        e->time = t;
-        e->use_rtclock = use_rtclock;
+    if (t != PA_USEC_INVALID) {
+        time_event_enable(e, t, use_rtclock);
         pa_mainloop_wakeup(e->mainloop);
-    }
-
-    if (e->mainloop->cached_next_time_event && e->enabled) {
-        pa_assert(e->mainloop->cached_next_time_event->enabled);
-
-        if (t < e->mainloop->cached_next_time_event->time)
-            e->mainloop->cached_next_time_event = e;
-    } else if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
+    } else
+        time_event_disable(e);
 }
 
 static void mainloop_time_free(pa_time_event *e) {
@@ -422,14 +571,7 @@ static void mainloop_time_free(pa_time_event *e) {
     e->dead = TRUE;
     e->mainloop->time_events_please_scan ++;
 
-    if (e->enabled) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
-        e->enabled = FALSE;
-    }
-
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
+    time_event_disable(e);
 
     /* no wakeup needed here. Think about it! */
 }
@@ -495,6 +637,13 @@ pa_mainloop *pa_mainloop_new(void) {
 
     m->rebuild_pollfds = TRUE;
 
+    m->time_event_queue = pa_prioq_new(time_event_compare);
+
+#ifdef HAVE_SYS_EPOLL_H
+    if ((m->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        pa_log_debug("epoll_create1() failed, using poll(): %s", pa_cstrerror(errno));
+#endif
+
     m->api = vtable;
     m->api.userdata = m;
 
@@ -524,9 +673,11 @@ static void cleanup_io_events(pa_mainloop *m, pa_bool_t force) {
             if (e->destroy_callback)
                 e->destroy_callback(&m->api, e, e->userdata);
 
-            pa_xfree(e);
+            /* Events in the epoll set never had a pollfd */
+            if (e->pollfd)
+                m->rebuild_pollfds = TRUE;
 
-            m->rebuild_pollfds = TRUE;
+            pa_xfree(e);
         }
     }
 
@@ -549,11 +700,8 @@ static void cleanup_time_events(pa_mainloop *m, pa_bool_t force) {
                 m->time_events_please_scan--;
             }
 
-            if (!e->dead && e->enabled) {
-                pa_assert(m->n_enabled_time_events > 0);
-                m->n_enabled_time_events--;
-                e->enabled = FALSE;
-            }
+            if (!e->dead)
+                time_event_disable(e);
 
             if (e->destroy_callback)
                 e->destroy_callback(&m->api, e, e->userdata);
@@ -605,8 +753,15 @@ void pa_mainloop_free(pa_mainloop* m) {
     cleanup_defer_events(m, TRUE);
     cleanup_time_events(m, TRUE);
 
+    pa_prioq_free(m->time_event_queue, NULL, NULL);
+
     pa_xfree(m->pollfds);
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (m->epoll_fd >= 0)
+        pa_close(m->epoll_fd);
+#endif
+
     pa_close_pipe(m->wakeup_pipe);
 
     pa_xfree(m);
@@ -630,7 +785,7 @@ static void rebuild_pollfds(pa_mainloop *m) {
     struct pollfd *p;
     unsigned l;
 
-    l = m->n_io_events + 1;
+    l = m->n_io_events + 2;
     if (m->max_pollfds < l) {
         l *= 2;
         m->pollfds = pa_xrealloc(m->pollfds, sizeof(struct pollfd)*l);
@@ -638,6 +793,7 @@ static void rebuild_pollfds(pa_mainloop *m) {
     }
 
     m->n_pollfds = 0;
+    m->n_polled_io_events = 0;
     p = m->pollfds;
 
     if (m->wakeup_pipe[0] >= 0) {
@@ -648,8 +804,21 @@ static void rebuild_pollfds(pa_mainloop *m) {
         m->n_pollfds++;
     }
 
+#ifdef HAVE_SYS_EPOLL_H
+    m->epoll_pollfd = NULL;
+
+    if (m->epoll_fd >= 0) {
+        m->epoll_pollfd = p;
+        p->fd = m->epoll_fd;
+        p->events = POLLIN;
+        p->revents = 0;
+        p++;
+        m->n_pollfds++;
+    }
+#endif
+
     PA_LLIST_FOREACH(e, m->io_events) {
-        if (e->dead) {
+        if (e->dead || e->epoll) {
             e->pollfd = NULL;
             continue;
         }
@@ -661,6 +830,7 @@ static void rebuild_pollfds(pa_mainloop *m) {
 
         p++;
         m->n_pollfds++;
+        m->n_polled_io_events++;
     }
 
     m->rebuild_pollfds = FALSE;
@@ -674,6 +844,39 @@ static unsigned dispatch_pollfds(pa_mainloop *m) {
 
     k = m->poll_func_ret;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (m->epoll_pollfd && m->epoll_pollfd->revents) {
+        int i;
+
+        m->epoll_pollfd->revents = 0;
+        k--;
+
+        /* The set is ready, so this doesn't block */
+        if ((m->n_epoll_events = epoll_wait(m->epoll_fd, m->epoll_events, EPOLL_EVENTS_MAX, 0)) < 0) {
+            pa_log("epoll_wait(): %s", pa_cstrerror(errno));
+            m->n_epoll_events = 0;
+        }
+
+        for (i = 0; i < m->n_epoll_events && !m->quit; i++) {
+            e = m->epoll_events[i].data.ptr;
+
+            /* Freed events are only marked dead until the next
+             * iteration, so the pointer is still good */
+            if (e->dead || !e->epoll)
+                continue;
+
+            pa_assert(e->callback);
+            e->callback(&m->api, e, e->fd, map_flags_from_epoll(m->epoll_events[i].events), e->userdata);
+            r++;
+        }
+
+        m->n_epoll_events = 0;
+    }
+
+    if (m->n_polled_io_events <= 0)
+        return r;
+#endif
+
     PA_LLIST_FOREACH(e, m->io_events) {
 
         if (k <= 0 || m->quit)
@@ -717,31 +920,6 @@ static unsigned dispatch_defer(pa_mainloop *m) {
     return r;
 }
 
-static pa_time_event* find_next_time_event(pa_mainloop *m) {
-    pa_time_event *t, *n = NULL;
-    pa_assert(m);
-
-    if (m->cached_next_time_event)
-        return m->cached_next_time_event;
-
-    PA_LLIST_FOREACH(t, m->time_events) {
-
-        if (t->dead || !t->enabled)
-            continue;
-
-        if (!n || t->time < n->time) {
-            n = t;
-
-            /* Shortcut for time == 0 */
-            if (n->time == 0)
-                break;
-        }
-    }
-
-    m->cached_next_time_event = n;
-    return n;
-}
-
 static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     pa_time_event *t;
     pa_usec_t clock_now;
@@ -749,7 +927,7 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     if (m->n_enabled_time_events <= 0)
         return PA_USEC_INVALID;
 
-    pa_assert_se(t = find_next_time_event(m));
+    pa_assert_se(t = pa_prioq_peek(m->time_event_queue));
 
     if (t->time <= 0)
         return 0;
@@ -763,7 +941,7 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
 }
 
 static unsigned dispatch_timeout(pa_mainloop *m) {
-    pa_time_event *e;
+    pa_time_event *e, *due = NULL, **tail = &due;
     pa_usec_t now;
     unsigned r = 0;
     pa_assert(m);
@@ -773,25 +951,39 @@ static unsigned dispatch_timeout(pa_mainloop *m) {
 
     now = pa_rtclock_now();
 
-    PA_LLIST_FOREACH(e, m->time_events) {
+    /* Take everything that is due off the heap first, so that events
+     * which are restarted from a callback fire in the next iteration
+     * at the earliest */
+    while ((e = pa_prioq_peek(m->time_event_queue)) && e->time <= now) {
 
-        if (m->quit)
-            break;
+        /* Disable time event */
+        time_event_disable(e);
 
-        if (e->dead || !e->enabled)
-            continue;
+        e->due = TRUE;
+        e->next_due = NULL;
+        *tail = e;
+        tail = &e->next_due;
+    }
 
-        if (e->time <= now) {
-            struct timeval tv;
-            pa_assert(e->callback);
+    for (e = due; e; e = e->next_due) {
+        struct timeval tv;
 
-            /* Disable time event */
-            mainloop_time_restart(e, NULL);
+        /* Freed or restarted by an earlier callback */
+        if (e->dead || !e->due)
+            continue;
 
-            e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+        e->due = FALSE;
 
-            r++;
+        /* Leave the rest for whoever runs us next */
+        if (m->quit) {
+            time_event_enable(e, e->time, e->use_rtclock);
+            continue;
         }
+
+        pa_assert(e->callback);
+        e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+
+        r++;
     }
 
     return r;
@@ -30,7 +30,7 @@
 #include "internal.h"
 #include "operation.h"
 
-PA_STATIC_FLIST_DECLARE(operations, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(operations, 0, 16, pa_xfree);
 
 pa_operation *pa_operation_new(pa_context *c, pa_stream *s, pa_operation_cb_t cb, void *userdata) {
     pa_operation *o;
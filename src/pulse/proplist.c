@@ -33,17 +33,128 @@
 #include <pulsecore/hashmap.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/once.h>
 
 #include "proplist.h"
 
+/* A proplist is a flat array of properties in the order they were
+ * set. They are few enough that a scan over the key hashes beats a
+ * hash table, and much smaller. Copies share the array until one of
+ * them is changed.
+ *
+ * Keys and values are refcounted on their own, so that a list that
+ * stops sharing the array still shares the strings. That also keeps
+ * what pa_proplist_gets() and friends returned valid until the entry
+ * itself is changed, no matter who else shared the list. */
+
+struct blob {
+    PA_REFCNT_DECLARE;
+};
+
+#define BLOB_DATA(b) ((uint8_t*) (b) + PA_ALIGN(sizeof(struct blob)))
+#define BLOB_FROM_DATA(d) ((struct blob*) ((uint8_t*) (d) - PA_ALIGN(sizeof(struct blob))))
+
 struct property {
     char *key;
+    unsigned hash;
+    pa_bool_t interned;
+
     void *value;
     size_t nbytes;
 };
 
-#define MAKE_HASHMAP(p) ((pa_hashmap*) (p))
-#define MAKE_PROPLIST(p) ((pa_proplist*) (p))
+struct properties {
+    PA_REFCNT_DECLARE;
+    unsigned n, allocated;
+};
+
+struct pa_proplist {
+    /* NULL while empty */
+    struct properties *properties;
+};
+
+#define ENTRIES(s) ((struct property*) ((uint8_t*) (s) + PA_ALIGN(sizeof(struct properties))))
+
+#define INITIAL_ENTRIES 8
+
+/* The well-known keys are not copied into every proplist that uses
+ * them */
+static const char * const well_known_keys[] = {
+    PA_PROP_MEDIA_NAME,
+    PA_PROP_MEDIA_TITLE,
+    PA_PROP_MEDIA_ARTIST,
+    PA_PROP_MEDIA_COPYRIGHT,
+    PA_PROP_MEDIA_SOFTWARE,
+    PA_PROP_MEDIA_LANGUAGE,
+    PA_PROP_MEDIA_FILENAME,
+    PA_PROP_MEDIA_ICON,
+    PA_PROP_MEDIA_ICON_NAME,
+    PA_PROP_MEDIA_ROLE,
+    PA_PROP_MEDIA_POLICY,
+    PA_PROP_EVENT_ID,
+    PA_PROP_EVENT_DESCRIPTION,
+    PA_PROP_EVENT_MOUSE_X,
+    PA_PROP_EVENT_MOUSE_Y,
+    PA_PROP_EVENT_MOUSE_HPOS,
+    PA_PROP_EVENT_MOUSE_VPOS,
+    PA_PROP_EVENT_MOUSE_BUTTON,
+    PA_PROP_WINDOW_NAME,
+    PA_PROP_WINDOW_ID,
+    PA_PROP_WINDOW_ICON,
+    PA_PROP_WINDOW_ICON_NAME,
+    PA_PROP_WINDOW_X,
+    PA_PROP_WINDOW_Y,
+    PA_PROP_WINDOW_WIDTH,
+    PA_PROP_WINDOW_HEIGHT,
+    PA_PROP_WINDOW_HPOS,
+    PA_PROP_WINDOW_VPOS,
+    PA_PROP_WINDOW_DESKTOP,
+    PA_PROP_WINDOW_X11_DISPLAY,
+    PA_PROP_WINDOW_X11_SCREEN,
+    PA_PROP_WINDOW_X11_MONITOR,
+    PA_PROP_WINDOW_X11_XID,
+    PA_PROP_APPLICATION_NAME,
+    PA_PROP_APPLICATION_ID,
+    PA_PROP_APPLICATION_VERSION,
+    PA_PROP_APPLICATION_ICON,
+    PA_PROP_APPLICATION_ICON_NAME,
+    PA_PROP_APPLICATION_LANGUAGE,
+    PA_PROP_APPLICATION_PROCESS_ID,
+    PA_PROP_APPLICATION_PROCESS_BINARY,
+    PA_PROP_APPLICATION_PROCESS_USER,
+    PA_PROP_APPLICATION_PROCESS_HOST,
+    PA_PROP_APPLICATION_PROCESS_MACHINE_ID,
+    PA_PROP_APPLICATION_PROCESS_SESSION_ID,
+    PA_PROP_DEVICE_STRING,
+    PA_PROP_DEVICE_API,
+    PA_PROP_DEVICE_DESCRIPTION,
+    PA_PROP_DEVICE_BUS_PATH,
+    PA_PROP_DEVICE_SERIAL,
+    PA_PROP_DEVICE_VENDOR_ID,
+    PA_PROP_DEVICE_VENDOR_NAME,
+    PA_PROP_DEVICE_PRODUCT_ID,
+    PA_PROP_DEVICE_PRODUCT_NAME,
+    PA_PROP_DEVICE_CLASS,
+    PA_PROP_DEVICE_FORM_FACTOR,
+    PA_PROP_DEVICE_BUS,
+    PA_PROP_DEVICE_ICON,
+    PA_PROP_DEVICE_ICON_NAME,
+    PA_PROP_DEVICE_ACCESS_MODE,
+    PA_PROP_DEVICE_MASTER_DEVICE,
+    PA_PROP_DEVICE_BUFFERING_BUFFER_SIZE,
+    PA_PROP_DEVICE_BUFFERING_FRAGMENT_SIZE,
+    PA_PROP_DEVICE_PROFILE_NAME,
+    PA_PROP_DEVICE_INTENDED_ROLES,
+    PA_PROP_DEVICE_PROFILE_DESCRIPTION,
+    PA_PROP_MODULE_AUTHOR,
+    PA_PROP_MODULE_DESCRIPTION,
+    PA_PROP_MODULE_USAGE,
+    PA_PROP_MODULE_VERSION,
+};
+
+#define INTERN_TABLE_SIZE 256
+static const char *intern_table[INTERN_TABLE_SIZE];
 
 static pa_bool_t property_name_valid(const char *key) {
 
@@ -56,30 +167,197 @@ static pa_bool_t property_name_valid(const char *key) {
     return TRUE;
 }
 
-static void property_free(struct property *prop) {
+static unsigned key_hash(const char *key) {
+    return pa_idxset_string_hash_func(key);
+}
+
+static const char *intern(const char *key, unsigned hash) {
+    unsigned i;
+
+    PA_ONCE_BEGIN {
+        unsigned j;
+
+        pa_assert(PA_ELEMENTSOF(well_known_keys) < INTERN_TABLE_SIZE / 2);
+
+        for (j = 0; j < PA_ELEMENTSOF(well_known_keys); j++) {
+            for (i = key_hash(well_known_keys[j]) & (INTERN_TABLE_SIZE - 1); intern_table[i]; i = (i + 1) & (INTERN_TABLE_SIZE - 1))
+                ;
+
+            intern_table[i] = well_known_keys[j];
+        }
+    } PA_ONCE_END;
+
+    for (i = hash & (INTERN_TABLE_SIZE - 1); intern_table[i]; i = (i + 1) & (INTERN_TABLE_SIZE - 1))
+        if (intern_table[i] == key || pa_streq(intern_table[i], key))
+            return intern_table[i];
+
+    return NULL;
+}
+
+/* Returns a refcounted copy of data, followed by a NUL byte */
+static void* blob_new(const void *data, size_t nbytes) {
+    struct blob *b;
+
+    b = pa_xmalloc(PA_ALIGN(sizeof(struct blob)) + nbytes + 1);
+    PA_REFCNT_INIT(b);
+
+    if (nbytes > 0)
+        memcpy(BLOB_DATA(b), data, nbytes);
+    BLOB_DATA(b)[nbytes] = 0;
+
+    return BLOB_DATA(b);
+}
+
+static void* blob_ref(void *data) {
+    PA_REFCNT_INC(BLOB_FROM_DATA(data));
+    return data;
+}
+
+static void blob_unref(void *data) {
+    struct blob *b = BLOB_FROM_DATA(data);
+
+    pa_assert(PA_REFCNT_VALUE(b) >= 1);
+
+    if (PA_REFCNT_DEC(b) <= 0)
+        pa_xfree(b);
+}
+
+static struct properties* properties_new(unsigned allocated) {
+    struct properties *s;
+
+    s = pa_xmalloc(PA_ALIGN(sizeof(struct properties)) + allocated * sizeof(struct property));
+    PA_REFCNT_INIT(s);
+    s->n = 0;
+    s->allocated = allocated;
+
+    return s;
+}
+
+static void property_done(struct property *prop) {
     pa_assert(prop);
 
-    pa_xfree(prop->key);
-    pa_xfree(prop->value);
-    pa_xfree(prop);
+    if (!prop->interned)
+        blob_unref(prop->key);
+    blob_unref(prop->value);
+}
+
+static void properties_unref(struct properties *s) {
+    unsigned i;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    if (PA_REFCNT_DEC(s) > 0)
+        return;
+
+    for (i = 0; i < s->n; i++)
+        property_done(&ENTRIES(s)[i]);
+
+    pa_xfree(s);
+}
+
+static struct property* find(pa_proplist *p, const char *key) {
+    struct property *e;
+    unsigned i, hash;
+
+    if (!p->properties)
+        return NULL;
+
+    hash = key_hash(key);
+    e = ENTRIES(p->properties);
+
+    for (i = 0; i < p->properties->n; i++)
+        if (e[i].hash == hash && (e[i].key == key || pa_streq(e[i].key, key)))
+            return &e[i];
+
+    return NULL;
+}
+
+/* Makes sure nobody else sees what we are about to change */
+static void make_writable(pa_proplist *p) {
+    struct properties *s, *n;
+    struct property *from, *to;
+    unsigned i;
+
+    if (!(s = p->properties)) {
+        p->properties = properties_new(INITIAL_ENTRIES);
+        return;
+    }
+
+    if (PA_REFCNT_VALUE(s) <= 1)
+        return;
+
+    n = properties_new(s->allocated);
+    from = ENTRIES(s);
+    to = ENTRIES(n);
+
+    /* Only the array is copied, the strings are shared */
+    for (i = 0; i < s->n; i++) {
+        to[i] = from[i];
+
+        if (!to[i].interned)
+            blob_ref(to[i].key);
+
+        blob_ref(to[i].value);
+    }
+
+    n->n = s->n;
+    properties_unref(s);
+    p->properties = n;
+}
+
+/* Sets the property to the value, taking over a reference to it. The
+ * value has to be a blob. */
+static void put(pa_proplist *p, const char *key, void *value, size_t nbytes) {
+    struct property *prop;
+
+    make_writable(p);
+
+    if ((prop = find(p, key)))
+        blob_unref(prop->value);
+    else {
+        struct properties *s = p->properties;
+        const char *k;
+
+        if (s->n >= s->allocated) {
+            s->allocated *= 2;
+            p->properties = s = pa_xrealloc(s, PA_ALIGN(sizeof(struct properties)) + s->allocated * sizeof(struct property));
+        }
+
+        prop = &ENTRIES(s)[s->n++];
+        prop->hash = key_hash(key);
+
+        if ((k = intern(key, prop->hash))) {
+            prop->key = (char*) k;
+            prop->interned = TRUE;
+        } else {
+            prop->key = blob_new(key, strlen(key));
+            prop->interned = FALSE;
+        }
+    }
+
+    prop->value = value;
+    prop->nbytes = nbytes;
 }
 
 pa_proplist* pa_proplist_new(void) {
-    return MAKE_PROPLIST(pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func));
+    pa_proplist *p;
+
+    p = pa_xnew(pa_proplist, 1);
+    p->properties = NULL;
+
+    return p;
 }
 
 void pa_proplist_free(pa_proplist* p) {
     pa_assert(p);
 
     pa_proplist_clear(p);
-    pa_hashmap_free(MAKE_HASHMAP(p), NULL, NULL);
+    pa_xfree(p);
 }
 
 /** Will accept only valid UTF-8 */
 int pa_proplist_sets(pa_proplist *p, const char *key, const char *value) {
-    struct property *prop;
-    pa_bool_t add = FALSE;
-
     pa_assert(p);
     pa_assert(key);
     pa_assert(value);
@@ -87,26 +365,13 @@ int pa_proplist_sets(pa_proplist *p, const char *key, const char *value) {
     if (!property_name_valid(key) || !pa_utf8_valid(value))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = TRUE;
-    } else
-        pa_xfree(prop->value);
-
-    prop->value = pa_xstrdup(value);
-    prop->nbytes = strlen(value)+1;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    put(p, key, blob_new(value, strlen(value)+1), strlen(value)+1);
 
     return 0;
 }
 
 /** Will accept only valid UTF-8 */
 static int proplist_setn(pa_proplist *p, const char *key, size_t key_length, const char *value, size_t value_length) {
-    struct property *prop;
-    pa_bool_t add = FALSE;
     char *k, *v;
 
     pa_assert(p);
@@ -122,20 +387,9 @@ static int proplist_setn(pa_proplist *p, const char *key, size_t key_length, con
         return -1;
     }
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), k))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = k;
-        add = TRUE;
-    } else {
-        pa_xfree(prop->value);
-        pa_xfree(k);
-    }
-
-    prop->value = v;
-    prop->nbytes = strlen(v)+1;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    put(p, k, blob_new(v, strlen(v)+1), strlen(v)+1);
+    pa_xfree(k);
+    pa_xfree(v);
 
     return 0;
 }
@@ -156,8 +410,6 @@ int pa_proplist_setp(pa_proplist *p, const char *pair) {
 }
 
 static int proplist_sethex(pa_proplist *p, const char *key, size_t key_length, const char *value, size_t value_length) {
-    struct property *prop;
-    pa_bool_t add = FALSE;
     char *k, *v;
     uint8_t *d;
     size_t dn;
@@ -185,29 +437,15 @@ static int proplist_sethex(pa_proplist *p, const char *key, size_t key_length, c
 
     pa_xfree(v);
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), k))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = k;
-        add = TRUE;
-    } else {
-        pa_xfree(prop->value);
-        pa_xfree(k);
-    }
-
-    d[dn] = 0;
-    prop->value = d;
-    prop->nbytes = dn;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    put(p, k, blob_new(d, dn), dn);
+    pa_xfree(k);
+    pa_xfree(d);
 
     return 0;
 }
 
 /** Will accept only valid UTF-8 */
 int pa_proplist_setf(pa_proplist *p, const char *key, const char *format, ...) {
-    struct property *prop;
-    pa_bool_t add = FALSE;
     va_list ap;
     char *v;
 
@@ -225,18 +463,8 @@ int pa_proplist_setf(pa_proplist *p, const char *key, const char *format, ...) {
     if (!pa_utf8_valid(v))
         goto fail;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = TRUE;
-    } else
-        pa_xfree(prop->value);
-
-    prop->value = v;
-    prop->nbytes = strlen(v)+1;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    put(p, key, blob_new(v, strlen(v)+1), strlen(v)+1);
+    pa_xfree(v);
 
     return 0;
 
@@ -246,9 +474,6 @@ fail:
 }
 
 int pa_proplist_set(pa_proplist *p, const char *key, const void *data, size_t nbytes) {
-    struct property *prop;
-    pa_bool_t add = FALSE;
-
     pa_assert(p);
     pa_assert(key);
     pa_assert(data || nbytes == 0);
@@ -256,21 +481,7 @@ int pa_proplist_set(pa_proplist *p, const char *key, const void *data, size_t nb
     if (!property_name_valid(key))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = TRUE;
-    } else
-        pa_xfree(prop->value);
-
-    prop->value = pa_xmalloc(nbytes+1);
-    if (nbytes > 0)
-        memcpy(prop->value, data, nbytes);
-    ((char*) prop->value)[nbytes] = 0;
-    prop->nbytes = nbytes;
-
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    put(p, key, blob_new(data, nbytes), nbytes);
 
     return 0;
 }
@@ -284,7 +495,7 @@ const char *pa_proplist_gets(pa_proplist *p, const char *key) {
     if (!property_name_valid(key))
         return NULL;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key)))
+    if (!(prop = find(p, key)))
         return NULL;
 
     if (prop->nbytes <= 0)
@@ -313,7 +524,7 @@ int pa_proplist_get(pa_proplist *p, const char *key, const void **data, size_t *
     if (!property_name_valid(key))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key)))
+    if (!(prop = find(p, key)))
         return -1;
 
     *data = prop->value;
@@ -323,8 +534,8 @@ int pa_proplist_get(pa_proplist *p, const char *key, const void **data, size_t *
 }
 
 void pa_proplist_update(pa_proplist *p, pa_update_mode_t mode, pa_proplist *other) {
-    struct property *prop;
-    void *state = NULL;
+    struct property *e;
+    unsigned i;
 
     pa_assert(p);
     pa_assert(mode == PA_UPDATE_SET || mode == PA_UPDATE_MERGE || mode == PA_UPDATE_REPLACE);
@@ -333,17 +544,33 @@ void pa_proplist_update(pa_proplist *p, pa_update_mode_t mode, pa_proplist *othe
     if (mode == PA_UPDATE_SET)
         pa_proplist_clear(p);
 
-    while ((prop = pa_hashmap_iterate(MAKE_HASHMAP(other), &state, NULL))) {
+    if (!other->properties)
+        return;
+
+    /* Into an empty list we can just share */
+    if (!p->properties) {
+        PA_REFCNT_INC(other->properties);
+        p->properties = other->properties;
+        return;
+    }
+
+    e = ENTRIES(other->properties);
 
-        if (mode == PA_UPDATE_MERGE && pa_proplist_contains(p, prop->key))
+    for (i = 0; i < other->properties->n; i++) {
+
+        if (mode == PA_UPDATE_MERGE && find(p, e[i].key))
             continue;
 
-        pa_assert_se(pa_proplist_set(p, prop->key, prop->value, prop->nbytes) == 0);
+        put(p, e[i].key, blob_ref(e[i].value), e[i].nbytes);
+
+        /* Setting might have unshared us from other */
+        e = ENTRIES(other->properties);
     }
 }
 
 int pa_proplist_unset(pa_proplist *p, const char *key) {
     struct property *prop;
+    struct properties *s;
 
     pa_assert(p);
     pa_assert(key);
@@ -351,10 +578,18 @@ int pa_proplist_unset(pa_proplist *p, const char *key) {
     if (!property_name_valid(key))
         return -1;
 
-    if (!(prop = pa_hashmap_remove(MAKE_HASHMAP(p), key)))
+    if (!find(p, key))
         return -2;
 
-    property_free(prop);
+    make_writable(p);
+    pa_assert_se(prop = find(p, key));
+
+    property_done(prop);
+
+    s = p->properties;
+    memmove(prop, prop + 1, (size_t) (ENTRIES(s) + s->n - (prop + 1)) * sizeof(struct property));
+    s->n--;
+
     return 0;
 }
 
@@ -377,12 +612,18 @@ int pa_proplist_unset_many(pa_proplist *p, const char * const keys[]) {
 }
 
 const char *pa_proplist_iterate(pa_proplist *p, void **state) {
-    struct property *prop;
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(state);
 
-    if (!(prop = pa_hashmap_iterate(MAKE_HASHMAP(p), state, NULL)))
+    i = PA_PTR_TO_UINT(*state);
+
+    if (!p->properties || i >= p->properties->n)
         return NULL;
 
-    return prop->key;
+    *state = PA_UINT_TO_PTR(i + 1);
+    return ENTRIES(p->properties)[i].key;
 }
 
 char *pa_proplist_to_string_sep(pa_proplist *p, const char *sep) {
@@ -631,7 +872,7 @@ pa_proplist *pa_proplist_from_string(const char *s) {
     }
 
 success:
-    return MAKE_PROPLIST(pl);
+    return pl;
 
 fail:
     pa_proplist_free(pl);
@@ -645,18 +886,19 @@ int pa_proplist_contains(pa_proplist *p, const char *key) {
     if (!property_name_valid(key))
         return -1;
 
-    if (!(pa_hashmap_get(MAKE_HASHMAP(p), key)))
+    if (!find(p, key))
         return 0;
 
     return 1;
 }
 
 void pa_proplist_clear(pa_proplist *p) {
-    struct property *prop;
     pa_assert(p);
 
-    while ((prop = pa_hashmap_steal_first(MAKE_HASHMAP(p))))
-        property_free(prop);
+    if (p->properties) {
+        properties_unref(p->properties);
+        p->properties = NULL;
+    }
 }
 
 pa_proplist* pa_proplist_copy(pa_proplist *template) {
@@ -673,11 +915,11 @@ pa_proplist* pa_proplist_copy(pa_proplist *template) {
 unsigned pa_proplist_size(pa_proplist *p) {
     pa_assert(p);
 
-    return pa_hashmap_size(MAKE_HASHMAP(p));
+    return p->properties ? p->properties->n : 0;
 }
 
 int pa_proplist_isempty(pa_proplist *p) {
     pa_assert(p);
 
-    return pa_hashmap_isempty(MAKE_HASHMAP(p));
+    return !p->properties || p->properties->n == 0;
 }
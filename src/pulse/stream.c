@@ -170,6 +170,9 @@ pa_stream *pa_stream_new_with_proplist(
 
     s->smoother = NULL;
 
+    s->timing_page = NULL;
+    s->timing_info_tag = 0;
+
     /* Refcounting is strictly one-way: from the "bigger" to the "smaller" object. */
     PA_LLIST_PREPEND(pa_stream, c->streams, s);
     pa_stream_ref(s);
@@ -209,6 +212,9 @@ static void stream_unlink(pa_stream *s) {
 
     s->context = NULL;
 
+    /* It goes away with the connection */
+    s->timing_page = NULL;
+
     if (s->auto_timing_update_event) {
         pa_assert(s->mainloop);
         s->mainloop->time_free(s->auto_timing_update_event);
@@ -306,7 +312,68 @@ void pa_stream_set_state(pa_stream *s, pa_stream_state_t st) {
     pa_stream_unref(s);
 }
 
+static void update_smoother(pa_stream *s, pa_usec_t u);
+
+/* Refreshes the timing info from the page the server keeps up to date
+ * for this stream. Returns FALSE if we have to ask the server. */
+static pa_bool_t update_timing_info_from_page(pa_stream *s) {
+    pa_timing_info *i;
+    pa_timing_data d;
+    pa_usec_t now;
+
+    pa_assert(s);
+
+    if (!s->timing_page || s->state != PA_STREAM_READY)
+        return FALSE;
+
+    /* After a flush or seek the page might still show the indexes
+     * from before, so wait until the server answered a request made
+     * after it */
+    if (s->auto_timing_update_requested ||
+        s->timing_info_tag < s->write_index_not_before ||
+        s->timing_info_tag < s->read_index_not_before)
+        return FALSE;
+
+    if (pa_timing_page_read(s->timing_page, &d) < 0)
+        return FALSE;
+
+    now = pa_rtclock_now();
+
+    if (d.timestamp > now)
+        return FALSE;
+
+    i = &s->timing_info;
+
+    i->sink_usec = d.sink_usec;
+    i->source_usec = 0;
+    i->playing = (int) d.playing;
+    i->since_underrun = (int64_t) (d.playing ? d.playing_for : d.underrun_for);
+    i->read_index = d.read_index;
+    i->read_index_corrupt = FALSE;
+
+    /* What we wrote ourselves since might not have reached the IO
+     * thread yet, and pa_stream_write() accounts for it anyway */
+    if (!s->timing_info_valid || i->write_index_corrupt) {
+        i->write_index = d.write_index;
+        i->write_index_corrupt = FALSE;
+    }
+
+    /* We share the host and hence the clock with the server */
+    i->transport_usec = 0;
+    i->synchronized_clocks = TRUE;
+    pa_gettimeofday(&i->timestamp);
+    pa_timeval_sub(&i->timestamp, now - d.timestamp);
+
+    s->timing_info_valid = TRUE;
+
+    update_smoother(s, d.timestamp);
+
+    return TRUE;
+}
+
 static void request_auto_timing_update(pa_stream *s, pa_bool_t force) {
+    pa_bool_t from_page = FALSE;
+
     pa_assert(s);
     pa_assert(PA_REFCNT_VALUE(s) >= 1);
 
@@ -319,7 +386,11 @@ static void request_auto_timing_update(pa_stream *s, pa_bool_t force) {
 
 /*         pa_log("Automatically requesting new timing data"); */
 
-        if ((o = pa_stream_update_timing_info(s, NULL, NULL))) {
+        /* Changes we made ourselves have to be confirmed by the
+         * server, everything else we can read from the timing page */
+        if (!force && update_timing_info_from_page(s))
+            from_page = TRUE;
+        else if ((o = pa_stream_update_timing_info(s, NULL, NULL))) {
             pa_operation_unref(o);
             s->auto_timing_update_requested = TRUE;
         }
@@ -333,6 +404,10 @@ static void request_auto_timing_update(pa_stream *s, pa_bool_t force) {
 
         s->auto_timing_interval_usec = PA_MIN(AUTO_TIMING_INTERVAL_END_USEC, s->auto_timing_interval_usec*2);
     }
+
+    /* Last, since the callback might disconnect us */
+    if (from_page && s->latency_update_callback)
+        s->latency_update_callback(s, s->latency_update_userdata);
 }
 
 void pa_command_stream_killed(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -977,6 +1052,19 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
             s->timing_info.configured_sink_usec = usec;
     }
 
+    if (s->context->timing_pages && s->direction == PA_STREAM_PLAYBACK) {
+        uint32_t idx;
+        pa_srbchannel *srb;
+
+        if (pa_tagstruct_getu32(t, &idx) < 0) {
+            pa_context_fail(s->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        if (idx != PA_INVALID_INDEX && (srb = pa_pstream_get_srbchannel(s->context->pstream)))
+            s->timing_page = pa_srbchannel_get_timing_page(srb, idx);
+    }
+
     if (!pa_tagstruct_eof(t)) {
         pa_context_fail(s->context, PA_ERR_PROTOCOL);
         goto finish;
@@ -1554,6 +1642,43 @@ static pa_usec_t calc_time(pa_stream *s, pa_bool_t ignore_transport) {
     return usec;
 }
 
+/* Feeds the timing info into the smoother, u being the time when it
+ * was current */
+static void update_smoother(pa_stream *s, pa_usec_t u) {
+    pa_timing_info *i = &s->timing_info;
+    pa_usec_t x;
+
+    if (!s->smoother)
+        return;
+
+    x = u;
+
+    if (s->direction == PA_STREAM_PLAYBACK && s->context->version >= 13) {
+        pa_usec_t su;
+
+        /* If we weren't playing then it will take some time
+         * until the audio will actually come out through the
+         * speakers. Since we follow that timing here, we need
+         * to try to fix this up */
+
+        su = pa_bytes_to_usec((uint64_t) i->since_underrun, &s->sample_spec);
+
+        if (su < i->sink_usec)
+            x += i->sink_usec - su;
+    }
+
+    if (!i->playing)
+        pa_smoother_pause(s->smoother, x);
+
+    /* Update the smoother */
+    if ((s->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
+        (s->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
+        pa_smoother_put(s->smoother, u, calc_time(s, TRUE));
+
+    if (i->playing)
+        pa_smoother_resume(s->smoother, x, TRUE);
+}
+
 static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     struct timeval local, remote, now;
@@ -1607,6 +1732,7 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
             goto finish;
         }
         o->stream->timing_info_valid = TRUE;
+        o->stream->timing_info_tag = tag;
         i->write_index_corrupt = FALSE;
         i->read_index_corrupt = FALSE;
 
@@ -1692,37 +1818,7 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
                 i->read_index -= (int64_t) pa_memblockq_get_length(o->stream->record_memblockq);
         }
 
-        /* Update smoother */
-        if (o->stream->smoother) {
-            pa_usec_t u, x;
-
-            u = x = pa_rtclock_now() - i->transport_usec;
-
-            if (o->stream->direction == PA_STREAM_PLAYBACK && o->context->version >= 13) {
-                pa_usec_t su;
-
-                /* If we weren't playing then it will take some time
-                 * until the audio will actually come out through the
-                 * speakers. Since we follow that timing here, we need
-                 * to try to fix this up */
-
-                su = pa_bytes_to_usec((uint64_t) i->since_underrun, &o->stream->sample_spec);
-
-                if (su < i->sink_usec)
-                    x += i->sink_usec - su;
-            }
-
-            if (!i->playing)
-                pa_smoother_pause(o->stream->smoother, x);
-
-            /* Update the smoother */
-            if ((o->stream->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
-                (o->stream->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
-                pa_smoother_put(o->stream->smoother, u, calc_time(o->stream, TRUE));
-
-            if (i->playing)
-                pa_smoother_resume(o->stream->smoother, x, TRUE);
-        }
+        update_smoother(o->stream, pa_rtclock_now() - i->transport_usec);
     }
 
     o->stream->auto_timing_update_requested = FALSE;
@@ -2220,6 +2316,10 @@ int pa_stream_get_time(pa_stream *s, pa_usec_t *r_usec) {
     PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
     PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+
+    if (s->flags & PA_STREAM_AUTO_TIMING_UPDATE)
+        update_timing_info_from_page(s);
+
     PA_CHECK_VALIDITY(s->context, s->timing_info_valid, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_PLAYBACK || !s->timing_info.read_index_corrupt, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_RECORD || !s->timing_info.write_index_corrupt, PA_ERR_NODATA);
@@ -2273,6 +2373,10 @@ int pa_stream_get_latency(pa_stream *s, pa_usec_t *r_usec, int *negative) {
     PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
     PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+
+    if (s->flags & PA_STREAM_AUTO_TIMING_UPDATE)
+        update_timing_info_from_page(s);
+
     PA_CHECK_VALIDITY(s->context, s->timing_info_valid, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_PLAYBACK || !s->timing_info.write_index_corrupt, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_RECORD || !s->timing_info.read_index_corrupt, PA_ERR_NODATA);
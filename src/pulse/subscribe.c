@@ -49,7 +49,7 @@ void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag
 
     if (pa_tagstruct_getu32(t, &e) < 0 ||
         pa_tagstruct_getu32(t, &idx) < 0 ||
-        !pa_tagstruct_eof(t)) {
+        (!c->subscribe_info && !pa_tagstruct_eof(t))) {
         pa_context_fail(c, PA_ERR_PROTOCOL);
         goto finish;
     }
@@ -57,11 +57,20 @@ void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag
     if (c->subscribe_callback)
         c->subscribe_callback(c, e, idx, c->subscribe_userdata);
 
+    if (c->subscribe_info_callback) {
+        /* The object info is parsed the same way as the reply to an
+         * info request */
+        if (!pa_tagstruct_eof(t))
+            pa_context_dispatch_subscribe_info(c, pd, e, t);
+        else
+            c->subscribe_info_callback(c, e, idx, NULL, c->subscribe_info_userdata);
+    }
+
 finish:
     pa_context_unref(c);
 }
 
-pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+static pa_operation* subscribe(pa_context *c, pa_subscription_mask_t m, pa_bool_t with_info, pa_context_success_cb_t cb, void *userdata) {
     pa_operation *o;
     pa_tagstruct *t;
     uint32_t tag;
@@ -70,17 +79,28 @@ pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_c
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
 
     PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !with_info || c->subscribe_info, PA_ERR_NOTSUPPORTED);
 
     o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
 
     t = pa_tagstruct_command(c, PA_COMMAND_SUBSCRIBE, &tag);
     pa_tagstruct_putu32(t, m);
+    if (c->subscribe_info)
+        pa_tagstruct_put_boolean(t, with_info);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, pa_context_simple_ack_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
     return o;
 }
 
+pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+    return subscribe(c, m, FALSE, cb, userdata);
+}
+
+pa_operation* pa_context_subscribe_with_info(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+    return subscribe(c, m, TRUE, cb, userdata);
+}
+
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata) {
     pa_assert(c);
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
@@ -91,3 +111,14 @@ void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t
     c->subscribe_callback = cb;
     c->subscribe_userdata = userdata;
 }
+
+void pa_context_set_subscribe_info_callback(pa_context *c, pa_context_subscribe_info_cb_t cb, void *userdata) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    if (c->state == PA_CONTEXT_TERMINATED || c->state == PA_CONTEXT_FAILED)
+        return;
+
+    c->subscribe_info_callback = cb;
+    c->subscribe_info_userdata = userdata;
+}
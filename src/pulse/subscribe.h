@@ -42,6 +42,12 @@
  * The application sets the notification mask using pa_context_subscribe()
  * and the function that will be called whenever a notification occurs using
  * pa_context_set_subscribe_callback().
+ *
+ * Applications that keep a copy of the server state would normally
+ * query the object again for every event they get. With
+ * pa_context_subscribe_with_info() instead the server sends the new
+ * state of the object along with the event, which is passed to the
+ * function set with pa_context_set_subscribe_info_callback().
  */
 
 /** \file
@@ -58,6 +64,26 @@ pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_c
 /** Set the context specific call back function that is called whenever the state of the daemon changes */
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata);
 
+/** Subscription event callback prototype that also gets the new state
+ * of the object. Depending on the facility of the event info points
+ * to a pa_sink_info, pa_source_info, pa_sink_input_info,
+ * pa_source_output_info, pa_module_info, pa_client_info,
+ * pa_sample_info or pa_card_info which is only valid during the
+ * call. It is NULL for remove events, for server events and for
+ * objects that were gone before the event was sent. \since 0.9.22 */
+typedef void (*pa_context_subscribe_info_cb_t)(pa_context *c, pa_subscription_event_type_t t, uint32_t idx, const void *info, void *userdata);
+
+/** Enable event notification, and have the server send the new state
+ * of objects along with the events. Fails with PA_ERR_NOTSUPPORTED if
+ * the server cannot do that. \since 0.9.22 */
+pa_operation* pa_context_subscribe_with_info(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata);
+
+/** Set the call back function that is called with the new state of
+ * objects as requested with pa_context_subscribe_with_info(). The
+ * function set with pa_context_set_subscribe_callback() is called
+ * for the same events as well. \since 0.9.22 */
+void pa_context_set_subscribe_info_callback(pa_context *c, pa_context_subscribe_info_cb_t cb, void *userdata);
+
 PA_C_DECL_END
 
 #endif
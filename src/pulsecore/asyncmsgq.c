@@ -39,8 +39,12 @@
 
 #include "asyncmsgq.h"
 
-PA_STATIC_FLIST_DECLARE(asyncmsgq, 0, pa_xfree);
-PA_STATIC_FLIST_DECLARE(semaphores, 0, (void(*)(void*)) pa_semaphore_free);
+/* Maximum number of messages pa_asyncmsgq_process_pending()
+ * dispatches in one go */
+#define BATCH_MAX 256
+
+PA_STATIC_FLIST_DECLARE(asyncmsgq, 0, 32, pa_xfree);
+PA_STATIC_FLIST_DECLARE(semaphores, 0, 4, (void(*)(void*)) pa_semaphore_free);
 
 struct asyncmsgq_item {
     int code;
@@ -282,6 +286,43 @@ int pa_asyncmsgq_process_one(pa_asyncmsgq *a) {
     return 1;
 }
 
+unsigned pa_asyncmsgq_process_pending(pa_asyncmsgq *a, pa_bool_t *shutdown) {
+    unsigned n;
+
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+
+    if (shutdown)
+        *shutdown = FALSE;
+
+    pa_asyncmsgq_ref(a);
+
+    for (n = 0; n < BATCH_MAX; n++) {
+        pa_msgobject *object;
+        int code;
+        void *data;
+        pa_memchunk chunk;
+        int64_t offset;
+        int ret;
+
+        if (pa_asyncmsgq_get(a, &object, &code, &data, &offset, &chunk, FALSE) < 0)
+            break;
+
+        if (shutdown && !object && code == PA_MESSAGE_SHUTDOWN) {
+            pa_asyncmsgq_done(a, 0);
+            *shutdown = TRUE;
+            n++;
+            break;
+        }
+
+        ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
+        pa_asyncmsgq_done(a, ret);
+    }
+
+    pa_asyncmsgq_unref(a);
+
+    return n;
+}
+
 int pa_asyncmsgq_read_fd(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
@@ -318,6 +359,24 @@ void pa_asyncmsgq_write_after_poll(pa_asyncmsgq *a) {
     pa_asyncq_write_after_poll(a->asyncq);
 }
 
+/* These flush what the writers had to queue locally, so with more than
+ * one writer they need the writer lock, too */
+void pa_asyncmsgq_write_before_poll_locked(pa_asyncmsgq *a) {
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+
+    pa_mutex_lock(a->mutex);
+    pa_asyncq_write_before_poll(a->asyncq);
+    pa_mutex_unlock(a->mutex);
+}
+
+void pa_asyncmsgq_write_after_poll_locked(pa_asyncmsgq *a) {
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+
+    pa_mutex_lock(a->mutex);
+    pa_asyncq_write_after_poll(a->asyncq);
+    pa_mutex_unlock(a->mutex);
+}
+
 int pa_asyncmsgq_dispatch(pa_msgobject *object, int code, void *userdata, int64_t offset, pa_memchunk *memchunk) {
 
     if (object)
@@ -66,6 +66,13 @@ void pa_asyncmsgq_done(pa_asyncmsgq *q, int ret);
 int pa_asyncmsgq_wait_for(pa_asyncmsgq *a, int code);
 int pa_asyncmsgq_process_one(pa_asyncmsgq *a);
 
+/* Dispatches all pending messages, but no more than a queue's worth
+ * so that a busy writer cannot starve the caller. If shutdown is
+ * non-NULL an object-less PA_MESSAGE_SHUTDOWN ends the batch without
+ * being dispatched and sets *shutdown. Returns the number of messages
+ * taken from the queue. */
+unsigned pa_asyncmsgq_process_pending(pa_asyncmsgq *a, pa_bool_t *shutdown);
+
 void pa_asyncmsgq_flush(pa_asyncmsgq *a, pa_bool_t run);
 
 /* For the reading side */
@@ -78,6 +85,12 @@ int pa_asyncmsgq_write_fd(pa_asyncmsgq *q);
 void pa_asyncmsgq_write_before_poll(pa_asyncmsgq *a);
 void pa_asyncmsgq_write_after_poll(pa_asyncmsgq *a);
 
+/* The same for queues that more than one thread writes to, such as the
+ * inq of a thread. Takes the writer lock, so not for the IO threads,
+ * which only poll their outq. */
+void pa_asyncmsgq_write_before_poll_locked(pa_asyncmsgq *a);
+void pa_asyncmsgq_write_after_poll_locked(pa_asyncmsgq *a);
+
 pa_bool_t pa_asyncmsgq_dispatching(pa_asyncmsgq *a);
 
 #endif
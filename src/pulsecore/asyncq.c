@@ -40,6 +40,11 @@
 
 #define ASYNCQ_SIZE 256
 
+/* When the queue is full the writer moves on to a ring of twice the
+ * size, up to this many entries. Beyond that pushes block and posts
+ * are queued locally, as before. */
+#define ASYNCQ_SIZE_MAX (16*1024)
+
 /* For debugging purposes we can define _Y to put an extra thread
  * yield between each operation. */
 
@@ -56,8 +61,15 @@ struct localq {
     PA_LLIST_FIELDS(struct localq);
 };
 
-struct pa_asyncq {
+/* The reader frees a ring once it emptied it and the writer has
+ * moved on to the next one. */
+struct ring {
     unsigned size;
+    pa_atomic_ptr_t next;
+};
+
+struct pa_asyncq {
+    struct ring *read_ring, *write_ring;
     unsigned read_idx;
     unsigned write_idx;
     pa_fdsem *read_fdsem, *write_fdsem;
@@ -67,12 +79,22 @@ struct pa_asyncq {
     pa_bool_t waiting_for_post;
 };
 
-PA_STATIC_FLIST_DECLARE(localq, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(localq, 0, 16, pa_xfree);
 
-#define PA_ASYNCQ_CELLS(x) ((pa_atomic_ptr_t*) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct pa_asyncq))))
+#define PA_ASYNCQ_CELLS(x) ((pa_atomic_ptr_t*) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct ring))))
 
-static unsigned reduce(pa_asyncq *l, unsigned value) {
-    return value & (unsigned) (l->size - 1);
+static unsigned reduce(struct ring *r, unsigned value) {
+    return value & (unsigned) (r->size - 1);
+}
+
+static struct ring *ring_new(unsigned size) {
+    struct ring *r;
+
+    r = pa_xmalloc0(PA_ALIGN(sizeof(struct ring)) + (sizeof(pa_atomic_ptr_t) * size));
+    r->size = size;
+    pa_atomic_ptr_store(&r->next, NULL);
+
+    return r;
 }
 
 pa_asyncq *pa_asyncq_new(unsigned size) {
@@ -83,21 +105,23 @@ pa_asyncq *pa_asyncq_new(unsigned size) {
 
     pa_assert(pa_is_power_of_two(size));
 
-    l = pa_xmalloc0(PA_ALIGN(sizeof(pa_asyncq)) + (sizeof(pa_atomic_ptr_t) * size));
+    l = pa_xnew0(pa_asyncq, 1);
 
-    l->size = size;
+    l->read_ring = l->write_ring = ring_new(size);
 
     PA_LLIST_HEAD_INIT(struct localq, l->localq);
     l->last_localq = NULL;
     l->waiting_for_post = FALSE;
 
     if (!(l->read_fdsem = pa_fdsem_new())) {
+        pa_xfree(l->read_ring);
         pa_xfree(l);
         return NULL;
     }
 
     if (!(l->write_fdsem = pa_fdsem_new())) {
         pa_fdsem_free(l->read_fdsem);
+        pa_xfree(l->read_ring);
         pa_xfree(l);
         return NULL;
     }
@@ -107,14 +131,13 @@ pa_asyncq *pa_asyncq_new(unsigned size) {
 
 void pa_asyncq_free(pa_asyncq *l, pa_free_cb_t free_cb) {
     struct localq *q;
-    pa_assert(l);
+    void *p;
 
-    if (free_cb) {
-        void *p;
+    pa_assert(l);
 
-        while ((p = pa_asyncq_pop(l, 0)))
+    while ((p = pa_asyncq_pop(l, 0)))
+        if (free_cb)
             free_cb(p);
-    }
 
     while ((q = l->localq)) {
         if (free_cb)
@@ -126,25 +149,51 @@ void pa_asyncq_free(pa_asyncq *l, pa_free_cb_t free_cb) {
             pa_xfree(q);
     }
 
+    /* Popping everything left us on the last ring */
+    pa_assert(l->read_ring == l->write_ring);
+
     pa_fdsem_free(l->read_fdsem);
     pa_fdsem_free(l->write_fdsem);
+    pa_xfree(l->read_ring);
     pa_xfree(l);
 }
 
 static int push(pa_asyncq*l, void *p, pa_bool_t wait_op) {
     unsigned idx;
     pa_atomic_ptr_t *cells;
+    struct ring *r;
 
     pa_assert(l);
     pa_assert(p);
 
-    cells = PA_ASYNCQ_CELLS(l);
+    r = l->write_ring;
+    cells = PA_ASYNCQ_CELLS(r);
 
     _Y;
-    idx = reduce(l, l->write_idx);
+    idx = reduce(r, l->write_idx);
 
     if (!pa_atomic_ptr_cmpxchg(&cells[idx], NULL, p)) {
 
+        if (r->size < ASYNCQ_SIZE_MAX) {
+            struct ring *n;
+
+            /* Rather than waiting for the reader, continue in a
+             * bigger ring. The entry needs to be in place before the
+             * reader can see the new ring. */
+            n = ring_new(r->size * 2);
+            pa_atomic_ptr_store(&PA_ASYNCQ_CELLS(n)[0], p);
+
+            _Y;
+            pa_atomic_ptr_store(&r->next, n);
+
+            l->write_ring = n;
+            l->write_idx = 1;
+
+            pa_fdsem_post(l->write_fdsem);
+
+            return 0;
+        }
+
         if (!wait_op)
             return -1;
 
@@ -221,19 +270,46 @@ void pa_asyncq_post(pa_asyncq*l, void *p) {
     return;
 }
 
+/* Returns the cell the reader is looking at, moving on to the next
+ * ring if the writer left the current one behind and it is empty */
+static pa_atomic_ptr_t *read_cell(pa_asyncq *l) {
+
+    for (;;) {
+        struct ring *r, *n;
+        pa_atomic_ptr_t *cell;
+
+        r = l->read_ring;
+        cell = &PA_ASYNCQ_CELLS(r)[reduce(r, l->read_idx)];
+
+        _Y;
+        if (pa_atomic_ptr_load(cell))
+            return cell;
+
+        _Y;
+        if (!(n = pa_atomic_ptr_load(&r->next)))
+            return cell;
+
+        /* The writer might have filled the cell right before it
+         * moved on */
+        _Y;
+        if (pa_atomic_ptr_load(cell))
+            return cell;
+
+        l->read_ring = n;
+        l->read_idx = 0;
+        pa_xfree(r);
+    }
+}
+
 void* pa_asyncq_pop(pa_asyncq*l, pa_bool_t wait_op) {
-    unsigned idx;
     void *ret;
-    pa_atomic_ptr_t *cells;
+    pa_atomic_ptr_t *cell;
 
     pa_assert(l);
 
-    cells = PA_ASYNCQ_CELLS(l);
+    cell = read_cell(l);
 
-    _Y;
-    idx = reduce(l, l->read_idx);
-
-    if (!(ret = pa_atomic_ptr_load(&cells[idx]))) {
+    if (!(ret = pa_atomic_ptr_load(cell))) {
 
         if (!wait_op)
             return NULL;
@@ -242,13 +318,14 @@ void* pa_asyncq_pop(pa_asyncq*l, pa_bool_t wait_op) {
 
         do {
             pa_fdsem_wait(l->write_fdsem);
-        } while (!(ret = pa_atomic_ptr_load(&cells[idx])));
+            cell = read_cell(l);
+        } while (!(ret = pa_atomic_ptr_load(cell)));
     }
 
     pa_assert(ret);
 
     /* Guaranteed to succeed if we only have a single reader */
-    pa_assert_se(pa_atomic_ptr_cmpxchg(&cells[idx], ret, NULL));
+    pa_assert_se(pa_atomic_ptr_cmpxchg(cell, ret, NULL));
 
     _Y;
     l->read_idx++;
@@ -265,18 +342,10 @@ int pa_asyncq_read_fd(pa_asyncq *q) {
 }
 
 int pa_asyncq_read_before_poll(pa_asyncq *l) {
-    unsigned idx;
-    pa_atomic_ptr_t *cells;
-
     pa_assert(l);
 
-    cells = PA_ASYNCQ_CELLS(l);
-
-    _Y;
-    idx = reduce(l, l->read_idx);
-
     for (;;) {
-        if (pa_atomic_ptr_load(&cells[idx]))
+        if (pa_atomic_ptr_load(read_cell(l)))
             return -1;
 
         if (pa_fdsem_before_poll(l->write_fdsem) >= 0)
@@ -33,12 +33,14 @@
  * communication between a normal thread and a single real-time
  * thread. Only the real-time side needs to be lock-free/wait-free.
  *
- * If the queue is full and another entry shall be pushed, or when the
- * queue is empty and another entry shall be popped and the "wait"
- * argument is non-zero, the queue will block on a UNIX FIFO object --
- * that will probably require locking on the kernel side -- which
- * however is probably not problematic, because we do it only on
- * starvation or overload in which case we have to block anyway.  */
+ * If the queue is full and another entry shall be pushed, the writer
+ * continues in a new ring of twice the size, until a fixed maximum is
+ * reached. Only then, or when the queue is empty and another entry
+ * shall be popped and the "wait" argument is non-zero, the queue will
+ * block on a UNIX FIFO object -- that will probably require locking
+ * on the kernel side -- which however is probably not problematic,
+ * because we do it only on starvation or overload in which case we
+ * have to block anyway.  */
 
 typedef struct pa_asyncq pa_asyncq;
 
@@ -52,6 +52,10 @@ typedef struct pa_atomic {
 
 #define PA_ATOMIC_INIT(v) { .value = (v) }
 
+static inline void pa_memory_barrier(void) {
+    __sync_synchronize();
+}
+
 static inline int pa_atomic_load(const pa_atomic_t *a) {
     __sync_synchronize();
     return a->value;
@@ -119,6 +123,10 @@ typedef struct pa_atomic {
 
 #define PA_ATOMIC_INIT(v) { .value = (unsigned int) (v) }
 
+static inline void pa_memory_barrier(void) {
+    membar_sync();
+}
+
 static inline int pa_atomic_load(const pa_atomic_t *a) {
     membar_sync();
     return (int) a->value;
@@ -192,6 +200,10 @@ typedef struct pa_atomic {
 
 #define PA_ATOMIC_INIT(v) { .value = (v) }
 
+static inline void pa_memory_barrier(void) {
+    __asm__ __volatile__ ("mfence" : : : "memory");
+}
+
 static inline int pa_atomic_load(const pa_atomic_t *a) {
     return a->value;
 }
@@ -270,7 +282,9 @@ typedef struct pa_atomic {
 
 static inline void pa_memory_barrier(void) {
 #ifdef ATOMIC_ARM_MEMORY_BARRIER_ENABLED
-    asm volatile ("mcr  p15, 0, r0, c7, c10, 5  @ dmb");
+    asm volatile ("mcr  p15, 0, r0, c7, c10, 5  @ dmb" : : : "memory");
+#else
+    asm volatile ("" : : : "memory");
 #endif
 }
 
@@ -497,6 +511,10 @@ typedef struct pa_atomic {
 
 #define PA_ATOMIC_INIT(v) { .value = (AO_t) (v) }
 
+static inline void pa_memory_barrier(void) {
+    AO_nop_full();
+}
+
 static inline int pa_atomic_load(const pa_atomic_t *a) {
     return (int) AO_load_full((AO_t*) &a->value);
 }
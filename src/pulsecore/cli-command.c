@@ -48,6 +48,8 @@
 #include <pulsecore/sample-util.h>
 #include <pulsecore/sound-file.h>
 #include <pulsecore/play-memchunk.h>
+#include <pulsecore/polyphase.h>
+#include <pulsecore/flist.h>
 #include <pulsecore/sound-file-stream.h>
 #include <pulsecore/shared.h>
 #include <pulsecore/core-util.h>
@@ -328,9 +330,12 @@ static int pa_cli_command_source_outputs(pa_core *c, pa_tokenizer *t, pa_strbuf
 static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, pa_bool_t *fail) {
     char ss[PA_SAMPLE_SPEC_SNPRINT_MAX];
     char cm[PA_CHANNEL_MAP_SNPRINT_MAX];
-    char bytes[PA_BYTES_SNPRINT_MAX];
+    char bytes[PA_BYTES_SNPRINT_MAX], bytes_max[PA_BYTES_SNPRINT_MAX];
     const pa_mempool_stat *stat;
-    unsigned k;
+    pa_polyphase_cache_stat filter_stat;
+    pa_flist_stat flist_stat[32];
+    unsigned k, n, lookups;
+    size_t pool_size, pool_size_max;
     pa_sink *def_sink;
     pa_source *def_source;
 
@@ -369,6 +374,18 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, pa_b
     pa_strbuf_printf(buf, "Total sample cache size: %s.\n",
                      pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_scache_total_size(c)));
 
+    pa_polyphase_get_cache_stat(&filter_stat);
+    lookups = filter_stat.n_hits + filter_stat.n_misses;
+
+    pa_strbuf_printf(buf, "Resampler filter tables currently allocated: %u, size: %s.\n",
+                     filter_stat.n_filters,
+                     pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) filter_stat.allocated_size));
+
+    pa_strbuf_printf(buf, "Resampler filter tables shared during the whole lifetime: %u of %u (%u%%), currently saving: %s.\n",
+                     filter_stat.n_hits, lookups,
+                     lookups > 0 ? (unsigned) ((100ULL * filter_stat.n_hits) / lookups) : 0,
+                     pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) filter_stat.saved_size));
+
     pa_strbuf_printf(buf, "Default sample spec: %s\n",
                      pa_sample_spec_snprint(ss, sizeof(ss), &c->default_sample_spec));
 
@@ -389,6 +406,46 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, pa_b
                          (unsigned) pa_atomic_load(&stat->n_allocated_by_type[k]),
                          (unsigned) pa_atomic_load(&stat->n_accumulated_by_type[k]));
 
+    pool_size = pa_mempool_get_size(c->mempool, &pool_size_max);
+
+    pa_strbuf_printf(buf, "Memory pool segments: %u, size: %s of at most %s.\n",
+                     (unsigned) pa_atomic_load(&stat->n_segments),
+                     pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pool_size),
+                     pa_bytes_snprint(bytes_max, sizeof(bytes_max), (unsigned) pool_size_max));
+
+    for (k = 0; k < PA_MEMPOOL_SIZE_CLASSES_MAX; k++) {
+        size_t block_size;
+        unsigned n_blocks;
+
+        pa_mempool_get_size_class(c->mempool, k, &block_size, &n_blocks);
+
+        if (n_blocks <= 0)
+            continue;
+
+        pa_strbuf_printf(buf,
+                         "Memory pool slots of size %s: %u of %u allocated/%u accumulated, %u times full.\n",
+                         pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) block_size),
+                         (unsigned) pa_atomic_load(&stat->n_allocated_by_class[k]),
+                         n_blocks,
+                         (unsigned) pa_atomic_load(&stat->n_accumulated_by_class[k]),
+                         (unsigned) pa_atomic_load(&stat->n_full_by_class[k]));
+    }
+
+    n = pa_flist_get_stats(flist_stat, PA_ELEMENTSOF(flist_stat));
+
+    for (k = 0; k < n; k++) {
+        lookups = flist_stat[k].n_hits + flist_stat[k].n_misses;
+
+        pa_strbuf_printf(buf,
+                         "Object cache %s: %u per thread, %u of %u lookups hit (%u%%), %u overflows, %u transfers.\n",
+                         flist_stat[k].name,
+                         flist_stat[k].magazine_size,
+                         flist_stat[k].n_hits, lookups,
+                         lookups > 0 ? (unsigned) ((100ULL * flist_stat[k].n_hits) / lookups) : 0,
+                         flist_stat[k].n_overflows,
+                         flist_stat[k].n_transfers);
+    }
+
     return 0;
 }
 
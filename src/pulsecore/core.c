@@ -44,6 +44,7 @@
 #include <pulsecore/random.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/polyphase.h>
 
 #include "core.h"
 
@@ -126,6 +127,7 @@ pa_core* pa_core_new(pa_mainloop_api *m, pa_bool_t shared, size_t shm_size) {
     c->subscription_event_last = NULL;
 
     c->mempool = pool;
+    pa_mempool_set_mainloop(c->mempool, m);
     pa_silence_cache_init(&c->silence_cache);
 
     c->exit_event = NULL;
@@ -141,7 +143,12 @@ pa_core* pa_core_new(pa_mainloop_api *m, pa_bool_t shared, size_t shm_size) {
     c->realtime_priority = 5;
     c->disable_remixing = FALSE;
     c->disable_lfe_remixing = FALSE;
+    c->float_mixing = FALSE;
+#ifdef HAVE_SPEEX
     c->resample_method = PA_RESAMPLER_SPEEX_FLOAT_BASE + 3;
+#else
+    c->resample_method = PA_RESAMPLER_POLYPHASE_BASE + PA_POLYPHASE_QUALITY_DEFAULT;
+#endif
 
     for (j = 0; j < PA_CORE_HOOK_MAX; j++)
         pa_hook_init(&c->hooks[j], c);
@@ -135,5 +135,13 @@ void pa_cpu_init_arm (void) {
 
     if (flags & PA_CPU_ARM_V6)
         pa_volume_func_init_arm (flags);
+
+    if (flags & PA_CPU_ARM_NEON) {
+        pa_volume_func_init_neon (flags);
+        pa_convert_func_init_neon (flags);
+        pa_remap_func_init_neon (flags);
+        pa_mix_func_init_neon (flags);
+        pa_polyphase_func_init_neon (flags);
+    }
 #endif /* defined (__arm__) */
 }
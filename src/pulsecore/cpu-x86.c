@@ -41,9 +41,24 @@ get_cpuid (uint32_t op, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
         "  pop %%"PA_REG_b"    \n\t"
 
         : "=a" (*a), "=S" (*b), "=c" (*c), "=d" (*d)
-        : "0" (op)
+        : "0" (op), "2" (0)
     );
 }
+
+/* Check that the OS saves the AVX (YMM) state on context switches */
+static int os_supports_avx (void)
+{
+    uint32_t xcr0_lo, xcr0_hi;
+
+    /* xgetbv with ecx = 0, spelled out for older assemblers */
+    __asm__ __volatile__ (
+        "  .byte 0x0f, 0x01, 0xd0  \n\t"
+        : "=a" (xcr0_lo), "=d" (xcr0_hi)
+        : "c" (0)
+    );
+
+    return (xcr0_lo & 0x6) == 0x6;
+}
 #endif
 
 void pa_cpu_init_x86 (void) {
@@ -77,6 +92,17 @@ void pa_cpu_init_x86 (void) {
 
         if (ecx & (1<<20))
           flags |= PA_CPU_X86_SSE4_2;
+
+        /* AVX needs both the CPU bit and OSXSAVE */
+        if ((ecx & (1<<28)) && (ecx & (1<<27)) && os_supports_avx ())
+          flags |= PA_CPU_X86_AVX;
+    }
+
+    if (level >= 7 && (flags & PA_CPU_X86_AVX)) {
+        get_cpuid (0x00000007, &eax, &ebx, &ecx, &edx);
+
+        if (ebx & (1<<5))
+          flags |= PA_CPU_X86_AVX2;
     }
 
     /* get extended level */
@@ -97,7 +123,7 @@ void pa_cpu_init_x86 (void) {
           flags |= PA_CPU_X86_3DNOW;
     }
 
-    pa_log_info ("CPU flags: %s%s%s%s%s%s%s%s%s%s",
+    pa_log_info ("CPU flags: %s%s%s%s%s%s%s%s%s%s%s%s",
     (flags & PA_CPU_X86_MMX) ? "MMX " : "",
     (flags & PA_CPU_X86_SSE) ? "SSE " : "",
     (flags & PA_CPU_X86_SSE2) ? "SSE2 " : "",
@@ -107,7 +133,9 @@ void pa_cpu_init_x86 (void) {
     (flags & PA_CPU_X86_SSE4_2) ? "SSE4_2 " : "",
     (flags & PA_CPU_X86_MMXEXT) ? "MMXEXT " : "",
     (flags & PA_CPU_X86_3DNOW) ? "3DNOW " : "",
-    (flags & PA_CPU_X86_3DNOWEXT) ? "3DNOWEXT " : "");
+    (flags & PA_CPU_X86_3DNOWEXT) ? "3DNOWEXT " : "",
+    (flags & PA_CPU_X86_AVX) ? "AVX " : "",
+    (flags & PA_CPU_X86_AVX2) ? "AVX2 " : "");
 
     /* activate various optimisations */
     if (flags & PA_CPU_X86_MMX) {
@@ -119,7 +147,12 @@ void pa_cpu_init_x86 (void) {
         pa_volume_func_init_sse (flags);
         pa_remap_func_init_sse (flags);
         pa_convert_func_init_sse (flags);
+        pa_mix_func_init_sse (flags);
+        pa_polyphase_func_init_sse (flags);
     }
 
+    if (flags & PA_CPU_X86_AVX2)
+        pa_mix_func_init_avx (flags);
+
 #endif /* defined (__i386__) || defined (__amd64__) */
 }
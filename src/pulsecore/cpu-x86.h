@@ -35,7 +35,9 @@ typedef enum pa_cpu_x86_flag {
     PA_CPU_X86_SSE4_1    = (1 << 6),
     PA_CPU_X86_SSE4_2    = (1 << 7),
     PA_CPU_X86_3DNOW     = (1 << 8),
-    PA_CPU_X86_3DNOWEXT  = (1 << 9)
+    PA_CPU_X86_3DNOWEXT  = (1 << 9),
+    PA_CPU_X86_AVX       = (1 << 10),
+    PA_CPU_X86_AVX2      = (1 << 11)
 } pa_cpu_x86_flag_t;
 
 void pa_cpu_init_x86 (void);
@@ -59,6 +61,14 @@ typedef int64_t pa_reg_x86;
 #define PA_REG_S "rsi"
 #endif
 
+/* The SSE2/AVX2 mixers are written with intrinsics and enable the
+ * instruction set per function, which needs a reasonably recent
+ * compiler. */
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || (defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define PA_CPU_X86_HAVE_TARGET_ATTRIBUTE 1
+#endif
+
 /* some optimized functions */
 void pa_volume_func_init_mmx(pa_cpu_x86_flag_t flags);
 void pa_volume_func_init_sse(pa_cpu_x86_flag_t flags);
@@ -68,4 +78,9 @@ void pa_remap_func_init_sse(pa_cpu_x86_flag_t flags);
 
 void pa_convert_func_init_sse (pa_cpu_x86_flag_t flags);
 
+void pa_mix_func_init_sse(pa_cpu_x86_flag_t flags);
+void pa_mix_func_init_avx(pa_cpu_x86_flag_t flags);
+
+void pa_polyphase_func_init_sse(pa_cpu_x86_flag_t flags);
+
 #endif /* foocpux86hfoo */
@@ -54,7 +54,7 @@
     used.
 */
 
-PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(items, 0, 8, pa_xfree);
 
 struct pa_envelope_item {
     PA_LLIST_FIELDS(pa_envelope_item);
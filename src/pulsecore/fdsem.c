@@ -122,6 +122,7 @@ pa_fdsem *pa_fdsem_new_shm(pa_fdsem_data *data, int* event_fd) {
     pa_make_fd_cloexec(f->efd);
     f->fds[0] = f->fds[1] = -1;
     f->data = data;
+    *event_fd = f->efd;
 
     pa_atomic_store(&f->data->waiting, 0);
     pa_atomic_store(&f->data->signalled, 0);
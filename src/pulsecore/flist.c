@@ -24,10 +24,12 @@
 #endif
 
 #include <pulse/xmalloc.h>
+#include <pulse/util.h>
 
 #include <pulsecore/atomic.h>
 #include <pulsecore/log.h>
 #include <pulsecore/thread.h>
+#include <pulsecore/mutex.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/macro.h>
@@ -63,11 +65,23 @@
  * stack or queue, which however requires DCAS to be simple. Patches
  * welcome.
  *
- * Please note that this algorithm is home grown.*/
+ * Please note that this algorithm is home grown.
+ *
+ * Since every push and pop is a CAS on cache lines shared by all
+ * threads, lists can be created with a per-thread magazine in front
+ * of them. A thread pops from and pushes to its magazine without any
+ * atomic operations, and only when the magazine runs empty or full
+ * it moves half a magazine from or to the shared list. The statistics
+ * are counted in the magazine too, and only summed up in the list
+ * every now and then. */
 
 #define FLIST_SIZE 128
 #define N_EXTRA_SCAN 3
 
+/* After this many operations a magazine adds its counters to the
+ * list's statistics */
+#define STAT_INTERVAL 64
+
 /* For debugging purposes we can define _Y to put and extra thread
  * yield between each operation. */
 
@@ -82,9 +96,30 @@ struct pa_flist {
     pa_atomic_t length;
     pa_atomic_t read_idx;
     pa_atomic_t write_idx;
+
+    /* Only used by lists created with pa_flist_new_cached() */
+    const char *name;
+    unsigned magazine_size;
+    pa_free_cb_t free_cb;
+    pa_tls *magazines;
+    pa_atomic_t n_hits, n_misses, n_overflows, n_transfers;
+    pa_flist *next, *prev;
+};
+
+struct magazine {
+    pa_flist *flist;
+    unsigned n;
+    unsigned n_hits, n_misses, n_overflows, n_transfers, n_ops;
 };
 
 #define PA_FLIST_CELLS(x) ((pa_atomic_ptr_t*) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct pa_flist))))
+#define MAGAZINE_ITEMS(x) ((void**) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct magazine))))
+
+static unsigned magazine_max = (unsigned) -1;
+
+/* All cached lists, for the statistics */
+static pa_static_mutex cached_mutex = PA_STATIC_MUTEX_INIT;
+static pa_flist *cached_lists = NULL;
 
 pa_flist *pa_flist_new(unsigned size) {
     pa_flist *l;
@@ -105,6 +140,39 @@ pa_flist *pa_flist_new(unsigned size) {
     return l;
 }
 
+static void magazine_free(void *p);
+
+pa_flist *pa_flist_new_cached(unsigned size, unsigned magazine_size, pa_free_cb_t free_cb, const char *name) {
+    pa_flist *l;
+    pa_mutex *m;
+
+    pa_assert(magazine_size > 0);
+    pa_assert(free_cb);
+    pa_assert(name);
+
+    l = pa_flist_new(size);
+
+    l->name = pa_path_get_filename(name);
+    l->magazine_size = magazine_size;
+    l->free_cb = free_cb;
+    l->magazines = pa_tls_new(magazine_free);
+
+    pa_atomic_store(&l->n_hits, 0);
+    pa_atomic_store(&l->n_misses, 0);
+    pa_atomic_store(&l->n_overflows, 0);
+    pa_atomic_store(&l->n_transfers, 0);
+
+    m = pa_static_mutex_get(&cached_mutex, FALSE, FALSE);
+    pa_mutex_lock(m);
+    l->prev = NULL;
+    if ((l->next = cached_lists))
+        l->next->prev = l;
+    cached_lists = l;
+    pa_mutex_unlock(m);
+
+    return l;
+}
+
 static unsigned reduce(pa_flist *l, unsigned value) {
     return value & (l->size - 1);
 }
@@ -112,6 +180,28 @@ static unsigned reduce(pa_flist *l, unsigned value) {
 void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb) {
     pa_assert(l);
 
+    if (l->magazines) {
+        struct magazine *g;
+        pa_mutex *m;
+
+        /* We can only get hold of our own magazine, the ones of the
+         * other threads are lost */
+        if ((g = pa_tls_set(l->magazines, NULL)))
+            magazine_free(g);
+
+        pa_tls_free(l->magazines);
+
+        m = pa_static_mutex_get(&cached_mutex, FALSE, FALSE);
+        pa_mutex_lock(m);
+        if (l->next)
+            l->next->prev = l->prev;
+        if (l->prev)
+            l->prev->next = l->next;
+        else
+            cached_lists = l->next;
+        pa_mutex_unlock(m);
+    }
+
     if (free_cb) {
         pa_atomic_ptr_t*cells;
         unsigned idx;
@@ -129,7 +219,7 @@ void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb) {
     pa_xfree(l);
 }
 
-int pa_flist_push(pa_flist*l, void *p) {
+static int flist_push(pa_flist*l, void *p) {
     unsigned idx, n;
     pa_atomic_ptr_t*cells;
 #ifdef PROFILE
@@ -177,7 +267,7 @@ int pa_flist_push(pa_flist*l, void *p) {
     return -1;
 }
 
-void* pa_flist_pop(pa_flist*l) {
+static void* flist_pop(pa_flist*l) {
     unsigned idx, n;
     pa_atomic_ptr_t *cells;
 #ifdef PROFILE
@@ -229,3 +319,185 @@ void* pa_flist_pop(pa_flist*l) {
 
     return NULL;
 }
+
+static unsigned magazine_limit(pa_flist *l) {
+    return PA_MIN(l->magazine_size, magazine_max);
+}
+
+static void flush_stat(struct magazine *g) {
+    pa_flist *l = g->flist;
+
+    if (g->n_hits > 0)
+        pa_atomic_add(&l->n_hits, (int) g->n_hits);
+    if (g->n_misses > 0)
+        pa_atomic_add(&l->n_misses, (int) g->n_misses);
+    if (g->n_overflows > 0)
+        pa_atomic_add(&l->n_overflows, (int) g->n_overflows);
+    if (g->n_transfers > 0)
+        pa_atomic_add(&l->n_transfers, (int) g->n_transfers);
+
+    g->n_hits = g->n_misses = g->n_overflows = g->n_transfers = g->n_ops = 0;
+}
+
+static void account(struct magazine *g) {
+    if (++g->n_ops >= STAT_INTERVAL)
+        flush_stat(g);
+}
+
+/* Moves the magazine down to n objects */
+static void drain(struct magazine *g, unsigned n) {
+    pa_flist *l = g->flist;
+    void **items = MAGAZINE_ITEMS(g);
+
+    if (g->n <= n)
+        return;
+
+    for (; g->n > n; g->n--)
+        if (flist_push(l, items[g->n-1]) < 0) {
+            l->free_cb(items[g->n-1]);
+            g->n_overflows++;
+        }
+
+    g->n_transfers++;
+}
+
+/* Moves up to n objects from the shared list into the magazine */
+static void refill(struct magazine *g, unsigned n) {
+    pa_flist *l = g->flist;
+    void **items = MAGAZINE_ITEMS(g);
+    void *p;
+
+    pa_assert(g->n + n <= l->magazine_size);
+
+    while (n > 0 && (p = flist_pop(l))) {
+        items[g->n++] = p;
+        n--;
+    }
+
+    if (g->n > 0)
+        g->n_transfers++;
+}
+
+static void magazine_free(void *p) {
+    struct magazine *g = p;
+
+    /* Called from the thread destructor, so that objects cached by
+     * threads that go away are not lost */
+    drain(g, 0);
+    flush_stat(g);
+    pa_xfree(g);
+}
+
+static struct magazine *get_magazine(pa_flist *l) {
+    struct magazine *g;
+
+    if ((g = pa_tls_get(l->magazines)))
+        return g;
+
+    if (magazine_limit(l) <= 0)
+        return NULL;
+
+    g = pa_xmalloc0(PA_ALIGN(sizeof(struct magazine)) + sizeof(void*) * l->magazine_size);
+    g->flist = l;
+    pa_tls_set(l->magazines, g);
+
+    return g;
+}
+
+int pa_flist_push(pa_flist*l, void *p) {
+    struct magazine *g;
+    unsigned limit;
+
+    pa_assert(l);
+    pa_assert(p);
+
+    if (!l->magazines)
+        return flist_push(l, p);
+
+    if (!(g = get_magazine(l))) {
+        if (flist_push(l, p) < 0) {
+            pa_atomic_inc(&l->n_overflows);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    limit = magazine_limit(l);
+
+    if (g->n >= limit)
+        drain(g, limit / 2);
+
+    if (g->n < limit)
+        MAGAZINE_ITEMS(g)[g->n++] = p;
+    else if (flist_push(l, p) < 0) {
+        /* The caller frees it */
+        g->n_overflows++;
+        account(g);
+        return -1;
+    }
+
+    account(g);
+    return 0;
+}
+
+void* pa_flist_pop(pa_flist*l) {
+    struct magazine *g;
+    void *p;
+
+    pa_assert(l);
+
+    if (!l->magazines)
+        return flist_pop(l);
+
+    if (!(g = get_magazine(l))) {
+        if ((p = flist_pop(l)))
+            pa_atomic_inc(&l->n_hits);
+        else
+            pa_atomic_inc(&l->n_misses);
+
+        return p;
+    }
+
+    if (g->n <= 0)
+        refill(g, PA_MAX(magazine_limit(l) / 2, 1U));
+
+    if (g->n > 0) {
+        p = MAGAZINE_ITEMS(g)[--g->n];
+        g->n_hits++;
+    } else {
+        p = NULL;
+        g->n_misses++;
+    }
+
+    account(g);
+    return p;
+}
+
+void pa_flist_set_magazine_max(unsigned n) {
+    magazine_max = n;
+}
+
+unsigned pa_flist_get_stats(pa_flist_stat *s, unsigned n) {
+    pa_flist *l;
+    pa_mutex *m;
+    unsigned i = 0;
+
+    pa_assert(s || n <= 0);
+
+    m = pa_static_mutex_get(&cached_mutex, FALSE, FALSE);
+    pa_mutex_lock(m);
+
+    for (l = cached_lists; l && i < n; l = l->next, i++) {
+        s[i].name = l->name;
+        s[i].magazine_size = magazine_limit(l);
+        s[i].n_hits = (unsigned) pa_atomic_load(&l->n_hits);
+        s[i].n_misses = (unsigned) pa_atomic_load(&l->n_misses);
+        s[i].n_overflows = (unsigned) pa_atomic_load(&l->n_overflows);
+        s[i].n_transfers = (unsigned) pa_atomic_load(&l->n_transfers);
+    }
+
+    pa_mutex_unlock(m);
+
+    return i;
+}
@@ -34,22 +34,49 @@ typedef struct pa_flist pa_flist;
 
 /* Size is required to be a power of two, or 0 for the default size */
 pa_flist * pa_flist_new(unsigned size);
+
+/* Like pa_flist_new(), but each thread keeps up to magazine_size
+ * objects in a private magazine in front of the shared list, and only
+ * moves them to and from the shared list in batches. Objects that fit
+ * into neither are freed with free_cb. The list is listed under name
+ * in the statistics. */
+pa_flist * pa_flist_new_cached(unsigned size, unsigned magazine_size, pa_free_cb_t free_cb, const char *name);
+
 void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb);
 
 /* Please note that this routine might fail! */
 int pa_flist_push(pa_flist*l, void *p);
 void* pa_flist_pop(pa_flist*l);
 
+/* Caps the magazines of all lists to n objects per thread, 0 disables
+ * them */
+void pa_flist_set_magazine_max(unsigned n);
+
+typedef struct pa_flist_stat {
+    const char *name;
+    unsigned magazine_size;
+
+    /* Pops served without allocation, pops that came back empty,
+     * pushes that had to free the object, and batches moved between
+     * the magazines and the shared list */
+    unsigned n_hits, n_misses, n_overflows, n_transfers;
+} pa_flist_stat;
+
+/* Fills in up to n entries for the cached lists, returns how many */
+unsigned pa_flist_get_stats(pa_flist_stat *s, unsigned n);
+
 /* Please not that the destructor stuff is not really necesary, we do
  * this just to make valgrind output more useful. */
 
-#define PA_STATIC_FLIST_DECLARE(name, size, free_cb)                    \
+#define PA_STATIC_FLIST_DECLARE(name, size, magazine_size, free_cb)     \
     static struct {                                                     \
         pa_flist *flist;                                                \
         pa_once once;                                                   \
     } name##_flist = { NULL, PA_ONCE_INIT };                            \
     static void name##_flist_init(void) {                               \
-        name##_flist.flist = pa_flist_new(size);                        \
+        name##_flist.flist =                                            \
+            pa_flist_new_cached(size, magazine_size, (free_cb),         \
+                                __FILE__ ":" #name);                    \
     }                                                                   \
     static inline pa_flist* name##_flist_get(void) {                    \
         pa_run_once(&name##_flist.once, name##_flist_init);             \
@@ -54,7 +54,7 @@ struct pa_hashmap {
 
 #define BY_HASH(h) ((struct hashmap_entry**) ((uint8_t*) (h) + PA_ALIGN(sizeof(pa_hashmap))))
 
-PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(entries, 0, 32, pa_xfree);
 
 pa_hashmap *pa_hashmap_new(pa_hash_func_t hash_func, pa_compare_func_t compare_func) {
     pa_hashmap *h;
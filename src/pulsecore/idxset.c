@@ -59,7 +59,7 @@ struct pa_idxset {
 #define BY_DATA(i) ((struct idxset_entry**) ((uint8_t*) (i) + PA_ALIGN(sizeof(pa_idxset))))
 #define BY_INDEX(i) (BY_DATA(i) + NBUCKETS)
 
-PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(entries, 0, 32, pa_xfree);
 
 unsigned pa_idxset_string_hash_func(const void *p) {
     unsigned hash = 0;
@@ -214,6 +214,50 @@ ssize_t pa_iochannel_write(pa_iochannel*io, const void*data, size_t l) {
     return r;
 }
 
+ssize_t pa_iochannel_writev(pa_iochannel*io, const struct iovec *iov, unsigned n_iov) {
+    ssize_t r;
+
+    pa_assert(io);
+    pa_assert(iov);
+    pa_assert(n_iov > 0);
+    pa_assert(io->ofd >= 0);
+
+#ifdef HAVE_SYS_UIO_H
+    if (io->ofd_type == 0) {
+        struct msghdr mh;
+
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = (struct iovec*) iov;
+        mh.msg_iovlen = n_iov;
+
+        /* Like pa_write() we try sendmsg() first so that we don't get
+         * SIGPIPE, and fall back to writev() for anything that is not
+         * a socket */
+        while ((r = sendmsg(io->ofd, &mh, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+            ;
+
+        if (r < 0 && errno == ENOTSOCK) {
+            io->ofd_type = 1;
+
+            while ((r = writev(io->ofd, iov, (int) n_iov)) < 0 && errno == EINTR)
+                ;
+        }
+
+    } else
+        while ((r = writev(io->ofd, iov, (int) n_iov)) < 0 && errno == EINTR)
+            ;
+
+    if (r >= 0) {
+        io->writable = FALSE;
+        enable_mainloop_sources(io);
+    }
+#else
+    r = pa_iochannel_write(io, iov[0].iov_base, iov[0].iov_len);
+#endif
+
+    return r;
+}
+
 ssize_t pa_iochannel_read(pa_iochannel*io, void*data, size_t l) {
     ssize_t r;
 
@@ -313,14 +357,57 @@ ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l
     return r;
 }
 
+ssize_t pa_iochannel_writev_with_fds(pa_iochannel*io, const struct iovec *iov, unsigned n_iov, const int *fds, unsigned n_fds) {
+    ssize_t r;
+    struct msghdr mh;
+    union {
+        struct cmsghdr hdr;
+        uint8_t data[CMSG_SPACE(sizeof(int) * PA_IOCHANNEL_FDS_MAX)];
+    } cmsg;
+
+    pa_assert(io);
+    pa_assert(iov);
+    pa_assert(n_iov > 0);
+    pa_assert(io->ofd >= 0);
+    pa_assert(fds);
+    pa_assert(n_fds > 0 && n_fds <= PA_IOCHANNEL_FDS_MAX);
+
+    memset(&cmsg, 0, sizeof(cmsg));
+    cmsg.hdr.cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+    cmsg.hdr.cmsg_level = SOL_SOCKET;
+    cmsg.hdr.cmsg_type = SCM_RIGHTS;
+    memcpy(CMSG_DATA(&cmsg.hdr), fds, sizeof(int) * n_fds);
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_name = NULL;
+    mh.msg_namelen = 0;
+    mh.msg_iov = (struct iovec*) iov;
+    mh.msg_iovlen = n_iov;
+    mh.msg_control = &cmsg;
+    mh.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+    mh.msg_flags = 0;
+
+    if ((r = sendmsg(io->ofd, &mh, MSG_NOSIGNAL)) >= 0) {
+        io->writable = FALSE;
+        enable_mainloop_sources(io);
+    }
+
+    return r;
+}
+
 ssize_t pa_iochannel_read_with_creds(pa_iochannel*io, void*data, size_t l, pa_creds *creds, pa_bool_t *creds_valid) {
+    return pa_iochannel_read_with_ancil(io, data, l, creds, creds_valid, NULL, NULL);
+}
+
+ssize_t pa_iochannel_read_with_ancil(pa_iochannel*io, void*data, size_t l, pa_creds *creds, pa_bool_t *creds_valid, int *fds, unsigned *n_fds) {
     ssize_t r;
     struct msghdr mh;
     struct iovec iov;
     union {
         struct cmsghdr hdr;
-        uint8_t data[CMSG_SPACE(sizeof(struct ucred))];
+        uint8_t data[CMSG_SPACE(sizeof(struct ucred)) + CMSG_SPACE(sizeof(int) * PA_IOCHANNEL_FDS_MAX)];
     } cmsg;
+    int flags = 0;
 
     pa_assert(io);
     pa_assert(data);
@@ -328,6 +415,11 @@ ssize_t pa_iochannel_read_with_creds(pa_iochannel*io, void*data, size_t l, pa_cr
     pa_assert(io->ifd >= 0);
     pa_assert(creds);
     pa_assert(creds_valid);
+    pa_assert(!fds == !n_fds);
+
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
 
     memset(&iov, 0, sizeof(iov));
     iov.iov_base = data;
@@ -344,7 +436,10 @@ ssize_t pa_iochannel_read_with_creds(pa_iochannel*io, void*data, size_t l, pa_cr
     mh.msg_controllen = sizeof(cmsg);
     mh.msg_flags = 0;
 
-    if ((r = recvmsg(io->ifd, &mh, 0)) >= 0) {
+    if (n_fds)
+        *n_fds = 0;
+
+    if ((r = recvmsg(io->ifd, &mh, flags)) >= 0) {
         struct cmsghdr *cmh;
 
         *creds_valid = 0;
@@ -359,7 +454,25 @@ ssize_t pa_iochannel_read_with_creds(pa_iochannel*io, void*data, size_t l, pa_cr
                 creds->gid = u.gid;
                 creds->uid = u.uid;
                 *creds_valid = TRUE;
-                break;
+
+            } else if (cmh->cmsg_level == SOL_SOCKET && cmh->cmsg_type == SCM_RIGHTS) {
+                unsigned n, i;
+
+                /* We take at most PA_IOCHANNEL_FDS_MAX fds per call,
+                 * everything else the peer sent us is closed right
+                 * away */
+                n = (unsigned) ((cmh->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+
+                for (i = 0; i < n; i++) {
+                    int k;
+
+                    memcpy(&k, CMSG_DATA(cmh) + i * sizeof(int), sizeof(int));
+
+                    if (fds && *n_fds < PA_IOCHANNEL_FDS_MAX)
+                        fds[(*n_fds)++] = k;
+                    else
+                        pa_close(k);
+                }
             }
         }
 
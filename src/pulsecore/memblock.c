@@ -46,6 +46,7 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/memtrap.h>
+#include <pulsecore/fdsem.h>
 
 #include "memblock.h"
 
@@ -56,6 +57,32 @@
 #define PA_MEMPOOL_SLOTS_MAX 1024
 #define PA_MEMPOOL_SLOT_SIZE (64*1024)
 
+/* The pool starts out with a single SHM segment and attaches more of
+ * the same size when it runs full, until the configured pool size is
+ * reached. The peers' memimports follow since every exported block
+ * carries the id of its segment. */
+#define PA_MEMPOOL_SEGMENTS_MAX 8
+
+/* A pool attached to a main loop asks it for another segment once
+ * less than this fraction of a segment's slots of a class is left */
+#define PA_MEMPOOL_LOW_WATER 4
+
+/* The pool is carved into slots of several sizes, so that a small
+ * low-latency fragment doesn't use up a full 64K slot. Each class gets
+ * the given share (in eighths) of the pool, the largest class gets
+ * whatever is left. Pools too small to hold eight of the largest slots
+ * are not split. */
+#define PA_MEMPOOL_SHARES 8
+
+static const struct {
+    size_t slot_size;
+    unsigned share;
+} size_class_table[PA_MEMPOOL_SIZE_CLASSES_MAX] = {
+    { 4*1024, 1 },
+    { 16*1024, 1 },
+    { PA_MEMPOOL_SLOT_SIZE, 6 }
+};
+
 #define PA_MEMEXPORT_SLOTS_MAX 128
 
 #define PA_MEMIMPORT_SLOTS_MAX 160
@@ -96,6 +123,12 @@ struct pa_memimport_segment {
     unsigned n_blocks;
 };
 
+/* memfd segments cannot be attached again by id once they have been
+ * dropped, hence we keep them until the memimport goes away */
+static inline pa_bool_t segment_is_permanent(pa_memimport_segment *seg) {
+    return seg->memory.memfd;
+}
+
 /* A collection of multiple segments */
 struct pa_memimport {
     pa_mutex *mutex;
@@ -136,28 +169,60 @@ struct pa_memexport {
     PA_LLIST_FIELDS(pa_memexport);
 };
 
+struct mempool_class {
+    size_t block_size;
+    unsigned n_blocks;
+
+    /* Where the slots of this class start in the SHM segment */
+    size_t offset;
+
+    pa_atomic_t n_init;
+
+    /* A list of free slots that may be reused */
+    pa_flist *free_slots;
+};
+
+struct mempool_segment {
+    pa_shm memory;
+    struct mempool_class classes[PA_MEMPOOL_SIZE_CLASSES_MAX];
+};
+
 struct pa_mempool {
     pa_semaphore *semaphore;
     pa_mutex *mutex;
 
-    pa_shm memory;
+    pa_bool_t shared:1;
+    pa_bool_t memfd:1;
+
+    /* The slot size of the largest class */
     size_t block_size;
-    unsigned n_blocks;
 
-    pa_atomic_t n_init;
+    /* Segments are only ever added, and only while holding
+     * grow_mutex. n_segments is increased after the new segment has
+     * been set up, so that the allocation paths can stay lock-free. */
+    pa_mutex *grow_mutex;
+    struct mempool_segment segments[PA_MEMPOOL_SEGMENTS_MAX];
+    size_t segment_size;
+    unsigned n_segments_max;
+    pa_atomic_t n_segments;
+
+    /* If set, segments are only added from this main loop. The
+     * allocation paths just post grow_fdsem, and fall back to appended
+     * memory blocks until the new segment is there. */
+    pa_mainloop_api *mainloop;
+    pa_io_event *grow_event;
+    pa_fdsem *grow_fdsem;
+    pa_atomic_t grow_requested;
 
     PA_LLIST_HEAD(pa_memimport, imports);
     PA_LLIST_HEAD(pa_memexport, exports);
 
-    /* A list of free slots that may be reused */
-    pa_flist *free_slots;
-
     pa_mempool_stat stat;
 };
 
 static void segment_detach(pa_memimport_segment *seg);
 
-PA_STATIC_FLIST_DECLARE(unused_memblocks, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(unused_memblocks, 0, 64, pa_xfree);
 
 /* No lock necessary */
 static void stat_add(pa_memblock*b) {
@@ -243,26 +308,146 @@ static pa_memblock *memblock_new_appended(pa_mempool *p, size_t length) {
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
+static struct mempool_slot* mempool_class_allocate_slot(pa_mempool *p, struct mempool_segment *seg, unsigned c) {
+    struct mempool_class *k;
     struct mempool_slot *slot;
+
     pa_assert(p);
+    pa_assert(seg);
+    pa_assert(c < PA_MEMPOOL_SIZE_CLASSES_MAX);
+
+    k = &seg->classes[c];
 
-    if (!(slot = pa_flist_pop(p->free_slots))) {
+    if (!(slot = pa_flist_pop(k->free_slots))) {
         int idx;
 
         /* The free list was empty, we have to allocate a new entry */
 
-        if ((unsigned) (idx = pa_atomic_inc(&p->n_init)) >= p->n_blocks)
-            pa_atomic_dec(&p->n_init);
+        if ((unsigned) (idx = pa_atomic_inc(&k->n_init)) >= k->n_blocks)
+            pa_atomic_dec(&k->n_init);
         else
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) idx));
+            slot = (struct mempool_slot*) ((uint8_t*) seg->memory.ptr + k->offset + (k->block_size * (size_t) idx));
 
-        if (!slot) {
-            if (pa_log_ratelimit())
-                pa_log_debug("Pool full");
-            pa_atomic_inc(&p->stat.n_pool_full);
+        if (!slot)
             return NULL;
+    }
+
+    pa_atomic_inc(&p->stat.n_allocated_by_class[c]);
+    pa_atomic_inc(&p->stat.n_accumulated_by_class[c]);
+
+    return slot;
+}
+
+static int segment_init(pa_mempool *p, struct mempool_segment *seg);
+
+/* Self-locked. Returns FALSE if the pool cannot grow any further */
+static pa_bool_t mempool_grow(pa_mempool *p, unsigned n_segments) {
+    pa_bool_t ret = TRUE;
+    unsigned n;
+
+    pa_assert(p);
+
+    pa_mutex_lock(p->grow_mutex);
+
+    /* Somebody else might have grown the pool in the meantime */
+    if ((n = (unsigned) pa_atomic_load(&p->n_segments)) != n_segments)
+        goto finish;
+
+    if (n >= p->n_segments_max) {
+        ret = FALSE;
+        goto finish;
+    }
+
+    if (segment_init(p, &p->segments[n]) < 0) {
+        /* Don't try again on every allocation */
+        p->n_segments_max = n;
+        ret = FALSE;
+        goto finish;
+    }
+
+    pa_atomic_inc(&p->n_segments);
+    pa_atomic_inc(&p->stat.n_segments);
+
+finish:
+    pa_mutex_unlock(p->grow_mutex);
+
+    return ret;
+}
+
+/* No lock necessary. The request stays pending until the main loop
+ * managed to grow the pool, so it is posted only once per segment, and
+ * never again once the pool is at its maximum size. */
+static void mempool_request_grow(pa_mempool *p) {
+    pa_assert(p);
+    pa_assert(p->mainloop);
+
+    if (pa_atomic_cmpxchg(&p->grow_requested, 0, 1))
+        pa_fdsem_post(p->grow_fdsem);
+}
+
+/* No lock necessary */
+static void mempool_check_low_water(pa_mempool *p, unsigned c, unsigned n) {
+    unsigned n_blocks;
+
+    pa_assert(p);
+    pa_assert(c < PA_MEMPOOL_SIZE_CLASSES_MAX);
+
+    n_blocks = p->segments[0].classes[c].n_blocks;
+
+    if (n_blocks * n < (unsigned) pa_atomic_load(&p->stat.n_allocated_by_class[c]) + n_blocks / PA_MEMPOOL_LOW_WATER)
+        mempool_request_grow(p);
+}
+
+/* No lock necessary. Without a main loop attached this grows the pool
+ * in corner cases, and locks by its own to do so */
+static struct mempool_slot* mempool_allocate_slot(pa_mempool *p, size_t length, unsigned *c) {
+    struct mempool_slot *slot = NULL;
+    unsigned k, i, n;
+
+    pa_assert(p);
+    pa_assert(c);
+
+    for (;;) {
+        n = (unsigned) pa_atomic_load(&p->n_segments);
+
+        /* Take the smallest class the data fits in. If that one is
+         * full in all segments we move up to the next larger class,
+         * and only if all of them are full we add another segment. */
+        for (k = 0; k < PA_MEMPOOL_SIZE_CLASSES_MAX && !slot; k++) {
+
+            if (p->segments[0].classes[k].block_size < length)
+                continue;
+
+            for (i = 0; i < n && !slot; i++)
+                if (p->segments[i].classes[k].n_blocks > 0)
+                    slot = mempool_class_allocate_slot(p, &p->segments[i], k);
+
+            if (slot)
+                *c = k;
+            else if (p->segments[0].classes[k].n_blocks > 0)
+                pa_atomic_inc(&p->stat.n_full_by_class[k]);
         }
+
+        if (slot)
+            break;
+
+        if (p->mainloop) {
+            mempool_request_grow(p);
+            break;
+        }
+
+        if (!mempool_grow(p, n))
+            break;
+    }
+
+    if (slot && p->mainloop)
+        mempool_check_low_water(p, *c, n);
+
+    if (!slot) {
+        if (pa_log_ratelimit())
+            pa_log_debug("Pool full");
+        pa_atomic_inc(&p->stat.n_pool_full);
+        return NULL;
     }
 
 /* #ifdef HAVE_VALGRIND_MEMCHECK_H */
@@ -280,29 +465,86 @@ static inline void* mempool_slot_data(struct mempool_slot *slot) {
 }
 
 /* No lock necessary */
-static unsigned mempool_slot_idx(pa_mempool *p, void *ptr) {
+static struct mempool_segment* mempool_segment_by_ptr(pa_mempool *p, void *ptr) {
+    unsigned i, n;
+
     pa_assert(p);
 
-    pa_assert((uint8_t*) ptr >= (uint8_t*) p->memory.ptr);
-    pa_assert((uint8_t*) ptr < (uint8_t*) p->memory.ptr + p->memory.size);
+    n = (unsigned) pa_atomic_load(&p->n_segments);
+
+    for (i = 0; i < n; i++) {
+        struct mempool_segment *seg = &p->segments[i];
+
+        if ((uint8_t*) ptr >= (uint8_t*) seg->memory.ptr &&
+            (uint8_t*) ptr < (uint8_t*) seg->memory.ptr + seg->memory.size)
+            return seg;
+    }
+
+    return NULL;
+}
+
+/* No lock necessary */
+static unsigned mempool_slot_idx(struct mempool_segment *seg, void *ptr, unsigned *c) {
+    size_t offset;
+    unsigned k;
+
+    pa_assert(seg);
+    pa_assert(c);
+
+    pa_assert((uint8_t*) ptr >= (uint8_t*) seg->memory.ptr);
+    pa_assert((uint8_t*) ptr < (uint8_t*) seg->memory.ptr + seg->memory.size);
+
+    offset = (size_t) ((uint8_t*) ptr - (uint8_t*) seg->memory.ptr);
+
+    for (k = 0; k < PA_MEMPOOL_SIZE_CLASSES_MAX; k++) {
+        struct mempool_class *l = &seg->classes[k];
+
+        if (offset >= l->offset && offset < l->offset + l->block_size * l->n_blocks) {
+            *c = k;
+            return (unsigned) ((offset - l->offset) / l->block_size);
+        }
+    }
 
-    return (unsigned) ((size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr) / p->block_size);
+    return (unsigned) -1;
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr) {
+static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr, struct mempool_segment **seg, unsigned *c) {
     unsigned idx;
 
-    if ((idx = mempool_slot_idx(p, ptr)) == (unsigned) -1)
+    pa_assert(seg);
+
+    if (!(*seg = mempool_segment_by_ptr(p, ptr)))
+        return NULL;
+
+    if ((idx = mempool_slot_idx(*seg, ptr, c)) == (unsigned) -1)
         return NULL;
 
-    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (idx * p->block_size));
+    return (struct mempool_slot*) ((uint8_t*) (*seg)->memory.ptr + (*seg)->classes[*c].offset + (idx * (*seg)->classes[*c].block_size));
+}
+
+/* No lock necessary */
+static void mempool_free_slot(pa_mempool *p, struct mempool_segment *seg, struct mempool_slot *slot, unsigned c) {
+    pa_assert(p);
+    pa_assert(seg);
+    pa_assert(slot);
+    pa_assert(c < PA_MEMPOOL_SIZE_CLASSES_MAX);
+
+    pa_assert(pa_atomic_load(&p->stat.n_allocated_by_class[c]) > 0);
+    pa_atomic_dec(&p->stat.n_allocated_by_class[c]);
+
+    /* The free list dimensions should easily allow all slots
+     * to fit in, hence try harder if pushing this slot into
+     * the free list fails */
+    while (pa_flist_push(seg->classes[c].free_slots, slot) < 0)
+        ;
 }
 
 /* No lock necessary */
 pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
     pa_memblock *b = NULL;
     struct mempool_slot *slot;
+    unsigned c;
     static int mempool_disable = 0;
 
     pa_assert(p);
@@ -320,30 +562,28 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
     if (length == (size_t) -1)
         length = pa_mempool_block_size_max(p);
 
-    if (p->block_size >= PA_ALIGN(sizeof(pa_memblock)) + length) {
+    if (p->block_size < length) {
+        pa_log_debug("Memory block too large for pool: %lu > %lu", (unsigned long) length, (unsigned long) p->block_size);
+        pa_atomic_inc(&p->stat.n_too_large_for_pool);
+        return NULL;
+    }
 
-        if (!(slot = mempool_allocate_slot(p)))
-            return NULL;
+    if (!(slot = mempool_allocate_slot(p, length, &c)))
+        return NULL;
+
+    if (p->segments[0].classes[c].block_size >= PA_ALIGN(sizeof(pa_memblock)) + length) {
 
         b = mempool_slot_data(slot);
         b->type = PA_MEMBLOCK_POOL;
         pa_atomic_ptr_store(&b->data, (uint8_t*) b + PA_ALIGN(sizeof(pa_memblock)));
 
-    } else if (p->block_size >= length) {
-
-        if (!(slot = mempool_allocate_slot(p)))
-            return NULL;
+    } else {
 
         if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
             b = pa_xnew(pa_memblock, 1);
 
         b->type = PA_MEMBLOCK_POOL_EXTERNAL;
         pa_atomic_ptr_store(&b->data, mempool_slot_data(slot));
-
-    } else {
-        pa_log_debug("Memory block too large for pool: %lu > %lu", (unsigned long) length, (unsigned long) p->block_size);
-        pa_atomic_inc(&p->stat.n_too_large_for_pool);
-        return NULL;
     }
 
     PA_REFCNT_INIT(b);
@@ -536,7 +776,7 @@ static void memblock_free(pa_memblock *b) {
                                  PA_UINT32_TO_PTR(b->per_type.imported.id)));
 
             pa_assert(segment->n_blocks >= 1);
-            if (-- segment->n_blocks <= 0)
+            if (-- segment->n_blocks <= 0 && !segment_is_permanent(segment))
                 segment_detach(segment);
 
             pa_mutex_unlock(import->mutex);
@@ -551,10 +791,12 @@ static void memblock_free(pa_memblock *b) {
 
         case PA_MEMBLOCK_POOL_EXTERNAL:
         case PA_MEMBLOCK_POOL: {
+            struct mempool_segment *seg;
             struct mempool_slot *slot;
             pa_bool_t call_free;
+            unsigned c;
 
-            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data)));
+            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data), &seg, &c));
 
             call_free = b->type == PA_MEMBLOCK_POOL_EXTERNAL;
 
@@ -564,11 +806,7 @@ static void memblock_free(pa_memblock *b) {
 /*             } */
 /* #endif */
 
-            /* The free list dimensions should easily allow all slots
-             * to fit in, hence try harder if pushing this slot into
-             * the free list fails */
-            while (pa_flist_push(b->pool->free_slots, slot) < 0)
-                ;
+            mempool_free_slot(b->pool, seg, slot, c);
 
             if (call_free)
                 if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
@@ -620,8 +858,9 @@ static void memblock_make_local(pa_memblock *b) {
 
     if (b->length <= b->pool->block_size) {
         struct mempool_slot *slot;
+        unsigned c;
 
-        if ((slot = mempool_allocate_slot(b->pool))) {
+        if ((slot = mempool_allocate_slot(b->pool, b->length, &c))) {
             void *new_data;
             /* We can move it into a local pool, perfect! */
 
@@ -700,60 +939,214 @@ static void memblock_replace_import(pa_memblock *b) {
     memblock_make_local(b);
 
     pa_assert(segment->n_blocks >= 1);
-    if (-- segment->n_blocks <= 0)
+    if (-- segment->n_blocks <= 0 && !segment_is_permanent(segment))
         segment_detach(segment);
 
     pa_mutex_unlock(import->mutex);
 }
 
-pa_mempool* pa_mempool_new(pa_bool_t shared, size_t size) {
+/* Called with grow_mutex held, or before the pool is used */
+static int segment_init(pa_mempool *p, struct mempool_segment *seg) {
+    char t1[PA_BYTES_SNPRINT_MAX], t2[PA_BYTES_SNPRINT_MAX];
+    size_t offset;
+    unsigned n, c, share;
+
+    pa_assert(p);
+    pa_assert(seg);
+
+    if (p->memfd) {
+        if (pa_shm_create_memfd(&seg->memory, p->segment_size) < 0)
+            return -1;
+    } else if (pa_shm_create_rw(&seg->memory, p->segment_size, p->shared, 0700) < 0)
+        return -1;
+
+    pa_log_debug("Using %s memory pool segment %u of size %s",
+                 seg->memory.memfd ? "memfd" : seg->memory.shared ? "shared" : "private",
+                 (unsigned) (seg - p->segments),
+                 pa_bytes_snprint(t1, sizeof(t1), (unsigned) p->segment_size));
+
+    /* Hand out the shares of the smaller classes first, the largest
+     * class gets the rest. A class whose slots are not smaller than
+     * the ones of the next class (i.e. with large pages) passes its
+     * share on. */
+    n = (unsigned) (p->segment_size / p->block_size);
+    offset = 0;
+    share = 0;
+
+    for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES_MAX; c++) {
+        struct mempool_class *k = &seg->classes[c];
+
+        k->block_size = PA_PAGE_ALIGN(size_class_table[c].slot_size);
+        if (k->block_size < PA_PAGE_SIZE)
+            k->block_size = PA_PAGE_SIZE;
+        if (k->block_size > p->block_size)
+            k->block_size = p->block_size;
+
+        share += size_class_table[c].share;
+        k->offset = offset;
+
+        if (c == PA_MEMPOOL_SIZE_CLASSES_MAX-1)
+            k->n_blocks = (unsigned) ((p->segment_size - offset) / k->block_size);
+        else if (n < PA_MEMPOOL_SHARES ||
+                 k->block_size >= PA_PAGE_ALIGN(size_class_table[c+1].slot_size))
+            k->n_blocks = 0;
+        else {
+            k->n_blocks = (unsigned) (p->segment_size / PA_MEMPOOL_SHARES * share / k->block_size);
+            share = 0;
+        }
+
+        offset += k->n_blocks * k->block_size;
+
+        pa_atomic_store(&k->n_init, 0);
+        k->free_slots = pa_flist_new(pa_make_power_of_two(PA_MAX(k->n_blocks, 1U)));
+
+        if (k->n_blocks > 0 && seg == p->segments)
+            pa_log_debug("Memory pool class %u: %u slots of size %s each, %s in total per segment",
+                         c, k->n_blocks,
+                         pa_bytes_snprint(t1, sizeof(t1), (unsigned) k->block_size),
+                         pa_bytes_snprint(t2, sizeof(t2), (unsigned) (k->n_blocks * k->block_size)));
+    }
+
+    return 0;
+}
+
+static void segment_done(struct mempool_segment *seg) {
+    unsigned c;
+
+    pa_assert(seg);
+
+    for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES_MAX; c++)
+        pa_flist_free(seg->classes[c].free_slots, NULL);
+
+    pa_shm_free(&seg->memory);
+}
+
+static pa_mempool* mempool_new(pa_bool_t shared, pa_bool_t memfd, size_t size) {
     pa_mempool *p;
     char t1[PA_BYTES_SNPRINT_MAX], t2[PA_BYTES_SNPRINT_MAX];
+    unsigned n;
 
     p = pa_xnew(pa_mempool, 1);
 
     p->mutex = pa_mutex_new(TRUE, TRUE);
+    p->grow_mutex = pa_mutex_new(FALSE, TRUE);
     p->semaphore = pa_semaphore_new(0);
+    p->shared = shared;
+    p->memfd = memfd;
 
     p->block_size = PA_PAGE_ALIGN(PA_MEMPOOL_SLOT_SIZE);
     if (p->block_size < PA_PAGE_SIZE)
         p->block_size = PA_PAGE_SIZE;
 
     if (size <= 0)
-        p->n_blocks = PA_MEMPOOL_SLOTS_MAX;
+        n = PA_MEMPOOL_SLOTS_MAX;
     else {
-        p->n_blocks = (unsigned) (size / p->block_size);
+        n = (unsigned) (size / p->block_size);
+
+        if (n < 2)
+            n = 2;
+    }
 
-        if (p->n_blocks < 2)
-            p->n_blocks = 2;
+    /* The pool size is the ceiling. We start with one segment and grow
+     * in steps of the same size, unless the segments would get too
+     * small to be split into size classes. */
+    if (n >= PA_MEMPOOL_SEGMENTS_MAX * PA_MEMPOOL_SHARES) {
+        p->n_segments_max = PA_MEMPOOL_SEGMENTS_MAX;
+        p->segment_size = (n / PA_MEMPOOL_SEGMENTS_MAX) * p->block_size;
+    } else {
+        p->n_segments_max = 1;
+        p->segment_size = n * p->block_size;
     }
 
-    if (pa_shm_create_rw(&p->memory, p->n_blocks * p->block_size, shared, 0700) < 0) {
+    memset(&p->stat, 0, sizeof(p->stat));
+
+    if (segment_init(p, &p->segments[0]) < 0) {
+        pa_mutex_free(p->mutex);
+        pa_mutex_free(p->grow_mutex);
+        pa_semaphore_free(p->semaphore);
         pa_xfree(p);
         return NULL;
     }
 
-    pa_log_debug("Using %s memory pool with %u slots of size %s each, total size is %s, maximum usable slot size is %lu",
-                 p->memory.shared ? "shared" : "private",
-                 p->n_blocks,
-                 pa_bytes_snprint(t1, sizeof(t1), (unsigned) p->block_size),
-                 pa_bytes_snprint(t2, sizeof(t2), (unsigned) (p->n_blocks * p->block_size)),
-                 (unsigned long) pa_mempool_block_size_max(p));
+    pa_atomic_store(&p->n_segments, 1);
+    pa_atomic_store(&p->stat.n_segments, 1);
 
-    memset(&p->stat, 0, sizeof(p->stat));
-    pa_atomic_store(&p->n_init, 0);
+    p->mainloop = NULL;
+    p->grow_event = NULL;
+    p->grow_fdsem = NULL;
+    pa_atomic_store(&p->grow_requested, 0);
+
+    pa_log_debug("Using %s memory pool with up to %u segments of size %s each, maximum size is %s, maximum usable slot size is %lu",
+                 p->memfd ? "memfd" : p->shared ? "shared" : "private",
+                 p->n_segments_max,
+                 pa_bytes_snprint(t1, sizeof(t1), (unsigned) p->segment_size),
+                 pa_bytes_snprint(t2, sizeof(t2), (unsigned) (p->n_segments_max * p->segment_size)),
+                 (unsigned long) pa_mempool_block_size_max(p));
 
     PA_LLIST_HEAD_INIT(pa_memimport, p->imports);
     PA_LLIST_HEAD_INIT(pa_memexport, p->exports);
 
-    p->free_slots = pa_flist_new(p->n_blocks);
-
     return p;
 }
 
+pa_mempool* pa_mempool_new(pa_bool_t shared, size_t size) {
+    return mempool_new(shared, FALSE, size);
+}
+
+pa_mempool* pa_mempool_new_memfd(size_t size) {
+#ifdef HAVE_MEMFD
+    return mempool_new(TRUE, TRUE, size);
+#else
+    return NULL;
+#endif
+}
+
+static void grow_cb(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_mempool *p = userdata;
+
+    pa_assert(p);
+    pa_assert(p->grow_event == e);
+
+    pa_fdsem_after_poll(p->grow_fdsem);
+
+    for (;;) {
+
+        /* If the pool cannot grow any further we leave the request
+         * pending, so that nobody posts it again */
+        if (pa_atomic_load(&p->grow_requested))
+            if (mempool_grow(p, (unsigned) pa_atomic_load(&p->n_segments)))
+                pa_atomic_store(&p->grow_requested, 0);
+
+        if (pa_fdsem_before_poll(p->grow_fdsem) >= 0)
+            break;
+    }
+}
+
+void pa_mempool_set_mainloop(pa_mempool *p, pa_mainloop_api *m) {
+    pa_assert(p);
+    pa_assert(m);
+    pa_assert(!p->mainloop);
+
+    if (p->n_segments_max <= 1)
+        return;
+
+    p->grow_fdsem = pa_fdsem_new();
+    pa_assert_se(pa_fdsem_before_poll(p->grow_fdsem) >= 0);
+    pa_assert_se(p->grow_event = m->io_new(m, pa_fdsem_get(p->grow_fdsem), PA_IO_EVENT_INPUT, grow_cb, p));
+    p->mainloop = m;
+}
+
 void pa_mempool_free(pa_mempool *p) {
+    unsigned i, n;
+
     pa_assert(p);
 
+    if (p->mainloop) {
+        p->mainloop->io_free(p->grow_event);
+        pa_fdsem_after_poll(p->grow_fdsem);
+        pa_fdsem_free(p->grow_fdsem);
+    }
+
     pa_mutex_lock(p->mutex);
 
     while (p->imports)
@@ -764,45 +1157,51 @@ void pa_mempool_free(pa_mempool *p) {
 
     pa_mutex_unlock(p->mutex);
 
-    pa_flist_free(p->free_slots, NULL);
+    n = (unsigned) pa_atomic_load(&p->n_segments);
 
     if (pa_atomic_load(&p->stat.n_allocated) > 0) {
 
         /* Ouch, somebody is retaining a memory block reference! */
 
 #ifdef DEBUG_REF
-        unsigned i;
+        unsigned c, j;
         pa_flist *list;
 
         /* Let's try to find at least one of those leaked memory blocks */
 
-        list = pa_flist_new(p->n_blocks);
+        for (i = 0; i < n; i++) {
+            for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES_MAX; c++) {
+                struct mempool_segment *seg = &p->segments[i];
+                struct mempool_class *k = &seg->classes[c];
 
-        for (i = 0; i < (unsigned) pa_atomic_load(&p->n_init); i++) {
-            struct mempool_slot *slot;
-            pa_memblock *b, *k;
+                list = pa_flist_new(pa_make_power_of_two(PA_MAX(k->n_blocks, 1U)));
 
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) i));
-            b = mempool_slot_data(slot);
+                for (j = 0; j < (unsigned) pa_atomic_load(&k->n_init); j++) {
+                    struct mempool_slot *slot;
+                    pa_memblock *b, *l;
 
-            while ((k = pa_flist_pop(p->free_slots))) {
-                while (pa_flist_push(list, k) < 0)
-                    ;
+                    slot = (struct mempool_slot*) ((uint8_t*) seg->memory.ptr + k->offset + (k->block_size * (size_t) j));
+                    b = mempool_slot_data(slot);
 
-                if (b == k)
-                    break;
-            }
+                    while ((l = pa_flist_pop(k->free_slots))) {
+                        while (pa_flist_push(list, l) < 0)
+                            ;
 
-            if (!k)
-                pa_log("REF: Leaked memory block %p", b);
+                        if (b == l)
+                            break;
+                    }
 
-            while ((k = pa_flist_pop(list)))
-                while (pa_flist_push(p->free_slots, k) < 0)
-                    ;
-        }
+                    if (!l)
+                        pa_log("REF: Leaked memory block %p", b);
 
-        pa_flist_free(list, NULL);
+                    while ((l = pa_flist_pop(list)))
+                        while (pa_flist_push(k->free_slots, l) < 0)
+                            ;
+                }
 
+                pa_flist_free(list, NULL);
+            }
+        }
 #endif
 
         pa_log_error("Memory pool destroyed but not all memory blocks freed! %u remain.", pa_atomic_load(&p->stat.n_allocated));
@@ -810,9 +1209,11 @@ void pa_mempool_free(pa_mempool *p) {
 /*         PA_DEBUG_TRAP; */
     }
 
-    pa_shm_free(&p->memory);
+    for (i = 0; i < n; i++)
+        segment_done(&p->segments[i]);
 
     pa_mutex_free(p->mutex);
+    pa_mutex_free(p->grow_mutex);
     pa_semaphore_free(p->semaphore);
 
     pa_xfree(p);
@@ -832,37 +1233,74 @@ size_t pa_mempool_block_size_max(pa_mempool *p) {
     return p->block_size - PA_ALIGN(sizeof(pa_memblock));
 }
 
+/* No lock necessary */
+void pa_mempool_get_size_class(pa_mempool *p, unsigned c, size_t *block_size, unsigned *n_blocks) {
+    pa_assert(p);
+    pa_assert(c < PA_MEMPOOL_SIZE_CLASSES_MAX);
+
+    /* All segments are carved up the same way */
+    if (block_size)
+        *block_size = p->segments[0].classes[c].block_size;
+
+    if (n_blocks)
+        *n_blocks = p->segments[0].classes[c].n_blocks * (unsigned) pa_atomic_load(&p->n_segments);
+}
+
+/* No lock necessary */
+size_t pa_mempool_get_size(pa_mempool *p, size_t *size_max) {
+    pa_assert(p);
+
+    if (size_max)
+        *size_max = p->segment_size * p->n_segments_max;
+
+    return p->segment_size * (size_t) pa_atomic_load(&p->n_segments);
+}
+
 /* No lock necessary */
 void pa_mempool_vacuum(pa_mempool *p) {
     struct mempool_slot *slot;
     pa_flist *list;
+    unsigned i, n, c;
 
     pa_assert(p);
 
-    list = pa_flist_new(p->n_blocks);
+    /* Segments are never unmapped again, since the lock-free paths
+     * might still look at them. But we give all memory of free slots
+     * back to the OS, which makes idle segments cost next to nothing. */
+    n = (unsigned) pa_atomic_load(&p->n_segments);
 
-    while ((slot = pa_flist_pop(p->free_slots)))
-        while (pa_flist_push(list, slot) < 0)
-            ;
+    for (i = 0; i < n; i++) {
+        struct mempool_segment *seg = &p->segments[i];
 
-    while ((slot = pa_flist_pop(list))) {
-        pa_shm_punch(&p->memory, (size_t) ((uint8_t*) slot - (uint8_t*) p->memory.ptr), p->block_size);
+        for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES_MAX; c++) {
+            struct mempool_class *k = &seg->classes[c];
 
-        while (pa_flist_push(p->free_slots, slot))
-            ;
-    }
+            list = pa_flist_new(pa_make_power_of_two(PA_MAX(k->n_blocks, 1U)));
 
-    pa_flist_free(list, NULL);
+            while ((slot = pa_flist_pop(k->free_slots)))
+                while (pa_flist_push(list, slot) < 0)
+                    ;
+
+            while ((slot = pa_flist_pop(list))) {
+                pa_shm_punch(&seg->memory, (size_t) ((uint8_t*) slot - (uint8_t*) seg->memory.ptr), k->block_size);
+
+                while (pa_flist_push(k->free_slots, slot))
+                    ;
+            }
+
+            pa_flist_free(list, NULL);
+        }
+    }
 }
 
 /* No lock necessary */
 int pa_mempool_get_shm_id(pa_mempool *p, uint32_t *id) {
     pa_assert(p);
 
-    if (!p->memory.shared)
+    if (!p->shared)
         return -1;
 
-    *id = p->memory.id;
+    *id = p->segments[0].memory.id;
 
     return 0;
 }
@@ -871,7 +1309,14 @@ int pa_mempool_get_shm_id(pa_mempool *p, uint32_t *id) {
 pa_bool_t pa_mempool_is_shared(pa_mempool *p) {
     pa_assert(p);
 
-    return !!p->memory.shared;
+    return !!p->shared;
+}
+
+/* No lock necessary */
+pa_bool_t pa_mempool_is_memfd_backed(pa_mempool *p) {
+    pa_assert(p);
+
+    return !!p->memfd;
 }
 
 /* For recieving blocks from other nodes */
@@ -932,10 +1377,51 @@ static void segment_detach(pa_memimport_segment *seg) {
     pa_xfree(seg);
 }
 
+/* Self-locked. Takes over the fd in any case */
+int pa_memimport_attach_memfd(pa_memimport *i, uint32_t shm_id, int fd) {
+    pa_memimport_segment *seg;
+    int ret = -1;
+
+    pa_assert(i);
+    pa_assert(fd >= 0);
+
+    pa_mutex_lock(i->mutex);
+
+    if (pa_hashmap_get(i->segments, PA_UINT32_TO_PTR(shm_id))) {
+        pa_log_warn("Segment %u is already attached.", shm_id);
+        pa_close(fd);
+        goto finish;
+    }
+
+    if (pa_hashmap_size(i->segments) >= PA_MEMIMPORT_SEGMENTS_MAX) {
+        pa_close(fd);
+        goto finish;
+    }
+
+    seg = pa_xnew0(pa_memimport_segment, 1);
+
+    if (pa_shm_attach_fd(&seg->memory, shm_id, fd, FALSE) < 0) {
+        pa_xfree(seg);
+        goto finish;
+    }
+
+    seg->import = i;
+    seg->trap = pa_memtrap_add(seg->memory.ptr, seg->memory.size);
+
+    pa_hashmap_put(i->segments, PA_UINT32_TO_PTR(seg->memory.id), seg);
+    ret = 0;
+
+finish:
+    pa_mutex_unlock(i->mutex);
+
+    return ret;
+}
+
 /* Self-locked. Not multiple-caller safe */
 void pa_memimport_free(pa_memimport *i) {
     pa_memexport *e;
     pa_memblock *b;
+    pa_memimport_segment *seg;
 
     pa_assert(i);
 
@@ -944,7 +1430,11 @@ void pa_memimport_free(pa_memimport *i) {
     while ((b = pa_hashmap_first(i->blocks)))
         memblock_replace_import(b);
 
-    pa_assert(pa_hashmap_size(i->segments) == 0);
+    while ((seg = pa_hashmap_first(i->segments))) {
+        pa_assert(segment_is_permanent(seg));
+        pa_assert(seg->n_blocks == 0);
+        segment_detach(seg);
+    }
 
     pa_mutex_unlock(i->mutex);
 
@@ -1044,7 +1534,7 @@ pa_memexport* pa_memexport_new(pa_mempool *p, pa_memexport_revoke_cb_t cb, void
     pa_assert(p);
     pa_assert(cb);
 
-    if (!p->memory.shared)
+    if (!p->shared)
         return NULL;
 
     e = pa_xnew(pa_memexport, 1);
@@ -1149,12 +1639,14 @@ static pa_memblock *memblock_shared_copy(pa_mempool *p, pa_memblock *b) {
     pa_assert(p);
     pa_assert(b);
 
-    if (b->type == PA_MEMBLOCK_IMPORTED ||
-        b->type == PA_MEMBLOCK_POOL ||
-        b->type == PA_MEMBLOCK_POOL_EXTERNAL) {
-        pa_assert(b->pool == p);
+    /* Blocks that live in another pool are copied, so that a peer we
+     * gave a private pool to never learns about any other segment. The
+     * same goes for memfd segments we imported from somebody else. */
+    if (b->pool == p &&
+        (b->type == PA_MEMBLOCK_POOL ||
+         b->type == PA_MEMBLOCK_POOL_EXTERNAL ||
+         (b->type == PA_MEMBLOCK_IMPORTED && !b->per_type.imported.segment->memory.memfd)))
         return pa_memblock_ref(b);
-    }
 
     if (!(n = pa_memblock_new_pool(p, b->length)))
         return NULL;
@@ -1175,7 +1667,6 @@ int pa_memexport_put(pa_memexport *e, pa_memblock *b, uint32_t *block_id, uint32
     pa_assert(shm_id);
     pa_assert(offset);
     pa_assert(size);
-    pa_assert(b->pool == e->pool);
 
     if (!(b = memblock_shared_copy(e->pool, b)))
         return -1;
@@ -1206,9 +1697,12 @@ int pa_memexport_put(pa_memexport *e, pa_memblock *b, uint32_t *block_id, uint32
         pa_assert(b->per_type.imported.segment);
         memory = &b->per_type.imported.segment->memory;
     } else {
+        struct mempool_segment *seg;
+
         pa_assert(b->type == PA_MEMBLOCK_POOL || b->type == PA_MEMBLOCK_POOL_EXTERNAL);
-        pa_assert(b->pool);
-        memory = &b->pool->memory;
+        pa_assert(b->pool == e->pool);
+        pa_assert_se(seg = mempool_segment_by_ptr(b->pool, data));
+        memory = &seg->memory;
     }
 
     pa_assert(data >= memory->ptr);
@@ -1225,3 +1719,23 @@ int pa_memexport_put(pa_memexport *e, pa_memblock *b, uint32_t *block_id, uint32
 
     return 0;
 }
+
+/* No lock necessary. Returns the memfd behind a segment id we handed
+ * out in pa_memexport_put(), or -1 if it is not a memfd segment. The
+ * descriptor stays owned by the pool. */
+int pa_memexport_get_memfd(pa_memexport *e, uint32_t shm_id) {
+    unsigned i, n;
+
+    pa_assert(e);
+
+    if (!e->pool->memfd)
+        return -1;
+
+    n = (unsigned) pa_atomic_load(&e->pool->n_segments);
+
+    for (i = 0; i < n; i++)
+        if (e->pool->segments[i].memory.id == shm_id)
+            return e->pool->segments[i].memory.fd;
+
+    return -1;
+}
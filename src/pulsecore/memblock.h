@@ -27,6 +27,7 @@
 #include <inttypes.h>
 
 #include <pulse/def.h>
+#include <pulse/mainloop-api.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/refcnt.h>
 #include <pulsecore/atomic.h>
@@ -47,6 +48,9 @@ typedef enum pa_memblock_type {
     PA_MEMBLOCK_TYPE_MAX
 } pa_memblock_type_t;
 
+/* The pool hands out slots of a few different sizes, see memblock.c */
+#define PA_MEMPOOL_SIZE_CLASSES_MAX 3
+
 typedef struct pa_memblock pa_memblock;
 typedef struct pa_mempool pa_mempool;
 typedef struct pa_mempool_stat pa_mempool_stat;
@@ -74,8 +78,17 @@ struct pa_mempool_stat {
     pa_atomic_t n_too_large_for_pool;
     pa_atomic_t n_pool_full;
 
+    /* SHM segments the pool currently consists of */
+    pa_atomic_t n_segments;
+
     pa_atomic_t n_allocated_by_type[PA_MEMBLOCK_TYPE_MAX];
     pa_atomic_t n_accumulated_by_type[PA_MEMBLOCK_TYPE_MAX];
+
+    /* Pool slots per size class. n_full_by_class counts how often a
+     * class had no free slot left in any segment */
+    pa_atomic_t n_allocated_by_class[PA_MEMPOOL_SIZE_CLASSES_MAX];
+    pa_atomic_t n_accumulated_by_class[PA_MEMPOOL_SIZE_CLASSES_MAX];
+    pa_atomic_t n_full_by_class[PA_MEMPOOL_SIZE_CLASSES_MAX];
 };
 
 /* Allocate a new memory block of type PA_MEMBLOCK_MEMPOOL or PA_MEMBLOCK_APPENDED, depending on the size */
@@ -118,23 +131,43 @@ pa_memblock *pa_memblock_will_need(pa_memblock *b);
 
 /* The memory block manager */
 pa_mempool* pa_mempool_new(pa_bool_t shared, size_t size);
+
+/* A shared pool whose segments are memfds. They are not visible in
+ * /dev/shm, peers can only map them after they were passed the fd,
+ * see pa_memexport_get_memfd() and pa_memimport_attach_memfd().
+ * Returns NULL if memfds are not available. */
+pa_mempool* pa_mempool_new_memfd(size_t size);
 void pa_mempool_free(pa_mempool *p);
 const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p);
 void pa_mempool_vacuum(pa_mempool *p);
 int pa_mempool_get_shm_id(pa_mempool *p, uint32_t *id);
 pa_bool_t pa_mempool_is_shared(pa_mempool *p);
+pa_bool_t pa_mempool_is_memfd_backed(pa_mempool *p);
 size_t pa_mempool_block_size_max(pa_mempool *p);
+void pa_mempool_get_size_class(pa_mempool *p, unsigned c, size_t *block_size, unsigned *n_blocks);
+
+/* The pool grows by attaching more SHM segments when it runs full.
+ * Returns the current size, and the size it may grow to in *size_max */
+size_t pa_mempool_get_size(pa_mempool *p, size_t *size_max);
+
+/* Attach the pool to the main loop. From then on it only grows from
+ * there, threads allocating from it never set up segments themselves
+ * and get appended blocks while they wait for one. Call this before
+ * the pool is used by any other thread. */
+void pa_mempool_set_mainloop(pa_mempool *p, pa_mainloop_api *m);
 
 /* For recieving blocks from other nodes */
 pa_memimport* pa_memimport_new(pa_mempool *p, pa_memimport_release_cb_t cb, void *userdata);
 void pa_memimport_free(pa_memimport *i);
 pa_memblock* pa_memimport_get(pa_memimport *i, uint32_t block_id, uint32_t shm_id, size_t offset, size_t size);
 int pa_memimport_process_revoke(pa_memimport *i, uint32_t block_id);
+int pa_memimport_attach_memfd(pa_memimport *i, uint32_t shm_id, int fd);
 
 /* For sending blocks to other nodes */
 pa_memexport* pa_memexport_new(pa_mempool *p, pa_memexport_revoke_cb_t cb, void *userdata);
 void pa_memexport_free(pa_memexport *e);
 int pa_memexport_put(pa_memexport *e, pa_memblock *b, uint32_t *block_id, uint32_t *shm_id, size_t *offset, size_t *size);
 int pa_memexport_process_release(pa_memexport *e, uint32_t id);
+int pa_memexport_get_memfd(pa_memexport *e, uint32_t shm_id);
 
 #endif
@@ -34,22 +34,26 @@
 #include <pulsecore/log.h>
 #include <pulsecore/mcalign.h>
 #include <pulsecore/macro.h>
-#include <pulsecore/flist.h>
 
 #include "memblockq.h"
 
-struct list_item {
-    struct list_item *next, *prev;
+/* The blocks are kept in a ring array, sorted by their index and
+ * without overlaps. Dropping played data from the front and appending
+ * new data at the end are O(1), everything else is found by binary
+ * search. The read and write cursors cache the positions of the last
+ * lookups, which usually stay valid or move on by a single block. */
+
+struct item {
     int64_t index;
     pa_memchunk chunk;
 };
 
-PA_STATIC_FLIST_DECLARE(list_items, 0, pa_xfree);
+#define ITEMS_MIN 16
 
 struct pa_memblockq {
-    struct list_item *blocks, *blocks_tail;
-    struct list_item *current_read, *current_write;
-    unsigned n_blocks;
+    struct item *items;
+    unsigned n_allocated, first, n_blocks;
+    unsigned current_read, current_write;
     size_t maxlength, tlength, base, prebuf, minreq, maxrewind;
     int64_t read_index, write_index;
     pa_bool_t in_prebuf;
@@ -73,9 +77,9 @@ pa_memblockq* pa_memblockq_new(
     pa_assert(base > 0);
 
     bq = pa_xnew(pa_memblockq, 1);
-    bq->blocks = bq->blocks_tail = NULL;
-    bq->current_read = bq->current_write = NULL;
-    bq->n_blocks = 0;
+    bq->items = NULL;
+    bq->n_allocated = bq->first = bq->n_blocks = 0;
+    bq->current_read = bq->current_write = 0;
 
     bq->base = base;
     bq->read_index = bq->write_index = idx;
@@ -118,107 +122,144 @@ void pa_memblockq_free(pa_memblockq* bq) {
     if (bq->mcalign)
         pa_mcalign_free(bq->mcalign);
 
+    pa_xfree(bq->items);
     pa_xfree(bq);
 }
 
-static void fix_current_read(pa_memblockq *bq) {
+static inline struct item* item_at(pa_memblockq *bq, unsigned i) {
+    return bq->items + ((bq->first + i) & (bq->n_allocated - 1));
+}
+
+static inline int64_t item_end(const struct item *q) {
+    return q->index + (int64_t) q->chunk.length;
+}
+
+/* Returns the position of the first block that ends right of idx,
+ * which is n_blocks if there is none */
+static unsigned locate(pa_memblockq *bq, int64_t idx, unsigned hint) {
+    unsigned l, r;
+
     pa_assert(bq);
 
-    if (PA_UNLIKELY(!bq->blocks)) {
-        bq->current_read = NULL;
-        return;
-    }
+    /* Check the cached position and the one after it first */
+    for (l = hint; l <= bq->n_blocks && l <= hint + 1; l++)
+        if ((l >= bq->n_blocks || item_end(item_at(bq, l)) > idx) &&
+            (l <= 0 || item_end(item_at(bq, l - 1)) <= idx))
+            return l;
 
-    if (PA_UNLIKELY(!bq->current_read))
-        bq->current_read = bq->blocks;
+    l = 0;
+    r = bq->n_blocks;
 
-    /* Scan left */
-    while (PA_UNLIKELY(bq->current_read->index > bq->read_index))
+    while (l < r) {
+        unsigned m = l + (r - l) / 2;
 
-        if (bq->current_read->prev)
-            bq->current_read = bq->current_read->prev;
+        if (item_end(item_at(bq, m)) > idx)
+            r = m;
         else
-            break;
+            l = m + 1;
+    }
+
+    return l;
+}
+
+static void fix_current_read(pa_memblockq *bq) {
+    pa_assert(bq);
 
-    /* Scan right */
-    while (PA_LIKELY(bq->current_read != NULL) && PA_UNLIKELY(bq->current_read->index + (int64_t) bq->current_read->chunk.length <= bq->read_index))
-        bq->current_read = bq->current_read->next;
+    bq->current_read = locate(bq, bq->read_index, bq->current_read);
 
     /* At this point current_read will either point at or left of the
-       next block to play. It may be NULL in case everything in
+       next block to play. It may be n_blocks in case everything in
        the queue was already played */
 }
 
 static void fix_current_write(pa_memblockq *bq) {
     pa_assert(bq);
 
-    if (PA_UNLIKELY(!bq->blocks)) {
-        bq->current_write = NULL;
-        return;
-    }
+    bq->current_write = locate(bq, bq->write_index, bq->current_write);
+
+    /* At this point current_write will point to the first block that
+       is (partially) overwritten by the next write, or the first block
+       right of it. It may be n_blocks in case the write index is
+       beyond the end of the queue */
+}
 
-    if (PA_UNLIKELY(!bq->current_write))
-        bq->current_write = bq->blocks_tail;
+static void grow(pa_memblockq *bq, unsigned n) {
+    struct item *items;
+    unsigned n_allocated, i;
 
-    /* Scan right */
-    while (PA_UNLIKELY(bq->current_write->index + (int64_t) bq->current_write->chunk.length <= bq->write_index))
+    pa_assert(bq);
 
-        if (bq->current_write->next)
-            bq->current_write = bq->current_write->next;
-        else
-            break;
+    n_allocated = bq->n_allocated > 0 ? bq->n_allocated : ITEMS_MIN;
 
-    /* Scan left */
-    while (PA_LIKELY(bq->current_write != NULL) && PA_UNLIKELY(bq->current_write->index > bq->write_index))
-        bq->current_write = bq->current_write->prev;
+    while (n_allocated < n)
+        n_allocated *= 2;
 
-    /* At this point current_write will either point at or right of
-       the next block to write data to. It may be NULL in case
-       everything in the queue is still to be played */
+    items = pa_xnew(struct item, n_allocated);
+
+    for (i = 0; i < bq->n_blocks; i++)
+        items[i] = *item_at(bq, i);
+
+    pa_xfree(bq->items);
+    bq->items = items;
+    bq->n_allocated = n_allocated;
+    bq->first = 0;
 }
 
-static void drop_block(pa_memblockq *bq, struct list_item *q) {
+/* Makes room for n blocks in front of position i, the new slots are
+ * left uninitialized */
+static void insert_slots(pa_memblockq *bq, unsigned i, unsigned n) {
+    unsigned j;
+
     pa_assert(bq);
-    pa_assert(q);
+    pa_assert(i <= bq->n_blocks);
 
-    pa_assert(bq->n_blocks >= 1);
+    if (bq->n_blocks + n > bq->n_allocated)
+        grow(bq, bq->n_blocks + n);
 
-    if (q->prev)
-        q->prev->next = q->next;
-    else {
-        pa_assert(bq->blocks == q);
-        bq->blocks = q->next;
-    }
+    for (j = bq->n_blocks; j > i; j--)
+        *item_at(bq, j - 1 + n) = *item_at(bq, j - 1);
 
-    if (q->next)
-        q->next->prev = q->prev;
-    else {
-        pa_assert(bq->blocks_tail == q);
-        bq->blocks_tail = q->prev;
-    }
+    bq->n_blocks += n;
+}
 
-    if (bq->current_write == q)
-        bq->current_write = q->prev;
+/* Drops the blocks at the positions [i, j) */
+static void drop_blocks(pa_memblockq *bq, unsigned i, unsigned j) {
+    unsigned k;
 
-    if (bq->current_read == q)
-        bq->current_read = q->next;
+    pa_assert(bq);
+    pa_assert(i <= j);
+    pa_assert(j <= bq->n_blocks);
 
-    pa_memblock_unref(q->chunk.memblock);
+    if (i >= j)
+        return;
 
-    if (pa_flist_push(PA_STATIC_FLIST_GET(list_items), q) < 0)
-        pa_xfree(q);
+    for (k = i; k < j; k++)
+        pa_memblock_unref(item_at(bq, k)->chunk.memblock);
 
-    bq->n_blocks--;
+    if (i == 0) {
+        bq->first = (bq->first + j) & (bq->n_allocated - 1);
+
+        /* Keep the cursors pointing to the same blocks */
+        bq->current_read -= PA_MIN(bq->current_read, j);
+        bq->current_write -= PA_MIN(bq->current_write, j);
+    } else
+        for (k = j; k < bq->n_blocks; k++)
+            *item_at(bq, k - (j - i)) = *item_at(bq, k);
+
+    bq->n_blocks -= j - i;
 }
 
 static void drop_backlog(pa_memblockq *bq) {
     int64_t boundary;
+    unsigned n;
     pa_assert(bq);
 
     boundary = bq->read_index - (int64_t) bq->maxrewind;
 
-    while (bq->blocks && (bq->blocks->index + (int64_t) bq->blocks->chunk.length <= boundary))
-        drop_block(bq, bq->blocks);
+    for (n = 0; n < bq->n_blocks && item_end(item_at(bq, n)) <= boundary; n++)
+        ;
+
+    drop_blocks(bq, 0, n);
 }
 
 static pa_bool_t can_push(pa_memblockq *bq, size_t l) {
@@ -235,7 +276,7 @@ static pa_bool_t can_push(pa_memblockq *bq, size_t l) {
             return TRUE;
     }
 
-    end = bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->write_index;
+    end = bq->n_blocks > 0 ? item_end(item_at(bq, bq->n_blocks - 1)) : bq->write_index;
 
     /* Make sure that the list doesn't get too long */
     if (bq->write_index + (int64_t) l > end)
@@ -272,9 +313,10 @@ static void read_index_changed(pa_memblockq *bq, int64_t old_read_index) {
 }
 
 int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
-    struct list_item *q, *n;
+    struct item *q;
     pa_memchunk chunk;
-    int64_t old;
+    int64_t old, end;
+    unsigned i, j;
 
     pa_assert(bq);
     pa_assert(uchunk);
@@ -290,149 +332,83 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
 
     old = bq->write_index;
     chunk = *uchunk;
+    end = bq->write_index + (int64_t) chunk.length;
 
+    /* All blocks left of i end before the new data starts */
     fix_current_write(bq);
-    q = bq->current_write;
-
-    /* First we advance the q pointer right of where we want to
-     * write to */
-
-    if (q) {
-        while (bq->write_index + (int64_t) chunk.length > q->index)
-            if (q->next)
-                q = q->next;
-            else
-                break;
-    }
+    i = bq->current_write;
 
-    if (!q)
-        q = bq->blocks_tail;
+    if (i < bq->n_blocks && (q = item_at(bq, i))->index < bq->write_index) {
 
-    /* We go from back to front to look for the right place to add
-     * this new entry. Drop data we will overwrite on the way */
-
-    while (q) {
-
-        if (bq->write_index >= q->index + (int64_t) q->chunk.length)
-            /* We found the entry where we need to place the new entry immediately after */
-            break;
-        else if (bq->write_index + (int64_t) chunk.length <= q->index) {
-            /* This entry isn't touched at all, let's skip it */
-            q = q->prev;
-        } else if (bq->write_index <= q->index &&
-                   bq->write_index + (int64_t) chunk.length >= q->index + (int64_t) q->chunk.length) {
-
-            /* This entry is fully replaced by the new entry, so let's drop it */
-
-            struct list_item *p;
-            p = q;
-            q = q->prev;
-            drop_block(bq, p);
-        } else if (bq->write_index >= q->index) {
-            /* The write index points into this memblock, so let's
-             * truncate or split it */
-
-            if (bq->write_index + (int64_t) chunk.length < q->index + (int64_t) q->chunk.length) {
-
-                /* We need to save the end of this memchunk */
-                struct list_item *p;
-                size_t d;
-
-                /* Create a new list entry for the end of thie memchunk */
-                if (!(p = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
-                    p = pa_xnew(struct list_item, 1);
-
-                p->chunk = q->chunk;
-                pa_memblock_ref(p->chunk.memblock);
-
-                /* Calculate offset */
-                d = (size_t) (bq->write_index + (int64_t) chunk.length - q->index);
-                pa_assert(d > 0);
-
-                /* Drop it from the new entry */
-                p->index = q->index + (int64_t) d;
-                p->chunk.length -= d;
-
-                /* Add it to the list */
-                p->prev = q;
-                if ((p->next = q->next))
-                    q->next->prev = p;
-                else
-                    bq->blocks_tail = p;
-                q->next = p;
-
-                bq->n_blocks++;
-            }
-
-            /* Truncate the chunk */
-            if (!(q->chunk.length = (size_t) (bq->write_index - q->index))) {
-                struct list_item *p;
-                p = q;
-                q = q->prev;
-                drop_block(bq, p);
-            }
-
-            /* We had to truncate this block, hence we're now at the right position */
-            break;
-        } else {
+        if (item_end(q) > end) {
+            struct item *p;
             size_t d;
 
-            pa_assert(bq->write_index + (int64_t)chunk.length > q->index &&
-                   bq->write_index + (int64_t)chunk.length < q->index + (int64_t)q->chunk.length &&
-                   bq->write_index < q->index);
+            /* The new data lies in the middle of this block, so let's
+             * save its end in a block of its own */
 
-            /* The job overwrites the current entry at the end, so let's drop the beginning of this entry */
+            insert_slots(bq, i + 1, 1);
+            q = item_at(bq, i);
+            p = item_at(bq, i + 1);
 
-            d = (size_t) (bq->write_index + (int64_t) chunk.length - q->index);
-            q->index += (int64_t) d;
-            q->chunk.index += d;
-            q->chunk.length -= d;
+            *p = *q;
+            pa_memblock_ref(p->chunk.memblock);
 
-            q = q->prev;
+            d = (size_t) (end - q->index);
+            p->index = end;
+            p->chunk.index += d;
+            p->chunk.length -= d;
         }
-    }
 
-    if (q) {
-        pa_assert(bq->write_index >=  q->index + (int64_t)q->chunk.length);
-        pa_assert(!q->next || (bq->write_index + (int64_t)chunk.length <= q->next->index));
+        /* The write index points into this memblock, so let's
+         * truncate it */
+        q->chunk.length = (size_t) (bq->write_index - q->index);
+        i++;
+    }
 
-        /* Try to merge memory blocks */
+    /* Skip all blocks that are fully replaced by the new data */
+    for (j = i; j < bq->n_blocks && item_end(item_at(bq, j)) <= end; j++)
+        ;
 
-        if (q->chunk.memblock == chunk.memblock &&
-            q->chunk.index + q->chunk.length == chunk.index &&
-            bq->write_index == q->index + (int64_t) q->chunk.length) {
+    if (j < bq->n_blocks && (q = item_at(bq, j))->index < end) {
+        size_t d;
 
-            q->chunk.length += chunk.length;
-            bq->write_index += (int64_t) chunk.length;
-            goto finish;
-        }
-    } else
-        pa_assert(!bq->blocks || (bq->write_index + (int64_t)chunk.length <= bq->blocks->index));
+        /* The new data overwrites the beginning of this block, so
+         * let's drop that */
 
-    if (!(n = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
-        n = pa_xnew(struct list_item, 1);
+        d = (size_t) (end - q->index);
+        q->index += (int64_t) d;
+        q->chunk.index += d;
+        q->chunk.length -= d;
+    }
 
-    n->chunk = chunk;
-    pa_memblock_ref(n->chunk.memblock);
-    n->index = bq->write_index;
-    bq->write_index += (int64_t) n->chunk.length;
+    /* Try to merge memory blocks */
+    if (i > 0 &&
+        (q = item_at(bq, i - 1))->chunk.memblock == chunk.memblock &&
+        q->chunk.index + q->chunk.length == chunk.index &&
+        bq->write_index == item_end(q)) {
 
-    n->next = q ? q->next : bq->blocks;
-    n->prev = q;
+        q->chunk.length += chunk.length;
+        drop_blocks(bq, i, j);
 
-    if (n->next)
-        n->next->prev = n;
-    else
-        bq->blocks_tail = n;
+    } else {
 
-    if (n->prev)
-        n->prev->next = n;
-    else
-        bq->blocks = n;
+        if (j > i) {
+            /* Reuse the slot of the first block we replace */
+            pa_memblock_unref(item_at(bq, i)->chunk.memblock);
+            drop_blocks(bq, i + 1, j);
+        } else
+            insert_slots(bq, i, 1);
 
-    bq->n_blocks++;
+        q = item_at(bq, i);
+        q->index = bq->write_index;
+        q->chunk = chunk;
+        pa_memblock_ref(q->chunk.memblock);
+        i++;
+    }
 
-finish:
+    bq->write_index = end;
+    bq->current_write = i;
 
     write_index_changed(bq, old, TRUE);
     return 0;
@@ -469,6 +445,7 @@ static pa_bool_t update_prebuf(pa_memblockq *bq) {
 }
 
 int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
+    struct item *q;
     int64_t d;
     pa_assert(bq);
     pa_assert(chunk);
@@ -478,14 +455,15 @@ int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
         return -1;
 
     fix_current_read(bq);
+    q = bq->current_read < bq->n_blocks ? item_at(bq, bq->current_read) : NULL;
 
     /* Do we need to spit out silence? */
-    if (!bq->current_read || bq->current_read->index > bq->read_index) {
+    if (!q || q->index > bq->read_index) {
         size_t length;
 
         /* How much silence shall we return? */
-        if (bq->current_read)
-            length = (size_t) (bq->current_read->index - bq->read_index);
+        if (q)
+            length = (size_t) (q->index - bq->read_index);
         else if (bq->write_index > bq->read_index)
             length = (size_t) (bq->write_index - bq->read_index);
         else
@@ -515,11 +493,11 @@ int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
     }
 
     /* Ok, let's pass real data to the caller */
-    *chunk = bq->current_read->chunk;
+    *chunk = q->chunk;
     pa_memblock_ref(chunk->memblock);
 
-    pa_assert(bq->read_index >= bq->current_read->index);
-    d = bq->read_index - bq->current_read->index;
+    pa_assert(bq->read_index >= q->index);
+    d = bq->read_index - q->index;
     chunk->index += (size_t) d;
     chunk->length -= (size_t) d;
 
@@ -529,7 +507,8 @@ int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
 int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchunk *chunk) {
     pa_memchunk tchunk, rchunk;
     int64_t ri;
-    struct list_item *item;
+    struct item *item;
+    unsigned i;
 
     pa_assert(bq);
     pa_assert(block_size > 0);
@@ -556,7 +535,8 @@ int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchun
 
     /* We don't need to call fix_current_read() here, since
      * pa_memblock_peek() already did that */
-    item = bq->current_read;
+    i = bq->current_read;
+    item = i < bq->n_blocks ? item_at(bq, i) : NULL;
     ri = bq->read_index + tchunk.length;
 
     while (rchunk.index < block_size) {
@@ -579,7 +559,7 @@ int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchun
             tchunk.length -= (size_t) d;
 
             /* Go to next item for the next iteration */
-            item = item->next;
+            item = ++i < bq->n_blocks ? item_at(bq, i) : NULL;
         }
 
         rchunk.length = tchunk.length = PA_MIN(tchunk.length, block_size - rchunk.index);
@@ -609,15 +589,22 @@ void pa_memblockq_drop(pa_memblockq *bq, size_t length) {
         if (update_prebuf(bq))
             break;
 
+        /* Prebuffering cannot start again before we reach the write
+         * index, so there's no need to go piece by piece up to it */
+        if (bq->prebuf <= 0 || bq->read_index + (int64_t) length <= bq->write_index) {
+            bq->read_index += (int64_t) length;
+            break;
+        }
+
         fix_current_read(bq);
 
-        if (bq->current_read) {
+        if (bq->current_read < bq->n_blocks) {
             int64_t p, d;
 
             /* We go through this piece by piece to make sure we don't
              * drop more than allowed by prebuf */
 
-            p = bq->current_read->index + (int64_t) bq->current_read->chunk.length;
+            p = item_end(item_at(bq, bq->current_read));
             pa_assert(p >= bq->read_index);
             d = p - bq->read_index;
 
@@ -703,7 +690,7 @@ void pa_memblockq_seek(pa_memblockq *bq, int64_t offset, pa_seek_mode_t seek, pa
             bq->write_index = bq->read_index + offset;
             break;
         case PA_SEEK_RELATIVE_END:
-            bq->write_index = (bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->read_index) + offset;
+            bq->write_index = (bq->n_blocks > 0 ? item_end(item_at(bq, bq->n_blocks - 1)) : bq->read_index) + offset;
             break;
         default:
             pa_assert_not_reached();
@@ -966,14 +953,14 @@ int pa_memblockq_splice(pa_memblockq *bq, pa_memblockq *source) {
 }
 
 void pa_memblockq_willneed(pa_memblockq *bq) {
-    struct list_item *q;
+    unsigned i;
 
     pa_assert(bq);
 
     fix_current_read(bq);
 
-    for (q = bq->current_read; q; q = q->next)
-        pa_memchunk_will_need(&q->chunk);
+    for (i = bq->current_read; i < bq->n_blocks; i++)
+        pa_memchunk_will_need(&item_at(bq, i)->chunk);
 }
 
 void pa_memblockq_set_silence(pa_memblockq *bq, pa_memchunk *silence) {
@@ -992,14 +979,13 @@ void pa_memblockq_set_silence(pa_memblockq *bq, pa_memchunk *silence) {
 pa_bool_t pa_memblockq_is_empty(pa_memblockq *bq) {
     pa_assert(bq);
 
-    return !bq->blocks;
+    return bq->n_blocks <= 0;
 }
 
 void pa_memblockq_silence(pa_memblockq *bq) {
     pa_assert(bq);
 
-    while (bq->blocks)
-        drop_block(bq, bq->blocks);
+    drop_blocks(bq, 0, bq->n_blocks);
 
     pa_assert(bq->n_blocks == 0);
 }
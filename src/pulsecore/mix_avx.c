@@ -0,0 +1,222 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-x86.h"
+
+#include "sample-util.h"
+
+#ifdef PA_CPU_X86_HAVE_TARGET_ATTRIBUTE
+
+#include <immintrin.h>
+
+#define AVX2 __attribute__ ((target ("avx2")))
+
+#define NEXT_CHANNEL(channel, step, channels)   \
+    do {                                        \
+        channel += step;                        \
+        if (channel >= channels)                \
+            channel -= channels;                \
+    } while (0)
+
+/* These are the SSE2 mixers from mix_sse.c at twice the width. The 256
+ * bit unpack and pack instructions work on the two 128 bit halves
+ * separately, which keeps the samples in order. No FMA is used, so the
+ * float results stay identical to the C version. */
+
+static AVX2 void pa_mix_s16ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    const __m256i one = _mm256_set1_epi16(1);
+    unsigned i, n, channel = 0, step = 16 % channels;
+    size_t offset = 0;
+    int16_t *d = data;
+
+    pa_mix_split_s16_volumes(streams, nstreams, channels);
+
+    for (n = length / sizeof(int16_t); n >= 16; n -= 16) {
+        __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            __m256i s, lo, hi, t;
+
+            s = _mm256_loadu_si256((const __m256i*) ((uint8_t*) m->ptr + offset));
+            lo = _mm256_loadu_si256((const __m256i*) &m->linear_lo[channel]);
+            hi = _mm256_loadu_si256((const __m256i*) &m->linear_hi[channel]);
+
+            t = _mm256_add_epi16(_mm256_mulhi_epi16(s, lo), _mm256_and_si256(s, _mm256_srai_epi16(lo, 15)));
+
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(s, t), _mm256_unpacklo_epi16(hi, one)));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(s, t), _mm256_unpackhi_epi16(hi, one)));
+        }
+
+        _mm256_storeu_si256((__m256i*) d, _mm256_packs_epi32(acc0, acc1));
+
+        d += 16;
+        offset += 16 * sizeof(int16_t);
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; n > 0; n--) {
+        int32_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, lo, hi;
+
+            hi = m->linear_hi[channel];
+            lo = (uint16_t) m->linear_lo[channel];
+
+            v = *((int16_t*) ((uint8_t*) m->ptr + offset));
+            v = ((v * lo) >> 16) + (v * hi);
+            sum += v;
+        }
+
+        *(d++) = (int16_t) PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+
+        offset += sizeof(int16_t);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+/* Arithmetic right shift by 16 of four 64 bit lanes */
+static AVX2 inline __m256i sra64_16(__m256i x) {
+    __m256i sign = _mm256_shuffle_epi32(_mm256_srai_epi32(x, 31), _MM_SHUFFLE(3, 3, 1, 1));
+
+    return _mm256_or_si256(_mm256_srli_epi64(x, 16), _mm256_slli_epi64(sign, 48));
+}
+
+static AVX2 void pa_mix_s32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    const __m256i min = _mm256_set1_epi64x(-0x80000000LL), max = _mm256_set1_epi64x(0x7FFFFFFFLL);
+    unsigned i, n, channel = 0, step = 8 % channels;
+    size_t offset = 0;
+    int32_t *d = data;
+
+    for (n = length / sizeof(int32_t); n >= 8; n -= 8) {
+        __m256i even = _mm256_setzero_si256(), odd = _mm256_setzero_si256(), r;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            __m256i v, cv;
+
+            v = _mm256_loadu_si256((const __m256i*) ((uint8_t*) m->ptr + offset));
+            cv = _mm256_loadu_si256((const __m256i*) &m->linear[channel].i);
+
+            /* signed 32x32 -> 64 bit multiplies of the even and the odd
+             * samples */
+            even = _mm256_add_epi64(even, sra64_16(_mm256_mul_epi32(v, cv)));
+            odd = _mm256_add_epi64(odd, sra64_16(_mm256_mul_epi32(_mm256_srli_epi64(v, 32), _mm256_srli_epi64(cv, 32))));
+        }
+
+        /* clamp, then interleave the low dwords back into sample order */
+        even = _mm256_blendv_epi8(even, min, _mm256_cmpgt_epi64(min, even));
+        even = _mm256_blendv_epi8(even, max, _mm256_cmpgt_epi64(even, max));
+        odd = _mm256_blendv_epi8(odd, min, _mm256_cmpgt_epi64(min, odd));
+        odd = _mm256_blendv_epi8(odd, max, _mm256_cmpgt_epi64(odd, max));
+
+        r = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+        _mm256_storeu_si256((__m256i*) d, r);
+
+        d += 8;
+        offset += 8 * sizeof(int32_t);
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; n > 0; n--) {
+        int64_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int64_t v;
+
+            v = *((int32_t*) ((uint8_t*) m->ptr + offset));
+            v = (v * m->linear[channel].i) >> 16;
+            sum += v;
+        }
+
+        *(d++) = (int32_t) PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+
+        offset += sizeof(int32_t);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static AVX2 void pa_mix_float32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned i, n, channel = 0, step = 16 % channels;
+    size_t offset = 0;
+    float *d = data;
+
+    for (n = length / sizeof(float); n >= 16; n -= 16) {
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const float *s = (const float*) ((uint8_t*) m->ptr + offset);
+
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(s), _mm256_loadu_ps(&m->linear[channel].f)));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(s + 8), _mm256_loadu_ps(&m->linear[channel + 8].f)));
+        }
+
+        _mm256_storeu_ps(d, acc0);
+        _mm256_storeu_ps(d + 8, acc1);
+
+        d += 16;
+        offset += 16 * sizeof(float);
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; n > 0; n--) {
+        float sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+
+            sum += *((float*) ((uint8_t*) m->ptr + offset)) * m->linear[channel].f;
+        }
+
+        *(d++) = sum;
+
+        offset += sizeof(float);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+#endif /* PA_CPU_X86_HAVE_TARGET_ATTRIBUTE */
+
+void pa_mix_func_init_avx(pa_cpu_x86_flag_t flags) {
+#ifdef PA_CPU_X86_HAVE_TARGET_ATTRIBUTE
+
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized mixers.");
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) pa_mix_s16ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) pa_mix_s32ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) pa_mix_float32ne_avx2);
+    }
+
+#endif /* PA_CPU_X86_HAVE_TARGET_ATTRIBUTE */
+}
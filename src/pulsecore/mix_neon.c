@@ -0,0 +1,208 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-arm.h"
+
+#include "sample-util.h"
+
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#include <arm_neon.h>
+
+#define NEXT_CHANNEL(channel, step, channels)   \
+    do {                                        \
+        channel += step;                        \
+        if (channel >= channels)                \
+            channel -= channels;                \
+    } while (0)
+
+/* Same arithmetic as the C mixers in sample-util.c. The S16 and S32
+ * versions are bit exact; NEON flushes float denormals to zero, so the
+ * float version may differ for those. */
+
+static void pa_mix_s16ne_neon(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned i, n, channel = 0, step = 8 % channels;
+    size_t offset = 0;
+    int16_t *d = data;
+
+    pa_mix_split_s16_volumes(streams, nstreams, channels);
+
+    for (n = length / sizeof(int16_t); n >= 8; n -= 8) {
+        int32x4_t acc0 = vdupq_n_s32(0), acc1 = vdupq_n_s32(0);
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int16x8_t s, lo, hi, corr;
+
+            s = vld1q_s16((const int16_t*) ((uint8_t*) m->ptr + offset));
+            lo = vld1q_s16(&m->linear_lo[channel]);
+            hi = vld1q_s16(&m->linear_hi[channel]);
+
+            /* s * hi + ((s * lo) >> 16), where lo is unsigned: multiply
+             * with lo as signed and add s where that made lo negative */
+            corr = vandq_s16(s, vshrq_n_s16(lo, 15));
+
+            acc0 = vmlal_s16(acc0, vget_low_s16(s), vget_low_s16(hi));
+            acc0 = vsraq_n_s32(acc0, vmull_s16(vget_low_s16(s), vget_low_s16(lo)), 16);
+            acc0 = vaddw_s16(acc0, vget_low_s16(corr));
+
+            acc1 = vmlal_s16(acc1, vget_high_s16(s), vget_high_s16(hi));
+            acc1 = vsraq_n_s32(acc1, vmull_s16(vget_high_s16(s), vget_high_s16(lo)), 16);
+            acc1 = vaddw_s16(acc1, vget_high_s16(corr));
+        }
+
+        vst1q_s16(d, vcombine_s16(vqmovn_s32(acc0), vqmovn_s32(acc1)));
+
+        d += 8;
+        offset += 8 * sizeof(int16_t);
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; n > 0; n--) {
+        int32_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, lo, hi;
+
+            hi = m->linear_hi[channel];
+            lo = (uint16_t) m->linear_lo[channel];
+
+            v = *((int16_t*) ((uint8_t*) m->ptr + offset));
+            v = ((v * lo) >> 16) + (v * hi);
+            sum += v;
+        }
+
+        *(d++) = (int16_t) PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+
+        offset += sizeof(int16_t);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static void pa_mix_s32ne_neon(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned i, n, channel = 0, step = 4 % channels;
+    size_t offset = 0;
+    int32_t *d = data;
+
+    for (n = length / sizeof(int32_t); n >= 4; n -= 4) {
+        int64x2_t acc0 = vdupq_n_s64(0), acc1 = vdupq_n_s64(0);
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32x4_t v, cv;
+
+            v = vld1q_s32((const int32_t*) ((uint8_t*) m->ptr + offset));
+            cv = vld1q_s32(&m->linear[channel].i);
+
+            acc0 = vsraq_n_s64(acc0, vmull_s32(vget_low_s32(v), vget_low_s32(cv)), 16);
+            acc1 = vsraq_n_s64(acc1, vmull_s32(vget_high_s32(v), vget_high_s32(cv)), 16);
+        }
+
+        vst1q_s32(d, vcombine_s32(vqmovn_s64(acc0), vqmovn_s64(acc1)));
+
+        d += 4;
+        offset += 4 * sizeof(int32_t);
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; n > 0; n--) {
+        int64_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int64_t v;
+
+            v = *((int32_t*) ((uint8_t*) m->ptr + offset));
+            v = (v * m->linear[channel].i) >> 16;
+            sum += v;
+        }
+
+        *(d++) = (int32_t) PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+
+        offset += sizeof(int32_t);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static void pa_mix_float32ne_neon(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned i, n, channel = 0, step = 8 % channels;
+    size_t offset = 0;
+    float *d = data;
+
+    for (n = length / sizeof(float); n >= 8; n -= 8) {
+        float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const float *s = (const float*) ((uint8_t*) m->ptr + offset);
+
+            acc0 = vaddq_f32(acc0, vmulq_f32(vld1q_f32(s), vld1q_f32(&m->linear[channel].f)));
+            acc1 = vaddq_f32(acc1, vmulq_f32(vld1q_f32(s + 4), vld1q_f32(&m->linear[channel + 4].f)));
+        }
+
+        vst1q_f32(d, acc0);
+        vst1q_f32(d + 4, acc1);
+
+        d += 8;
+        offset += 8 * sizeof(float);
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; n > 0; n--) {
+        float sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+
+            sum += *((float*) ((uint8_t*) m->ptr + offset)) * m->linear[channel].f;
+        }
+
+        *(d++) = sum;
+
+        offset += sizeof(float);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+
+void pa_mix_func_init_neon(pa_cpu_arm_flag_t flags) {
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+    if (flags & PA_CPU_ARM_NEON) {
+        pa_log_info("Initialising NEON optimized mixers.");
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) pa_mix_s16ne_neon);
+        pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) pa_mix_s32ne_neon);
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) pa_mix_float32ne_neon);
+    }
+
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+}
@@ -0,0 +1,233 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-x86.h"
+
+#include "sample-util.h"
+
+#ifdef PA_CPU_X86_HAVE_TARGET_ATTRIBUTE
+
+#include <emmintrin.h>
+
+#define SSE2 __attribute__ ((target ("sse2")))
+
+/* All streams are read at the same offset, so we keep a single
+ * channel index for the whole block and advance it by the block size. */
+#define NEXT_CHANNEL(channel, step, channels)   \
+    do {                                        \
+        channel += step;                        \
+        if (channel >= channels)                \
+            channel -= channels;                \
+    } while (0)
+
+/* The vector loops below produce exactly what the C mixers in
+ * sample-util.c do, including the clamping. */
+
+static SSE2 void pa_mix_s16ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    const __m128i one = _mm_set1_epi16(1);
+    unsigned i, n, channel = 0, step = 8 % channels;
+    size_t offset = 0;
+    int16_t *d = data;
+
+    pa_mix_split_s16_volumes(streams, nstreams, channels);
+
+    for (n = length / sizeof(int16_t); n >= 8; n -= 8) {
+        __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            __m128i s, lo, hi, t;
+
+            s = _mm_loadu_si128((const __m128i*) ((uint8_t*) m->ptr + offset));
+            lo = _mm_loadu_si128((const __m128i*) &m->linear_lo[channel]);
+            hi = _mm_loadu_si128((const __m128i*) &m->linear_hi[channel]);
+
+            /* (s * lo) >> 16 with lo unsigned: multiply with lo as
+             * signed word and add s back where that made lo negative */
+            t = _mm_add_epi16(_mm_mulhi_epi16(s, lo), _mm_and_si128(s, _mm_srai_epi16(lo, 15)));
+
+            /* s * hi + t in 32 bit */
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(s, t), _mm_unpacklo_epi16(hi, one)));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(s, t), _mm_unpackhi_epi16(hi, one)));
+        }
+
+        _mm_storeu_si128((__m128i*) d, _mm_packs_epi32(acc0, acc1));
+
+        d += 8;
+        offset += 8 * sizeof(int16_t);
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; n > 0; n--) {
+        int32_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, lo, hi;
+
+            hi = m->linear_hi[channel];
+            lo = (uint16_t) m->linear_lo[channel];
+
+            v = *((int16_t*) ((uint8_t*) m->ptr + offset));
+            v = ((v * lo) >> 16) + (v * hi);
+            sum += v;
+        }
+
+        *(d++) = (int16_t) PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+
+        offset += sizeof(int16_t);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+/* Arithmetic right shift by 16 of two 64 bit lanes */
+static SSE2 inline __m128i sra64_16(__m128i x) {
+    __m128i sign = _mm_shuffle_epi32(_mm_srai_epi32(x, 31), _MM_SHUFFLE(3, 3, 1, 1));
+
+    return _mm_or_si128(_mm_srli_epi64(x, 16), _mm_slli_epi64(sign, 48));
+}
+
+static SSE2 void pa_mix_s32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    const __m128i high_dwords = _mm_set_epi32(-1, 0, -1, 0);
+    unsigned i, n, channel = 0, step = 4 % channels;
+    size_t offset = 0;
+    int32_t *d = data;
+
+    for (n = length / sizeof(int32_t); n >= 4; n -= 4) {
+        __m128i even = _mm_setzero_si128(), odd = _mm_setzero_si128();
+        int64_t sum[4];
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            __m128i v, cv, corr, p;
+
+            v = _mm_loadu_si128((const __m128i*) ((uint8_t*) m->ptr + offset));
+            cv = _mm_loadu_si128((const __m128i*) &m->linear[channel].i);
+
+            /* Only an unsigned 32x32 multiply is available, the factors
+             * are never negative so only the sign of the sample needs to
+             * be corrected for: subtract cv << 32 where v < 0. */
+            corr = _mm_and_si128(_mm_srai_epi32(v, 31), cv);
+
+            p = _mm_mul_epu32(v, cv);
+            p = _mm_sub_epi64(p, _mm_slli_epi64(corr, 32));
+            even = _mm_add_epi64(even, sra64_16(p));
+
+            p = _mm_mul_epu32(_mm_srli_epi64(v, 32), _mm_srli_epi64(cv, 32));
+            p = _mm_sub_epi64(p, _mm_and_si128(corr, high_dwords));
+            odd = _mm_add_epi64(odd, sra64_16(p));
+        }
+
+        _mm_storeu_si128((__m128i*) &sum[0], _mm_unpacklo_epi64(even, odd));
+        _mm_storeu_si128((__m128i*) &sum[2], _mm_unpackhi_epi64(even, odd));
+
+        d[0] = (int32_t) PA_CLAMP_UNLIKELY(sum[0], -0x80000000LL, 0x7FFFFFFFLL);
+        d[1] = (int32_t) PA_CLAMP_UNLIKELY(sum[1], -0x80000000LL, 0x7FFFFFFFLL);
+        d[2] = (int32_t) PA_CLAMP_UNLIKELY(sum[2], -0x80000000LL, 0x7FFFFFFFLL);
+        d[3] = (int32_t) PA_CLAMP_UNLIKELY(sum[3], -0x80000000LL, 0x7FFFFFFFLL);
+
+        d += 4;
+        offset += 4 * sizeof(int32_t);
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; n > 0; n--) {
+        int64_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int64_t v;
+
+            v = *((int32_t*) ((uint8_t*) m->ptr + offset));
+            v = (v * m->linear[channel].i) >> 16;
+            sum += v;
+        }
+
+        *(d++) = (int32_t) PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+
+        offset += sizeof(int32_t);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static SSE2 void pa_mix_float32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned i, n, channel = 0, step = 8 % channels;
+    size_t offset = 0;
+    float *d = data;
+
+    for (n = length / sizeof(float); n >= 8; n -= 8) {
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const float *s = (const float*) ((uint8_t*) m->ptr + offset);
+
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(s), _mm_loadu_ps(&m->linear[channel].f)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(s + 4), _mm_loadu_ps(&m->linear[channel + 4].f)));
+        }
+
+        _mm_storeu_ps(d, acc0);
+        _mm_storeu_ps(d + 4, acc1);
+
+        d += 8;
+        offset += 8 * sizeof(float);
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; n > 0; n--) {
+        float sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+
+            sum += *((float*) ((uint8_t*) m->ptr + offset)) * m->linear[channel].f;
+        }
+
+        *(d++) = sum;
+
+        offset += sizeof(float);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+#endif /* PA_CPU_X86_HAVE_TARGET_ATTRIBUTE */
+
+void pa_mix_func_init_sse(pa_cpu_x86_flag_t flags) {
+#ifdef PA_CPU_X86_HAVE_TARGET_ATTRIBUTE
+
+    if (flags & PA_CPU_X86_SSE2) {
+        pa_log_info("Initialising SSE2 optimized mixers.");
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) pa_mix_s16ne_sse2);
+        pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) pa_mix_s32ne_sse2);
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) pa_mix_float32ne_sse2);
+    }
+
+#endif /* PA_CPU_X86_HAVE_TARGET_ATTRIBUTE */
+}
@@ -27,9 +27,13 @@
 
 #include <pulsecore/refcnt.h>
 
+/* Packets of up to this size share one size of allocation, which is
+ * recycled instead of freed */
+#define PA_PACKET_POOL_SIZE 2048
+
 typedef struct pa_packet {
     PA_REFCNT_DECLARE;
-    enum { PA_PACKET_APPENDED, PA_PACKET_DYNAMIC } type;
+    enum { PA_PACKET_APPENDED, PA_PACKET_DYNAMIC, PA_PACKET_POOLED } type;
     size_t length;
     uint8_t *data;
 } pa_packet;
@@ -189,7 +189,7 @@ static const char *command_names[PA_COMMAND_MAX] = {
 
 #endif
 
-PA_STATIC_FLIST_DECLARE(reply_infos, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(reply_infos, 0, 16, pa_xfree);
 
 struct reply_info {
     pa_pdispatch *pdispatch;
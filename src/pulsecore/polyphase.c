@@ -0,0 +1,532 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulse/sample.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+
+#include "polyphase.h"
+
+/* Use one filter per phase if there are at most this many phases and
+ * the filters don't need more than this many coefficients */
+#define EXACT_PHASES_MAX 1024
+#define EXACT_COEFS_MAX (64*1024)
+
+/* Number of filters in the interpolated table, plus one for the end */
+#define INTERP_BITS 7
+#define INTERP_PHASES (1U << INTERP_BITS)
+#define INTERP_SHIFT (32 - INTERP_BITS)
+
+/* The interpolated table is kept when a rate change moves the cutoff by
+ * less than this fraction */
+#define CUTOFF_TOLERANCE 0.005
+
+#define TAPS_MAX 2048U
+
+static const struct {
+    unsigned taps;
+    double beta;      /* of the Kaiser window */
+    double rolloff;   /* cutoff relative to the lower Nyquist frequency */
+} quality_table[PA_POLYPHASE_QUALITY_MAX + 1] = {
+    {  16,  6.0, 0.850 },
+    {  32,  6.0, 0.880 },
+    {  48,  8.0, 0.895 },
+    {  64,  8.0, 0.921 },
+    {  96, 10.0, 0.940 }
+};
+
+/* Filters only depend on these parameters, so all resamplers that
+ * need the same one share it */
+typedef struct polyphase_filter polyphase_filter;
+
+struct polyphase_filter {
+    unsigned ref;
+
+    unsigned n_phases, n_rows, n_taps;
+    double cutoff, beta;
+    float *coefs;
+
+    PA_LLIST_FIELDS(polyphase_filter);
+};
+
+static PA_LLIST_HEAD(polyphase_filter, filters);
+static pa_polyphase_cache_stat cache_stat;
+static pa_static_mutex mutex = PA_STATIC_MUTEX_INIT; /* protects both of the above */
+
+struct pa_polyphase {
+    unsigned channels;
+    unsigned quality;
+    uint32_t i_rate, o_rate;
+
+    polyphase_filter *exact, *interp;
+    pa_bool_t use_exact;
+    unsigned n_taps;
+
+    /* Position of the next output frame: the index of the first input
+     * frame of its filter window, and the phase between two input
+     * frames. For exact filters the phase counts in 1/n_phases steps,
+     * otherwise it is a 32 bit fraction. */
+    unsigned index;
+    uint32_t phase;
+    unsigned step_int;
+    uint32_t step_frac;
+
+    /* Input history, one array per channel */
+    float *buf[PA_CHANNELS_MAX];
+    unsigned buf_frames;
+    unsigned filled;
+
+    /* Interpolated filter for the current output frame */
+    float *row;
+};
+
+static float dot_c(const float *a, const float *b, unsigned n) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+    for (; n > 0; n -= 4) {
+        s0 += a[0] * b[0];
+        s1 += a[1] * b[1];
+        s2 += a[2] * b[2];
+        s3 += a[3] * b[3];
+
+        a += 4;
+        b += 4;
+    }
+
+    return (s0 + s1) + (s2 + s3);
+}
+
+static pa_polyphase_dot_func_t dot_func = dot_c;
+
+pa_polyphase_dot_func_t pa_get_polyphase_dot_func(void) {
+    return dot_func;
+}
+
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func) {
+    pa_assert(func);
+
+    dot_func = func;
+}
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    unsigned k;
+
+    x = x * x / 4.0;
+
+    for (k = 1; k < 100; k++) {
+        term *= x / ((double) k * (double) k);
+        sum += term;
+
+        if (term < sum * 1e-12)
+            break;
+    }
+
+    return sum;
+}
+
+/* Fills n_rows filters for the phases 0, 1/n_phases, 2/n_phases, ...
+ * For phase f, tap k is the input frame k - n_taps/2 + 1 input frames
+ * away from the output position. */
+static void filter_compute(polyphase_filter *f) {
+    unsigned n_phases = f->n_phases, n_rows = f->n_rows, n_taps = f->n_taps;
+    double cutoff = f->cutoff, beta = f->beta;
+    double half = (double) n_taps / 2.0, i0_beta = bessel_i0(beta);
+    unsigned row, k;
+
+    pa_assert(n_taps % 8 == 0);
+
+    f->coefs = pa_xnew(float, n_rows * n_taps);
+
+    for (row = 0; row < n_rows; row++) {
+        float *c = f->coefs + row * n_taps;
+        double sum = 0.0;
+
+        for (k = 0; k < n_taps; k++) {
+            double d, x, v;
+
+            d = (double) k - half + 1.0 - (double) row / (double) n_phases;
+            x = d / half;
+
+            if (x <= -1.0 || x >= 1.0)
+                v = 0.0;
+            else {
+                v = fabs(d) < 1e-9 ? cutoff : sin(M_PI * cutoff * d) / (M_PI * d);
+                v *= bessel_i0(beta * sqrt(1.0 - x * x)) / i0_beta;
+            }
+
+            c[k] = (float) v;
+            sum += v;
+        }
+
+        /* Make every phase pass DC unchanged */
+        for (k = 0; k < n_taps; k++)
+            c[k] = (float) (c[k] / sum);
+    }
+}
+
+/* The parameters of a filter are always computed the same way, so
+ * comparing their bits is enough to tell whether it can be shared */
+static pa_bool_t same_param(double a, double b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static size_t filter_size(polyphase_filter *f) {
+    return sizeof(float) * f->n_rows * f->n_taps;
+}
+
+static polyphase_filter *filter_get(unsigned n_phases, unsigned n_rows, unsigned n_taps, double cutoff, double beta) {
+    polyphase_filter *f;
+    pa_mutex *mx;
+
+    mx = pa_static_mutex_get(&mutex, FALSE, FALSE);
+    pa_mutex_lock(mx);
+
+    PA_LLIST_FOREACH(f, filters)
+        if (f->n_phases == n_phases && f->n_rows == n_rows && f->n_taps == n_taps &&
+            same_param(f->cutoff, cutoff) && same_param(f->beta, beta)) {
+
+            f->ref++;
+            cache_stat.n_hits++;
+            cache_stat.saved_size += filter_size(f);
+            goto finish;
+        }
+
+    pa_log_debug("Computing %u polyphase filters with %u taps.", n_rows, n_taps);
+
+    f = pa_xnew(polyphase_filter, 1);
+    f->ref = 1;
+    f->n_phases = n_phases;
+    f->n_rows = n_rows;
+    f->n_taps = n_taps;
+    f->cutoff = cutoff;
+    f->beta = beta;
+    filter_compute(f);
+
+    PA_LLIST_PREPEND(polyphase_filter, filters, f);
+
+    cache_stat.n_misses++;
+    cache_stat.n_filters++;
+    cache_stat.allocated_size += filter_size(f);
+
+finish:
+    pa_mutex_unlock(mx);
+
+    return f;
+}
+
+static void filter_unref(polyphase_filter *f) {
+    pa_mutex *mx;
+
+    pa_assert(f);
+
+    mx = pa_static_mutex_get(&mutex, FALSE, FALSE);
+    pa_mutex_lock(mx);
+
+    pa_assert(f->ref >= 1);
+
+    if (--f->ref > 0)
+        cache_stat.saved_size -= filter_size(f);
+    else {
+        PA_LLIST_REMOVE(polyphase_filter, filters, f);
+
+        cache_stat.n_filters--;
+        cache_stat.allocated_size -= filter_size(f);
+
+        pa_xfree(f->coefs);
+        pa_xfree(f);
+    }
+
+    pa_mutex_unlock(mx);
+}
+
+void pa_polyphase_get_cache_stat(pa_polyphase_cache_stat *s) {
+    pa_mutex *mx;
+
+    pa_assert(s);
+
+    mx = pa_static_mutex_get(&mutex, FALSE, FALSE);
+    pa_mutex_lock(mx);
+    *s = cache_stat;
+    pa_mutex_unlock(mx);
+}
+
+static void ensure_buffer(pa_polyphase *p, unsigned frames) {
+    unsigned c;
+
+    if (frames <= p->buf_frames)
+        return;
+
+    p->buf_frames = ((frames + 255) / 256) * 256;
+
+    for (c = 0; c < p->channels; c++)
+        p->buf[c] = pa_xrealloc(p->buf[c], sizeof(float) * p->buf_frames);
+}
+
+/* Keep the output position in time when the filter length changes */
+static void move_window(pa_polyphase *p, unsigned old_taps, unsigned new_taps) {
+    unsigned missing, c;
+
+    if (p->index + old_taps / 2 >= new_taps / 2) {
+        p->index = p->index + old_taps / 2 - new_taps / 2;
+        return;
+    }
+
+    missing = new_taps / 2 - old_taps / 2 - p->index;
+    ensure_buffer(p, p->filled + missing);
+
+    for (c = 0; c < p->channels; c++) {
+        memmove(p->buf[c] + missing, p->buf[c], sizeof(float) * p->filled);
+        memset(p->buf[c], 0, sizeof(float) * missing);
+    }
+
+    p->filled += missing;
+    p->index = 0;
+}
+
+static void setup_filter(pa_polyphase *p) {
+    unsigned g, num, den, n_taps, old_taps;
+    uint32_t frac;
+    double cutoff, beta;
+
+    g = pa_gcd(p->i_rate, p->o_rate);
+    num = p->i_rate / g;
+    den = p->o_rate / g;
+
+    beta = quality_table[p->quality].beta;
+    cutoff = quality_table[p->quality].rolloff;
+    n_taps = quality_table[p->quality].taps;
+
+    /* When downsampling the filter has to cut off at the output Nyquist
+     * frequency and gets longer by the same factor */
+    if (p->o_rate < p->i_rate) {
+        cutoff = cutoff * p->o_rate / p->i_rate;
+        n_taps = (unsigned) (((uint64_t) n_taps * p->i_rate + p->o_rate - 1) / p->o_rate);
+        n_taps = PA_MIN(((n_taps + 7) / 8) * 8, TAPS_MAX);
+    }
+
+    /* The phase as a 32 bit fraction, so that it survives switching
+     * between exact and interpolated filters */
+    if (!p->n_taps)
+        frac = 0;
+    else if (p->use_exact)
+        frac = (uint32_t) (((uint64_t) p->phase << 32) / p->exact->n_phases);
+    else
+        frac = p->phase;
+
+    old_taps = p->n_taps;
+
+    if (den <= EXACT_PHASES_MAX && den * n_taps <= EXACT_COEFS_MAX) {
+
+        if (!p->exact || p->exact->n_phases != den || p->exact->n_taps != n_taps || !same_param(p->exact->cutoff, cutoff)) {
+            if (p->exact)
+                filter_unref(p->exact);
+            p->exact = filter_get(den, den, n_taps, cutoff, beta);
+        }
+
+        p->use_exact = TRUE;
+        p->step_int = num / den;
+        p->step_frac = num % den;
+
+        p->phase = (uint32_t) (((uint64_t) frac * den + (1ULL << 31)) >> 32);
+        if (p->phase >= den) {
+            p->phase -= den;
+            p->index++;
+        }
+
+    } else {
+
+        if (!p->interp || fabs(p->interp->cutoff - cutoff) > cutoff * CUTOFF_TOLERANCE) {
+            if (p->interp)
+                filter_unref(p->interp);
+            p->interp = filter_get(INTERP_PHASES, INTERP_PHASES + 1, n_taps, cutoff, beta);
+            p->row = pa_xrealloc(p->row, sizeof(float) * n_taps);
+        }
+
+        n_taps = p->interp->n_taps;
+
+        p->use_exact = FALSE;
+        p->step_int = p->i_rate / p->o_rate;
+        p->step_frac = (uint32_t) (((uint64_t) (p->i_rate % p->o_rate) << 32) / p->o_rate);
+
+        p->phase = frac;
+    }
+
+    p->n_taps = n_taps;
+
+    if (old_taps && old_taps != n_taps)
+        move_window(p, old_taps, n_taps);
+}
+
+pa_polyphase* pa_polyphase_new(unsigned channels, uint32_t i_rate, uint32_t o_rate, unsigned quality) {
+    pa_polyphase *p;
+
+    pa_assert(channels > 0);
+    pa_assert(channels <= PA_CHANNELS_MAX);
+    pa_assert(i_rate > 0);
+    pa_assert(o_rate > 0);
+    pa_assert(quality <= PA_POLYPHASE_QUALITY_MAX);
+
+    p = pa_xnew0(pa_polyphase, 1);
+    p->channels = channels;
+    p->quality = quality;
+    p->i_rate = i_rate;
+    p->o_rate = o_rate;
+
+    setup_filter(p);
+    pa_polyphase_reset(p);
+
+    return p;
+}
+
+void pa_polyphase_free(pa_polyphase *p) {
+    unsigned c;
+
+    pa_assert(p);
+
+    for (c = 0; c < p->channels; c++)
+        pa_xfree(p->buf[c]);
+
+    if (p->exact)
+        filter_unref(p->exact);
+    if (p->interp)
+        filter_unref(p->interp);
+    pa_xfree(p->row);
+    pa_xfree(p);
+}
+
+void pa_polyphase_set_rates(pa_polyphase *p, uint32_t i_rate, uint32_t o_rate) {
+    pa_assert(p);
+    pa_assert(i_rate > 0);
+    pa_assert(o_rate > 0);
+
+    if (p->i_rate == i_rate && p->o_rate == o_rate)
+        return;
+
+    p->i_rate = i_rate;
+    p->o_rate = o_rate;
+
+    setup_filter(p);
+}
+
+void pa_polyphase_reset(pa_polyphase *p) {
+    unsigned c;
+
+    pa_assert(p);
+
+    /* Start with half a window of silence, so that the first output
+     * frame lines up with the first input frame */
+    p->filled = p->n_taps / 2 - 1;
+    p->index = 0;
+    p->phase = 0;
+
+    ensure_buffer(p, p->filled);
+
+    for (c = 0; c < p->channels; c++)
+        memset(p->buf[c], 0, sizeof(float) * p->filled);
+}
+
+unsigned pa_polyphase_process(pa_polyphase *p, const float *in, unsigned in_n_frames, float *out, unsigned out_n_frames) {
+    unsigned c, i, avail, shift, n_taps, o = 0;
+
+    pa_assert(p);
+    pa_assert(in || in_n_frames == 0);
+    pa_assert(out);
+
+    ensure_buffer(p, p->filled + in_n_frames);
+
+    /* Split up the channels */
+    for (c = 0; c < p->channels; c++) {
+        const float *s = in + c;
+        float *d = p->buf[c] + p->filled;
+
+        for (i = 0; i < in_n_frames; i++) {
+            d[i] = *s;
+            s += p->channels;
+        }
+    }
+
+    avail = p->filled + in_n_frames;
+    n_taps = p->n_taps;
+
+    if (p->use_exact) {
+        unsigned n_phases = p->exact->n_phases;
+
+        for (; o < out_n_frames && p->index + n_taps <= avail; o++) {
+            const float *row = p->exact->coefs + p->phase * n_taps;
+
+            for (c = 0; c < p->channels; c++)
+                *(out++) = dot_func(row, p->buf[c] + p->index, n_taps);
+
+            p->index += p->step_int;
+            p->phase += p->step_frac;
+            if (p->phase >= n_phases) {
+                p->phase -= n_phases;
+                p->index++;
+            }
+        }
+
+    } else {
+
+        for (; o < out_n_frames && p->index + n_taps <= avail; o++) {
+            const float *a, *b;
+            float t;
+            uint32_t phase;
+
+            a = p->interp->coefs + (p->phase >> INTERP_SHIFT) * n_taps;
+            b = a + n_taps;
+            t = (float) (p->phase & ((1U << INTERP_SHIFT) - 1)) * (1.0f / (float) (1U << INTERP_SHIFT));
+
+            for (i = 0; i < n_taps; i++)
+                p->row[i] = a[i] + t * (b[i] - a[i]);
+
+            for (c = 0; c < p->channels; c++)
+                *(out++) = dot_func(p->row, p->buf[c] + p->index, n_taps);
+
+            phase = p->phase;
+            p->phase += p->step_frac;
+            p->index += p->step_int + (p->phase < phase ? 1 : 0);
+        }
+    }
+
+    /* Drop what we don't need anymore. When downsampling the next
+     * output frame may start beyond the data we have. */
+    shift = PA_MIN(p->index, avail);
+
+    if (shift > 0)
+        for (c = 0; c < p->channels; c++)
+            memmove(p->buf[c], p->buf[c] + shift, sizeof(float) * (avail - shift));
+
+    p->filled = avail - shift;
+    p->index -= shift;
+
+    return o;
+}
@@ -0,0 +1,67 @@
+#ifndef foopolyphasehfoo
+#define foopolyphasehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+/* A windowed sinc resampler for interleaved float samples. When the
+ * reduced ratio of the two rates has a small denominator (44.1kHz <->
+ * 48kHz, 8kHz/16kHz <-> 44.1kHz/48kHz, ...) every output phase gets its
+ * own precomputed filter. All other ratios interpolate linearly between
+ * the filters of a finely sampled table, which is also kept across small
+ * rate changes. */
+
+#define PA_POLYPHASE_QUALITY_MAX 4
+#define PA_POLYPHASE_QUALITY_DEFAULT 2
+
+typedef struct pa_polyphase pa_polyphase;
+
+pa_polyphase* pa_polyphase_new(unsigned channels, uint32_t i_rate, uint32_t o_rate, unsigned quality);
+void pa_polyphase_free(pa_polyphase *p);
+
+/* Change the rates without losing the filter history */
+void pa_polyphase_set_rates(pa_polyphase *p, uint32_t i_rate, uint32_t o_rate);
+void pa_polyphase_reset(pa_polyphase *p);
+
+/* Takes all input frames and writes at most out_n_frames output
+ * frames. Returns the number of frames written. */
+unsigned pa_polyphase_process(pa_polyphase *p, const float *in, unsigned in_n_frames, float *out, unsigned out_n_frames);
+
+/* The filter tables are shared between all resamplers that use the
+ * same rates and quality */
+typedef struct pa_polyphase_cache_stat {
+    unsigned n_hits;
+    unsigned n_misses;
+    unsigned n_filters;
+    size_t allocated_size;
+    size_t saved_size; /* what the users of shared tables would need on top */
+} pa_polyphase_cache_stat;
+
+void pa_polyphase_get_cache_stat(pa_polyphase_cache_stat *s);
+
+/* Returns the sum of a[i]*b[i], n is always a multiple of 8 */
+typedef float (*pa_polyphase_dot_func_t) (const float *a, const float *b, unsigned n);
+
+pa_polyphase_dot_func_t pa_get_polyphase_dot_func(void);
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func);
+
+#endif
@@ -0,0 +1,117 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <pulse/rtclock.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-arm.h"
+#include "polyphase.h"
+
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#include <arm_neon.h>
+
+/* Sums in a different order than the C version and flushes denormals
+ * to zero, so the results may differ in the last bits */
+static float pa_polyphase_dot_neon(const float *a, const float *b, unsigned n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    float32x2_t r;
+
+    for (; n > 0; n -= 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a), vld1q_f32(b));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + 4), vld1q_f32(b + 4));
+
+        a += 8;
+        b += 8;
+    }
+
+    acc0 = vaddq_f32(acc0, acc1);
+    r = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    r = vpadd_f32(r, r);
+
+    return vget_lane_f32(r, 0);
+}
+
+#undef RUN_TEST
+
+#ifdef RUN_TEST
+#define TAPS 48
+#define TIMES 100000
+
+static void run_test (void) {
+    float a[TAPS], b[TAPS + 1];
+    float r = 0.0f, r_ref = 0.0f;
+    int i;
+    pa_usec_t start, stop;
+    pa_polyphase_dot_func_t func;
+
+    printf ("checking NEON %d\n", TAPS);
+
+    for (i = 0; i < TAPS; i++) {
+        a[i] = (rand()/(RAND_MAX+1.0)) - 0.5;
+        b[i] = (rand()/(RAND_MAX+1.0)) - 0.5;
+    }
+
+    func = pa_get_polyphase_dot_func ();
+    r_ref = func (a, b, TAPS);
+    r = pa_polyphase_dot_neon (a, b, TAPS);
+
+    if (fabsf (r - r_ref) > 1e-5f)
+        printf ("%f != %f\n", r, r_ref);
+
+    /* unaligned input, like the history buffer gives us */
+    start = pa_rtclock_now();
+    for (i = 0; i < TIMES; i++)
+        r += pa_polyphase_dot_neon (a, b + (i & 1), TAPS);
+    stop = pa_rtclock_now();
+    pa_log_info("NEON: %llu usec.", (long long unsigned int)(stop - start));
+
+    start = pa_rtclock_now();
+    for (i = 0; i < TIMES; i++)
+        r_ref += func (a, b + (i & 1), TAPS);
+    stop = pa_rtclock_now();
+    pa_log_info("ref: %llu usec.", (long long unsigned int)(stop - start));
+}
+#endif
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+
+void pa_polyphase_func_init_neon (pa_cpu_arm_flag_t flags) {
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#ifdef RUN_TEST
+    run_test ();
+#endif
+
+    if (flags & PA_CPU_ARM_NEON) {
+        pa_log_info("Initialising NEON optimized resampler filters.");
+
+        pa_set_polyphase_dot_func ((pa_polyphase_dot_func_t) pa_polyphase_dot_neon);
+    }
+
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+}
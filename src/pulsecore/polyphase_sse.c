@@ -0,0 +1,120 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <pulse/rtclock.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-x86.h"
+#include "polyphase.h"
+
+#ifdef PA_CPU_X86_HAVE_TARGET_ATTRIBUTE
+
+#include <xmmintrin.h>
+
+#define SSE __attribute__ ((target ("sse")))
+
+/* Sums in a different order than the C version, so the results may
+ * differ in the last bits */
+static SSE float pa_polyphase_dot_sse(const float *a, const float *b, unsigned n) {
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    float r;
+
+    for (; n > 0; n -= 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + 4), _mm_loadu_ps(b + 4)));
+
+        a += 8;
+        b += 8;
+    }
+
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, _MM_SHUFFLE(1, 1, 1, 1)));
+    _mm_store_ss(&r, acc0);
+
+    return r;
+}
+
+#undef RUN_TEST
+
+#ifdef RUN_TEST
+#define TAPS 48
+#define TIMES 100000
+
+static void run_test (void) {
+    float a[TAPS], b[TAPS + 1];
+    float r = 0.0f, r_ref = 0.0f;
+    int i;
+    pa_usec_t start, stop;
+    pa_polyphase_dot_func_t func;
+
+    printf ("checking SSE %d\n", TAPS);
+
+    for (i = 0; i < TAPS; i++) {
+        a[i] = (rand()/(RAND_MAX+1.0)) - 0.5;
+        b[i] = (rand()/(RAND_MAX+1.0)) - 0.5;
+    }
+
+    func = pa_get_polyphase_dot_func ();
+    r_ref = func (a, b, TAPS);
+    r = pa_polyphase_dot_sse (a, b, TAPS);
+
+    if (fabsf (r - r_ref) > 1e-5f)
+        printf ("%f != %f\n", r, r_ref);
+
+    /* unaligned input, like the history buffer gives us */
+    start = pa_rtclock_now();
+    for (i = 0; i < TIMES; i++)
+        r += pa_polyphase_dot_sse (a, b + (i & 1), TAPS);
+    stop = pa_rtclock_now();
+    pa_log_info("SSE: %llu usec.", (long long unsigned int)(stop - start));
+
+    start = pa_rtclock_now();
+    for (i = 0; i < TIMES; i++)
+        r_ref += func (a, b + (i & 1), TAPS);
+    stop = pa_rtclock_now();
+    pa_log_info("ref: %llu usec.", (long long unsigned int)(stop - start));
+}
+#endif
+#endif /* PA_CPU_X86_HAVE_TARGET_ATTRIBUTE */
+
+void pa_polyphase_func_init_sse (pa_cpu_x86_flag_t flags) {
+#ifdef PA_CPU_X86_HAVE_TARGET_ATTRIBUTE
+
+#ifdef RUN_TEST
+    run_test ();
+#endif
+
+    if (flags & PA_CPU_X86_SSE) {
+        pa_log_info("Initialising SSE optimized resampler filters.");
+
+        pa_set_polyphase_dot_func ((pa_polyphase_dot_func_t) pa_polyphase_dot_sse);
+    }
+
+#endif /* PA_CPU_X86_HAVE_TARGET_ATTRIBUTE */
+}
@@ -41,7 +41,7 @@ struct pa_prioq {
     pa_compare_func_t compare_func;
 };
 
-PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(items, 0, 16, pa_xfree);
 
 pa_prioq *pa_prioq_new(pa_compare_func_t compare_func) {
 
@@ -216,14 +216,19 @@ void* pa_prioq_remove(pa_prioq *q, pa_prioq_item *i) {
 
     } else {
 
+        pa_prioq_item *l;
+
         /* We are not the last entry, we need to replace ourselves
-         * with the last node and reshuffle */
+         * with the last node and reshuffle. The last node might
+         * belong further up if we weren't its ancestor. */
 
-        q->items[i->idx] = q->items[q->n_items-1];
-        q->items[i->idx]->idx = i->idx;
+        l = q->items[q->n_items-1];
+        q->items[i->idx] = l;
+        l->idx = i->idx;
         q->n_items--;
 
-        shuffle_down(q, i->idx);
+        shuffle_down(q, l->idx);
+        shuffle_up(q, l);
     }
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(items), i) < 0)
@@ -35,6 +35,7 @@
 #include <pulse/utf8.h>
 #include <pulse/util.h>
 #include <pulse/xmalloc.h>
+#include <pulse/mainloop.h>
 
 #include <pulsecore/native-common.h>
 #include <pulsecore/packet.h>
@@ -55,9 +56,14 @@
 #include <pulsecore/sample-util.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/creds.h>
+#include <pulsecore/shm.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/ipacl.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/timing-page.h>
 
 #include "protocol-native.h"
 
@@ -65,7 +71,9 @@
 #define AUTH_TIMEOUT (60 * PA_USEC_PER_SEC)
 
 /* Don't accept more connection than this */
-#define MAX_CONNECTIONS 64
+#define DEFAULT_MAX_CONNECTIONS 64
+
+#define MAX_WORKERS 64
 
 #define MAX_MEMBLOCKQ_LENGTH (4*1024*1024) /* 4MB */
 #define DEFAULT_TLENGTH_MSEC 2000 /* 2s */
@@ -134,6 +142,14 @@ typedef struct playback_stream {
     size_t render_memblockq_length;
     pa_usec_t current_sink_latency;
     uint64_t playing_for, underrun_for;
+
+    /* Kept up to date by the IO thread, see timing-page.h */
+    pa_timing_page *timing_page;
+    uint32_t timing_page_index;
+
+    /* The worker thread of the connection, which the IO thread sends
+     * data requests to. NULL if the main thread handles them. */
+    pa_native_worker *worker;
 } playback_stream;
 
 #define PLAYBACK_STREAM(o) (playback_stream_cast(o))
@@ -170,17 +186,89 @@ struct pa_native_connection {
     uint32_t rrobin_index;
     pa_subscription *subscription;
     pa_time_event *auth_timeout_event;
+    pa_mempool *memfd_pool;
+
+    /* Whether the client reads playback timing from pages in the
+     * ring buffer segment, and which of them are taken */
+    pa_bool_t timing_pages;
+    pa_bool_t timing_page_used[PA_SRBCHANNEL_TIMING_PAGES_MAX];
+
+    /* Whether the client understands subscription events that carry
+     * the new state of the object, and whether it asked for them */
+    pa_bool_t subscribe_info_supported;
+    pa_bool_t subscribe_info;
+
+    /* The thread running the pstream, NULL for the main thread */
+    pa_native_worker *worker;
+
+    /* Only touched from the worker thread: channel -> worker_stream */
+    pa_hashmap *worker_channels;
+
+    /* How many packets and blocks the worker passed on to us that we
+     * didn't handle yet. The worker posts blocks to the IO threads
+     * itself only while this is zero, so that nothing overtakes the
+     * commands that came in before. */
+    pa_atomic_t worker_in_flight;
 };
 
 #define PA_NATIVE_CONNECTION(o) (pa_native_connection_cast(o))
 PA_DEFINE_PRIVATE_CLASS(pa_native_connection, pa_msgobject);
 
+/* A thread with a main loop of its own that runs the pstreams of some
+ * connections. Packets are passed on to the main thread, which still
+ * dispatches all commands. Blocks for playback streams go straight to
+ * the IO thread of the sink. */
+struct pa_native_worker {
+    pa_msgobject parent;
+
+    pa_thread *thread;
+    pa_mainloop *mainloop;
+    pa_thread_mq thread_mq;
+
+    /* Only touched from the main thread */
+    unsigned n_connections;
+
+    /* Only touched from the worker thread: playback_stream -> worker_stream */
+    pa_hashmap *streams;
+};
+
+#define PA_NATIVE_WORKER(o) (pa_native_worker_cast(o))
+PA_DEFINE_PRIVATE_CLASS(pa_native_worker, pa_msgobject);
+
+/* What the worker knows about a playback stream. The main thread
+ * attaches and detaches it synchronously, so the sink input is valid
+ * in between. */
+typedef struct worker_stream {
+    pa_native_connection *connection;
+    uint32_t channel;
+    pa_sink_input *sink_input;
+
+    /* NULL while the sink input is being moved */
+    pa_asyncmsgq *asyncmsgq;
+} worker_stream;
+
+/* A packet or block the worker passes on to the main thread */
+typedef struct worker_frame {
+    pa_packet *packet;
+#ifdef HAVE_CREDS
+    pa_creds creds;
+    pa_bool_t with_creds;
+#endif
+
+    uint32_t channel;
+    int64_t offset;
+    pa_seek_mode_t seek;
+    pa_memchunk chunk;
+} worker_frame;
+
 struct pa_native_protocol {
     PA_REFCNT_DECLARE;
 
     pa_core *core;
     pa_idxset *connections;
 
+    pa_hook_slot *sink_input_move_start_slot, *sink_input_move_finish_slot, *sink_input_move_fail_slot;
+
     pa_strlist *servers;
     pa_hook hooks[PA_NATIVE_HOOK_MAX];
 
@@ -208,7 +296,8 @@ enum {
     PLAYBACK_STREAM_MESSAGE_OVERFLOW,
     PLAYBACK_STREAM_MESSAGE_DRAIN_ACK,
     PLAYBACK_STREAM_MESSAGE_STARTED,
-    PLAYBACK_STREAM_MESSAGE_UPDATE_TLENGTH
+    PLAYBACK_STREAM_MESSAGE_UPDATE_TLENGTH,
+    PLAYBACK_STREAM_MESSAGE_WORKER_REQUEST_DATA /* the same as REQUEST_DATA, handled by the worker of the connection */
 };
 
 enum {
@@ -217,7 +306,24 @@ enum {
 
 enum {
     CONNECTION_MESSAGE_RELEASE,
-    CONNECTION_MESSAGE_REVOKE
+    CONNECTION_MESSAGE_REVOKE,
+
+    /* From the worker thread running the pstream */
+    CONNECTION_MESSAGE_PACKET,
+    CONNECTION_MESSAGE_MEMBLOCK,
+    CONNECTION_MESSAGE_DRAIN,
+    CONNECTION_MESSAGE_DIE
+};
+
+enum {
+    WORKER_MESSAGE_CONNECTION_ATTACH,
+    WORKER_MESSAGE_CONNECTION_DETACH,
+    WORKER_MESSAGE_ENABLE_SHM,
+    WORKER_MESSAGE_ENABLE_MEMFD,
+    WORKER_MESSAGE_ENABLE_SRBCHANNEL,
+    WORKER_MESSAGE_STREAM_ATTACH,
+    WORKER_MESSAGE_STREAM_HOLD,
+    WORKER_MESSAGE_STREAM_DETACH
 };
 
 static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk);
@@ -230,7 +336,13 @@ static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_send_event_cb(pa_sink_input *i, const char *event, pa_proplist *pl);
 
 static void native_connection_send_memblock(pa_native_connection *c);
+static void native_connection_setup_pstream(pa_native_connection *c, int code, pa_bool_t enable);
+static void playback_stream_send_request(playback_stream *s, pa_pstream *pstream);
+static void playback_stream_worker_send(playback_stream *s, int code);
+static void worker_request_data(playback_stream *s);
 static void playback_stream_request_bytes(struct playback_stream*s);
+static void playback_stream_take_timing_page(playback_stream *s);
+static void playback_stream_update_timing_page(playback_stream *s);
 
 static void source_output_kill_cb(pa_source_output *o);
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk);
@@ -723,6 +835,10 @@ static void playback_stream_unlink(playback_stream *s) {
     if (!s->connection)
         return;
 
+    /* Make sure the worker doesn't post anything to the sink input
+     * anymore */
+    playback_stream_worker_send(s, WORKER_MESSAGE_STREAM_DETACH);
+
     if (s->sink_input) {
         pa_sink_input_unlink(s->sink_input);
         pa_sink_input_unref(s->sink_input);
@@ -732,6 +848,12 @@ static void playback_stream_unlink(playback_stream *s) {
     if (s->drain_request)
         pa_pstream_send_error(s->connection->pstream, s->drain_tag, PA_ERR_NOENTITY);
 
+    /* The IO thread is done with it now */
+    if (s->timing_page) {
+        s->connection->timing_page_used[s->timing_page_index] = FALSE;
+        s->timing_page = NULL;
+    }
+
     pa_assert_se(pa_idxset_remove_by_data(s->connection->output_streams, s, NULL) == s);
     s->connection = NULL;
     playback_stream_unref(s);
@@ -748,38 +870,49 @@ static void playback_stream_free(pa_object* o) {
     pa_xfree(s);
 }
 
-/* Called from main context */
+/* Called from main context, or from worker context for the requests */
+static void playback_stream_send_request(playback_stream *s, pa_pstream *pstream) {
+    pa_tagstruct *t;
+    int l = 0;
+
+    for (;;) {
+        if ((l = pa_atomic_load(&s->missing)) <= 0)
+            return;
+
+        if (pa_atomic_cmpxchg(&s->missing, l, 0))
+            break;
+    }
+
+    t = pa_tagstruct_new(NULL, 0);
+    pa_tagstruct_putu32(t, PA_COMMAND_REQUEST);
+    pa_tagstruct_putu32(t, (uint32_t) -1); /* tag */
+    pa_tagstruct_putu32(t, s->index);
+    pa_tagstruct_putu32(t, (uint32_t) l);
+    pa_pstream_send_tagstruct(pstream, t);
+
+/*     pa_log("Requesting %lu bytes", (unsigned long) l); */
+}
+
+/* Called from main context, or from worker context for
+ * PLAYBACK_STREAM_MESSAGE_WORKER_REQUEST_DATA */
 static int playback_stream_process_msg(pa_msgobject *o, int code, void*userdata, int64_t offset, pa_memchunk *chunk) {
     playback_stream *s = PLAYBACK_STREAM(o);
     playback_stream_assert_ref(s);
 
+    /* Only the worker knows whether the stream is still around */
+    if (code == PLAYBACK_STREAM_MESSAGE_WORKER_REQUEST_DATA) {
+        worker_request_data(s);
+        return 0;
+    }
+
     if (!s->connection)
         return -1;
 
     switch (code) {
 
-        case PLAYBACK_STREAM_MESSAGE_REQUEST_DATA: {
-            pa_tagstruct *t;
-            int l = 0;
-
-            for (;;) {
-                if ((l = pa_atomic_load(&s->missing)) <= 0)
-                    return 0;
-
-                if (pa_atomic_cmpxchg(&s->missing, l, 0))
-                    break;
-            }
-
-            t = pa_tagstruct_new(NULL, 0);
-            pa_tagstruct_putu32(t, PA_COMMAND_REQUEST);
-            pa_tagstruct_putu32(t, (uint32_t) -1); /* tag */
-            pa_tagstruct_putu32(t, s->index);
-            pa_tagstruct_putu32(t, (uint32_t) l);
-            pa_pstream_send_tagstruct(s->connection->pstream, t);
-
-/*             pa_log("Requesting %lu bytes", (unsigned long) l); */
+        case PLAYBACK_STREAM_MESSAGE_REQUEST_DATA:
+            playback_stream_send_request(s, s->connection->pstream);
             break;
-        }
 
         case PLAYBACK_STREAM_MESSAGE_UNDERFLOW: {
             pa_tagstruct *t;
@@ -1118,6 +1251,13 @@ static playback_stream* playback_stream_new(
 
     pa_idxset_put(c->output_streams, s, &s->index);
 
+    s->timing_page = NULL;
+    s->timing_page_index = PA_INVALID_INDEX;
+    s->worker = c->worker;
+
+    if (c->timing_pages)
+        playback_stream_take_timing_page(s);
+
     pa_log_info("Final latency %0.2f ms = %0.2f ms + 2*%0.2f ms + %0.2f ms",
                 ((double) pa_bytes_to_usec(s->buffer_attr.tlength, &sink_input->sample_spec) + (double) s->configured_sink_latency) / PA_USEC_PER_MSEC,
                 (double) pa_bytes_to_usec(s->buffer_attr.tlength-s->buffer_attr.minreq*2, &sink_input->sample_spec) / PA_USEC_PER_MSEC,
@@ -1128,6 +1268,59 @@ static playback_stream* playback_stream_new(
     return s;
 }
 
+/* Called from main context */
+static void playback_stream_take_timing_page(playback_stream *s) {
+    pa_srbchannel *srb;
+    uint32_t i;
+
+    if (!(srb = pa_pstream_get_srbchannel(s->connection->pstream)))
+        return;
+
+    for (i = 0; i < PA_SRBCHANNEL_TIMING_PAGES_MAX; i++) {
+
+        if (s->connection->timing_page_used[i])
+            continue;
+
+        if (!(s->timing_page = pa_srbchannel_get_timing_page(srb, i)))
+            return;
+
+        /* Until the IO thread writes to it the client won't use it */
+        pa_atomic_store(&s->timing_page->seq, 0);
+
+        s->connection->timing_page_used[i] = TRUE;
+        s->timing_page_index = i;
+        return;
+    }
+}
+
+/* Called from IO context */
+static void playback_stream_update_timing_page(playback_stream *s) {
+    pa_sink_input *i;
+    pa_timing_data d;
+
+    playback_stream_assert_ref(s);
+
+    if (!s->timing_page)
+        return;
+
+    i = s->sink_input;
+
+    d.write_index = pa_memblockq_get_write_index(s->memblockq);
+    d.read_index = pa_memblockq_get_read_index(s->memblockq);
+    d.sink_usec =
+        pa_sink_get_latency_within_thread(i->sink) +
+        pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec);
+    d.timestamp = pa_rtclock_now();
+    d.underrun_for = i->thread_info.underrun_for;
+    d.playing_for = i->thread_info.playing_for;
+    d.playing =
+        d.playing_for > 0 &&
+        i->sink->thread_info.state == PA_SINK_RUNNING &&
+        i->thread_info.state == PA_SINK_INPUT_RUNNING;
+
+    pa_timing_page_write(s->timing_page, &d);
+}
+
 /* Called from IO context */
 static void playback_stream_request_bytes(playback_stream *s) {
     size_t m, minreq;
@@ -1152,8 +1345,13 @@ static void playback_stream_request_bytes(playback_stream *s) {
     minreq = pa_memblockq_get_minreq(s->memblockq);
 
     if (pa_memblockq_prebuf_active(s->memblockq) ||
-        (previous_missing < (int) minreq && previous_missing + (int) m >= (int) minreq))
-        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_REQUEST_DATA, NULL, 0, NULL, NULL);
+        (previous_missing < (int) minreq && previous_missing + (int) m >= (int) minreq)) {
+
+        if (s->worker)
+            pa_asyncmsgq_post(s->worker->thread_mq.inq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_WORKER_REQUEST_DATA, NULL, 0, NULL, NULL);
+        else
+            pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_REQUEST_DATA, NULL, 0, NULL, NULL);
+    }
 }
 
 /* Called from main context */
@@ -1168,11 +1366,43 @@ static void playback_stream_send_killed(playback_stream *p) {
     pa_pstream_send_tagstruct(p->connection->pstream, t);
 }
 
+static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata);
+static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata);
+static void pstream_die_callback(pa_pstream *p, void *userdata);
+static void pstream_drain_callback(pa_pstream *p, void *userdata);
+
+/* Called from main context */
+static void native_connection_handle_frame(pa_native_connection *c, int code, worker_frame *f) {
+    const pa_creds *creds = NULL;
+
+    pa_assert(f);
+
+    if (c->protocol) {
+
+        if (code == CONNECTION_MESSAGE_PACKET) {
+#ifdef HAVE_CREDS
+            if (f->with_creds)
+                creds = &f->creds;
+#endif
+            pstream_packet_callback(c->pstream, f->packet, creds, c);
+        } else
+            pstream_memblock_callback(c->pstream, f->channel, f->offset, f->seek, &f->chunk, c);
+    }
+
+    pa_atomic_dec(&c->worker_in_flight);
+}
+
 /* Called from main context */
 static int native_connection_process_msg(pa_msgobject *o, int code, void*userdata, int64_t offset, pa_memchunk *chunk) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(o);
     pa_native_connection_assert_ref(c);
 
+    /* These have to be counted even if we're gone already */
+    if (code == CONNECTION_MESSAGE_PACKET || code == CONNECTION_MESSAGE_MEMBLOCK) {
+        native_connection_handle_frame(c, code, userdata);
+        return 0;
+    }
+
     if (!c->protocol)
         return -1;
 
@@ -1185,6 +1415,14 @@ static int native_connection_process_msg(pa_msgobject *o, int code, void*userdat
         case CONNECTION_MESSAGE_RELEASE:
             pa_pstream_send_release(c->pstream, PA_PTR_TO_UINT(userdata));
             break;
+
+        case CONNECTION_MESSAGE_DRAIN:
+            pstream_drain_callback(c->pstream, c);
+            break;
+
+        case CONNECTION_MESSAGE_DIE:
+            pstream_die_callback(c->pstream, c);
+            break;
     }
 
     return 0;
@@ -1202,9 +1440,6 @@ static void native_connection_unlink(pa_native_connection *c) {
 
     pa_hook_fire(&c->protocol->hooks[PA_NATIVE_HOOK_CONNECTION_UNLINK], c);
 
-    if (c->options)
-        pa_native_options_unref(c->options);
-
     while ((r = pa_idxset_first(c->record_streams, NULL)))
         record_stream_unlink(r);
 
@@ -1217,7 +1452,10 @@ static void native_connection_unlink(pa_native_connection *c) {
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
-    if (c->pstream)
+    if (c->worker) {
+        pa_assert_se(pa_asyncmsgq_send(c->worker->thread_mq.inq, PA_MSGOBJECT(c->worker), WORKER_MESSAGE_CONNECTION_DETACH, c, 0, NULL) == 0);
+        c->worker->n_connections--;
+    } else if (c->pstream)
         pa_pstream_unlink(c->pstream);
 
     if (c->auth_timeout_event) {
@@ -1225,6 +1463,10 @@ static void native_connection_unlink(pa_native_connection *c) {
         c->auth_timeout_event = NULL;
     }
 
+    /* This might stop the worker, so it has to come last */
+    pa_native_options_unref(c->options);
+    c->options = NULL;
+
     pa_assert_se(pa_idxset_remove_by_data(c->protocol->connections, c, NULL) == c);
     c->protocol = NULL;
     pa_native_connection_unref(c);
@@ -1241,10 +1483,16 @@ static void native_connection_free(pa_object *o) {
     pa_idxset_free(c->record_streams, NULL, NULL);
     pa_idxset_free(c->output_streams, NULL, NULL);
 
+    if (c->worker_channels)
+        pa_hashmap_free(c->worker_channels, NULL, NULL);
+
     pa_pdispatch_unref(c->pdispatch);
     pa_pstream_unref(c->pstream);
     pa_client_free(c->client);
 
+    if (c->memfd_pool)
+        pa_mempool_free(c->memfd_pool);
+
     pa_xfree(c);
 }
 
@@ -1332,6 +1580,7 @@ static void handle_seek(playback_stream *s, int64_t indexw) {
     }
 
     playback_stream_request_bytes(s);
+    playback_stream_update_timing_page(s);
 }
 
 static void flush_write_no_account(pa_memblockq *q) {
@@ -1455,10 +1704,12 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
             s->underrun_for = s->sink_input->thread_info.underrun_for;
             s->playing_for = s->sink_input->thread_info.playing_for;
 
+            playback_stream_update_timing_page(s);
             return 0;
 
         case PA_SINK_INPUT_MESSAGE_SET_STATE: {
             int64_t windex;
+            int r;
 
             windex = pa_memblockq_get_write_index(s->memblockq);
 
@@ -1466,8 +1717,11 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
 
             handle_seek(s, windex);
 
-            /* Fall through to the default handler */
-            break;
+            /* The default handler applies the new state, which the
+             * timing page should show */
+            r = pa_sink_input_process_msg(o, code, userdata, offset, chunk);
+            playback_stream_update_timing_page(s);
+            return r;
         }
 
         case PA_SINK_INPUT_MESSAGE_GET_LATENCY: {
@@ -1501,6 +1755,10 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
 /*     pa_log("%s, pop(): %lu", pa_proplist_gets(i->proplist, PA_PROP_MEDIA_NAME), (unsigned long) pa_memblockq_get_length(s->memblockq)); */
 
+    /* Before we take anything, so that the read index matches what
+     * the sink has actually got */
+    playback_stream_update_timing_page(s);
+
     if (pa_memblockq_is_readable(s->memblockq))
         s->is_underrun = FALSE;
     else {
@@ -2033,7 +2291,13 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
     if (c->version >= 13)
         pa_tagstruct_put_usec(reply, s->configured_sink_latency);
 
+    if (c->timing_pages)
+        pa_tagstruct_putu32(reply, s->timing_page_index);
+
     pa_pstream_send_tagstruct(c->pstream, reply);
+
+    /* Only after the reply, so that no request overtakes it */
+    playback_stream_worker_send(s, WORKER_MESSAGE_STREAM_ATTACH);
 }
 
 static void command_delete_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -2308,7 +2572,11 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     const void*cookie;
     pa_tagstruct *reply;
-    pa_bool_t shm_on_remote = FALSE, do_shm;
+    pa_bool_t shm_on_remote = FALSE, srb_on_remote = FALSE, timing_on_remote = FALSE, do_shm, do_memfd = FALSE, do_srb;
+    pa_bool_t subscribe_info_on_remote = FALSE;
+#ifdef HAVE_MEMFD
+    pa_bool_t memfd_on_remote = FALSE;
+#endif
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
@@ -2334,6 +2602,23 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
         c->version &= 0x7FFFFFFFU;
     }
 
+    /* Starting with protocol version 17 the second MSB tells us that
+     * the client can pass and map memfd segments, which is what it
+     * prefers over POSIX SHM, the third one that it can talk to us
+     * through a shared ring buffer, the fourth one that it reads
+     * playback timing from there and the fifth one that it takes
+     * subscription events with object info. Older clients never get
+     * these bits back, since we only set what the client offered. */
+    if ((c->version & 0x07FFFFFFU) >= 17) {
+#ifdef HAVE_MEMFD
+        memfd_on_remote = !!(c->version & 0x40000000U);
+#endif
+        srb_on_remote = !!(c->version & 0x20000000U);
+        timing_on_remote = !!(c->version & 0x10000000U);
+        subscribe_info_on_remote = !!(c->version & 0x08000000U);
+        c->version &= 0x07FFFFFFU;
+    }
+
     pa_log_debug("Protocol version: remote %u, local %u", c->version, PA_PROTOCOL_VERSION);
 
     pa_proplist_setf(c->client->proplist, "native-protocol.version", "%u", c->version);
@@ -2397,29 +2682,64 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
         pa_mempool_is_shared(c->protocol->core->mempool) &&
         c->is_local;
 
+#ifdef HAVE_MEMFD
+    do_memfd = memfd_on_remote && c->is_local;
+#endif
+
     pa_log_debug("SHM possible: %s", pa_yes_no(do_shm));
+    pa_log_debug("memfd possible: %s", pa_yes_no(do_memfd));
 
     if (do_shm)
         if (c->version < 10 || (c->version >= 13 && !shm_on_remote))
             do_shm = FALSE;
 
 #ifdef HAVE_CREDS
-    if (do_shm) {
+    if (do_shm || do_memfd) {
         /* Only enable SHM if both sides are owned by the same
          * user. This is a security measure because otherwise data
          * private to the user might leak. */
 
         const pa_creds *creds;
         if (!(creds = pa_pdispatch_creds(pd)) || getuid() != creds->uid)
-            do_shm = FALSE;
+            do_shm = do_memfd = FALSE;
     }
 #endif
 
+    if (do_memfd && !c->memfd_pool) {
+        size_t size_max;
+
+        /* Every client gets a pool of its own, so that nothing but
+         * the data meant for it is ever mapped into its address
+         * space */
+        pa_mempool_get_size(c->protocol->core->mempool, &size_max);
+
+        if (!(c->memfd_pool = pa_mempool_new_memfd(size_max)))
+            do_memfd = FALSE;
+    }
+
+    if (do_memfd) {
+        native_connection_setup_pstream(c, WORKER_MESSAGE_ENABLE_MEMFD, TRUE);
+        do_shm = TRUE;
+    }
+
+    /* The ring buffer is a memfd of its own, so we offer it only to
+     * clients we would hand our memfds anyway */
+    do_srb = do_memfd && srb_on_remote;
+
+    /* A worker frees the ring buffer as soon as the client goes away,
+     * while the IO threads may still write to the timing pages in it */
+    c->timing_pages = do_srb && timing_on_remote && !c->worker;
+    c->subscribe_info_supported = subscribe_info_on_remote;
+
     pa_log_debug("Negotiated SHM: %s", pa_yes_no(do_shm));
-    pa_pstream_enable_shm(c->pstream, do_shm);
+    pa_log_debug("Negotiated memfd: %s", pa_yes_no(do_memfd));
+    pa_log_debug("Negotiated ring buffer: %s", pa_yes_no(do_srb));
+    pa_log_debug("Negotiated timing pages: %s", pa_yes_no(c->timing_pages));
+    pa_log_debug("Negotiated subscription info: %s", pa_yes_no(c->subscribe_info_supported));
+    native_connection_setup_pstream(c, WORKER_MESSAGE_ENABLE_SHM, do_shm);
 
     reply = reply_new(tag);
-    pa_tagstruct_putu32(reply, PA_PROTOCOL_VERSION | (do_shm ? 0x80000000 : 0));
+    pa_tagstruct_putu32(reply, PA_PROTOCOL_VERSION | (do_shm ? 0x80000000 : 0) | (do_memfd ? 0x40000000 : 0) | (do_srb ? 0x20000000 : 0) | (c->timing_pages ? 0x10000000 : 0) | (c->subscribe_info_supported ? 0x08000000 : 0));
 
 #ifdef HAVE_CREDS
 {
@@ -2435,6 +2755,11 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
 #else
     pa_pstream_send_tagstruct(c->pstream, reply);
 #endif
+
+    /* This goes out after the reply, so that the client knows what
+     * to expect */
+    if (do_srb)
+        native_connection_setup_pstream(c, WORKER_MESSAGE_ENABLE_SRBCHANNEL, TRUE);
 }
 
 static void command_set_client_name(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -3311,6 +3636,63 @@ static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+/* Appends the current state of the object the event is about, in the
+ * same format as the replies to the GET_*_INFO commands. Objects that
+ * are gone or have no such command are left out. */
+static void subscription_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_subscription_event_type_t e, uint32_t idx) {
+    pa_core *core = c->protocol->core;
+    void *p;
+
+    if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE)
+        return;
+
+    switch (e & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) {
+
+        case PA_SUBSCRIPTION_EVENT_SINK:
+            if ((p = pa_idxset_get_by_index(core->sinks, idx)))
+                sink_fill_tagstruct(c, t, p);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE:
+            if ((p = pa_idxset_get_by_index(core->sources, idx)))
+                source_fill_tagstruct(c, t, p);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+            if ((p = pa_idxset_get_by_index(core->sink_inputs, idx)))
+                sink_input_fill_tagstruct(c, t, p);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT:
+            if ((p = pa_idxset_get_by_index(core->source_outputs, idx)))
+                source_output_fill_tagstruct(c, t, p);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_MODULE:
+            if ((p = pa_idxset_get_by_index(core->modules, idx)))
+                module_fill_tagstruct(c, t, p);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_CLIENT:
+            if ((p = pa_idxset_get_by_index(core->clients, idx)))
+                client_fill_tagstruct(c, t, p);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE:
+            if (core->scache && (p = pa_idxset_get_by_index(core->scache, idx)))
+                scache_fill_tagstruct(c, t, p);
+            break;
+
+        case PA_SUBSCRIPTION_EVENT_CARD:
+            if ((p = pa_idxset_get_by_index(core->cards, idx)))
+                card_fill_tagstruct(c, t, p);
+            break;
+
+        default:
+            break;
+    }
+}
+
 static void subscription_cb(pa_core *core, pa_subscription_event_type_t e, uint32_t idx, void *userdata) {
     pa_tagstruct *t;
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
@@ -3322,17 +3704,23 @@ static void subscription_cb(pa_core *core, pa_subscription_event_type_t e, uint3
     pa_tagstruct_putu32(t, (uint32_t) -1);
     pa_tagstruct_putu32(t, e);
     pa_tagstruct_putu32(t, idx);
+
+    if (c->subscribe_info)
+        subscription_fill_tagstruct(c, t, e, idx);
+
     pa_pstream_send_tagstruct(c->pstream, t);
 }
 
 static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_subscription_mask_t m;
+    pa_bool_t with_info = FALSE;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
 
     if (pa_tagstruct_getu32(t, &m) < 0 ||
+        (c->subscribe_info_supported && pa_tagstruct_get_boolean(t, &with_info) < 0) ||
         !pa_tagstruct_eof(t)) {
         protocol_error(c);
         return;
@@ -3344,6 +3732,8 @@ static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
+    c->subscribe_info = with_info;
+
     if (m != 0) {
         c->subscription = pa_subscription_new(c->protocol->core, m, subscription_cb, c);
         pa_assert(c->subscription);
@@ -4410,6 +4800,19 @@ static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_c
     }
 }
 
+/* Called from main context, or from worker context while the sink input
+ * is attached to the worker */
+static void playback_stream_post_data(pa_asyncmsgq *q, pa_sink_input *i, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk) {
+
+    if (chunk->memblock) {
+        if (seek != PA_SEEK_RELATIVE || offset != 0)
+            pa_asyncmsgq_post(q, PA_MSGOBJECT(i), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset, NULL, NULL);
+
+        pa_asyncmsgq_post(q, PA_MSGOBJECT(i), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
+    } else
+        pa_asyncmsgq_post(q, PA_MSGOBJECT(i), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset+chunk->length, NULL, NULL);
+}
+
 static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     output_stream *stream;
@@ -4429,13 +4832,7 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
     if (playback_stream_isinstance(stream)) {
         playback_stream *ps = PLAYBACK_STREAM(stream);
 
-        if (chunk->memblock) {
-            if (seek != PA_SEEK_RELATIVE || offset != 0)
-                pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset, NULL, NULL);
-
-            pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
-        } else
-            pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset+chunk->length, NULL, NULL);
+        playback_stream_post_data(ps->sink_input->sink->asyncmsgq, ps->sink_input, offset, seek, chunk);
 
     } else {
         upload_stream *u = UPLOAD_STREAM(stream);
@@ -4518,6 +4915,366 @@ static void pstream_release_callback(pa_pstream *p, uint32_t block_id, void *use
         pa_asyncmsgq_post(q->outq, PA_MSGOBJECT(userdata), CONNECTION_MESSAGE_RELEASE, PA_UINT_TO_PTR(block_id), 0, NULL, NULL);
 }
 
+/*** worker threads ***/
+
+static void worker_frame_free(void *p) {
+    worker_frame *f = p;
+
+    pa_assert(f);
+
+    if (f->packet)
+        pa_packet_unref(f->packet);
+
+    if (f->chunk.memblock)
+        pa_memblock_unref(f->chunk.memblock);
+
+    pa_xfree(f);
+}
+
+/* Called from worker context */
+static void worker_pass_on(pa_native_connection *c, int code, worker_frame *f) {
+    pa_atomic_inc(&c->worker_in_flight);
+    pa_asyncmsgq_post(c->worker->thread_mq.outq, PA_MSGOBJECT(c), code, f, 0, NULL, worker_frame_free);
+}
+
+/* Called from worker context */
+static void worker_pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    worker_frame *f;
+
+    pa_assert(p);
+    pa_assert(packet);
+    pa_native_connection_assert_ref(c);
+
+    f = pa_xnew0(worker_frame, 1);
+    f->packet = pa_packet_ref(packet);
+#ifdef HAVE_CREDS
+    if ((f->with_creds = !!creds))
+        f->creds = *creds;
+#endif
+
+    worker_pass_on(c, CONNECTION_MESSAGE_PACKET, f);
+}
+
+/* Called from worker context */
+static void worker_pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    worker_stream *ws;
+    worker_frame *f;
+
+    pa_assert(p);
+    pa_assert(chunk);
+    pa_native_connection_assert_ref(c);
+
+    if ((ws = pa_hashmap_get(c->worker_channels, PA_UINT32_TO_PTR(channel))) &&
+        ws->asyncmsgq &&
+        pa_atomic_load(&c->worker_in_flight) <= 0) {
+
+        playback_stream_post_data(ws->asyncmsgq, ws->sink_input, offset, seek, chunk);
+        return;
+    }
+
+    /* Upload streams, streams we don't know yet or which are being
+     * moved, and anything that came in after a command the main
+     * thread is still busy with */
+    f = pa_xnew0(worker_frame, 1);
+    f->channel = channel;
+    f->offset = offset;
+    f->seek = seek;
+    f->chunk = *chunk;
+
+    if (f->chunk.memblock)
+        pa_memblock_ref(f->chunk.memblock);
+
+    worker_pass_on(c, CONNECTION_MESSAGE_MEMBLOCK, f);
+}
+
+/* Called from worker context */
+static void worker_pstream_die_callback(pa_pstream *p, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_assert(p);
+    pa_native_connection_assert_ref(c);
+
+    pa_asyncmsgq_post(c->worker->thread_mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_DIE, NULL, 0, NULL, NULL);
+}
+
+/* Called from worker context */
+static void worker_pstream_drain_callback(pa_pstream *p, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_assert(p);
+    pa_native_connection_assert_ref(c);
+
+    pa_asyncmsgq_post(c->worker->thread_mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_DRAIN, NULL, 0, NULL, NULL);
+}
+
+/* Called from main context, or from worker context, whichever runs the
+ * pstream */
+static void pstream_setup(pa_native_connection *c, int code, pa_bool_t enable) {
+
+    switch (code) {
+
+        case WORKER_MESSAGE_ENABLE_SHM:
+            pa_pstream_enable_shm(c->pstream, enable);
+            break;
+
+        case WORKER_MESSAGE_ENABLE_MEMFD:
+            pa_pstream_enable_memfd(c->pstream, c->memfd_pool);
+            break;
+
+        case WORKER_MESSAGE_ENABLE_SRBCHANNEL:
+            pa_pstream_enable_srbchannel(c->pstream, enable);
+            break;
+    }
+}
+
+/* Called from main context */
+static void native_connection_setup_pstream(pa_native_connection *c, int code, pa_bool_t enable) {
+    pa_native_connection_assert_ref(c);
+
+    if (c->worker)
+        pa_assert_se(pa_asyncmsgq_send(c->worker->thread_mq.inq, PA_MSGOBJECT(c->worker), code, c, enable, NULL) == 0);
+    else
+        pstream_setup(c, code, enable);
+}
+
+/* Called from main context */
+static void playback_stream_worker_send(playback_stream *s, int code) {
+    playback_stream_assert_ref(s);
+
+    if (!s->worker)
+        return;
+
+    pa_assert_se(pa_asyncmsgq_send(s->worker->thread_mq.inq, PA_MSGOBJECT(s->worker), code, s, 0, NULL) == 0);
+}
+
+/* Called from worker context */
+static void worker_request_data(playback_stream *s) {
+    worker_stream *ws;
+
+    /* The main thread detaches a stream before it drops its own
+     * reference, so while we know the stream the message can't hold
+     * the last one. Otherwise we hand the message on, so that the
+     * stream is never freed here. The main thread sends the request
+     * if the stream is still linked. */
+    if (!(ws = pa_hashmap_get(s->worker->streams, s))) {
+        pa_asyncmsgq_post(s->worker->thread_mq.outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_REQUEST_DATA, NULL, 0, NULL, NULL);
+        return;
+    }
+
+    playback_stream_send_request(s, ws->connection->pstream);
+}
+
+/* Called from worker context, while the main thread waits for us */
+static void worker_connection_attach(pa_native_worker *w, pa_native_connection *c, int fd) {
+    pa_mainloop_api *m;
+
+    m = pa_mainloop_get_api(w->mainloop);
+
+    c->pstream = pa_pstream_new(m, pa_iochannel_new(m, fd, fd), c->protocol->core->mempool);
+    pa_pstream_enable_threaded_send(c->pstream);
+
+    pa_pstream_set_recieve_packet_callback(c->pstream, worker_pstream_packet_callback, c);
+    pa_pstream_set_recieve_memblock_callback(c->pstream, worker_pstream_memblock_callback, c);
+    pa_pstream_set_die_callback(c->pstream, worker_pstream_die_callback, c);
+    pa_pstream_set_drain_callback(c->pstream, worker_pstream_drain_callback, c);
+    pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
+    pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+}
+
+/* Called from worker context, while the main thread waits for us */
+static void worker_stream_attach(pa_native_worker *w, playback_stream *s) {
+    worker_stream *ws;
+
+    if (!(ws = pa_hashmap_get(w->streams, s))) {
+        ws = pa_xnew(worker_stream, 1);
+        ws->connection = s->connection;
+        ws->channel = s->index;
+        ws->sink_input = s->sink_input;
+
+        pa_assert_se(pa_hashmap_put(w->streams, s, ws) == 0);
+        pa_assert_se(pa_hashmap_put(ws->connection->worker_channels, PA_UINT32_TO_PTR(ws->channel), ws) == 0);
+    }
+
+    ws->asyncmsgq = s->sink_input->sink->asyncmsgq;
+
+    /* The IO thread might have asked for data before */
+    playback_stream_send_request(s, ws->connection->pstream);
+}
+
+/* Called from worker context, while the main thread waits for us */
+static void worker_stream_detach(pa_native_worker *w, playback_stream *s) {
+    worker_stream *ws;
+
+    if (!(ws = pa_hashmap_remove(w->streams, s)))
+        return;
+
+    pa_assert_se(pa_hashmap_remove(ws->connection->worker_channels, PA_UINT32_TO_PTR(ws->channel)) == ws);
+    pa_xfree(ws);
+}
+
+/* Called from worker context */
+static int native_worker_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    pa_native_worker *w = PA_NATIVE_WORKER(o);
+    worker_stream *ws;
+
+    pa_native_worker_assert_ref(w);
+
+    switch (code) {
+
+        case PA_MESSAGE_SHUTDOWN:
+            pa_mainloop_quit(w->mainloop, 0);
+            break;
+
+        case WORKER_MESSAGE_CONNECTION_ATTACH:
+            worker_connection_attach(w, PA_NATIVE_CONNECTION(userdata), (int) offset);
+            break;
+
+        case WORKER_MESSAGE_CONNECTION_DETACH:
+            pa_pstream_unlink(PA_NATIVE_CONNECTION(userdata)->pstream);
+            break;
+
+        case WORKER_MESSAGE_ENABLE_SHM:
+        case WORKER_MESSAGE_ENABLE_MEMFD:
+        case WORKER_MESSAGE_ENABLE_SRBCHANNEL:
+            pstream_setup(PA_NATIVE_CONNECTION(userdata), code, !!offset);
+            break;
+
+        case WORKER_MESSAGE_STREAM_ATTACH:
+            worker_stream_attach(w, PLAYBACK_STREAM(userdata));
+            break;
+
+        case WORKER_MESSAGE_STREAM_HOLD:
+            /* Until it is attached again the blocks take the way
+             * through the main thread */
+            if ((ws = pa_hashmap_get(w->streams, userdata)))
+                ws->asyncmsgq = NULL;
+            break;
+
+        case WORKER_MESSAGE_STREAM_DETACH:
+            worker_stream_detach(w, PLAYBACK_STREAM(userdata));
+            break;
+    }
+
+    return 0;
+}
+
+static void worker_thread_func(void *userdata) {
+    pa_native_worker *w = userdata;
+    int ret;
+
+    pa_assert(w);
+
+    pa_log_debug("Native protocol worker starting up");
+
+    pa_thread_mq_install(&w->thread_mq);
+    pa_mainloop_run(w->mainloop, &ret);
+
+    pa_log_debug("Native protocol worker shutting down");
+}
+
+/* Called from main context */
+static void native_worker_free(pa_object *o) {
+    pa_native_worker *w = PA_NATIVE_WORKER(o);
+
+    pa_assert(w);
+    pa_assert(!w->thread);
+
+    pa_thread_mq_done(&w->thread_mq);
+
+    pa_assert(pa_hashmap_isempty(w->streams));
+    pa_hashmap_free(w->streams, NULL, NULL);
+
+    pa_mainloop_free(w->mainloop);
+    pa_xfree(w);
+}
+
+/* Called from main context */
+static void native_worker_stop(pa_native_worker *w) {
+    pa_native_worker_assert_ref(w);
+
+    /* The message needs a reference to the worker, so this has to
+     * happen before the last unref */
+    if (!w->thread)
+        return;
+
+    pa_asyncmsgq_send(w->thread_mq.inq, PA_MSGOBJECT(w), PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(w->thread);
+    w->thread = NULL;
+}
+
+/* Called from main context */
+static pa_native_worker* native_worker_new(pa_core *c) {
+    pa_native_worker *w;
+
+    pa_assert(c);
+
+    w = pa_msgobject_new(pa_native_worker);
+    w->parent.parent.free = native_worker_free;
+    w->parent.process_msg = native_worker_process_msg;
+
+    w->mainloop = pa_mainloop_new();
+    pa_thread_mq_init_thread_mainloop(&w->thread_mq, c->mainloop, pa_mainloop_get_api(w->mainloop));
+
+    w->n_connections = 0;
+    w->streams = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    if (!(w->thread = pa_thread_new(worker_thread_func, w))) {
+        pa_log("Failed to create native protocol worker thread.");
+        pa_native_worker_unref(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+/* Called from main context */
+static pa_native_worker* native_options_pick_worker(pa_native_options *o) {
+    pa_native_worker *w = NULL;
+    uint32_t i;
+
+    for (i = 0; i < o->n_workers; i++)
+        if (!w || o->workers[i]->n_connections < w->n_connections)
+            w = o->workers[i];
+
+    return w;
+}
+
+/* Called from main context */
+static pa_hook_result_t sink_input_move_start_cb(pa_core *core, pa_sink_input *i, pa_native_protocol *p) {
+    pa_sink_input_assert_ref(i);
+
+    if (i->pop == sink_input_pop_cb)
+        playback_stream_worker_send(PLAYBACK_STREAM(i->userdata), WORKER_MESSAGE_STREAM_HOLD);
+
+    return PA_HOOK_OK;
+}
+
+/* Called from main context */
+static pa_hook_result_t sink_input_move_finish_cb(pa_core *core, pa_sink_input *i, pa_native_protocol *p) {
+    pa_sink_input_assert_ref(i);
+
+    /* Only now the new sink knows about the sink input */
+    if (i->pop == sink_input_pop_cb)
+        playback_stream_worker_send(PLAYBACK_STREAM(i->userdata), WORKER_MESSAGE_STREAM_ATTACH);
+
+    return PA_HOOK_OK;
+}
+
+/* Called from main context */
+static pa_hook_result_t sink_input_move_fail_cb(pa_core *core, pa_sink_input *i, pa_native_protocol *p) {
+    pa_sink_input_assert_ref(i);
+
+    /* No move finish follows unless somebody rescues the sink input,
+     * so don't leave the stream held. The worker forgets about it and
+     * learns about it again when it is moved to some other sink. */
+    if (i->pop == sink_input_pop_cb)
+        playback_stream_worker_send(PLAYBACK_STREAM(i->userdata), WORKER_MESSAGE_STREAM_DETACH);
+
+    return PA_HOOK_OK;
+}
+
 /*** client callbacks ***/
 
 static void client_kill_cb(pa_client *c) {
@@ -4571,8 +5328,8 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     pa_assert(io);
     pa_assert(o);
 
-    if (pa_idxset_size(p->connections)+1 > MAX_CONNECTIONS) {
-        pa_log_warn("Warning! Too many connections (%u), dropping incoming connection.", MAX_CONNECTIONS);
+    if (pa_idxset_size(p->connections)+1 > o->max_connections) {
+        pa_log_warn("Warning! Too many connections (%u), dropping incoming connection.", o->max_connections);
         pa_iochannel_free(io);
         return;
     }
@@ -4616,19 +5373,52 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
 
     c->is_local = pa_iochannel_socket_is_local(io);
     c->version = 8;
+    c->memfd_pool = NULL;
+    c->timing_pages = FALSE;
+    memset(c->timing_page_used, 0, sizeof(c->timing_page_used));
+    c->subscribe_info_supported = FALSE;
+    c->subscribe_info = FALSE;
 
     c->client = client;
     c->client->kill = client_kill_cb;
     c->client->send_event = client_send_event_cb;
     c->client->userdata = c;
 
-    c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
-    pa_pstream_set_recieve_packet_callback(c->pstream, pstream_packet_callback, c);
-    pa_pstream_set_recieve_memblock_callback(c->pstream, pstream_memblock_callback, c);
-    pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
-    pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
-    pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
-    pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+#ifdef HAVE_CREDS
+    if (pa_iochannel_creds_supported(io))
+        pa_iochannel_creds_enable(io);
+#endif
+
+    c->worker = NULL;
+    c->worker_channels = NULL;
+    pa_atomic_store(&c->worker_in_flight, 0);
+
+    if (pa_iochannel_get_recv_fd(io) == pa_iochannel_get_send_fd(io))
+        c->worker = native_options_pick_worker(o);
+
+    if (c->worker) {
+        int fd = pa_iochannel_get_recv_fd(io);
+
+        /* The socket is reading and writing from the worker thread from
+         * now on, we only keep the command dispatching here */
+        c->worker->n_connections++;
+        c->worker_channels = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+        pa_iochannel_set_noclose(io, TRUE);
+        pa_iochannel_free(io);
+
+        c->pstream = NULL;
+        pa_assert_se(pa_asyncmsgq_send(c->worker->thread_mq.inq, PA_MSGOBJECT(c->worker), WORKER_MESSAGE_CONNECTION_ATTACH, c, fd, NULL) == 0);
+
+    } else {
+        c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
+        pa_pstream_set_recieve_packet_callback(c->pstream, pstream_packet_callback, c);
+        pa_pstream_set_recieve_memblock_callback(c->pstream, pstream_memblock_callback, c);
+        pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
+        pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
+        pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
+        pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+    }
 
     c->pdispatch = pa_pdispatch_new(p->core->mainloop, TRUE, command_table, PA_COMMAND_MAX);
 
@@ -4640,11 +5430,6 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
 
     pa_idxset_put(p->connections, c, NULL);
 
-#ifdef HAVE_CREDS
-    if (pa_iochannel_creds_supported(io))
-        pa_iochannel_creds_enable(io);
-#endif
-
     pa_hook_fire(&p->hooks[PA_NATIVE_HOOK_CONNECTION_PUT], c);
 }
 
@@ -4678,6 +5463,10 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
         pa_hook_init(&p->hooks[h], p);
 
+    p->sink_input_move_start_slot = pa_hook_connect(&c->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_START], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_start_cb, p);
+    p->sink_input_move_finish_slot = pa_hook_connect(&c->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_finish_cb, p);
+    p->sink_input_move_fail_slot = pa_hook_connect(&c->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FAIL], PA_HOOK_EARLY, (pa_hook_cb_t) sink_input_move_fail_cb, p);
+
     pa_assert_se(pa_shared_set(c, "native-protocol", p) >= 0);
 
     return p;
@@ -4716,6 +5505,10 @@ void pa_native_protocol_unref(pa_native_protocol *p) {
 
     pa_idxset_free(p->connections, NULL, NULL);
 
+    pa_hook_slot_free(p->sink_input_move_start_slot);
+    pa_hook_slot_free(p->sink_input_move_finish_slot);
+    pa_hook_slot_free(p->sink_input_move_fail_slot);
+
     pa_strlist_free(p->servers);
 
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
@@ -4787,6 +5580,8 @@ pa_native_options* pa_native_options_new(void) {
     o = pa_xnew0(pa_native_options, 1);
     PA_REFCNT_INIT(o);
 
+    o->max_connections = DEFAULT_MAX_CONNECTIONS;
+
     return o;
 }
 
@@ -4814,12 +5609,24 @@ void pa_native_options_unref(pa_native_options *o) {
     if (o->auth_cookie)
         pa_auth_cookie_unref(o->auth_cookie);
 
+    if (o->workers) {
+        uint32_t i;
+
+        for (i = 0; i < o->n_workers; i++) {
+            native_worker_stop(o->workers[i]);
+            pa_native_worker_unref(o->workers[i]);
+        }
+
+        pa_xfree(o->workers);
+    }
+
     pa_xfree(o);
 }
 
 int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
     pa_bool_t enabled;
     const char *acl;
+    uint32_t n_workers;
 
     pa_assert(o);
     pa_assert(PA_REFCNT_VALUE(o) >= 1);
@@ -4882,6 +5689,25 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
     } else
           o->auth_cookie = NULL;
 
+    if (pa_modargs_get_value_u32(ma, "max-connections", &o->max_connections) < 0 || o->max_connections <= 0) {
+        pa_log("max-connections= expects a positive integer argument.");
+        return -1;
+    }
+
+    n_workers = o->n_workers;
+    if (pa_modargs_get_value_u32(ma, "workers", &n_workers) < 0 || n_workers > MAX_WORKERS) {
+        pa_log("workers= expects an integer argument between 0 and %u.", MAX_WORKERS);
+        return -1;
+    }
+
+    if (n_workers > 0 && !o->workers) {
+        o->workers = pa_xnew0(pa_native_worker*, n_workers);
+
+        for (o->n_workers = 0; o->n_workers < n_workers; o->n_workers++)
+            if (!(o->workers[o->n_workers] = native_worker_new(c)))
+                return -1;
+    }
+
     return 0;
 }
 
@@ -38,6 +38,8 @@ typedef struct pa_native_protocol pa_native_protocol;
 
 typedef struct pa_native_connection pa_native_connection;
 
+typedef struct pa_native_worker pa_native_worker;
+
 typedef struct pa_native_options {
     PA_REFCNT_DECLARE;
 
@@ -47,6 +49,16 @@ typedef struct pa_native_options {
     char *auth_group;
     pa_ip_acl *auth_ip_acl;
     pa_auth_cookie *auth_cookie;
+
+    /* We refuse new clients when we already have this many */
+    uint32_t max_connections;
+
+    /* The I/O of the connections and the data of their playback
+     * streams is handled by this many threads of their own. The
+     * commands are still dispatched from the main loop. With no
+     * workers everything happens in the main loop. */
+    uint32_t n_workers;
+    pa_native_worker **workers;
 } pa_native_options;
 
 typedef enum pa_native_hook {
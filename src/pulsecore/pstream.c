@@ -49,6 +49,11 @@
 #include <pulsecore/refcnt.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/shm.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/srbchannel.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/fdsem.h>
 
 #include "pstream.h"
 
@@ -59,6 +64,35 @@
 #define PA_FLAG_SHMMASK    0xFF000000LU
 #define PA_FLAG_SEEKMASK   0x000000FFLU
 
+/* An SHM data frame that carries the memfd of its segment as
+ * ancillary data. This is sent once per segment and connection, the
+ * following frames only refer to the segment by its id. */
+#define PA_FLAG_SHMDATA_FD 0xA0000000LU
+
+/* We never export from more segments than an import accepts */
+#define MEMFD_IDS_MAX 16
+
+/* Switches the connection over to a shared ring buffer. The side
+ * that creates the channel sends this frame with the memfd and the
+ * two eventfds of the channel attached. The other side answers with
+ * the same frame without fds, and after that writes only to the
+ * ring. The creator then sends one more and switches too. Each side
+ * reads the ring once it received the other side's last frame on the
+ * socket, so that nothing is ever reordered. */
+#define PA_FLAG_SRBCHANNEL 0x20000000LU
+
+#define FDS_MAX 3
+
+/* How many frames we gather into a single write */
+#define WRITE_FRAMES_MAX 32
+
+/* Small frames are read into a buffer, many of them at once. Larger
+ * payloads go straight to where they belong. */
+#define READ_BUFFER_SIZE 4096
+
+/* Received fds wait here until the frame they belong to shows up */
+#define READ_FDS_MAX (2*FDS_MAX)
+
 /* The sequence descriptor header consists of 5 32bit integers: */
 enum {
     PA_PSTREAM_DESCRIPTOR_LENGTH,
@@ -83,14 +117,15 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
 #define PA_PSTREAM_DESCRIPTOR_SIZE (PA_PSTREAM_DESCRIPTOR_MAX*sizeof(uint32_t))
 #define FRAME_SIZE_MAX_ALLOW PA_SCACHE_ENTRY_SIZE_MAX /* allow uploading a single sample in one frame at max */
 
-PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(items, 0, 32, pa_xfree);
 
 struct item_info {
     enum {
         PA_PSTREAM_ITEM_PACKET,
         PA_PSTREAM_ITEM_MEMBLOCK,
         PA_PSTREAM_ITEM_SHMRELEASE,
-        PA_PSTREAM_ITEM_SHMREVOKE
+        PA_PSTREAM_ITEM_SHMREVOKE,
+        PA_PSTREAM_ITEM_SRBCHANNEL
     } type;
 
     /* packet info */
@@ -108,6 +143,40 @@ struct item_info {
 
     /* release/revoke info */
     uint32_t block_id;
+
+    /* srbchannel info */
+    pa_bool_t srb_switch;
+#ifdef HAVE_CREDS
+    int fds[FDS_MAX];
+    unsigned n_fds;
+#endif
+};
+
+struct pstream_read {
+    pa_pstream_descriptor descriptor;
+    pa_memblock *memblock;
+    pa_packet *packet;
+    uint32_t shm_info[PA_PSTREAM_SHM_MAX];
+    void *data;
+    size_t index;
+    int fds[FDS_MAX];
+    unsigned n_fds;
+};
+
+struct pstream_write {
+    pa_pstream_descriptor descriptor;
+    struct item_info* current;
+    uint32_t shm_info[PA_PSTREAM_SHM_MAX];
+    void *data;
+    pa_memchunk memchunk;
+
+#ifdef HAVE_CREDS
+    /* Ancillary data for the first bytes of this frame */
+    pa_bool_t send_creds;
+    pa_creds creds;
+    int fds[FDS_MAX];
+    unsigned n_fds;
+#endif
 };
 
 struct pa_pstream {
@@ -119,30 +188,43 @@ struct pa_pstream {
 
     pa_queue *send_queue;
 
+    /* Only set if other threads may send, see
+     * pa_pstream_enable_threaded_send(). The mutex protects the send
+     * queue and n_write. */
+    pa_mutex *mutex;
+    pa_fdsem *fdsem;
+    pa_io_event *fdsem_event;
+
     pa_bool_t dead;
 
-    struct {
-        pa_pstream_descriptor descriptor;
-        struct item_info* current;
-        uint32_t shm_info[PA_PSTREAM_SHM_MAX];
-        void *data;
-        size_t index;
-        pa_memchunk memchunk;
-    } write;
-
-    struct {
-        pa_pstream_descriptor descriptor;
-        pa_memblock *memblock;
-        pa_packet *packet;
-        uint32_t shm_info[PA_PSTREAM_SHM_MAX];
-        void *data;
-        size_t index;
-    } read;
+    /* The frames prepared for writing, kept in a ring. Only the first
+     * one may have been written partially. */
+    struct pstream_write write[WRITE_FRAMES_MAX];
+    unsigned write_first, n_write;
+    size_t write_index;
+
+    /* Frames come in on the socket and, once we switched over, on the
+     * ring buffer */
+    struct pstream_read readio, readsrb;
+    uint8_t read_buffer[READ_BUFFER_SIZE];
+
+    pa_srbchannel *srb;
+    pa_bool_t srb_accept:1;
+    pa_bool_t srb_creator:1;
+    pa_bool_t srb_read:1;
+    pa_bool_t srb_write:1;
 
     pa_bool_t use_shm;
     pa_memimport *import;
     pa_memexport *export;
 
+    /* The pool we export from, and the memfd segments the other side
+     * has been sent already */
+    pa_mempool *export_pool;
+    pa_bool_t use_memfd;
+    uint32_t memfd_ids[MEMFD_IDS_MAX];
+    unsigned n_memfd_ids;
+
     pa_pstream_packet_cb_t recieve_packet_callback;
     void *recieve_packet_callback_userdata;
 
@@ -164,15 +246,20 @@ struct pa_pstream {
     pa_mempool *mempool;
 
 #ifdef HAVE_CREDS
-    pa_creds read_creds, write_creds;
-    pa_bool_t read_creds_valid, send_creds_now;
+    pa_creds read_creds;
+    pa_bool_t read_creds_valid;
+
+    int read_fds[READ_FDS_MAX];
+    unsigned n_read_fds;
 #endif
 };
 
 static int do_write(pa_pstream *p);
-static int do_read(pa_pstream *p);
+static int do_read(pa_pstream *p, struct pstream_read *re);
 
 static void do_something(pa_pstream *p) {
+    int r;
+
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
@@ -181,12 +268,32 @@ static void do_something(pa_pstream *p) {
     p->mainloop->defer_enable(p->defer_event, 0);
 
     if (!p->dead && pa_iochannel_is_readable(p->io)) {
-        if (do_read(p) < 0)
+        if (do_read(p, &p->readio) < 0)
             goto fail;
     } else if (!p->dead && pa_iochannel_is_hungup(p->io))
         goto fail;
 
-    if (!p->dead && pa_iochannel_is_writable(p->io)) {
+    while (!p->dead && p->srb_read) {
+        if ((r = do_read(p, &p->readsrb)) < 0)
+            goto fail;
+
+        if (r == 0)
+            break;
+    }
+
+    if (!p->dead && p->srb_write) {
+
+        /* Writing to the ring never blocks, so we can keep going
+         * until it is full or we ran out of data */
+        while (!p->dead && p->srb_write) {
+            if ((r = do_write(p)) < 0)
+                goto fail;
+
+            if (r == 0)
+                break;
+        }
+
+    } else if (!p->dead && pa_iochannel_is_writable(p->io)) {
         if (do_write(p) < 0)
             goto fail;
     }
@@ -224,6 +331,67 @@ static void defer_callback(pa_mainloop_api *m, pa_defer_event *e, void*userdata)
     do_something(p);
 }
 
+static pa_bool_t srb_callback(pa_srbchannel *srb, void *userdata) {
+    pa_pstream *p = userdata;
+    pa_bool_t ret;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->srb == srb);
+
+    pa_pstream_ref(p);
+
+    do_something(p);
+
+    /* If we're the last one holding a reference the channel goes
+     * away with the stream */
+    ret = !p->dead && PA_REFCNT_VALUE(p) > 1;
+    pa_pstream_unref(p);
+
+    return ret;
+}
+
+/* Another thread sent something */
+static void fdsem_callback(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_pstream *p = userdata;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->fdsem_event == e);
+
+    pa_fdsem_after_poll(p->fdsem);
+
+    while (pa_fdsem_before_poll(p->fdsem) < 0)
+        ;
+
+    p->mainloop->defer_enable(p->defer_event, 1);
+}
+
+static void read_reset(struct pstream_read *re) {
+    pa_assert(re);
+
+    re->memblock = NULL;
+    re->packet = NULL;
+    re->index = 0;
+    re->data = NULL;
+    re->n_fds = 0;
+}
+
+static void read_free(struct pstream_read *re) {
+    unsigned i;
+
+    pa_assert(re);
+
+    if (re->memblock)
+        pa_memblock_unref(re->memblock);
+
+    if (re->packet)
+        pa_packet_unref(re->packet);
+
+    for (i = 0; i < re->n_fds; i++)
+        pa_close(re->fds[i]);
+}
+
 static void memimport_release_cb(pa_memimport *i, uint32_t block_id, void *userdata);
 
 pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *pool) {
@@ -244,13 +412,17 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     m->defer_enable(p->defer_event, 0);
 
     p->send_queue = pa_queue_new();
+    p->mutex = NULL;
+    p->fdsem = NULL;
+    p->fdsem_event = NULL;
+
+    p->write_first = p->n_write = 0;
+    p->write_index = 0;
+    read_reset(&p->readio);
+    read_reset(&p->readsrb);
 
-    p->write.current = NULL;
-    p->write.index = 0;
-    pa_memchunk_reset(&p->write.memchunk);
-    p->read.memblock = NULL;
-    p->read.packet = NULL;
-    p->read.index = 0;
+    p->srb = NULL;
+    p->srb_accept = p->srb_creator = p->srb_read = p->srb_write = FALSE;
 
     p->recieve_packet_callback = NULL;
     p->recieve_packet_callback_userdata = NULL;
@@ -269,6 +441,9 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
 
     p->use_shm = FALSE;
     p->export = NULL;
+    p->export_pool = pool;
+    p->use_memfd = FALSE;
+    p->n_memfd_ids = 0;
 
     /* We do importing unconditionally */
     p->import = pa_memimport_new(p->mempool, memimport_release_cb, p);
@@ -277,9 +452,10 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     pa_iochannel_socket_set_sndbuf(io, pa_mempool_block_size_max(p->mempool));
 
 #ifdef HAVE_CREDS
-    p->send_creds_now = FALSE;
     p->read_creds_valid = FALSE;
+    p->n_read_fds = 0;
 #endif
+
     return p;
 }
 
@@ -299,24 +475,87 @@ static void item_free(void *item, void *q) {
         pa_xfree(i);
 }
 
+static void queue_item(pa_pstream *p, struct item_info *i) {
+    pa_assert(p);
+    pa_assert(i);
+
+    if (p->mutex) {
+        pa_mutex_lock(p->mutex);
+        pa_queue_push(p->send_queue, i);
+        pa_mutex_unlock(p->mutex);
+    } else
+        pa_queue_push(p->send_queue, i);
+}
+
+/* Makes the thread of the main loop look at the send queue */
+static void wakeup(pa_pstream *p) {
+    pa_assert(p);
+
+    if (p->fdsem)
+        pa_fdsem_post(p->fdsem);
+    else
+        p->mainloop->defer_enable(p->defer_event, 1);
+}
+
+static inline struct pstream_write* write_slot(pa_pstream *p, unsigned i) {
+    return p->write + (p->write_first + i) % WRITE_FRAMES_MAX;
+}
+
+/* Drops the first of the prepared frames */
+static void write_done(pa_pstream *p) {
+    struct pstream_write *w;
+
+    pa_assert(p);
+    pa_assert(p->n_write > 0);
+
+    w = write_slot(p, 0);
+
+    item_free(w->current, NULL);
+    w->current = NULL;
+
+    if (w->memchunk.memblock)
+        pa_memblock_unref(w->memchunk.memblock);
+
+    pa_memchunk_reset(&w->memchunk);
+
+    p->write_first = (p->write_first + 1) % WRITE_FRAMES_MAX;
+    p->write_index = 0;
+
+    if (p->mutex) {
+        pa_mutex_lock(p->mutex);
+        p->n_write--;
+        pa_mutex_unlock(p->mutex);
+    } else
+        p->n_write--;
+}
+
 static void pstream_free(pa_pstream *p) {
+#ifdef HAVE_CREDS
+    unsigned i;
+#endif
+
     pa_assert(p);
 
     pa_pstream_unlink(p);
 
     pa_queue_free(p->send_queue, item_free, NULL);
 
-    if (p->write.current)
-        item_free(p->write.current, NULL);
+    while (p->n_write > 0)
+        write_done(p);
+
+    if (p->fdsem)
+        pa_fdsem_free(p->fdsem);
 
-    if (p->write.memchunk.memblock)
-        pa_memblock_unref(p->write.memchunk.memblock);
+    if (p->mutex)
+        pa_mutex_free(p->mutex);
 
-    if (p->read.memblock)
-        pa_memblock_unref(p->read.memblock);
+    read_free(&p->readio);
+    read_free(&p->readsrb);
 
-    if (p->read.packet)
-        pa_packet_unref(p->read.packet);
+#ifdef HAVE_CREDS
+    for (i = 0; i < p->n_read_fds; i++)
+        pa_close(p->read_fds[i]);
+#endif
 
     pa_xfree(p);
 }
@@ -337,14 +576,15 @@ void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, const pa_creds *cre
     i->type = PA_PSTREAM_ITEM_PACKET;
     i->packet = pa_packet_ref(packet);
 
+    i->srb_switch = FALSE;
 #ifdef HAVE_CREDS
     if ((i->with_creds = !!creds))
         i->creds = *creds;
+    i->n_fds = 0;
 #endif
 
-    pa_queue_push(p->send_queue, i);
-
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, i);
+    wakeup(p);
 }
 
 void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa_seek_mode_t seek_mode, const pa_memchunk *chunk) {
@@ -380,17 +620,19 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
         i->channel = channel;
         i->offset = offset;
         i->seek_mode = seek_mode;
+        i->srb_switch = FALSE;
 #ifdef HAVE_CREDS
         i->with_creds = FALSE;
+        i->n_fds = 0;
 #endif
 
-        pa_queue_push(p->send_queue, i);
+        queue_item(p, i);
 
         idx += n;
         length -= n;
     }
 
-    p->mainloop->defer_enable(p->defer_event, 1);
+    wakeup(p);
 }
 
 void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
@@ -407,12 +649,14 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
         item = pa_xnew(struct item_info, 1);
     item->type = PA_PSTREAM_ITEM_SHMRELEASE;
     item->block_id = block_id;
+    item->srb_switch = FALSE;
 #ifdef HAVE_CREDS
     item->with_creds = FALSE;
+    item->n_fds = 0;
 #endif
 
-    pa_queue_push(p->send_queue, item);
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, item);
+    wakeup(p);
 }
 
 /* might be called from thread context */
@@ -444,12 +688,14 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
         item = pa_xnew(struct item_info, 1);
     item->type = PA_PSTREAM_ITEM_SHMREVOKE;
     item->block_id = block_id;
+    item->srb_switch = FALSE;
 #ifdef HAVE_CREDS
     item->with_creds = FALSE;
+    item->n_fds = 0;
 #endif
 
-    pa_queue_push(p->send_queue, item);
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, item);
+    wakeup(p);
 }
 
 /* might be called from thread context */
@@ -465,53 +711,160 @@ static void memexport_revoke_cb(pa_memexport *e, uint32_t block_id, void *userda
         pa_pstream_send_revoke(p, block_id);
 }
 
-static void prepare_next_write_item(pa_pstream *p) {
+static void send_srbchannel(pa_pstream *p, pa_bool_t with_fds, pa_bool_t srb_switch) {
+    struct item_info *item;
+
+    pa_assert(p);
+    pa_assert(p->srb);
+
+    if (p->dead)
+        return;
+
+    if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
+        item = pa_xnew(struct item_info, 1);
+    item->type = PA_PSTREAM_ITEM_SRBCHANNEL;
+    item->srb_switch = srb_switch;
+#ifdef HAVE_CREDS
+    item->with_creds = FALSE;
+    item->n_fds = 0;
+
+    if (with_fds) {
+        pa_srbchannel_template t;
+
+        /* The fds stay owned by the channel, which lives at least as
+         * long as the item */
+        pa_srbchannel_export(p->srb, &t);
+        item->fds[0] = t.memfd;
+        item->fds[1] = t.eventfd[0];
+        item->fds[2] = t.eventfd[1];
+        item->n_fds = 3;
+    }
+#else
+    pa_assert(!with_fds);
+#endif
+
+    queue_item(p, item);
+    wakeup(p);
+}
+
+/* Makes sure the other side can map the segment an exported block
+ * lives in. The first block of every memfd segment takes the fd of
+ * the segment along. If the other side cannot learn about the
+ * segment the block is taken back and -1 returned, so that it is
+ * copied instead. */
+static int memfd_prepare(pa_pstream *p, struct pstream_write *w, uint32_t block_id, uint32_t shm_id) {
+#ifdef HAVE_MEMFD
+    unsigned i;
+    int fd;
+
+    pa_assert(p);
+    pa_assert(w);
+
+    /* POSIX SHM segments can be attached by id */
+    if ((fd = pa_memexport_get_memfd(p->export, shm_id)) < 0)
+        return 0;
+
+    for (i = 0; i < p->n_memfd_ids; i++)
+        if (p->memfd_ids[i] == shm_id)
+            return 0;
+
+    /* No fds can be passed through the ring buffer */
+    if (!p->use_memfd || p->n_memfd_ids >= MEMFD_IDS_MAX || p->srb_write) {
+        pa_memexport_process_release(p->export, block_id);
+        return -1;
+    }
+
+    p->memfd_ids[p->n_memfd_ids++] = shm_id;
+    w->fds[0] = fd;
+    w->n_fds = 1;
+#endif
+
+    return 0;
+}
+
+/* Takes the next item off the queue and turns it into a frame at the
+ * end of the prepared ones. Returns FALSE if there was nothing to
+ * prepare or no room for it. */
+static pa_bool_t prepare_next_write_item(pa_pstream *p) {
+    struct pstream_write *w;
+
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    p->write.current = pa_queue_pop(p->send_queue);
+    if (p->n_write >= WRITE_FRAMES_MAX)
+        return FALSE;
 
-    if (!p->write.current)
-        return;
+    /* Whatever follows our last frame on the socket goes to the ring
+     * buffer, so we can only prepare it once we switched */
+    if (p->n_write > 0 && write_slot(p, p->n_write - 1)->current->srb_switch)
+        return FALSE;
 
-    p->write.index = 0;
-    p->write.data = NULL;
-    pa_memchunk_reset(&p->write.memchunk);
+    w = write_slot(p, p->n_write);
 
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+    if (p->mutex)
+        pa_mutex_lock(p->mutex);
 
-    if (p->write.current->type == PA_PSTREAM_ITEM_PACKET) {
+    if ((w->current = pa_queue_pop(p->send_queue)))
+        p->n_write++;
 
-        pa_assert(p->write.current->packet);
-        p->write.data = p->write.current->packet->data;
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->packet->length);
+    if (p->mutex)
+        pa_mutex_unlock(p->mutex);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
+    if (!w->current)
+        return FALSE;
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+    w->data = NULL;
+    pa_memchunk_reset(&w->memchunk);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+#ifdef HAVE_CREDS
+    w->n_fds = 0;
+#endif
+
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+
+    if (w->current->type == PA_PSTREAM_ITEM_PACKET) {
+
+        pa_assert(w->current->packet);
+        w->data = w->current->packet->data;
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) w->current->packet->length);
+
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
+
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
+
+    } else if (w->current->type == PA_PSTREAM_ITEM_SRBCHANNEL) {
+
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SRBCHANNEL);
+
+#ifdef HAVE_CREDS
+        if (w->current->n_fds > 0) {
+            memcpy(w->fds, w->current->fds, sizeof(int) * w->current->n_fds);
+            w->n_fds = w->current->n_fds;
+        }
+#endif
 
     } else {
         uint32_t flags;
         pa_bool_t send_payload = TRUE;
 
-        pa_assert(p->write.current->type == PA_PSTREAM_ITEM_MEMBLOCK);
-        pa_assert(p->write.current->chunk.memblock);
+        pa_assert(w->current->type == PA_PSTREAM_ITEM_MEMBLOCK);
+        pa_assert(w->current->chunk.memblock);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(p->write.current->channel);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) p->write.current->offset) >> 32));
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) p->write.current->offset));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(w->current->channel);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) w->current->offset) >> 32));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) w->current->offset));
 
-        flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
+        flags = (uint32_t) (w->current->seek_mode & PA_FLAG_SEEKMASK);
 
         if (p->use_shm) {
             uint32_t block_id, shm_id;
@@ -520,182 +873,487 @@ static void prepare_next_write_item(pa_pstream *p) {
             pa_assert(p->export);
 
             if (pa_memexport_put(p->export,
-                                 p->write.current->chunk.memblock,
+                                 w->current->chunk.memblock,
                                  &block_id,
                                  &shm_id,
                                  &offset,
-                                 &length) >= 0) {
+                                 &length) >= 0 &&
+                memfd_prepare(p, w, block_id, shm_id) >= 0) {
 
                 flags |= PA_FLAG_SHMDATA;
                 send_payload = FALSE;
 
-                p->write.shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
-                p->write.shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
-                p->write.shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + p->write.current->chunk.index));
-                p->write.shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
+#ifdef HAVE_CREDS
+                if (w->n_fds > 0)
+                    flags |= PA_FLAG_SHMDATA_FD;
+#endif
+
+                w->shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
+                w->shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
+                w->shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + w->current->chunk.index));
+                w->shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) w->current->chunk.length);
 
-                p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(sizeof(p->write.shm_info));
-                p->write.data = p->write.shm_info;
+                w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(sizeof(w->shm_info));
+                w->data = w->shm_info;
             }
 /*             else */
 /*                 pa_log_warn("Failed to export memory block."); */
         }
 
         if (send_payload) {
-            p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
-            p->write.memchunk = p->write.current->chunk;
-            pa_memblock_ref(p->write.memchunk.memblock);
-            p->write.data = NULL;
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) w->current->chunk.length);
+            w->memchunk = w->current->chunk;
+            pa_memblock_ref(w->memchunk.memblock);
+            w->data = NULL;
         }
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
     }
 
 #ifdef HAVE_CREDS
-    if ((p->send_creds_now = p->write.current->with_creds))
-        p->write_creds = p->write.current->creds;
+    /* Credentials are only passed during authentication, long before
+     * we could have switched to the ring buffer */
+    if ((w->send_creds = w->current->with_creds && !p->srb_write))
+        w->creds = w->current->creds;
 #endif
+
+    return TRUE;
 }
 
+/* Returns 1 if something was written, 0 if there was nothing to
+ * write or no room for it */
 static int do_write(pa_pstream *p) {
-    void *d;
-    size_t l;
+    struct iovec iov[2*WRITE_FRAMES_MAX];
+    pa_memblock *acquired[WRITE_FRAMES_MAX];
+    unsigned n_iov = 0, n_acquired = 0, i;
+    size_t index;
     ssize_t r;
-    pa_memblock *release_memblock = NULL;
+    pa_bool_t done = FALSE;
+#ifdef HAVE_CREDS
+    struct pstream_write *ancil = NULL;
+#endif
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    if (!p->write.current)
-        prepare_next_write_item(p);
+    while (prepare_next_write_item(p))
+        ;
 
-    if (!p->write.current)
+    if (p->n_write <= 0)
         return 0;
 
-    if (p->write.index < PA_PSTREAM_DESCRIPTOR_SIZE) {
-        d = (uint8_t*) p->write.descriptor + p->write.index;
-        l = PA_PSTREAM_DESCRIPTOR_SIZE - p->write.index;
-    } else {
-        pa_assert(p->write.data || p->write.memchunk.memblock);
+    /* Gather what's left of all prepared frames */
+    index = p->write_index;
 
-        if (p->write.data)
-            d = p->write.data;
-        else {
-            d = (uint8_t*) pa_memblock_acquire(p->write.memchunk.memblock) + p->write.memchunk.index;
-            release_memblock = p->write.memchunk.memblock;
+    for (i = 0; i < p->n_write; i++) {
+        struct pstream_write *w = write_slot(p, i);
+        size_t length = ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+
+#ifdef HAVE_CREDS
+        if (w->send_creds || w->n_fds > 0) {
+
+            /* Ancillary data goes out with the first bytes of its
+             * frame, so such a frame starts a write of its own */
+            if (i > 0)
+                break;
+
+            pa_assert(!p->srb_write);
+            ancil = w;
+        }
+#endif
+
+        if (index < PA_PSTREAM_DESCRIPTOR_SIZE) {
+            iov[n_iov].iov_base = (uint8_t*) w->descriptor + index;
+            iov[n_iov].iov_len = PA_PSTREAM_DESCRIPTOR_SIZE - index;
+            n_iov++;
+            index = 0;
+        } else
+            index -= PA_PSTREAM_DESCRIPTOR_SIZE;
+
+#ifdef HAVE_CREDS
+        /* The credentials go with the descriptor alone */
+        if (w->send_creds) {
+            pa_assert(n_iov == 1);
+            break;
+        }
+#endif
+
+        if (length > 0) {
+            void *d;
+
+            pa_assert(w->data || w->memchunk.memblock);
+            pa_assert(index < length);
+
+            if (w->data)
+                d = w->data;
+            else {
+                d = (uint8_t*) pa_memblock_acquire(w->memchunk.memblock) + w->memchunk.index;
+                acquired[n_acquired++] = w->memchunk.memblock;
+            }
+
+            iov[n_iov].iov_base = (uint8_t*) d + index;
+            iov[n_iov].iov_len = length - index;
+            n_iov++;
         }
 
-        d = (uint8_t*) d + p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE;
-        l = ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE);
+        index = 0;
     }
 
-    pa_assert(l > 0);
+    pa_assert(n_iov > 0);
+
+    if (p->srb_write) {
+
+        /* Writing to the ring never blocks and never fails, we just
+         * stop where it is full */
+        r = 0;
+
+        for (i = 0; i < n_iov; i++) {
+            size_t n;
+
+            n = pa_srbchannel_write(p->srb, iov[i].iov_base, iov[i].iov_len);
+            r += (ssize_t) n;
+
+            if (n < iov[i].iov_len)
+                break;
+        }
+
+    } else
 
 #ifdef HAVE_CREDS
-    if (p->send_creds_now) {
+    if (ancil && ancil->send_creds) {
 
-        if ((r = pa_iochannel_write_with_creds(p->io, d, l, &p->write_creds)) < 0)
-            goto fail;
+        if ((r = pa_iochannel_write_with_creds(p->io, iov[0].iov_base, iov[0].iov_len, &ancil->creds)) >= 0)
+            ancil->send_creds = FALSE;
+
+    } else if (ancil) {
+
+        if ((r = pa_iochannel_writev_with_fds(p->io, iov, n_iov, ancil->fds, ancil->n_fds)) >= 0)
+            ancil->n_fds = 0;
 
-        p->send_creds_now = FALSE;
     } else
 #endif
 
-    if ((r = pa_iochannel_write(p->io, d, l)) < 0)
+        r = pa_iochannel_writev(p->io, iov, n_iov);
+
+    for (i = 0; i < n_acquired; i++)
+        pa_memblock_release(acquired[i]);
+
+    if (r < 0)
+        return -1;
+
+    if (r == 0 && p->srb_write)
+        return 0;
+
+    /* Now drop all frames that went out completely */
+    while (r > 0) {
+        struct pstream_write *w = write_slot(p, 0);
+        size_t left;
+
+        left = PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - p->write_index;
+
+        if ((size_t) r < left) {
+            p->write_index += (size_t) r;
+            break;
+        }
+
+        r -= (ssize_t) left;
+
+        /* This was our last frame on the socket */
+        if (w->current->srb_switch) {
+            pa_assert(p->srb);
+            pa_assert(r == 0);
+            p->srb_write = TRUE;
+        }
+
+        write_done(p);
+        done = TRUE;
+    }
+
+    if (done && p->drain_callback && !pa_pstream_is_pending(p))
+        p->drain_callback(p, p->drain_callback_userdata);
+
+    return 1;
+}
+
+static int handle_srbchannel(pa_pstream *p, struct pstream_read *re) {
+    pa_assert(p);
+    pa_assert(re);
+
+    if (re == &p->readsrb ||
+        ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) != 0 ||
+        ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]) != (uint32_t) -1)
         goto fail;
 
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
+#ifdef HAVE_CREDS
+    if (re->n_fds == 3) {
+        pa_srbchannel_template t;
 
-    p->write.index += (size_t) r;
+        /* The other side offers us a channel */
+        if (!p->srb_accept || p->srb)
+            goto fail;
 
-    if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) {
-        pa_assert(p->write.current);
-        item_free(p->write.current, NULL);
-        p->write.current = NULL;
+        p->srb_accept = FALSE;
 
-        if (p->write.memchunk.memblock)
-            pa_memblock_unref(p->write.memchunk.memblock);
+        t.memfd = re->fds[0];
+        t.eventfd[0] = re->fds[1];
+        t.eventfd[1] = re->fds[2];
+        re->n_fds = 0;
 
-        pa_memchunk_reset(&p->write.memchunk);
+        if (!(p->srb = pa_srbchannel_new_from_template(p->mainloop, &t))) {
+            /* We just stay on the socket, the other side will never
+             * hear back from us */
+            pa_log_warn("Failed to open ring buffer channel.");
+            return 0;
+        }
 
-        if (p->drain_callback && !pa_pstream_is_pending(p))
-            p->drain_callback(p, p->drain_callback_userdata);
+        pa_srbchannel_set_callback(p->srb, srb_callback, p);
+        send_srbchannel(p, FALSE, TRUE);
+        return 0;
     }
+#endif
 
-    return 0;
+    if (re->n_fds != 0 || !p->srb || p->srb_read)
+        goto fail;
 
-fail:
+    if (p->srb_creator) {
+        /* The other side took the channel and won't write anything
+         * to the socket anymore. Let's follow. */
+        p->srb_read = TRUE;
+        send_srbchannel(p, FALSE, TRUE);
 
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
+    } else if (p->srb_write) {
+        /* This was the last frame on the socket */
+        p->srb_read = TRUE;
+
+    } else
+        goto fail;
 
+    pa_log_debug("Switched to ring buffer channel.");
+    return 0;
+
+fail:
+    pa_log_warn("Received invalid ring buffer channel frame.");
     return -1;
 }
 
-static int do_read(pa_pstream *p) {
-    void *d;
-    size_t l;
-    ssize_t r;
-    pa_memblock *release_memblock = NULL;
-    pa_assert(p);
-    pa_assert(PA_REFCNT_VALUE(p) > 0);
+/* Where the next bytes of the current frame go */
+static void read_target(struct pstream_read *re, void **d, size_t *l, pa_memblock **acquired) {
+    pa_assert(re);
+    pa_assert(d);
+    pa_assert(l);
+    pa_assert(acquired);
+
+    *acquired = NULL;
 
-    if (p->read.index < PA_PSTREAM_DESCRIPTOR_SIZE) {
-        d = (uint8_t*) p->read.descriptor + p->read.index;
-        l = PA_PSTREAM_DESCRIPTOR_SIZE - p->read.index;
+    if (re->index < PA_PSTREAM_DESCRIPTOR_SIZE) {
+        *d = (uint8_t*) re->descriptor + re->index;
+        *l = PA_PSTREAM_DESCRIPTOR_SIZE - re->index;
     } else {
-        pa_assert(p->read.data || p->read.memblock);
+        pa_assert(re->data || re->memblock);
 
-        if (p->read.data)
-            d = p->read.data;
+        if (re->data)
+            *d = re->data;
         else {
-            d = pa_memblock_acquire(p->read.memblock);
-            release_memblock = p->read.memblock;
+            *d = pa_memblock_acquire(re->memblock);
+            *acquired = re->memblock;
         }
 
-        d = (uint8_t*) d + p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE;
-        l = ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE);
+        *d = (uint8_t*) *d + re->index - PA_PSTREAM_DESCRIPTOR_SIZE;
+        *l = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (re->index - PA_PSTREAM_DESCRIPTOR_SIZE);
     }
+}
+
+static ssize_t read_io(pa_pstream *p, void *d, size_t l, pa_bool_t *creds) {
+    ssize_t r;
+#ifdef HAVE_CREDS
+    int fds[PA_IOCHANNEL_FDS_MAX];
+    unsigned n_fds = 0, i;
+#endif
+
+    pa_assert(p);
+    pa_assert(creds);
+
+    *creds = FALSE;
 
 #ifdef HAVE_CREDS
-    {
-        pa_bool_t b = 0;
+    /* We always take fds, since with several frames per read we might
+     * not know yet that we are going to need them. They are matched
+     * to their frames later on. */
+    if ((r = pa_iochannel_read_with_ancil(p->io, d, l, &p->read_creds, creds, fds, &n_fds)) <= 0)
+        return r;
 
-        if ((r = pa_iochannel_read_with_creds(p->io, d, l, &p->read_creds, &b)) <= 0)
-            goto fail;
+    if (n_fds > READ_FDS_MAX - p->n_read_fds) {
+        pa_log_warn("Received too many file descriptors.");
+
+        for (i = 0; i < n_fds; i++)
+            pa_close(fds[i]);
 
-        p->read_creds_valid = p->read_creds_valid || b;
+        return -1;
     }
+
+    for (i = 0; i < n_fds; i++)
+        p->read_fds[p->n_read_fds++] = fds[i];
 #else
-    if ((r = pa_iochannel_read(p->io, d, l)) <= 0)
-        goto fail;
+    r = pa_iochannel_read(p->io, d, l);
+#endif
+
+    return r;
+}
+
+#ifdef HAVE_CREDS
+/* Hands the oldest n fds that came in on the socket to the frame. They
+ * arrive together with the first bytes of their frame at the latest. */
+static int claim_fds(pa_pstream *p, struct pstream_read *re, unsigned n) {
+    pa_assert(p);
+    pa_assert(re);
+    pa_assert(n <= FDS_MAX);
+    pa_assert(re->n_fds == 0);
+
+    if (re != &p->readio || p->n_read_fds < n)
+        return -1;
+
+    memcpy(re->fds, p->read_fds, sizeof(int) * n);
+    re->n_fds = n;
+
+    p->n_read_fds -= n;
+    memmove(p->read_fds, p->read_fds + n, sizeof(int) * p->n_read_fds);
+
+    return 0;
+}
+#endif
+
+static int read_advance(pa_pstream *p, struct pstream_read *re, size_t r);
+
+/* Returns 1 if something was read, 0 if the ring buffer was empty */
+static int do_read(pa_pstream *p, struct pstream_read *re) {
+    void *d;
+    size_t l, k;
+    ssize_t r;
+    pa_bool_t creds;
+    pa_memblock *acquired;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(re);
+
+    read_target(re, &d, &l, &acquired);
+
+    if (re == &p->readsrb) {
+
+        r = (ssize_t) pa_srbchannel_read(p->srb, d, l);
+
+        if (acquired)
+            pa_memblock_release(acquired);
+
+        if (r == 0)
+            return 0;
+
+        return read_advance(p, re, (size_t) r) < 0 ? -1 : 1;
+    }
+
+    /* Large payloads are read in place */
+    if (l >= READ_BUFFER_SIZE) {
+
+        r = read_io(p, d, l, &creds);
+
+        if (acquired)
+            pa_memblock_release(acquired);
+
+        if (r <= 0)
+            return -1;
+
+#ifdef HAVE_CREDS
+        p->read_creds_valid = p->read_creds_valid || creds;
 #endif
 
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
+        return read_advance(p, re, (size_t) r) < 0 ? -1 : 1;
+    }
+
+    if (acquired)
+        pa_memblock_release(acquired);
 
-    p->read.index += (size_t) r;
+    /* Everything else we read into our buffer, as much as we can get
+     * in one go, and then hand it out frame by frame */
+    if ((r = read_io(p, p->read_buffer, sizeof(p->read_buffer), &creds)) <= 0)
+        return -1;
 
-    if (p->read.index == PA_PSTREAM_DESCRIPTOR_SIZE) {
+    for (k = 0; k < (size_t) r && !p->dead; k += l) {
+
+        read_target(re, &d, &l, &acquired);
+
+        l = PA_MIN(l, (size_t) r - k);
+        memcpy(d, p->read_buffer + k, l);
+
+        if (acquired)
+            pa_memblock_release(acquired);
+
+#ifdef HAVE_CREDS
+        p->read_creds_valid = p->read_creds_valid || creds;
+#endif
+
+        if (read_advance(p, re, l) < 0)
+            return -1;
+    }
+
+    return 1;
+}
+
+/* Processes r bytes that were just added to the current frame */
+static int read_advance(pa_pstream *p, struct pstream_read *re, size_t r) {
+    unsigned i;
+    size_t l;
+
+    pa_assert(p);
+    pa_assert(re);
+    pa_assert(r > 0);
+
+    re->index += r;
+
+    if (re->index == PA_PSTREAM_DESCRIPTOR_SIZE) {
         uint32_t flags, length, channel;
         /* Reading of frame descriptor complete */
 
-        flags = ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]);
+        flags = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]);
+
+        if (flags == PA_FLAG_SRBCHANNEL) {
+
+#ifdef HAVE_CREDS
+            /* An offer comes with the fds of the channel */
+            if (re == &p->readio && p->srb_accept && !p->srb && claim_fds(p, re, 3) < 0) {
+                pa_log_warn("Received ring buffer channel frame without file descriptors.");
+                return -1;
+            }
+#endif
+
+            if (handle_srbchannel(p, re) < 0)
+                return -1;
+
+            goto frame_done;
+        }
 
         if (!p->use_shm && (flags & PA_FLAG_SHMMASK) != 0) {
             pa_log_warn("Received SHM frame on a socket where SHM is disabled.");
             return -1;
         }
 
+        if ((flags & PA_FLAG_SHMMASK) == PA_FLAG_SHMDATA_FD) {
+#ifdef HAVE_CREDS
+            if (!p->use_memfd || claim_fds(p, re, 1) < 0)
+#endif
+            {
+                pa_log_warn("Received SHM frame with missing file descriptor.");
+                return -1;
+            }
+        }
+
         if (flags == PA_FLAG_SHMRELEASE) {
 
             /* This is a SHM memblock release frame with no payload */
 
-/*             pa_log("Got release frame for %u", ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])); */
+/*             pa_log("Got release frame for %u", ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])); */
 
             pa_assert(p->export);
-            pa_memexport_process_release(p->export, ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI]));
+            pa_memexport_process_release(p->export, ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI]));
 
             goto frame_done;
 
@@ -703,24 +1361,24 @@ static int do_read(pa_pstream *p) {
 
             /* This is a SHM memblock revoke frame with no payload */
 
-/*             pa_log("Got revoke frame for %u", ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])); */
+/*             pa_log("Got revoke frame for %u", ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])); */
 
             pa_assert(p->import);
-            pa_memimport_process_revoke(p->import, ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI]));
+            pa_memimport_process_revoke(p->import, ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI]));
 
             goto frame_done;
         }
 
-        length = ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+        length = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
 
         if (length > FRAME_SIZE_MAX_ALLOW || length <= 0) {
             pa_log_warn("Received invalid frame size: %lu", (unsigned long) length);
             return -1;
         }
 
-        pa_assert(!p->read.packet && !p->read.memblock);
+        pa_assert(!re->packet && !re->memblock);
 
-        channel = ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]);
+        channel = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]);
 
         if (channel == (uint32_t) -1) {
 
@@ -730,8 +1388,8 @@ static int do_read(pa_pstream *p) {
             }
 
             /* Frame is a packet frame */
-            p->read.packet = pa_packet_new(length);
-            p->read.data = p->read.packet->data;
+            re->packet = pa_packet_new(length);
+            re->data = re->packet->data;
 
         } else {
 
@@ -740,22 +1398,23 @@ static int do_read(pa_pstream *p) {
                 return -1;
             }
 
-            if ((flags & PA_FLAG_SHMMASK) == PA_FLAG_SHMDATA) {
+            if ((flags & PA_FLAG_SHMMASK) == PA_FLAG_SHMDATA ||
+                (flags & PA_FLAG_SHMMASK) == PA_FLAG_SHMDATA_FD) {
 
-                if (length != sizeof(p->read.shm_info)) {
+                if (length != sizeof(re->shm_info)) {
                     pa_log_warn("Received SHM memblock frame with Invalid frame length.");
                     return -1;
                 }
 
                 /* Frame is a memblock frame referencing an SHM memblock */
-                p->read.data = p->read.shm_info;
+                re->data = re->shm_info;
 
             } else if ((flags & PA_FLAG_SHMMASK) == 0) {
 
                 /* Frame is a memblock frame */
 
-                p->read.memblock = pa_memblock_new(p->mempool, length);
-                p->read.data = NULL;
+                re->memblock = pa_memblock_new(p->mempool, length);
+                re->data = NULL;
             } else {
 
                 pa_log_warn("Received memblock frame with invalid flags value.");
@@ -763,74 +1422,86 @@ static int do_read(pa_pstream *p) {
             }
         }
 
-    } else if (p->read.index > PA_PSTREAM_DESCRIPTOR_SIZE) {
+    } else if (re->index > PA_PSTREAM_DESCRIPTOR_SIZE) {
         /* Frame payload available */
 
-        if (p->read.memblock && p->recieve_memblock_callback) {
+        if (re->memblock && p->recieve_memblock_callback) {
 
             /* Is this memblock data? Than pass it to the user */
-            l = (p->read.index - (size_t) r) < PA_PSTREAM_DESCRIPTOR_SIZE ? (size_t) (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE) : (size_t) r;
+            l = (re->index - r) < PA_PSTREAM_DESCRIPTOR_SIZE ? (size_t) (re->index - PA_PSTREAM_DESCRIPTOR_SIZE) : r;
 
             if (l > 0) {
                 pa_memchunk chunk;
 
-                chunk.memblock = p->read.memblock;
-                chunk.index = p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE - l;
+                chunk.memblock = re->memblock;
+                chunk.index = re->index - PA_PSTREAM_DESCRIPTOR_SIZE - l;
                 chunk.length = l;
 
                 if (p->recieve_memblock_callback) {
                     int64_t offset;
 
                     offset = (int64_t) (
-                            (((uint64_t) ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) << 32) |
-                            (((uint64_t) ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO]))));
+                            (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) << 32) |
+                            (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO]))));
 
                     p->recieve_memblock_callback(
                         p,
-                        ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]),
+                        ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]),
                         offset,
-                        ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SEEKMASK,
+                        ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SEEKMASK,
                         &chunk,
                         p->recieve_memblock_callback_userdata);
                 }
 
                 /* Drop seek info for following callbacks */
-                p->read.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] =
-                    p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] =
-                    p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
+                re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] =
+                    re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] =
+                    re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
             }
         }
 
         /* Frame complete */
-        if (p->read.index >= ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) + PA_PSTREAM_DESCRIPTOR_SIZE) {
+        if (re->index >= ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) + PA_PSTREAM_DESCRIPTOR_SIZE) {
 
-            if (p->read.memblock) {
+            if (re->memblock) {
 
                 /* This was a memblock frame. We can unref the memblock now */
-                pa_memblock_unref(p->read.memblock);
+                pa_memblock_unref(re->memblock);
 
-            } else if (p->read.packet) {
+            } else if (re->packet) {
 
                 if (p->recieve_packet_callback)
 #ifdef HAVE_CREDS
-                    p->recieve_packet_callback(p, p->read.packet, p->read_creds_valid ? &p->read_creds : NULL, p->recieve_packet_callback_userdata);
+                    p->recieve_packet_callback(p, re->packet, p->read_creds_valid ? &p->read_creds : NULL, p->recieve_packet_callback_userdata);
 #else
-                    p->recieve_packet_callback(p, p->read.packet, NULL, p->recieve_packet_callback_userdata);
+                    p->recieve_packet_callback(p, re->packet, NULL, p->recieve_packet_callback_userdata);
 #endif
 
-                pa_packet_unref(p->read.packet);
+                pa_packet_unref(re->packet);
             } else {
                 pa_memblock *b;
+                uint32_t flags;
 
-                pa_assert((ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SHMMASK) == PA_FLAG_SHMDATA);
+                flags = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SHMMASK;
+                pa_assert(flags == PA_FLAG_SHMDATA || flags == PA_FLAG_SHMDATA_FD);
 
                 pa_assert(p->import);
 
+                if (flags == PA_FLAG_SHMDATA_FD) {
+                    pa_assert(re->n_fds == 1);
+
+                    /* This takes over the fd */
+                    if (pa_memimport_attach_memfd(p->import, ntohl(re->shm_info[PA_PSTREAM_SHM_SHMID]), re->fds[0]) < 0)
+                        pa_log_warn("Failed to attach memfd segment.");
+
+                    re->n_fds = 0;
+                }
+
                 if (!(b = pa_memimport_get(p->import,
-                                          ntohl(p->read.shm_info[PA_PSTREAM_SHM_BLOCKID]),
-                                          ntohl(p->read.shm_info[PA_PSTREAM_SHM_SHMID]),
-                                          ntohl(p->read.shm_info[PA_PSTREAM_SHM_INDEX]),
-                                          ntohl(p->read.shm_info[PA_PSTREAM_SHM_LENGTH])))) {
+                                          ntohl(re->shm_info[PA_PSTREAM_SHM_BLOCKID]),
+                                          ntohl(re->shm_info[PA_PSTREAM_SHM_SHMID]),
+                                          ntohl(re->shm_info[PA_PSTREAM_SHM_INDEX]),
+                                          ntohl(re->shm_info[PA_PSTREAM_SHM_LENGTH])))) {
 
                     if (pa_log_ratelimit())
                         pa_log_debug("Failed to import memory block.");
@@ -842,17 +1513,17 @@ static int do_read(pa_pstream *p) {
 
                     chunk.memblock = b;
                     chunk.index = 0;
-                    chunk.length = b ? pa_memblock_get_length(b) : ntohl(p->read.shm_info[PA_PSTREAM_SHM_LENGTH]);
+                    chunk.length = b ? pa_memblock_get_length(b) : ntohl(re->shm_info[PA_PSTREAM_SHM_LENGTH]);
 
                     offset = (int64_t) (
-                            (((uint64_t) ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) << 32) |
-                            (((uint64_t) ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO]))));
+                            (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) << 32) |
+                            (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO]))));
 
                     p->recieve_memblock_callback(
                             p,
-                            ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]),
+                            ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]),
                             offset,
-                            ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SEEKMASK,
+                            ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SEEKMASK,
                             &chunk,
                             p->recieve_memblock_callback_userdata);
                 }
@@ -868,22 +1539,16 @@ static int do_read(pa_pstream *p) {
     return 0;
 
 frame_done:
-    p->read.memblock = NULL;
-    p->read.packet = NULL;
-    p->read.index = 0;
-    p->read.data = NULL;
+    for (i = 0; i < re->n_fds; i++)
+        pa_close(re->fds[i]);
+
+    read_reset(re);
 
 #ifdef HAVE_CREDS
     p->read_creds_valid = FALSE;
 #endif
 
     return 0;
-
-fail:
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
-
-    return -1;
 }
 
 void pa_pstream_set_die_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void *userdata) {
@@ -941,9 +1606,15 @@ pa_bool_t pa_pstream_is_pending(pa_pstream *p) {
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
     if (p->dead)
-        b = FALSE;
-    else
-        b = p->write.current || !pa_queue_isempty(p->send_queue);
+        return FALSE;
+
+    if (p->mutex)
+        pa_mutex_lock(p->mutex);
+
+    b = p->n_write > 0 || !pa_queue_isempty(p->send_queue);
+
+    if (p->mutex)
+        pa_mutex_unlock(p->mutex);
 
     return b;
 }
@@ -987,11 +1658,22 @@ void pa_pstream_unlink(pa_pstream *p) {
         p->io = NULL;
     }
 
+    if (p->srb) {
+        pa_srbchannel_free(p->srb);
+        p->srb = NULL;
+        p->srb_read = p->srb_write = FALSE;
+    }
+
     if (p->defer_event) {
         p->mainloop->defer_free(p->defer_event);
         p->defer_event = NULL;
     }
 
+    if (p->fdsem_event) {
+        p->mainloop->io_free(p->fdsem_event);
+        p->fdsem_event = NULL;
+    }
+
     p->die_callback = NULL;
     p->drain_callback = NULL;
     p->recieve_packet_callback = NULL;
@@ -1007,7 +1689,7 @@ void pa_pstream_enable_shm(pa_pstream *p, pa_bool_t enable) {
     if (enable) {
 
         if (!p->export)
-            p->export = pa_memexport_new(p->mempool, memexport_revoke_cb, p);
+            p->export = pa_memexport_new(p->export_pool, memexport_revoke_cb, p);
 
     } else {
 
@@ -1018,9 +1700,72 @@ void pa_pstream_enable_shm(pa_pstream *p, pa_bool_t enable) {
     }
 }
 
+void pa_pstream_enable_memfd(pa_pstream *p, pa_mempool *pool) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+#ifdef HAVE_MEMFD
+    p->use_memfd = TRUE;
+
+    if (pool && pool != p->export_pool) {
+        pa_assert(pa_mempool_is_memfd_backed(pool));
+        p->export_pool = pool;
+
+        if (p->export) {
+            pa_memexport_free(p->export);
+            p->export = pa_memexport_new(p->export_pool, memexport_revoke_cb, p);
+        }
+    }
+#endif
+}
+
+void pa_pstream_enable_srbchannel(pa_pstream *p, pa_bool_t create) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    if (p->dead || p->srb)
+        return;
+
+#ifdef HAVE_CREDS
+    if (!create) {
+        p->srb_accept = TRUE;
+        return;
+    }
+
+    if (!(p->srb = pa_srbchannel_new(p->mainloop)))
+        return;
+
+    p->srb_creator = TRUE;
+    pa_srbchannel_set_callback(p->srb, srb_callback, p);
+    send_srbchannel(p, TRUE, FALSE);
+#endif
+}
+
+void pa_pstream_enable_threaded_send(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(!p->mutex);
+
+    if (p->dead)
+        return;
+
+    p->mutex = pa_mutex_new(FALSE, FALSE);
+    pa_assert_se(p->fdsem = pa_fdsem_new());
+
+    pa_assert_se(pa_fdsem_before_poll(p->fdsem) >= 0);
+    p->fdsem_event = p->mainloop->io_new(p->mainloop, pa_fdsem_get(p->fdsem), PA_IO_EVENT_INPUT, fdsem_callback, p);
+}
+
 pa_bool_t pa_pstream_get_shm(pa_pstream *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
     return p->use_shm;
 }
+
+pa_srbchannel* pa_pstream_get_srbchannel(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    return p->srb;
+}
@@ -30,6 +30,7 @@
 
 #include <pulsecore/packet.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/srbchannel.h>
 #include <pulsecore/iochannel.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/creds.h>
@@ -63,7 +64,27 @@ void pa_pstream_set_revoke_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb,
 
 pa_bool_t pa_pstream_is_pending(pa_pstream *p);
 
+/* Allows the sending functions and pa_pstream_is_pending() to be
+ * called from any thread, not only from the one running the main loop
+ * the stream was created for. Everything else, including all
+ * callbacks, stays in that thread. Call this from there before handing
+ * the stream to other threads. */
+void pa_pstream_enable_threaded_send(pa_pstream *p);
+
 void pa_pstream_enable_shm(pa_pstream *p, pa_bool_t enable);
 pa_bool_t pa_pstream_get_shm(pa_pstream *p);
 
+/* Pass memfd segments along with the first block exported from them.
+ * If pool is not NULL, blocks are exported from it instead of the
+ * pool the pstream was created with. */
+void pa_pstream_enable_memfd(pa_pstream *p, pa_mempool *pool);
+
+/* Move all further traffic to a ring buffer in shared memory, see
+ * srbchannel.h. One side creates it, the other one has to accept
+ * it. This falls back to the socket silently if anything fails. */
+void pa_pstream_enable_srbchannel(pa_pstream *p, pa_bool_t create);
+
+/* Returns NULL while there is no ring buffer (yet) */
+pa_srbchannel* pa_pstream_get_srbchannel(pa_pstream *p);
+
 #endif
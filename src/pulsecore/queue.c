@@ -31,7 +31,7 @@
 
 #include "queue.h"
 
-PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(entries, 0, 32, pa_xfree);
 
 struct queue_entry {
     struct queue_entry *next;
@@ -0,0 +1,295 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/sample.h>
+#include <pulsecore/random.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-arm.h"
+#include "remap.h"
+
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#include <arm_neon.h>
+
+static void remap_mono_to_stereo_neon (pa_remap_t *m, void *dst, const void *src, unsigned n) {
+    unsigned i;
+
+    switch (*m->format) {
+        case PA_SAMPLE_FLOAT32NE:
+        {
+            float *d = (float *) dst;
+            const float *s = (const float *) src;
+
+            for (i = n >> 2; i; i--) {
+                float32x4x2_t t;
+
+                t.val[0] = t.val[1] = vld1q_f32(s);
+                vst2q_f32(d, t);
+
+                s += 4;
+                d += 8;
+            }
+            for (i = n & 3; i; i--) {
+                d[0] = d[1] = s[0];
+                s++;
+                d += 2;
+            }
+            break;
+        }
+        case PA_SAMPLE_S16NE:
+        {
+            int16_t *d = (int16_t *) dst;
+            const int16_t *s = (const int16_t *) src;
+
+            for (i = n >> 3; i; i--) {
+                int16x8x2_t t;
+
+                t.val[0] = t.val[1] = vld1q_s16(s);
+                vst2q_s16(d, t);
+
+                s += 8;
+                d += 16;
+            }
+            for (i = n & 7; i; i--) {
+                d[0] = d[1] = s[0];
+                s++;
+                d += 2;
+            }
+            break;
+        }
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+/* Does what remap_channels_matrix_c() does for one output and two input
+ * channels: each input is added as is for volumes >= 1, scaled for
+ * volumes between 0 and 1 and skipped otherwise. The S16 sum wraps
+ * around, like it does in the C version. */
+
+static inline float32x4_t remap_term_f32 (float32x4_t s, float vol) {
+    if (vol <= 0.0)
+        return vdupq_n_f32(0.0f);
+    if (vol >= 1.0)
+        return s;
+    return vmulq_f32(s, vdupq_n_f32(vol));
+}
+
+static inline int16x4_t remap_term_s16 (int16x4_t s, int32_t vol) {
+    if (vol <= 0)
+        return vdup_n_s16(0);
+    if (vol >= 0x10000)
+        return s;
+    return vmovn_s32(vshrq_n_s32(vmulq_s32(vmovl_s16(s), vdupq_n_s32(vol)), 16));
+}
+
+static void remap_stereo_to_mono_neon (pa_remap_t *m, void *dst, const void *src, unsigned n) {
+    unsigned i;
+
+    switch (*m->format) {
+        case PA_SAMPLE_FLOAT32NE:
+        {
+            const float32x4_t zero = vdupq_n_f32(0.0f);
+            float v0 = m->map_table_f[0][0], v1 = m->map_table_f[0][1];
+            float *d = (float *) dst;
+            const float *s = (const float *) src;
+
+            for (i = n >> 2; i; i--) {
+                float32x4x2_t t = vld2q_f32(s);
+                float32x4_t r;
+
+                /* start from 0 like the C version, so -0.0 comes out
+                 * the same */
+                r = vaddq_f32(zero, remap_term_f32(t.val[0], v0));
+                r = vaddq_f32(r, remap_term_f32(t.val[1], v1));
+                vst1q_f32(d, r);
+
+                s += 8;
+                d += 4;
+            }
+            for (i = n & 3; i; i--) {
+                float r = 0.0f;
+
+                if (v0 > 0.0)
+                    r += v0 >= 1.0 ? s[0] : s[0] * v0;
+                if (v1 > 0.0)
+                    r += v1 >= 1.0 ? s[1] : s[1] * v1;
+                *d = r;
+
+                s += 2;
+                d++;
+            }
+            break;
+        }
+        case PA_SAMPLE_S16NE:
+        {
+            int32_t v0 = m->map_table_i[0][0], v1 = m->map_table_i[0][1];
+            int16_t *d = (int16_t *) dst;
+            const int16_t *s = (const int16_t *) src;
+
+            for (i = n >> 2; i; i--) {
+                int16x4x2_t t = vld2_s16(s);
+
+                vst1_s16(d, vadd_s16(remap_term_s16(t.val[0], v0), remap_term_s16(t.val[1], v1)));
+
+                s += 8;
+                d += 4;
+            }
+            for (i = n & 3; i; i--) {
+                int16_t r = 0;
+
+                if (v0 > 0)
+                    r += v0 >= 0x10000 ? s[0] : (int16_t) (((int32_t) s[0] * v0) >> 16);
+                if (v1 > 0)
+                    r += v1 >= 0x10000 ? s[1] : (int16_t) (((int32_t) s[1] * v1) >> 16);
+                *d = r;
+
+                s += 2;
+                d++;
+            }
+            break;
+        }
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+#undef RUN_TEST
+
+#ifdef RUN_TEST
+#define SAMPLES 1019
+#define TIMES 1000
+
+static void run_test (void) {
+    float floats[2 * SAMPLES], floats_ref[2 * SAMPLES], floats_src[2 * SAMPLES];
+    int16_t samples[2 * SAMPLES], samples_ref[2 * SAMPLES], samples_src[2 * SAMPLES];
+    void *d, *d_ref, *s;
+    size_t size;
+    pa_sample_spec iss, oss;
+    pa_sample_format_t format;
+    pa_remap_t remap, remap_neon;
+    unsigned i, j;
+    pa_usec_t start, stop;
+
+    printf ("checking NEON %zd\n", sizeof (samples));
+
+    pa_random (samples_src, sizeof (samples_src));
+    for (i = 0; i < 2 * SAMPLES; i++)
+        floats_src[i] = (float) samples_src[i] / (float) 0x7FFF;
+
+    iss.rate = oss.rate = 44100;
+
+    /* mono to stereo and stereo to mono, for float and S16 */
+    for (i = 0; i < 4; i++) {
+        format = (i & 1) ? PA_SAMPLE_S16NE : PA_SAMPLE_FLOAT32NE;
+        iss.format = oss.format = format;
+        iss.channels = (i & 2) ? 2 : 1;
+        oss.channels = (i & 2) ? 1 : 2;
+
+        memset (&remap, 0, sizeof (remap));
+        remap.format = &format;
+        remap.i_ss = &iss;
+        remap.o_ss = &oss;
+        remap.map_table_f[0][0] = remap.map_table_f[1][0] = (i & 2) ? 0.5f : 1.0f;
+        remap.map_table_f[0][1] = (i & 2) ? 0.5f : 0.0f;
+        remap.map_table_i[0][0] = remap.map_table_i[1][0] = (i & 2) ? 0x8000 : 0x10000;
+        remap.map_table_i[0][1] = (i & 2) ? 0x8000 : 0;
+
+        pa_init_remap (&remap);
+
+        remap_neon = remap;
+        remap_neon.do_remap = (i & 2) ?
+            (pa_do_remap_func_t) remap_stereo_to_mono_neon :
+            (pa_do_remap_func_t) remap_mono_to_stereo_neon;
+
+        if (format == PA_SAMPLE_FLOAT32NE) {
+            d = floats;
+            d_ref = floats_ref;
+            s = floats_src;
+        } else {
+            d = samples;
+            d_ref = samples_ref;
+            s = samples_src;
+        }
+        size = SAMPLES * oss.channels * pa_sample_size_of_format (format);
+
+        remap.do_remap (&remap, d_ref, s, SAMPLES);
+        remap_neon.do_remap (&remap_neon, d, s, SAMPLES);
+        if (memcmp (d, d_ref, size) != 0)
+            printf ("%s %u -> %u: NEON result differs from reference\n",
+                    pa_sample_format_to_string (format), iss.channels, oss.channels);
+
+        start = pa_rtclock_now();
+        for (j = 0; j < TIMES; j++)
+            remap_neon.do_remap (&remap_neon, d, s, SAMPLES);
+        stop = pa_rtclock_now();
+        pa_log_info("NEON: %llu usec.", (long long unsigned int)(stop - start));
+
+        start = pa_rtclock_now();
+        for (j = 0; j < TIMES; j++)
+            remap.do_remap (&remap, d_ref, s, SAMPLES);
+        stop = pa_rtclock_now();
+        pa_log_info("ref: %llu usec.", (long long unsigned int)(stop - start));
+    }
+}
+#endif
+
+/* set the function that will execute the remapping based on the matrices */
+static void init_remap_neon (pa_remap_t *m) {
+    unsigned n_oc, n_ic;
+
+    n_oc = m->o_ss->channels;
+    n_ic = m->i_ss->channels;
+
+    /* find some common channel remappings, fall back to full matrix operation. */
+    if (n_ic == 1 && n_oc == 2 &&
+            m->map_table_f[0][0] >= 1.0 && m->map_table_f[1][0] >= 1.0) {
+        m->do_remap = (pa_do_remap_func_t) remap_mono_to_stereo_neon;
+        pa_log_info("Using NEON mono to stereo remapping");
+    } else if (n_ic == 2 && n_oc == 1) {
+        m->do_remap = (pa_do_remap_func_t) remap_stereo_to_mono_neon;
+        pa_log_info("Using NEON stereo to mono remapping");
+    }
+}
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+
+void pa_remap_func_init_neon (pa_cpu_arm_flag_t flags) {
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#ifdef RUN_TEST
+    run_test ();
+#endif
+
+    if (flags & PA_CPU_ARM_NEON) {
+        pa_log_info("Initialising NEON optimized remappers.");
+        pa_set_init_remap_func ((pa_init_remap_func_t) init_remap_neon);
+    }
+
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+}
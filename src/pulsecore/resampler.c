@@ -29,7 +29,9 @@
 #include <samplerate.h>
 #endif
 
+#ifdef HAVE_SPEEX
 #include <speex/speex_resampler.h>
+#endif
 
 #include <pulse/xmalloc.h>
 #include <pulsecore/sconv.h>
@@ -39,12 +41,25 @@
 
 #include "ffmpeg/avcodec.h"
 
+#include "polyphase.h"
 #include "resampler.h"
 #include "remap.h"
 
 /* Number of samples of extra space we allow the resamplers to return */
 #define EXTRA_FRAMES 128
 
+/* When more than one conversion step is needed, we run all of them on
+ * blocks of about this many bytes so the intermediate buffers stay in
+ * the cache, and the last step writes straight into the output. */
+#define FUSED_BLOCK_SIZE (8*1024)
+
+typedef enum pa_resampler_stage {
+    STAGE_TO_WORK_FORMAT,
+    STAGE_REMAP,
+    STAGE_RESAMPLE,
+    STAGE_FROM_WORK_FORMAT
+} pa_resampler_stage_t;
+
 struct pa_resampler {
     pa_resample_method_t method;
     pa_resample_flags_t flags;
@@ -65,6 +80,15 @@ struct pa_resampler {
     pa_remap_t remap;
     pa_bool_t map_required;
 
+    /* When upmixing we resample before remapping, so that fewer
+     * channels need to be resampled */
+    pa_bool_t resample_first;
+    unsigned work_channels;
+
+    pa_bool_t fused;
+    pa_resampler_stage_t last_stage;
+    size_t fused_block_frames;
+
     void (*impl_free)(pa_resampler *r);
     void (*impl_update_rates)(pa_resampler *r);
     void (*impl_resample)(pa_resampler *r, const pa_memchunk *in, unsigned in_samples, pa_memchunk *out, unsigned *out_samples);
@@ -90,26 +114,36 @@ struct pa_resampler {
     } src;
 #endif
 
+#ifdef HAVE_SPEEX
     struct { /* data specific to speex */
         SpeexResamplerState* state;
     } speex;
+#endif
 
     struct { /* data specific to ffmpeg */
         struct AVResampleContext *state;
         pa_memchunk buf[PA_CHANNELS_MAX];
     } ffmpeg;
+
+    struct { /* data specific to the polyphase resampler */
+        pa_polyphase *state;
+    } polyphase;
 };
 
 static int copy_init(pa_resampler *r);
 static int trivial_init(pa_resampler*r);
+#ifdef HAVE_SPEEX
 static int speex_init(pa_resampler*r);
+#endif
 static int ffmpeg_init(pa_resampler*r);
 static int peaks_init(pa_resampler*r);
+static int polyphase_init(pa_resampler*r);
 #ifdef HAVE_LIBSAMPLERATE
 static int libsamplerate_init(pa_resampler*r);
 #endif
 
 static void calc_map_table(pa_resampler *r);
+static void setup_fused(pa_resampler *r);
 
 static int (* const init_table[])(pa_resampler*r) = {
 #ifdef HAVE_LIBSAMPLERATE
@@ -126,6 +160,7 @@ static int (* const init_table[])(pa_resampler*r) = {
     [PA_RESAMPLER_SRC_LINEAR]              = NULL,
 #endif
     [PA_RESAMPLER_TRIVIAL]                 = trivial_init,
+#ifdef HAVE_SPEEX
     [PA_RESAMPLER_SPEEX_FLOAT_BASE+0]      = speex_init,
     [PA_RESAMPLER_SPEEX_FLOAT_BASE+1]      = speex_init,
     [PA_RESAMPLER_SPEEX_FLOAT_BASE+2]      = speex_init,
@@ -148,10 +183,39 @@ static int (* const init_table[])(pa_resampler*r) = {
     [PA_RESAMPLER_SPEEX_FIXED_BASE+8]      = speex_init,
     [PA_RESAMPLER_SPEEX_FIXED_BASE+9]      = speex_init,
     [PA_RESAMPLER_SPEEX_FIXED_BASE+10]     = speex_init,
+#else
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+0]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+1]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+2]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+3]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+4]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+5]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+6]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+7]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+8]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+9]      = NULL,
+    [PA_RESAMPLER_SPEEX_FLOAT_BASE+10]     = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+0]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+1]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+2]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+3]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+4]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+5]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+6]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+7]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+8]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+9]      = NULL,
+    [PA_RESAMPLER_SPEEX_FIXED_BASE+10]     = NULL,
+#endif
     [PA_RESAMPLER_FFMPEG]                  = ffmpeg_init,
     [PA_RESAMPLER_AUTO]                    = NULL,
     [PA_RESAMPLER_COPY]                    = copy_init,
     [PA_RESAMPLER_PEAKS]                   = peaks_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+0]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+1]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+2]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+3]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+4]        = polyphase_init,
 };
 
 pa_resampler* pa_resampler_new(
@@ -197,8 +261,12 @@ pa_resampler* pa_resampler_new(
 
     if (method == PA_RESAMPLER_AUTO)
     {
+#ifdef HAVE_SPEEX
     	//method = PA_RESAMPLER_SPEEX_FLOAT_BASE + 3;
     	method = PA_RESAMPLER_SPEEX_FIXED_BASE + 3;//use fixed base
+#else
+        method = PA_RESAMPLER_POLYPHASE_BASE + PA_POLYPHASE_QUALITY_DEFAULT;
+#endif
     }
 
     r = pa_xnew(pa_resampler, 1);
@@ -273,6 +341,10 @@ pa_resampler* pa_resampler_new(
 
     r->w_sz = pa_sample_size_of_format(r->work_format);
 
+    /* Remapping and resampling commute, except for the peak finder */
+    r->resample_first = r->map_required && r->o_ss.channels > r->i_ss.channels && method != PA_RESAMPLER_PEAKS;
+    r->work_channels = r->resample_first ? r->i_ss.channels : r->o_ss.channels;
+
     if (r->i_ss.format == r->work_format)
         r->to_work_format_func = NULL;
     else if (r->work_format == PA_SAMPLE_FLOAT32NE) {
@@ -299,6 +371,8 @@ pa_resampler* pa_resampler_new(
     if (init_table[method](r) < 0)
         goto fail;
 
+    setup_fused(r);
+
     return r;
 
 fail:
@@ -458,7 +532,12 @@ static const char * const resample_methods[] = {
     "ffmpeg",
     "auto",
     "copy",
-    "peaks"
+    "peaks",
+    "polyphase-0",
+    "polyphase-1",
+    "polyphase-2",
+    "polyphase-3",
+    "polyphase-4"
 };
 
 const char *pa_resample_method_to_string(pa_resample_method_t m) {
@@ -479,6 +558,11 @@ int pa_resample_method_supported(pa_resample_method_t m) {
         return 0;
 #endif
 
+#ifndef HAVE_SPEEX
+    if (m >= PA_RESAMPLER_SPEEX_FLOAT_BASE && m <= PA_RESAMPLER_SPEEX_FIXED_MAX)
+        return 0;
+#endif
+
     return 1;
 }
 
@@ -497,6 +581,9 @@ pa_resample_method_t pa_parse_resample_method(const char *string) {
     if (!strcmp(string, "speex-float"))
         return PA_RESAMPLER_SPEEX_FLOAT_BASE + 3;
 
+    if (!strcmp(string, "polyphase"))
+        return PA_RESAMPLER_POLYPHASE_BASE + PA_POLYPHASE_QUALITY_DEFAULT;
+
     return PA_RESAMPLER_INVALID;
 }
 
@@ -1035,9 +1122,38 @@ static void calc_map_table(pa_resampler *r) {
     pa_init_remap (m);
 }
 
-static pa_memchunk* convert_to_work_format(pa_resampler *r, pa_memchunk *input) {
+/* Returns the chunk a conversion step should write length bytes to:
+ * the caller supplied output if this is the last step of a fused run,
+ * otherwise one of our own buffers, which is only reallocated when it
+ * is too small. */
+static pa_memchunk *get_buffer(pa_resampler *r, pa_memchunk *buf, unsigned *buf_samples, unsigned n_samples, size_t length, pa_memchunk *output) {
+
+    if (output) {
+        pa_assert(output->memblock);
+        pa_assert(output->length >= length);
+
+        output->length = length;
+        return output;
+    }
+
+    buf->index = 0;
+    buf->length = length;
+
+    if (!buf->memblock || *buf_samples < n_samples) {
+        if (buf->memblock)
+            pa_memblock_unref(buf->memblock);
+
+        *buf_samples = n_samples;
+        buf->memblock = pa_memblock_new(r->mempool, buf->length);
+    }
+
+    return buf;
+}
+
+static pa_memchunk* convert_to_work_format(pa_resampler *r, pa_memchunk *input, pa_memchunk *output) {
     unsigned n_samples;
     void *src, *dst;
+    pa_memchunk *buf;
 
     pa_assert(r);
     pa_assert(input);
@@ -1050,32 +1166,24 @@ static pa_memchunk* convert_to_work_format(pa_resampler *r, pa_memchunk *input)
 
     n_samples = (unsigned) ((input->length / r->i_fz) * r->i_ss.channels);
 
-    r->buf1.index = 0;
-    r->buf1.length = r->w_sz * n_samples;
-
-    if (!r->buf1.memblock || r->buf1_samples < n_samples) {
-        if (r->buf1.memblock)
-            pa_memblock_unref(r->buf1.memblock);
-
-        r->buf1_samples = n_samples;
-        r->buf1.memblock = pa_memblock_new(r->mempool, r->buf1.length);
-    }
+    buf = get_buffer(r, &r->buf1, &r->buf1_samples, n_samples, r->w_sz * n_samples, output);
 
     src = (uint8_t*) pa_memblock_acquire(input->memblock) + input->index;
-    dst = (uint8_t*) pa_memblock_acquire(r->buf1.memblock);
+    dst = (uint8_t*) pa_memblock_acquire(buf->memblock) + buf->index;
 
     r->to_work_format_func(n_samples, src, dst);
 
     pa_memblock_release(input->memblock);
-    pa_memblock_release(r->buf1.memblock);
+    pa_memblock_release(buf->memblock);
 
-    return &r->buf1;
+    return buf;
 }
 
-static pa_memchunk *remap_channels(pa_resampler *r, pa_memchunk *input) {
+static pa_memchunk *remap_channels(pa_resampler *r, pa_memchunk *input, pa_memchunk *output) {
     unsigned in_n_samples, out_n_samples, n_frames;
     void *src, *dst;
     pa_remap_t *remap;
+    pa_memchunk *buf;
 
     pa_assert(r);
     pa_assert(input);
@@ -1090,19 +1198,10 @@ static pa_memchunk *remap_channels(pa_resampler *r, pa_memchunk *input) {
     n_frames = in_n_samples / r->i_ss.channels;
     out_n_samples = n_frames * r->o_ss.channels;
 
-    r->buf2.index = 0;
-    r->buf2.length = r->w_sz * out_n_samples;
-
-    if (!r->buf2.memblock || r->buf2_samples < out_n_samples) {
-        if (r->buf2.memblock)
-            pa_memblock_unref(r->buf2.memblock);
-
-        r->buf2_samples = out_n_samples;
-        r->buf2.memblock = pa_memblock_new(r->mempool, r->buf2.length);
-    }
+    buf = get_buffer(r, &r->buf2, &r->buf2_samples, out_n_samples, r->w_sz * out_n_samples, output);
 
     src = ((uint8_t*) pa_memblock_acquire(input->memblock) + input->index);
-    dst = pa_memblock_acquire(r->buf2.memblock);
+    dst = ((uint8_t*) pa_memblock_acquire(buf->memblock) + buf->index);
 
     remap = &r->remap;
 
@@ -1110,14 +1209,15 @@ static pa_memchunk *remap_channels(pa_resampler *r, pa_memchunk *input) {
     remap->do_remap (remap, dst, src, n_frames);
 
     pa_memblock_release(input->memblock);
-    pa_memblock_release(r->buf2.memblock);
+    pa_memblock_release(buf->memblock);
 
-    return &r->buf2;
+    return buf;
 }
 
-static pa_memchunk *resample(pa_resampler *r, pa_memchunk *input) {
+static pa_memchunk *resample(pa_resampler *r, pa_memchunk *input, pa_memchunk *output) {
     unsigned in_n_frames, in_n_samples;
     unsigned out_n_frames, out_n_samples;
+    pa_memchunk *buf;
 
     pa_assert(r);
     pa_assert(input);
@@ -1128,31 +1228,28 @@ static pa_memchunk *resample(pa_resampler *r, pa_memchunk *input) {
         return input;
 
     in_n_samples = (unsigned) (input->length / r->w_sz);
-    in_n_frames = (unsigned) (in_n_samples / r->o_ss.channels);
+    in_n_frames = (unsigned) (in_n_samples / r->work_channels);
 
-    out_n_frames = ((in_n_frames*r->o_ss.rate)/r->i_ss.rate)+EXTRA_FRAMES;
-    out_n_samples = out_n_frames * r->o_ss.channels;
+    if (output)
+        /* Whatever room is left in the output */
+        out_n_frames = (unsigned) (output->length / (r->w_sz * r->work_channels));
+    else
+        out_n_frames = ((in_n_frames*r->o_ss.rate)/r->i_ss.rate)+EXTRA_FRAMES;
 
-    r->buf3.index = 0;
-    r->buf3.length = r->w_sz * out_n_samples;
+    out_n_samples = out_n_frames * r->work_channels;
 
-    if (!r->buf3.memblock || r->buf3_samples < out_n_samples) {
-        if (r->buf3.memblock)
-            pa_memblock_unref(r->buf3.memblock);
+    buf = get_buffer(r, &r->buf3, &r->buf3_samples, out_n_samples, r->w_sz * out_n_samples, output);
 
-        r->buf3_samples = out_n_samples;
-        r->buf3.memblock = pa_memblock_new(r->mempool, r->buf3.length);
-    }
-
-    r->impl_resample(r, input, in_n_frames, &r->buf3, &out_n_frames);
-    r->buf3.length = out_n_frames * r->w_sz * r->o_ss.channels;
+    r->impl_resample(r, input, in_n_frames, buf, &out_n_frames);
+    buf->length = out_n_frames * r->w_sz * r->work_channels;
 
-    return &r->buf3;
+    return buf;
 }
 
-static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input) {
+static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input, pa_memchunk *output) {
     unsigned n_samples, n_frames;
     void *src, *dst;
+    pa_memchunk *buf;
 
     pa_assert(r);
     pa_assert(input);
@@ -1165,26 +1262,124 @@ static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input
     n_samples = (unsigned) (input->length / r->w_sz);
     n_frames = n_samples / r->o_ss.channels;
 
-    r->buf4.index = 0;
-    r->buf4.length = r->o_fz * n_frames;
-
-    if (!r->buf4.memblock || r->buf4_samples < n_samples) {
-        if (r->buf4.memblock)
-            pa_memblock_unref(r->buf4.memblock);
-
-        r->buf4_samples = n_samples;
-        r->buf4.memblock = pa_memblock_new(r->mempool, r->buf4.length);
-    }
+    buf = get_buffer(r, &r->buf4, &r->buf4_samples, n_samples, r->o_fz * n_frames, output);
 
     src = (uint8_t*) pa_memblock_acquire(input->memblock) + input->index;
-    dst = pa_memblock_acquire(r->buf4.memblock);
+    dst = (uint8_t*) pa_memblock_acquire(buf->memblock) + buf->index;
     r->from_work_format_func(n_samples, src, dst);
     pa_memblock_release(input->memblock);
-    pa_memblock_release(r->buf4.memblock);
+    pa_memblock_release(buf->memblock);
+
+    return buf;
+}
+
+/* Runs all conversion steps on buf. If output is set, the last step
+ * writes its result there. */
+static pa_memchunk *run_stages(pa_resampler *r, pa_memchunk *buf, pa_memchunk *output) {
+    pa_assert(r);
+    pa_assert(buf);
+
+    buf = convert_to_work_format(r, buf, r->last_stage == STAGE_TO_WORK_FORMAT ? output : NULL);
+
+    if (!r->resample_first)
+        buf = remap_channels(r, buf, r->last_stage == STAGE_REMAP ? output : NULL);
+
+    buf = resample(r, buf, r->last_stage == STAGE_RESAMPLE ? output : NULL);
+
+    if (r->resample_first)
+        buf = remap_channels(r, buf, r->last_stage == STAGE_REMAP ? output : NULL);
+
+    return convert_from_work_format(r, buf, r->last_stage == STAGE_FROM_WORK_FORMAT ? output : NULL);
+}
+
+static void setup_fused(pa_resampler *r) {
+    unsigned n_stages = 0;
+    size_t fz;
+
+    pa_assert(r);
+
+    if (r->to_work_format_func) {
+        r->last_stage = STAGE_TO_WORK_FORMAT;
+        n_stages++;
+    }
+
+    if (r->map_required && !r->resample_first) {
+        r->last_stage = STAGE_REMAP;
+        n_stages++;
+    }
+
+    if (r->impl_resample) {
+        r->last_stage = STAGE_RESAMPLE;
+        n_stages++;
+    }
+
+    if (r->map_required && r->resample_first) {
+        r->last_stage = STAGE_REMAP;
+        n_stages++;
+    }
 
-    r->buf4.length = r->o_fz * n_frames;
+    if (r->from_work_format_func) {
+        r->last_stage = STAGE_FROM_WORK_FORMAT;
+        n_stages++;
+    }
+
+    /* With a single step there is nothing to gain. The peak finder
+     * gives different results when its input is split up, so we leave
+     * it alone. */
+    r->fused = n_stages > 1 && r->method != PA_RESAMPLER_PEAKS;
+
+    fz = PA_MAX(r->i_fz, r->o_fz);
+    fz = PA_MAX(fz, r->w_sz * PA_MAX(r->i_ss.channels, r->o_ss.channels));
+    r->fused_block_frames = PA_MAX(FUSED_BLOCK_SIZE / fz, 1U);
 
-    return &r->buf4;
+    if (r->fused)
+        pa_log_debug("Running %u conversion steps in blocks of %lu frames.", n_stages, (unsigned long) r->fused_block_frames);
+}
+
+static void fused_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    size_t in_n_frames, out_n_frames, n, done;
+
+    pa_assert(r);
+    pa_assert(in);
+    pa_assert(out);
+
+    in_n_frames = in->length / r->i_fz;
+
+    if (r->impl_resample)
+        out_n_frames = ((in_n_frames*r->o_ss.rate)/r->i_ss.rate)+EXTRA_FRAMES;
+    else
+        out_n_frames = in_n_frames;
+
+    out->memblock = pa_memblock_new(r->mempool, out_n_frames * r->o_fz);
+    out->index = 0;
+    out->length = 0;
+
+    for (done = 0; done < in_n_frames; done += n) {
+        pa_memchunk block, dst, *result;
+
+        n = PA_MIN(in_n_frames - done, r->fused_block_frames);
+
+        block.memblock = in->memblock;
+        block.index = in->index + done * r->i_fz;
+        block.length = n * r->i_fz;
+
+        dst.memblock = out->memblock;
+        dst.index = out->length;
+        dst.length = out_n_frames * r->o_fz - out->length;
+
+        result = run_stages(r, &block, &dst);
+
+        /* A step may have produced no data, the following ones are
+         * skipped then */
+        pa_assert(result == &dst || result->length == 0);
+
+        out->length += result->length;
+    }
+
+    if (!out->length) {
+        pa_memblock_unref(out->memblock);
+        pa_memchunk_reset(out);
+    }
 }
 
 void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
@@ -1197,13 +1392,14 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
     pa_assert(in->memblock);
     pa_assert(in->length % r->i_fz == 0);
 
-    buf = (pa_memchunk*) in;
-    buf = convert_to_work_format(r, buf);
-    buf = remap_channels(r, buf);
-    buf = resample(r, buf);
+    if (r->fused) {
+        fused_run(r, in, out);
+        return;
+    }
+
+    buf = run_stages(r, (pa_memchunk*) in, NULL);
 
     if (buf->length) {
-        buf = convert_from_work_format(r, buf);
         *out = *buf;
 
         if (buf == in)
@@ -1269,7 +1465,7 @@ static int libsamplerate_init(pa_resampler *r) {
 
     pa_assert(r);
 
-    if (!(r->src.state = src_new(r->method, r->o_ss.channels, &err)))
+    if (!(r->src.state = src_new(r->method, r->work_channels, &err)))
         return -1;
 
     r->impl_free = libsamplerate_free;
@@ -1283,6 +1479,7 @@ static int libsamplerate_init(pa_resampler *r) {
 
 /*** speex based implementation ***/
 
+#ifdef HAVE_SPEEX
 static void speex_resample_float(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
     float *in, *out;
     uint32_t inf = in_n_frames, outf = *out_n_frames;
@@ -1369,11 +1566,12 @@ static int speex_init(pa_resampler *r) {
 
     pa_log_info("Choosing speex quality setting %i.", q);
 
-    if (!(r->speex.state = speex_resampler_init(r->o_ss.channels, r->i_ss.rate, r->o_ss.rate, q, &err)))
+    if (!(r->speex.state = speex_resampler_init(r->work_channels, r->i_ss.rate, r->o_ss.rate, q, &err)))
         return -1;
 
     return 0;
 }
+#endif
 
 /* Trivial implementation */
 
@@ -1387,7 +1585,7 @@ static void trivial_resample(pa_resampler *r, const pa_memchunk *input, unsigned
     pa_assert(output);
     pa_assert(out_n_frames);
 
-    fz = r->w_sz * r->o_ss.channels;
+    fz = r->w_sz * r->work_channels;
 
     src = (uint8_t*) pa_memblock_acquire(input->memblock) + input->index;
     dst = (uint8_t*) pa_memblock_acquire(output->memblock) + output->index;
@@ -1401,7 +1599,7 @@ static void trivial_resample(pa_resampler *r, const pa_memchunk *input, unsigned
         if (j >= in_n_frames)
             break;
 
-        pa_assert(o_index * fz < pa_memblock_get_length(output->memblock));
+        pa_assert(output->index + o_index * fz < pa_memblock_get_length(output->memblock));
 
         memcpy((uint8_t*) dst + fz * o_index,
                    (uint8_t*) src + fz * j, (int) fz);
@@ -1455,7 +1653,7 @@ static void peaks_resample(pa_resampler *r, const pa_memchunk *input, unsigned i
     pa_assert(output);
     pa_assert(out_n_frames);
 
-    fz = r->w_sz * r->o_ss.channels;
+    fz = r->w_sz * r->work_channels;
 
     src = (uint8_t*) pa_memblock_acquire(input->memblock) + input->index;
     dst = (uint8_t*) pa_memblock_acquire(output->memblock) + output->index;
@@ -1470,7 +1668,7 @@ static void peaks_resample(pa_resampler *r, const pa_memchunk *input, unsigned i
         else
             j = 0;
 
-        pa_assert(o_index * fz < pa_memblock_get_length(output->memblock));
+        pa_assert(output->index + o_index * fz < pa_memblock_get_length(output->memblock));
 
         if (r->work_format == PA_SAMPLE_S16NE) {
             unsigned i, c;
@@ -1479,7 +1677,7 @@ static void peaks_resample(pa_resampler *r, const pa_memchunk *input, unsigned i
 
             for (i = start; i <= j && i < in_n_frames; i++)
 
-                for (c = 0; c < r->o_ss.channels; c++, s++) {
+                for (c = 0; c < r->work_channels; c++, s++) {
                     int16_t n;
 
                     n = (int16_t) (*s < 0 ? -*s : *s);
@@ -1491,7 +1689,7 @@ static void peaks_resample(pa_resampler *r, const pa_memchunk *input, unsigned i
             if (i >= in_n_frames)
                 break;
 
-            for (c = 0; c < r->o_ss.channels; c++, d++) {
+            for (c = 0; c < r->work_channels; c++, d++) {
                 *d = r->peaks.max_i[c];
                 r->peaks.max_i[c] = 0;
             }
@@ -1504,7 +1702,7 @@ static void peaks_resample(pa_resampler *r, const pa_memchunk *input, unsigned i
             pa_assert(r->work_format == PA_SAMPLE_FLOAT32NE);
 
             for (i = start; i <= j && i < in_n_frames; i++)
-                for (c = 0; c < r->o_ss.channels; c++, s++) {
+                for (c = 0; c < r->work_channels; c++, s++) {
                     float n = fabsf(*s);
 
                     if (n > r->peaks.max_f[c])
@@ -1514,7 +1712,7 @@ static void peaks_resample(pa_resampler *r, const pa_memchunk *input, unsigned i
             if (i >= in_n_frames)
                 break;
 
-            for (c = 0; c < r->o_ss.channels; c++, d++) {
+            for (c = 0; c < r->work_channels; c++, d++) {
                 *d = r->peaks.max_f[c];
                 r->peaks.max_f[c] = 0;
             }
@@ -1570,7 +1768,7 @@ static void ffmpeg_resample(pa_resampler *r, const pa_memchunk *input, unsigned
     pa_assert(output);
     pa_assert(out_n_frames);
 
-    for (c = 0; c < r->o_ss.channels; c++) {
+    for (c = 0; c < r->work_channels; c++) {
         unsigned u;
         pa_memblock *b, *w;
         int16_t *p, *t, *k, *q, *s;
@@ -1596,7 +1794,7 @@ static void ffmpeg_resample(pa_resampler *r, const pa_memchunk *input, unsigned
         k = (int16_t*) ((uint8_t*) p + l);
         for (u = 0; u < in_n_frames; u++) {
             *k = *t;
-            t += r->o_ss.channels;
+            t += r->work_channels;
             k ++;
         }
         pa_memblock_release(input->memblock);
@@ -1613,7 +1811,7 @@ static void ffmpeg_resample(pa_resampler *r, const pa_memchunk *input, unsigned
                                              q, p,
                                              &consumed_frames,
                                              (int) in, (int) *out_n_frames,
-                                             c >= (unsigned) (r->o_ss.channels-1));
+                                             c >= (unsigned) (r->work_channels-1));
 
         pa_memblock_release(b);
 
@@ -1631,7 +1829,7 @@ static void ffmpeg_resample(pa_resampler *r, const pa_memchunk *input, unsigned
         for (u = 0; u < used_frames; u++) {
             *s = *q;
             q++;
-            s += r->o_ss.channels;
+            s += r->work_channels;
         }
         pa_memblock_release(output->memblock);
         pa_memblock_release(w);
@@ -1676,6 +1874,64 @@ static int ffmpeg_init(pa_resampler *r) {
     return 0;
 }
 
+/*** polyphase implementation ***/
+
+static void polyphase_resample(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
+    float *in, *out;
+
+    pa_assert(r);
+    pa_assert(input);
+    pa_assert(output);
+    pa_assert(out_n_frames);
+
+    in = (float*) ((uint8_t*) pa_memblock_acquire(input->memblock) + input->index);
+    out = (float*) ((uint8_t*) pa_memblock_acquire(output->memblock) + output->index);
+
+    *out_n_frames = pa_polyphase_process(r->polyphase.state, in, in_n_frames, out, *out_n_frames);
+
+    pa_memblock_release(input->memblock);
+    pa_memblock_release(output->memblock);
+}
+
+static void polyphase_update_rates(pa_resampler *r) {
+    pa_assert(r);
+
+    pa_polyphase_set_rates(r->polyphase.state, r->i_ss.rate, r->o_ss.rate);
+}
+
+static void polyphase_reset(pa_resampler *r) {
+    pa_assert(r);
+
+    pa_polyphase_reset(r->polyphase.state);
+}
+
+static void polyphase_free(pa_resampler *r) {
+    pa_assert(r);
+
+    if (r->polyphase.state)
+        pa_polyphase_free(r->polyphase.state);
+}
+
+static int polyphase_init(pa_resampler *r) {
+    unsigned q;
+
+    pa_assert(r);
+    pa_assert(r->method >= PA_RESAMPLER_POLYPHASE_BASE && r->method <= PA_RESAMPLER_POLYPHASE_MAX);
+
+    q = (unsigned) (r->method - PA_RESAMPLER_POLYPHASE_BASE);
+
+    pa_log_info("Choosing polyphase quality setting %u.", q);
+
+    r->polyphase.state = pa_polyphase_new(r->work_channels, r->i_ss.rate, r->o_ss.rate, q);
+
+    r->impl_free = polyphase_free;
+    r->impl_update_rates = polyphase_update_rates;
+    r->impl_resample = polyphase_resample;
+    r->impl_reset = polyphase_reset;
+
+    return 0;
+}
+
 /*** copy (noop) implementation ***/
 
 static int copy_init(pa_resampler *r) {
@@ -36,6 +36,12 @@
 #include <pulsecore/poll.h>
 #endif
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#define USE_EPOLL
+#endif
+
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
 
@@ -52,6 +58,21 @@
 
 /* #define DEBUG_TIMING */
 
+#ifdef USE_EPOLL
+/* How many events we take from the kernel at once, the rest is
+ * picked up in the next iteration */
+#define EPOLL_EVENTS_MAX 32
+
+/* What we told epoll about a single struct pollfd of an item */
+struct watch {
+    pa_rtpoll_item *item;
+    unsigned idx;
+    int fd;
+    short events;
+    pa_bool_t registered;
+};
+#endif
+
 struct pa_rtpoll {
     struct pollfd *pollfd, *pollfd2;
     unsigned n_pollfd_alloc, n_pollfd_used;
@@ -70,6 +91,17 @@ struct pa_rtpoll {
     pa_usec_t slept, awake;
 #endif
 
+#ifdef USE_EPOLL
+    /* Both -1 if we use poll() */
+    int epoll_fd, timer_fd;
+
+    pa_bool_t epoll_reset_needed:1;
+    pa_bool_t timer_armed:1;
+    struct timeval timer_armed_elapse;
+
+    struct epoll_event events[EPOLL_EVENTS_MAX];
+#endif
+
     PA_LLIST_HEAD(pa_rtpoll_item, items);
 };
 
@@ -87,10 +119,244 @@ struct pa_rtpoll_item {
     void (*after_cb)(pa_rtpoll_item *i);
     void *userdata;
 
+#ifdef USE_EPOLL
+    struct watch *watches;
+#endif
+
     PA_LLIST_FIELDS(pa_rtpoll_item);
 };
 
-PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(items, 0, 16, pa_xfree);
+
+#ifdef USE_EPOLL
+
+/* Instead of handing all pollfds to the kernel in every iteration we
+ * keep them registered with epoll. Since the items may change their
+ * pollfds at any time we compare them with what we registered before
+ * each sleep, which doesn't need any syscalls unless something
+ * changed. The timer is a timerfd in the same epoll set. If anything
+ * can't be done with epoll we fall back to poll() for good. */
+
+static void epoll_done(pa_rtpoll *p) {
+    pa_rtpoll_item *i;
+
+    for (i = p->items; i; i = i->next) {
+        pa_xfree(i->watches);
+        i->watches = NULL;
+    }
+
+    if (p->epoll_fd >= 0)
+        pa_close(p->epoll_fd);
+
+    if (p->timer_fd >= 0)
+        pa_close(p->timer_fd);
+
+    p->epoll_fd = p->timer_fd = -1;
+}
+
+static int epoll_create_set(pa_rtpoll *p) {
+    struct epoll_event ev;
+
+    if ((p->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        pa_log_debug("epoll_create1() failed, using poll(): %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    /* The timer is the only watch without a struct watch */
+    pa_zero(ev);
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+
+    if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, p->timer_fd, &ev) < 0) {
+        pa_log_debug("Failed to add timerfd to epoll set, using poll(): %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void epoll_init(pa_rtpoll *p) {
+
+    p->epoll_fd = -1;
+
+    if ((p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0) {
+        pa_log_debug("timerfd_create() failed, using poll(): %s", pa_cstrerror(errno));
+        return;
+    }
+
+    if (epoll_create_set(p) < 0)
+        epoll_done(p);
+}
+
+/* If we couldn't remove an fd, most likely because it was closed
+ * before its item was changed or freed, the kernel might still know
+ * it if it was dup()ed somewhere. So start over with a fresh set. */
+static void epoll_reset(pa_rtpoll *p) {
+    pa_rtpoll_item *i;
+
+    p->epoll_reset_needed = FALSE;
+
+    pa_close(p->epoll_fd);
+
+    if (epoll_create_set(p) < 0) {
+        epoll_done(p);
+        return;
+    }
+
+    for (i = p->items; i; i = i->next) {
+        unsigned k;
+
+        if (!i->watches)
+            continue;
+
+        for (k = 0; k < i->n_pollfd; k++)
+            i->watches[k].registered = FALSE;
+    }
+}
+
+static void epoll_unwatch_item(pa_rtpoll_item *i) {
+    unsigned k;
+
+    for (k = 0; k < i->n_pollfd; k++) {
+        struct watch *w = &i->watches[k];
+
+        if (!w->registered)
+            continue;
+
+        if (epoll_ctl(i->rtpoll->epoll_fd, EPOLL_CTL_DEL, w->fd, NULL) < 0)
+            i->rtpoll->epoll_reset_needed = TRUE;
+
+        w->registered = FALSE;
+    }
+}
+
+/* Returns -1 if we had to fall back to poll() */
+static int epoll_sync(pa_rtpoll *p) {
+    pa_rtpoll_item *i;
+
+restart:
+
+    if (p->epoll_reset_needed)
+        epoll_reset(p);
+
+    if (p->epoll_fd < 0)
+        return -1;
+
+    for (i = p->items; i; i = i->next) {
+        unsigned k;
+
+        if (i->dead || i->n_pollfd <= 0)
+            continue;
+
+        pa_assert(i->watches);
+
+        for (k = 0; k < i->n_pollfd; k++) {
+            struct pollfd *f = &i->pollfd[k];
+            struct watch *w = &i->watches[k];
+            struct epoll_event ev;
+
+            f->revents = 0;
+
+            if (w->registered && w->fd == f->fd && w->events == f->events)
+                continue;
+
+            /* Linux uses the same bits for epoll and poll() */
+            pa_zero(ev);
+            ev.events = (uint32_t) (unsigned short) f->events;
+            ev.data.ptr = w;
+
+            if (w->registered && w->fd == f->fd) {
+
+                if (epoll_ctl(p->epoll_fd, EPOLL_CTL_MOD, f->fd, &ev) < 0)
+                    goto fail;
+
+                w->events = f->events;
+                continue;
+            }
+
+            if (w->registered) {
+                w->registered = FALSE;
+
+                if (epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, w->fd, NULL) < 0) {
+                    p->epoll_reset_needed = TRUE;
+                    goto restart;
+                }
+            }
+
+            if (f->fd < 0)
+                continue;
+
+            if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, f->fd, &ev) < 0)
+                goto fail;
+
+            w->fd = f->fd;
+            w->events = f->events;
+            w->registered = TRUE;
+        }
+    }
+
+    return 0;
+
+fail:
+    pa_log_debug("Cannot watch fd with epoll, using poll(): %s", pa_cstrerror(errno));
+    epoll_done(p);
+    return -1;
+}
+
+static void epoll_set_timer(pa_rtpoll *p, pa_bool_t enable) {
+    struct itimerspec its;
+
+    pa_zero(its);
+
+    if (enable) {
+
+        /* A timerfd that elapsed stays readable until it is set
+         * again, which is exactly what we want if the time didn't
+         * change */
+        if (p->timer_armed && pa_timeval_cmp(&p->timer_armed_elapse, &p->next_elapse) == 0)
+            return;
+
+        its.it_value.tv_sec = p->next_elapse.tv_sec;
+        its.it_value.tv_nsec = (long) p->next_elapse.tv_usec * 1000;
+
+        /* All zero would disarm the timer */
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+            its.it_value.tv_nsec = 1;
+
+        pa_assert_se(timerfd_settime(p->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0);
+
+        p->timer_armed = TRUE;
+        p->timer_armed_elapse = p->next_elapse;
+
+    } else if (p->timer_armed) {
+        pa_assert_se(timerfd_settime(p->timer_fd, 0, &its, NULL) == 0);
+        p->timer_armed = FALSE;
+    }
+}
+
+/* Returns the number of pollfds with events, like poll() */
+static int epoll_run(pa_rtpoll *p, pa_bool_t wait_op) {
+    int r, k, n = 0;
+
+    epoll_set_timer(p, wait_op && !p->quit && p->timer_enabled);
+
+    if ((r = epoll_wait(p->epoll_fd, p->events, EPOLL_EVENTS_MAX, (!wait_op || p->quit) ? 0 : -1)) < 0)
+        return r;
+
+    for (k = 0; k < r; k++) {
+        struct watch *w;
+
+        if (!(w = p->events[k].data.ptr))
+            continue;
+
+        w->item->pollfd[w->idx].revents = (short) p->events[k].events;
+        n++;
+    }
+
+    return n;
+}
+
+#endif
 
 pa_rtpoll *pa_rtpoll_new(void) {
     pa_rtpoll *p;
@@ -101,6 +367,10 @@ pa_rtpoll *pa_rtpoll_new(void) {
     p->pollfd = pa_xnew(struct pollfd, p->n_pollfd_alloc);
     p->pollfd2 = pa_xnew(struct pollfd, p->n_pollfd_alloc);
 
+#ifdef USE_EPOLL
+    epoll_init(p);
+#endif
+
 #ifdef DEBUG_TIMING
     p->timestamp = pa_rtclock_now();
 #endif
@@ -164,6 +434,14 @@ static void rtpoll_item_destroy(pa_rtpoll_item *i) {
 
     p->n_pollfd_used -= i->n_pollfd;
 
+#ifdef USE_EPOLL
+    if (i->watches) {
+        epoll_unwatch_item(i);
+        pa_xfree(i->watches);
+        i->watches = NULL;
+    }
+#endif
+
     if (pa_flist_push(PA_STATIC_FLIST_GET(items), i) < 0)
         pa_xfree(i);
 
@@ -176,6 +454,10 @@ void pa_rtpoll_free(pa_rtpoll *p) {
     while (p->items)
         rtpoll_item_destroy(p->items);
 
+#ifdef USE_EPOLL
+    epoll_done(p);
+#endif
+
     pa_xfree(p->pollfd);
     pa_xfree(p->pollfd2);
 
@@ -296,16 +578,21 @@ int pa_rtpoll_run(pa_rtpoll *p, pa_bool_t wait_op) {
 #endif
 
     /* OK, now let's sleep */
-#ifdef HAVE_PPOLL
+#ifdef USE_EPOLL
+    if (p->epoll_fd >= 0 && epoll_sync(p) >= 0)
+        r = epoll_run(p, wait_op);
+    else
+#endif
     {
+#ifdef HAVE_PPOLL
         struct timespec ts;
         ts.tv_sec = timeout.tv_sec;
         ts.tv_nsec = timeout.tv_usec * 1000;
         r = ppoll(p->pollfd, p->n_pollfd_used, (!wait_op || p->quit || p->timer_enabled) ? &ts : NULL, NULL);
-    }
 #else
-    r = poll(p->pollfd, p->n_pollfd_used, (!wait_op || p->quit || p->timer_enabled) ? (int) ((timeout.tv_sec*1000) + (timeout.tv_usec / 1000)) : -1);
+        r = poll(p->pollfd, p->n_pollfd_used, (!wait_op || p->quit || p->timer_enabled) ? (int) ((timeout.tv_sec*1000) + (timeout.tv_usec / 1000)) : -1);
 #endif
+    }
 
     p->timer_elapsed = r == 0;
 
@@ -406,6 +693,21 @@ pa_rtpoll_item *pa_rtpoll_item_new(pa_rtpoll *p, pa_rtpoll_priority_t prio, unsi
     i->after_cb = NULL;
     i->work_cb = NULL;
 
+#ifdef USE_EPOLL
+    i->watches = NULL;
+
+    if (n_fds > 0 && p->epoll_fd >= 0) {
+        unsigned k;
+
+        i->watches = pa_xnew0(struct watch, n_fds);
+
+        for (k = 0; k < n_fds; k++) {
+            i->watches[k].item = i;
+            i->watches[k].idx = k;
+        }
+    }
+#endif
+
     for (j = p->items; j; j = j->next) {
         if (prio <= j->priority)
             break;
@@ -534,29 +836,19 @@ static void asyncmsgq_read_after(pa_rtpoll_item *i) {
 }
 
 static int asyncmsgq_read_work(pa_rtpoll_item *i) {
-    pa_msgobject *object;
-    int code;
-    void *data;
-    pa_memchunk chunk;
-    int64_t offset;
+    pa_bool_t shutdown;
 
     pa_assert(i);
 
-    if (pa_asyncmsgq_get(i->userdata, &object, &code, &data, &offset, &chunk, 0) == 0) {
-        int ret;
+    /* Handle everything that queued up in one iteration instead of
+     * going through the loop once per message */
+    if (pa_asyncmsgq_process_pending(i->userdata, &shutdown) <= 0)
+        return 0;
 
-        if (!object && code == PA_MESSAGE_SHUTDOWN) {
-            pa_asyncmsgq_done(i->userdata, 0);
-            pa_rtpoll_quit(i->rtpoll);
-            return 1;
-        }
-
-        ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
-        pa_asyncmsgq_done(i->userdata, ret);
-        return 1;
-    }
+    if (shutdown)
+        pa_rtpoll_quit(i->rtpoll);
 
-    return 0;
+    return 1;
 }
 
 pa_rtpoll_item *pa_rtpoll_item_new_asyncmsgq_read(pa_rtpoll *p, pa_rtpoll_priority_t prio, pa_asyncmsgq *q) {
@@ -39,6 +39,7 @@
 #include <pulsecore/core-util.h>
 
 #include "sample-util.h"
+#include "sconv.h"
 #include "endianmacros.h"
 
 #define PA_SILENCE_MAX (PA_PAGE_SIZE*16)
@@ -136,7 +137,7 @@ static void calc_linear_float_volume(float linear[], const pa_cvolume *volume) {
 }
 
 static void calc_linear_integer_stream_volumes(pa_mix_info streams[], unsigned nstreams, const pa_cvolume *volume, const pa_sample_spec *spec) {
-    unsigned k, channel;
+    unsigned k, channel, padding;
     float linear[PA_CHANNELS_MAX + VOLUME_PADDING];
 
     pa_assert(streams);
@@ -146,16 +147,18 @@ static void calc_linear_integer_stream_volumes(pa_mix_info streams[], unsigned n
     calc_linear_float_volume(linear, volume);
 
     for (k = 0; k < nstreams; k++) {
+        pa_mix_info *m = streams + k;
 
-        for (channel = 0; channel < spec->channels; channel++) {
-            pa_mix_info *m = streams + k;
+        for (channel = 0; channel < spec->channels; channel++)
             m->linear[channel].i = (int32_t) lrint(pa_sw_volume_to_linear(m->volume.values[channel]) * linear[channel] * 0x10000);
-        }
+
+        for (padding = 0; padding < PA_MIX_VOLUME_PADDING; padding++, channel++)
+            m->linear[channel].i = m->linear[padding].i;
     }
 }
 
 static void calc_linear_float_stream_volumes(pa_mix_info streams[], unsigned nstreams, const pa_cvolume *volume, const pa_sample_spec *spec) {
-    unsigned k, channel;
+    unsigned k, channel, padding;
     float linear[PA_CHANNELS_MAX + VOLUME_PADDING];
 
     pa_assert(streams);
@@ -165,532 +168,732 @@ static void calc_linear_float_stream_volumes(pa_mix_info streams[], unsigned nst
     calc_linear_float_volume(linear, volume);
 
     for (k = 0; k < nstreams; k++) {
+        pa_mix_info *m = streams + k;
 
-        for (channel = 0; channel < spec->channels; channel++) {
-            pa_mix_info *m = streams + k;
+        for (channel = 0; channel < spec->channels; channel++)
             m->linear[channel].f = (float) (pa_sw_volume_to_linear(m->volume.values[channel]) * linear[channel]);
-        }
+
+        for (padding = 0; padding < PA_MIX_VOLUME_PADDING; padding++, channel++)
+            m->linear[channel].f = m->linear[padding].f;
     }
 }
 
-size_t pa_mix(
-        pa_mix_info streams[],
-        unsigned nstreams,
-        void *data,
-        size_t length,
-        const pa_sample_spec *spec,
-        const pa_cvolume *volume,
-        pa_bool_t mute) {
+static void pa_mix_s16ne_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-    pa_cvolume full_volume;
-    unsigned k;
-    unsigned z;
-    void *end;
+    while (data < end) {
+        int32_t sum = 0;
+        unsigned i;
 
-    pa_assert(streams);
-    pa_assert(data);
-    pa_assert(length);
-    pa_assert(spec);
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, lo, hi, cv = m->linear[channel].i;
 
-    if (!volume)
-        volume = pa_cvolume_reset(&full_volume, spec->channels);
+            if (PA_LIKELY(cv > 0)) {
 
-    if (mute || pa_cvolume_is_muted(volume) || nstreams <= 0) {
-        pa_silence_memory(data, length, spec);
-        return length;
-    }
+                /* Multiplying the 32bit volume factor with the
+                 * 16bit sample might result in an 48bit value. We
+                 * want to do without 64 bit integers and hence do
+                 * the multiplication independantly for the HI and
+                 * LO part of the volume. */
 
-    for (k = 0; k < nstreams; k++)
-        streams[k].ptr = (uint8_t*) pa_memblock_acquire(streams[k].chunk.memblock) + streams[k].chunk.index;
+                hi = cv >> 16;
+                lo = cv & 0xFFFF;
 
-    for (z = 0; z < nstreams; z++)
-        if (length > streams[z].chunk.length)
-            length = streams[z].chunk.length;
+                v = *((int16_t*) m->ptr);
+                v = ((v * lo) >> 16) + (v * hi);
+                sum += v;
+            }
 
-    end = (uint8_t*) data + length;
+            m->ptr = (uint8_t*) m->ptr + sizeof(int16_t);
+        }
 
-    switch (spec->format) {
+        sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+        *((int16_t*) data) = (int16_t) sum;
 
-        case PA_SAMPLE_S16NE:{
-            unsigned channel = 0;
+        data = (uint8_t*) data + sizeof(int16_t);
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-            while (data < end) {
-                int32_t sum = 0;
-                unsigned i;
+static void pa_mix_s16re_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t v, lo, hi, cv = m->linear[channel].i;
+    while (data < end) {
+        int32_t sum = 0;
+        unsigned i;
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, lo, hi, cv = m->linear[channel].i;
 
-                    /* Multiplying the 32bit volume factor with the
-                     * 16bit sample might result in an 48bit value. We
-                     * want to do without 64 bit integers and hence do
-                     * the multiplication independantly for the HI and
-                     * LO part of the volume. */
+            if (PA_LIKELY(cv > 0)) {
+                hi = cv >> 16;
+                lo = cv & 0xFFFF;
 
-                    hi = cv >> 16;
-                    lo = cv & 0xFFFF;
+                v = PA_INT16_SWAP(*((int16_t*) m->ptr));
+                v = ((v * lo) >> 16) + (v * hi);
+                sum += v;
+            }
 
-                    v = *((int16_t*) m->ptr);
-                    v = ((v * lo) >> 16) + (v * hi);
-                    sum += v;
+            m->ptr = (uint8_t*) m->ptr + sizeof(int16_t);
+        }
 
-                    m->ptr = (uint8_t*) m->ptr + sizeof(int16_t);
-                }
+        sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+        *((int16_t*) data) = PA_INT16_SWAP((int16_t) sum);
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
-                *((int16_t*) data) = (int16_t) sum;
+        data = (uint8_t*) data + sizeof(int16_t);
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-                data = (uint8_t*) data + sizeof(int16_t);
+static void pa_mix_s32ne_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
+    while (data < end) {
+        int64_t sum = 0;
+        unsigned i;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t cv = m->linear[channel].i;
+            int64_t v;
+
+            if (PA_LIKELY(cv > 0)) {
+                v = *((int32_t*) m->ptr);
+                v = (v * cv) >> 16;
+                sum += v;
             }
 
-            break;
+            m->ptr = (uint8_t*) m->ptr + sizeof(int32_t);
         }
 
-        case PA_SAMPLE_S16RE:{
-            unsigned channel = 0;
+        sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+        *((int32_t*) data) = (int32_t) sum;
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+        data = (uint8_t*) data + sizeof(int32_t);
 
-            while (data < end) {
-                int32_t sum = 0;
-                unsigned i;
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t v, lo, hi, cv = m->linear[channel].i;
+static void pa_mix_s32re_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+    while (data < end) {
+        int64_t sum = 0;
+        unsigned i;
 
-                    hi = cv >> 16;
-                    lo = cv & 0xFFFF;
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t cv = m->linear[channel].i;
+            int64_t v;
 
-                    v = PA_INT16_SWAP(*((int16_t*) m->ptr));
-                    v = ((v * lo) >> 16) + (v * hi);
-                    sum += v;
+            if (PA_LIKELY(cv > 0)) {
+                v = PA_INT32_SWAP(*((int32_t*) m->ptr));
+                v = (v * cv) >> 16;
+                sum += v;
+            }
 
-                    m->ptr = (uint8_t*) m->ptr + sizeof(int16_t);
-                }
+            m->ptr = (uint8_t*) m->ptr + sizeof(int32_t);
+        }
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
-                *((int16_t*) data) = PA_INT16_SWAP((int16_t) sum);
+        sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+        *((int32_t*) data) = PA_INT32_SWAP((int32_t) sum);
 
-                data = (uint8_t*) data + sizeof(int16_t);
+        data = (uint8_t*) data + sizeof(int32_t);
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
-            }
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-            break;
-        }
+static void pa_mix_s24ne_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-        case PA_SAMPLE_S32NE:{
-            unsigned channel = 0;
+    while (data < end) {
+        int64_t sum = 0;
+        unsigned i;
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t cv = m->linear[channel].i;
+            int64_t v;
 
-            while (data < end) {
-                int64_t sum = 0;
-                unsigned i;
+            if (PA_LIKELY(cv > 0)) {
+                v = (int32_t) (PA_READ24NE(m->ptr) << 8);
+                v = (v * cv) >> 16;
+                sum += v;
+            }
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t cv = m->linear[channel].i;
-                    int64_t v;
+            m->ptr = (uint8_t*) m->ptr + 3;
+        }
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+        sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+        PA_WRITE24NE(data, ((uint32_t) sum) >> 8);
 
-                    v = *((int32_t*) m->ptr);
-                    v = (v * cv) >> 16;
-                    sum += v;
+        data = (uint8_t*) data + 3;
 
-                    m->ptr = (uint8_t*) m->ptr + sizeof(int32_t);
-                }
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static void pa_mix_s24re_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
-                *((int32_t*) data) = (int32_t) sum;
+    while (data < end) {
+        int64_t sum = 0;
+        unsigned i;
 
-                data = (uint8_t*) data + sizeof(int32_t);
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t cv = m->linear[channel].i;
+            int64_t v;
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
+            if (PA_LIKELY(cv > 0)) {
+                v = (int32_t) (PA_READ24RE(m->ptr) << 8);
+                v = (v * cv) >> 16;
+                sum += v;
             }
 
-            break;
+            m->ptr = (uint8_t*) m->ptr + 3;
         }
 
-        case PA_SAMPLE_S32RE:{
-            unsigned channel = 0;
+        sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+        PA_WRITE24RE(data, ((uint32_t) sum) >> 8);
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+        data = (uint8_t*) data + 3;
 
-            while (data < end) {
-                int64_t sum = 0;
-                unsigned i;
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t cv = m->linear[channel].i;
-                    int64_t v;
+static void pa_mix_s24_32ne_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+    while (data < end) {
+        int64_t sum = 0;
+        unsigned i;
 
-                    v = PA_INT32_SWAP(*((int32_t*) m->ptr));
-                    v = (v * cv) >> 16;
-                    sum += v;
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t cv = m->linear[channel].i;
+            int64_t v;
 
-                    m->ptr = (uint8_t*) m->ptr + sizeof(int32_t);
-                }
+            if (PA_LIKELY(cv > 0)) {
+                v = (int32_t) (*((uint32_t*)m->ptr) << 8);
+                v = (v * cv) >> 16;
+                sum += v;
+            }
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
-                *((int32_t*) data) = PA_INT32_SWAP((int32_t) sum);
+            m->ptr = (uint8_t*) m->ptr + sizeof(int32_t);
+        }
 
-                data = (uint8_t*) data + sizeof(int32_t);
+        sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+        *((uint32_t*) data) = ((uint32_t) (int32_t) sum) >> 8;
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
-            }
+        data = (uint8_t*) data + sizeof(uint32_t);
 
-            break;
-        }
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-        case PA_SAMPLE_S24NE: {
-            unsigned channel = 0;
+static void pa_mix_s24_32re_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+    while (data < end) {
+        int64_t sum = 0;
+        unsigned i;
 
-            while (data < end) {
-                int64_t sum = 0;
-                unsigned i;
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t cv = m->linear[channel].i;
+            int64_t v;
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t cv = m->linear[channel].i;
-                    int64_t v;
+            if (PA_LIKELY(cv > 0)) {
+                v = (int32_t) (PA_UINT32_SWAP(*((uint32_t*) m->ptr)) << 8);
+                v = (v * cv) >> 16;
+                sum += v;
+            }
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+            m->ptr = (uint8_t*) m->ptr + sizeof(int32_t);
+        }
 
-                    v = (int32_t) (PA_READ24NE(m->ptr) << 8);
-                    v = (v * cv) >> 16;
-                    sum += v;
+        sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+        *((uint32_t*) data) = PA_INT32_SWAP(((uint32_t) (int32_t) sum) >> 8);
 
-                    m->ptr = (uint8_t*) m->ptr + 3;
-                }
+        data = (uint8_t*) data + sizeof(uint32_t);
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
-                PA_WRITE24NE(data, ((uint32_t) sum) >> 8);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-                data = (uint8_t*) data + 3;
+static void pa_mix_u8_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
-            }
+    while (data < end) {
+        int32_t sum = 0;
+        unsigned i;
 
-            break;
-        }
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, cv = m->linear[channel].i;
 
-        case PA_SAMPLE_S24RE: {
-            unsigned channel = 0;
+            if (PA_LIKELY(cv > 0)) {
+                v = (int32_t) *((uint8_t*) m->ptr) - 0x80;
+                v = (v * cv) >> 16;
+                sum += v;
+            }
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+            m->ptr = (uint8_t*) m->ptr + 1;
+        }
 
-            while (data < end) {
-                int64_t sum = 0;
-                unsigned i;
+        sum = PA_CLAMP_UNLIKELY(sum, -0x80, 0x7F);
+        *((uint8_t*) data) = (uint8_t) (sum + 0x80);
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t cv = m->linear[channel].i;
-                    int64_t v;
+        data = (uint8_t*) data + 1;
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-                    v = (int32_t) (PA_READ24RE(m->ptr) << 8);
-                    v = (v * cv) >> 16;
-                    sum += v;
+static void pa_mix_ulaw_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                    m->ptr = (uint8_t*) m->ptr + 3;
-                }
+    while (data < end) {
+        int32_t sum = 0;
+        unsigned i;
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
-                PA_WRITE24RE(data, ((uint32_t) sum) >> 8);
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, hi, lo, cv = m->linear[channel].i;
 
-                data = (uint8_t*) data + 3;
+            if (PA_LIKELY(cv > 0)) {
+                hi = cv >> 16;
+                lo = cv & 0xFFFF;
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
+                v = (int32_t) st_ulaw2linear16(*((uint8_t*) m->ptr));
+                v = ((v * lo) >> 16) + (v * hi);
+                sum += v;
             }
 
-            break;
+            m->ptr = (uint8_t*) m->ptr + 1;
         }
 
-        case PA_SAMPLE_S24_32NE: {
-            unsigned channel = 0;
-
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+        sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+        *((uint8_t*) data) = (uint8_t) st_14linear2ulaw((int16_t) sum >> 2);
 
-            while (data < end) {
-                int64_t sum = 0;
-                unsigned i;
+        data = (uint8_t*) data + 1;
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t cv = m->linear[channel].i;
-                    int64_t v;
-
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-                    v = (int32_t) (*((uint32_t*)m->ptr) << 8);
-                    v = (v * cv) >> 16;
-                    sum += v;
+static void pa_mix_alaw_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                    m->ptr = (uint8_t*) m->ptr + sizeof(int32_t);
-                }
+    while (data < end) {
+        int32_t sum = 0;
+        unsigned i;
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
-                *((uint32_t*) data) = ((uint32_t) (int32_t) sum) >> 8;
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, hi, lo, cv = m->linear[channel].i;
 
-                data = (uint8_t*) data + sizeof(uint32_t);
+            if (PA_LIKELY(cv > 0)) {
+                hi = cv >> 16;
+                lo = cv & 0xFFFF;
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
+                v = (int32_t) st_alaw2linear16(*((uint8_t*) m->ptr));
+                v = ((v * lo) >> 16) + (v * hi);
+                sum += v;
             }
 
-            break;
+            m->ptr = (uint8_t*) m->ptr + 1;
         }
 
-        case PA_SAMPLE_S24_32RE: {
-            unsigned channel = 0;
+        sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+        *((uint8_t*) data) = (uint8_t) st_13linear2alaw((int16_t) sum >> 3);
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+        data = (uint8_t*) data + 1;
 
-            while (data < end) {
-                int64_t sum = 0;
-                unsigned i;
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t cv = m->linear[channel].i;
-                    int64_t v;
+static void pa_mix_float32ne_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+    while (data < end) {
+        float sum = 0;
+        unsigned i;
 
-                    v = (int32_t) (PA_UINT32_SWAP(*((uint32_t*) m->ptr)) << 8);
-                    v = (v * cv) >> 16;
-                    sum += v;
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            float v, cv = m->linear[channel].f;
 
-                    m->ptr = (uint8_t*) m->ptr + 3;
-                }
+            if (PA_LIKELY(cv > 0)) {
+                v = *((float*) m->ptr);
+                v *= cv;
+                sum += v;
+            }
+
+            m->ptr = (uint8_t*) m->ptr + sizeof(float);
+        }
+
+        *((float*) data) = sum;
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
-                *((uint32_t*) data) = PA_INT32_SWAP(((uint32_t) (int32_t) sum) >> 8);
+        data = (uint8_t*) data + sizeof(float);
 
-                data = (uint8_t*) data + sizeof(uint32_t);
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static void pa_mix_float32re_c(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    unsigned channel = 0;
+    void *end = (uint8_t*) data + length;
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
+    while (data < end) {
+        float sum = 0;
+        unsigned i;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            float v, cv = m->linear[channel].f;
+
+            if (PA_LIKELY(cv > 0)) {
+                v = PA_FLOAT32_SWAP(*(float*) m->ptr);
+                v *= cv;
+                sum += v;
             }
 
-            break;
+            m->ptr = (uint8_t*) m->ptr + sizeof(float);
         }
 
-        case PA_SAMPLE_U8: {
-            unsigned channel = 0;
+        *((float*) data) = PA_FLOAT32_SWAP(sum);
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+        data = (uint8_t*) data + sizeof(float);
 
-            while (data < end) {
-                int32_t sum = 0;
-                unsigned i;
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t v, cv = m->linear[channel].i;
+static pa_do_mix_func_t do_mix_table[] = {
+    [PA_SAMPLE_U8]        = (pa_do_mix_func_t) pa_mix_u8_c,
+    [PA_SAMPLE_ALAW]      = (pa_do_mix_func_t) pa_mix_alaw_c,
+    [PA_SAMPLE_ULAW]      = (pa_do_mix_func_t) pa_mix_ulaw_c,
+    [PA_SAMPLE_S16NE]     = (pa_do_mix_func_t) pa_mix_s16ne_c,
+    [PA_SAMPLE_S16RE]     = (pa_do_mix_func_t) pa_mix_s16re_c,
+    [PA_SAMPLE_FLOAT32NE] = (pa_do_mix_func_t) pa_mix_float32ne_c,
+    [PA_SAMPLE_FLOAT32RE] = (pa_do_mix_func_t) pa_mix_float32re_c,
+    [PA_SAMPLE_S32NE]     = (pa_do_mix_func_t) pa_mix_s32ne_c,
+    [PA_SAMPLE_S32RE]     = (pa_do_mix_func_t) pa_mix_s32re_c,
+    [PA_SAMPLE_S24NE]     = (pa_do_mix_func_t) pa_mix_s24ne_c,
+    [PA_SAMPLE_S24RE]     = (pa_do_mix_func_t) pa_mix_s24re_c,
+    [PA_SAMPLE_S24_32NE]  = (pa_do_mix_func_t) pa_mix_s24_32ne_c,
+    [PA_SAMPLE_S24_32RE]  = (pa_do_mix_func_t) pa_mix_s24_32re_c
+};
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+pa_do_mix_func_t pa_get_mix_func(pa_sample_format_t f) {
+    pa_assert(f >= 0);
+    pa_assert(f < PA_SAMPLE_MAX);
 
-                    v = (int32_t) *((uint8_t*) m->ptr) - 0x80;
-                    v = (v * cv) >> 16;
-                    sum += v;
+    return do_mix_table[f];
+}
 
-                    m->ptr = (uint8_t*) m->ptr + 1;
-                }
+void pa_set_mix_func(pa_sample_format_t f, pa_do_mix_func_t func) {
+    pa_assert(f >= 0);
+    pa_assert(f < PA_SAMPLE_MAX);
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x80, 0x7F);
-                *((uint8_t*) data) = (uint8_t) (sum + 0x80);
+    do_mix_table[f] = func;
+}
 
-                data = (uint8_t*) data + 1;
+void pa_mix_split_s16_volumes(pa_mix_info streams[], unsigned nstreams, unsigned channels) {
+    unsigned k, channel;
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
-            }
+    pa_assert(streams);
+    pa_assert(channels <= PA_CHANNELS_MAX);
+
+    for (k = 0; k < nstreams; k++) {
+        pa_mix_info *m = streams + k;
 
-            break;
+        for (channel = 0; channel < channels + PA_MIX_VOLUME_PADDING; channel++) {
+            m->linear_lo[channel] = (int16_t) (m->linear[channel].i & 0xFFFF);
+            m->linear_hi[channel] = (int16_t) (m->linear[channel].i >> 16);
         }
+    }
+}
 
-        case PA_SAMPLE_ULAW: {
-            unsigned channel = 0;
+typedef void (*pa_calc_stream_volumes_func_t) (pa_mix_info streams[], unsigned nstreams, const pa_cvolume *volume, const pa_sample_spec *spec);
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+/* Returns the length we can mix and whether any of the streams may be
+ * audible at all */
+static size_t streams_length(pa_mix_info streams[], unsigned nstreams, size_t length, pa_bool_t *audible) {
+    unsigned k;
 
-            while (data < end) {
-                int32_t sum = 0;
-                unsigned i;
+    *audible = FALSE;
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t v, hi, lo, cv = m->linear[channel].i;
+    for (k = 0; k < nstreams; k++) {
+        if (length > streams[k].chunk.length)
+            length = streams[k].chunk.length;
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+        if (!pa_memblock_is_silence(streams[k].chunk.memblock) && !pa_cvolume_is_muted(&streams[k].volume))
+            *audible = TRUE;
+    }
 
-                    hi = cv >> 16;
-                    lo = cv & 0xFFFF;
+    return length;
+}
 
-                    v = (int32_t) st_ulaw2linear16(*((uint8_t*) m->ptr));
-                    v = ((v * lo) >> 16) + (v * hi);
-                    sum += v;
+static const pa_calc_stream_volumes_func_t calc_stream_volumes_table[] = {
+  [PA_SAMPLE_U8]        = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_ALAW]      = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_ULAW]      = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_S16LE]     = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_S16BE]     = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_FLOAT32LE] = (pa_calc_stream_volumes_func_t) calc_linear_float_stream_volumes,
+  [PA_SAMPLE_FLOAT32BE] = (pa_calc_stream_volumes_func_t) calc_linear_float_stream_volumes,
+  [PA_SAMPLE_S32LE]     = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_S32BE]     = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_S24LE]     = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_S24BE]     = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_S24_32LE]  = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes,
+  [PA_SAMPLE_S24_32BE]  = (pa_calc_stream_volumes_func_t) calc_linear_integer_stream_volumes
+};
 
-                    m->ptr = (uint8_t*) m->ptr + 1;
-                }
+size_t pa_mix(
+        pa_mix_info streams[],
+        unsigned nstreams,
+        void *data,
+        size_t length,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume,
+        pa_bool_t mute) {
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
-                *((uint8_t*) data) = (uint8_t) st_14linear2ulaw((int16_t) sum >> 2);
+    pa_cvolume full_volume;
+    pa_do_mix_func_t do_mix;
+    pa_bool_t audible;
+    unsigned k;
 
-                data = (uint8_t*) data + 1;
+    pa_assert(streams);
+    pa_assert(data);
+    pa_assert(length);
+    pa_assert(spec);
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
-            }
+    if (!volume)
+        volume = pa_cvolume_reset(&full_volume, spec->channels);
 
-            break;
-        }
+    if (mute || pa_cvolume_is_muted(volume) || nstreams <= 0) {
+        pa_silence_memory(data, length, spec);
+        return length;
+    }
 
-        case PA_SAMPLE_ALAW: {
-            unsigned channel = 0;
+    if (spec->format < 0 || spec->format >= PA_SAMPLE_MAX) {
+        pa_log_error("Unable to mix audio data of format %s.", pa_sample_format_to_string(spec->format));
+        pa_assert_not_reached();
+    }
 
-            calc_linear_integer_stream_volumes(streams, nstreams, volume, spec);
+    length = streams_length(streams, nstreams, length, &audible);
 
-            while (data < end) {
-                int32_t sum = 0;
-                unsigned i;
+    if (!audible) {
+        pa_silence_memory(data, length, spec);
+        return length;
+    }
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    int32_t v, hi, lo, cv = m->linear[channel].i;
+    for (k = 0; k < nstreams; k++)
+        streams[k].ptr = (uint8_t*) pa_memblock_acquire(streams[k].chunk.memblock) + streams[k].chunk.index;
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+    calc_stream_volumes_table[spec->format](streams, nstreams, volume, spec);
 
-                    hi = cv >> 16;
-                    lo = cv & 0xFFFF;
+    do_mix = pa_get_mix_func(spec->format);
+    pa_assert(do_mix);
 
-                    v = (int32_t) st_alaw2linear16(*((uint8_t*) m->ptr));
-                    v = ((v * lo) >> 16) + (v * hi);
-                    sum += v;
+    do_mix(streams, nstreams, spec->channels, data, (unsigned) length);
 
-                    m->ptr = (uint8_t*) m->ptr + 1;
-                }
+    for (k = 0; k < nstreams; k++)
+        pa_memblock_release(streams[k].chunk.memblock);
 
-                sum = PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
-                *((uint8_t*) data) = (uint8_t) st_13linear2alaw((int16_t) sum >> 3);
+    return length;
+}
 
-                data = (uint8_t*) data + 1;
+/* pa_mix_float() converts up to this many streams at a time into
+ * buffers of this many samples, small enough to stay in the L1 cache */
+#define MIX_FLOAT_STREAMS 8U
+#define MIX_FLOAT_SAMPLES 256
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
-            }
+/* Size of one quantization step of the formats we dither */
+static float dither_step(pa_sample_format_t format) {
+    switch (format) {
+        case PA_SAMPLE_U8:
+            return 1.0f / (float) 0x7F;
 
-            break;
+        case PA_SAMPLE_ALAW:
+        case PA_SAMPLE_ULAW:
+        case PA_SAMPLE_S16LE:
+        case PA_SAMPLE_S16BE:
+            return 1.0f / (float) 0x7FFF;
+
+        default:
+            /* 24 and 32 bit samples are well below the noise floor of
+             * any DAC and floats aren't quantized at all */
+            return 0.0f;
+    }
+}
+
+/* The integer conversions clamp on their own, so we only need to clamp
+ * when we don't dither */
+static void dither_or_clamp(float *f, unsigned n, float step, uint32_t *state) {
+
+    if (step > 0.0f) {
+        const float scale = step / (float) 0x10000;
+        uint32_t r, a;
+
+        pa_assert(state);
+        r = *state;
+
+        /* Triangular noise of +-1 step: the difference of two uniform
+         * 16 bit numbers. Each is the high half of its own LCG output,
+         * the low bits of an LCG are far from random. */
+        for (; n > 0; n--, f++) {
+            r = r * 1103515245U + 12345U;
+            a = r >> 16;
+            r = r * 1103515245U + 12345U;
+            *f += (float) ((int32_t) a - (int32_t) (r >> 16)) * scale;
         }
 
-        case PA_SAMPLE_FLOAT32NE: {
-            unsigned channel = 0;
+        *state = r;
+    } else
+        for (; n > 0; n--, f++)
+            *f = PA_CLAMP_UNLIKELY(*f, -1.0f, 1.0f);
+}
 
-            calc_linear_float_stream_volumes(streams, nstreams, volume, spec);
+size_t pa_mix_float(
+        pa_mix_info streams[],
+        unsigned nstreams,
+        void *data,
+        size_t length,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume,
+        pa_bool_t mute,
+        uint32_t *dither) {
 
-            while (data < end) {
-                float sum = 0;
-                unsigned i;
+    float bus[MIX_FLOAT_SAMPLES], tmp[MIX_FLOAT_SAMPLES];
+    float work[MIX_FLOAT_STREAMS][MIX_FLOAT_SAMPLES];
+    pa_cvolume full_volume;
+    pa_convert_func_t to_float, from_float;
+    pa_do_mix_func_t do_mix;
+    void *saved[MIX_FLOAT_STREAMS];
+    pa_bool_t audible;
+    size_t ss, done;
+    unsigned k, block;
+    float step;
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    float v, cv = m->linear[channel].f;
+    pa_assert(streams);
+    pa_assert(data);
+    pa_assert(length);
+    pa_assert(spec);
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+    if (!volume)
+        volume = pa_cvolume_reset(&full_volume, spec->channels);
 
-                    v = *((float*) m->ptr);
-                    v *= cv;
-                    sum += v;
+    if (mute || pa_cvolume_is_muted(volume) || nstreams <= 0) {
+        pa_silence_memory(data, length, spec);
+        return length;
+    }
 
-                    m->ptr = (uint8_t*) m->ptr + sizeof(float);
-                }
+    length = streams_length(streams, nstreams, length, &audible);
 
-                *((float*) data) = sum;
+    if (!audible) {
+        pa_silence_memory(data, length, spec);
+        return length;
+    }
 
-                data = (uint8_t*) data + sizeof(float);
+    for (k = 0; k < nstreams; k++)
+        streams[k].ptr = (uint8_t*) pa_memblock_acquire(streams[k].chunk.memblock) + streams[k].chunk.index;
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
-            }
+    /* The per-stream factors always end up as floats, whatever the
+     * format of the sink */
+    calc_linear_float_stream_volumes(streams, nstreams, volume, spec);
 
-            break;
-        }
+    pa_assert_se(to_float = pa_get_convert_to_float32ne_function(spec->format));
+    pa_assert_se(from_float = pa_get_convert_from_float32ne_function(spec->format));
+    pa_assert_se(do_mix = pa_get_mix_func(PA_SAMPLE_FLOAT32NE));
 
-        case PA_SAMPLE_FLOAT32RE: {
-            unsigned channel = 0;
+    ss = pa_sample_size(spec);
+    block = (MIX_FLOAT_SAMPLES / spec->channels) * spec->channels;
+    step = dither ? dither_step(spec->format) : 0.0f;
 
-            calc_linear_float_stream_volumes(streams, nstreams, volume, spec);
+    for (done = 0; done < length; done += block * ss) {
+        unsigned n, first;
 
-            while (data < end) {
-                float sum = 0;
-                unsigned i;
+        if (length - done < block * ss)
+            block = (unsigned) ((length - done) / ss);
 
-                for (i = 0; i < nstreams; i++) {
-                    pa_mix_info *m = streams + i;
-                    float v, cv = m->linear[channel].f;
+        /* Every stream is converted to float exactly once and then a
+         * group of streams is summed up by the (vectorized) float
+         * mixer. Blocks are always whole frames, so the mixer starts at
+         * channel 0 each time. Streams that already are native floats
+         * are mixed in place. */
+        for (first = 0; first < nstreams; first += n) {
+            n = PA_MIN(nstreams - first, MIX_FLOAT_STREAMS);
 
-                    if (PA_UNLIKELY(cv <= 0))
-                        continue;
+            for (k = 0; k < n; k++) {
+                pa_mix_info *m = streams + first + k;
 
-                    v = PA_FLOAT32_SWAP(*(float*) m->ptr);
-                    v *= cv;
-                    sum += v;
+                /* The mixer may move ptr on, so we point it at the
+                 * current block and restore it afterwards */
+                saved[k] = m->ptr;
 
-                    m->ptr = (uint8_t*) m->ptr + sizeof(float);
+                if (spec->format == PA_SAMPLE_FLOAT32NE)
+                    m->ptr = (uint8_t*) saved[k] + done;
+                else {
+                    to_float(block, (uint8_t*) saved[k] + done, work[k]);
+                    m->ptr = work[k];
                 }
+            }
 
-                *((float*) data) = PA_FLOAT32_SWAP(sum);
+            do_mix(streams + first, n, spec->channels, first == 0 ? bus : tmp, block * (unsigned) sizeof(float));
 
-                data = (uint8_t*) data + sizeof(float);
+            for (k = 0; k < n; k++)
+                streams[first + k].ptr = saved[k];
 
-                if (PA_UNLIKELY(++channel >= spec->channels))
-                    channel = 0;
-            }
+            if (first > 0) {
+                unsigned i;
 
-            break;
+                for (i = 0; i < block; i++)
+                    bus[i] += tmp[i];
+            }
         }
 
-        default:
-            pa_log_error("Unable to mix audio data of format %s.", pa_sample_format_to_string(spec->format));
-            pa_assert_not_reached();
+        /* The only quantization on the whole way from the streams to
+         * the device */
+        dither_or_clamp(bus, block, step, dither);
+        from_float(block, bus, (uint8_t*) data + done);
     }
 
     for (k = 0; k < nstreams; k++)
@@ -42,6 +42,11 @@ pa_memblock* pa_silence_memblock(pa_memblock *b, const pa_sample_spec *spec);
 
 pa_memchunk* pa_silence_memchunk_get(pa_silence_cache *cache, pa_mempool *pool, pa_memchunk* ret, const pa_sample_spec *spec, size_t length);
 
+/* The per-channel factors in pa_mix_info are followed by this many
+ * entries repeating them, so that vectorized mixers can load a full
+ * register of factors starting at any channel. */
+#define PA_MIX_VOLUME_PADDING 16
+
 typedef struct pa_mix_info {
     pa_memchunk chunk;
     pa_cvolume volume;
@@ -53,7 +58,12 @@ typedef struct pa_mix_info {
     union {
         int32_t i;
         float f;
-    } linear[PA_CHANNELS_MAX];
+    } linear[PA_CHANNELS_MAX + PA_MIX_VOLUME_PADDING];
+
+    /* The 16.16 factors split into their low halves (as signed words)
+     * and high halves, see pa_mix_split_s16_volumes() */
+    int16_t linear_lo[PA_CHANNELS_MAX + PA_MIX_VOLUME_PADDING];
+    int16_t linear_hi[PA_CHANNELS_MAX + PA_MIX_VOLUME_PADDING];
 } pa_mix_info;
 
 size_t pa_mix(
@@ -65,6 +75,22 @@ size_t pa_mix(
     const pa_cvolume *volume,
     pa_bool_t mute);
 
+/* Like pa_mix(), but converts every stream to float once, sums them up
+ * in float and converts the result back in one final step. If dither
+ * is not NULL it is the state of the dither noise that is added before
+ * quantizing to 16 bit or less. The streams come in the format of spec,
+ * so unless that is float this is one conversion per stream more than
+ * pa_mix() does. */
+size_t pa_mix_float(
+    pa_mix_info channels[],
+    unsigned nchannels,
+    void *data,
+    size_t length,
+    const pa_sample_spec *spec,
+    const pa_cvolume *volume,
+    pa_bool_t mute,
+    uint32_t *dither);
+
 void pa_volume_memchunk(
     pa_memchunk*c,
     const pa_sample_spec *spec,
@@ -91,6 +117,18 @@ typedef void (*pa_do_volume_func_t) (void *samples, void *volumes, unsigned chan
 pa_do_volume_func_t pa_get_volume_func(pa_sample_format_t f);
 void pa_set_volume_func(pa_sample_format_t f, pa_do_volume_func_t func);
 
+/* Mixes the streams into data, length is in bytes. The streams' ptr
+ * and linear fields have been set up by pa_mix() */
+typedef void (*pa_do_mix_func_t) (pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length);
+
+pa_do_mix_func_t pa_get_mix_func(pa_sample_format_t f);
+void pa_set_mix_func(pa_sample_format_t f, pa_do_mix_func_t func);
+
+/* For mixers that multiply 16 bit samples in 16 bit lanes: fills in
+ * linear_lo[] and linear_hi[] from the 16.16 factors in linear[],
+ * padding included. */
+void pa_mix_split_s16_volumes(pa_mix_info streams[], unsigned nstreams, unsigned channels);
+
 size_t pa_convert_size(size_t size, const pa_sample_spec *from, const pa_sample_spec *to);
 
 #define PA_CHANNEL_POSITION_MASK_LEFT                                   \
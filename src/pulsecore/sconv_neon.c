@@ -0,0 +1,191 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <pulse/rtclock.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-arm.h"
+#include "sconv.h"
+
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#include <arm_neon.h>
+
+/* NEON has no division and no round-to-nearest conversion, so these
+ * multiply by the reciprocal and round half away from zero. The results
+ * may differ from the C versions by one in the last place. Converting
+ * float to S32 needs double precision to match the C rounding and is
+ * left to the C version. */
+
+static void pa_sconv_s16ne_to_f32ne_neon(unsigned n, const int16_t *a, float *b) {
+    const float32x4_t scale = vdupq_n_f32(1.0f / (float) 0x7FFF);
+
+    for (; n >= 8; n -= 8) {
+        int16x8_t s = vld1q_s16(a);
+
+        vst1q_f32(b, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))), scale));
+        vst1q_f32(b + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), scale));
+
+        a += 8;
+        b += 8;
+    }
+
+    for (; n > 0; n--)
+        *(b++) = ((float) (*(a++)))/(float) 0x7FFF;
+}
+
+static void pa_sconv_s32ne_to_f32ne_neon(unsigned n, const int32_t *a, float *b) {
+    const float32x4_t scale = vdupq_n_f32(1.0f / (float) 0x7FFFFFFF);
+
+    for (; n >= 4; n -= 4) {
+        vst1q_f32(b, vmulq_f32(vcvtq_f32_s32(vld1q_s32(a)), scale));
+
+        a += 4;
+        b += 4;
+    }
+
+    for (; n > 0; n--)
+        *(b++) = (float) (((double) (*(a++)))/0x7FFFFFFF);
+}
+
+static inline int32x4_t float_to_s16_range(float32x4_t v) {
+    const float32x4_t one = vdupq_n_f32(1.0f), mone = vdupq_n_f32(-1.0f);
+    const float32x4_t scale = vdupq_n_f32((float) 0x7FFF), half = vdupq_n_f32(0.5f);
+    const uint32x4_t sign = vdupq_n_u32(0x80000000U);
+    float32x4_t r;
+
+    v = vmulq_f32(vmaxq_f32(vminq_f32(v, one), mone), scale);
+
+    /* add +-0.5 with the sign of v, the conversion truncates */
+    r = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(half),
+                                        vandq_u32(vreinterpretq_u32_f32(v), sign)));
+
+    return vcvtq_s32_f32(vaddq_f32(v, r));
+}
+
+static void pa_sconv_s16ne_from_f32ne_neon(unsigned n, const float *a, int16_t *b) {
+    for (; n >= 8; n -= 8) {
+        int16x4_t lo, hi;
+
+        lo = vqmovn_s32(float_to_s16_range(vld1q_f32(a)));
+        hi = vqmovn_s32(float_to_s16_range(vld1q_f32(a + 4)));
+        vst1q_s16(b, vcombine_s16(lo, hi));
+
+        a += 8;
+        b += 8;
+    }
+
+    for (; n > 0; n--) {
+        float v = *(a++);
+
+        v = PA_CLAMP_UNLIKELY(v, -1.0f, 1.f);
+        *(b++) = (int16_t) lrintf(v * 0x7FFF);
+    }
+}
+
+#undef RUN_TEST
+
+#ifdef RUN_TEST
+#define SAMPLES 1019
+#define TIMES 1000
+
+static void run_test (void) {
+    int16_t samples[SAMPLES];
+    int16_t samples_ref[SAMPLES];
+    float floats[SAMPLES];
+    float floats_ref[SAMPLES];
+    int i;
+    pa_usec_t start, stop;
+    pa_convert_func_t func;
+
+    printf ("checking NEON %zd\n", sizeof (samples));
+
+    memset (samples_ref, 0, sizeof (samples_ref));
+    memset (samples, 0, sizeof (samples));
+
+    for (i = 0; i < SAMPLES; i++) {
+        floats[i] = (rand()/(RAND_MAX+2.2)) - 1.1;
+    }
+
+    func = pa_get_convert_from_float32ne_function (PA_SAMPLE_S16NE);
+    func (SAMPLES, floats, samples_ref);
+    pa_sconv_s16ne_from_f32ne_neon (SAMPLES, floats, samples);
+
+    for (i = 0; i < SAMPLES; i++) {
+        if (abs (samples[i] - samples_ref[i]) > 1) {
+            printf ("%d: %04x != %04x (%f)\n", i, samples[i], samples_ref[i],
+                      floats[i]);
+        }
+    }
+
+    func = pa_get_convert_to_float32ne_function (PA_SAMPLE_S16NE);
+    func (SAMPLES, samples_ref, floats_ref);
+    pa_sconv_s16ne_to_f32ne_neon (SAMPLES, samples_ref, floats);
+
+    for (i = 0; i < SAMPLES; i++) {
+        if (fabsf (floats[i] - floats_ref[i]) > 1e-6f) {
+            printf ("%d: %f != %f (%04x)\n", i, floats[i], floats_ref[i],
+                      samples_ref[i]);
+        }
+    }
+
+    start = pa_rtclock_now();
+    for (i = 0; i < TIMES; i++) {
+        pa_sconv_s16ne_from_f32ne_neon (SAMPLES, floats, samples);
+    }
+    stop = pa_rtclock_now();
+    pa_log_info("NEON: %llu usec.", (long long unsigned int)(stop - start));
+
+    func = pa_get_convert_from_float32ne_function (PA_SAMPLE_S16NE);
+    start = pa_rtclock_now();
+    for (i = 0; i < TIMES; i++) {
+        func (SAMPLES, floats, samples_ref);
+    }
+    stop = pa_rtclock_now();
+    pa_log_info("ref: %llu usec.", (long long unsigned int)(stop - start));
+}
+#endif
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+
+void pa_convert_func_init_neon (pa_cpu_arm_flag_t flags) {
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#ifdef RUN_TEST
+    run_test ();
+#endif
+
+    if (flags & PA_CPU_ARM_NEON) {
+        pa_log_info("Initialising NEON optimized conversions.");
+
+        pa_set_convert_from_float32ne_function (PA_SAMPLE_S16NE, (pa_convert_func_t) pa_sconv_s16ne_from_f32ne_neon);
+        pa_set_convert_to_float32ne_function (PA_SAMPLE_S16NE, (pa_convert_func_t) pa_sconv_s16ne_to_f32ne_neon);
+        pa_set_convert_to_float32ne_function (PA_SAMPLE_S32NE, (pa_convert_func_t) pa_sconv_s32ne_to_f32ne_neon);
+    }
+
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+}
@@ -40,6 +40,7 @@
 static const PA_DECLARE_ALIGNED (16, float, one[4]) = { 1.0, 1.0, 1.0, 1.0 };
 static const PA_DECLARE_ALIGNED (16, float, mone[4]) = { -1.0, -1.0, -1.0, -1.0 };
 static const PA_DECLARE_ALIGNED (16, float, scale[4]) = { 0x7fff, 0x7fff, 0x7fff, 0x7fff };
+static const PA_DECLARE_ALIGNED (16, float, iscale[4]) = { 1.0/0x7fff, 1.0/0x7fff, 1.0/0x7fff, 1.0/0x7fff };
 
 static void pa_sconv_s16le_from_f32ne_sse(unsigned n, const float *a, int16_t *b) {
     pa_reg_x86 temp, i;
@@ -164,6 +165,62 @@ static void pa_sconv_s16le_from_f32ne_sse2(unsigned n, const float *a, int16_t *
     );
 }
 
+/* Multiplies with the reciprocal instead of dividing, so the result may
+ * differ from the C version in the last place */
+static void pa_sconv_s16le_to_f32ne_sse2(unsigned n, const int16_t *a, float *b) {
+    pa_reg_x86 temp, i, s;
+
+    __asm__ __volatile__ (
+        " movaps %6, %%xmm7             \n\t"
+        " xor %0, %0                    \n\t"
+
+        " mov %5, %1                    \n\t"
+        " sar $3, %1                    \n\t" /* 8 samples at a time */
+        " cmp $0, %1                    \n\t"
+        " je 2f                         \n\t"
+
+        "1:                             \n\t"
+        " movdqu (%3, %0), %%xmm0       \n\t" /* read 8 samples */
+        " movdqa %%xmm0, %%xmm1         \n\t"
+        " punpcklwd %%xmm0, %%xmm0      \n\t" /* move them to the upper */
+        " punpckhwd %%xmm1, %%xmm1      \n\t" /* half of 32 bit words */
+        " psrad $16, %%xmm0             \n\t" /* and sign extend */
+        " psrad $16, %%xmm1             \n\t"
+
+        " cvtdq2ps %%xmm0, %%xmm0       \n\t"
+        " cvtdq2ps %%xmm1, %%xmm1       \n\t"
+        " mulps  %%xmm7, %%xmm0         \n\t" /* /= 0x7fff */
+        " mulps  %%xmm7, %%xmm1         \n\t"
+
+        " movups %%xmm0, (%4, %0, 2)    \n\t"
+        " movups %%xmm1, 16(%4, %0, 2)  \n\t"
+
+        " add $16, %0                   \n\t"
+        " dec %1                        \n\t"
+        " jne 1b                        \n\t"
+
+        "2:                             \n\t"
+        " mov %5, %1                    \n\t" /* prepare for leftovers */
+        " and $7, %1                    \n\t"
+        " je 4f                         \n\t"
+
+        "3:                             \n\t"
+        " movswl (%3, %0), %k2          \n\t"
+        " cvtsi2ssl %k2, %%xmm0         \n\t"
+        " mulss  %%xmm7, %%xmm0         \n\t"
+        " movss  %%xmm0, (%4, %0, 2)    \n\t"
+        " add $2, %0                    \n\t"
+        " dec %1                        \n\t"
+        " jne 3b                        \n\t"
+
+        "4:                             \n\t"
+
+        : "=&r" (i), "=&r" (temp), "=&r" (s)
+        : "r" (a), "r" (b), "r" ((pa_reg_x86)n), "m" (*iscale)
+        : "cc", "memory"
+    );
+}
+
 #undef RUN_TEST
 
 #ifdef RUN_TEST
@@ -226,6 +283,7 @@ void pa_convert_func_init_sse (pa_cpu_x86_flag_t flags) {
     if (flags & PA_CPU_X86_SSE2) {
         pa_log_info("Initialising SSE2 optimized conversions.");
         pa_set_convert_from_float32ne_function (PA_SAMPLE_S16LE, (pa_convert_func_t) pa_sconv_s16le_from_f32ne_sse2);
+        pa_set_convert_to_float32ne_function (PA_SAMPLE_S16LE, (pa_convert_func_t) pa_sconv_s16le_to_f32ne_sse2);
     } else {
         pa_log_info("Initialising SSE optimized conversions.");
         pa_set_convert_from_float32ne_function (PA_SAMPLE_S16LE, (pa_convert_func_t) pa_sconv_s16le_from_f32ne_sse);
@@ -60,6 +60,10 @@
 #define MADV_REMOVE 9
 #endif
 
+#if defined(HAVE_MEMFD) && !defined(MFD_CLOEXEC)
+#define MFD_CLOEXEC 0x0001U
+#endif
+
 /* 1 GiB at max */
 #define MAX_SHM_SIZE (PA_ALIGN(1024*1024*1024))
 
@@ -111,6 +115,9 @@ int pa_shm_create_rw(pa_shm *m, size_t size, pa_bool_t shared, mode_t mode) {
     /* Round up to make it page aligned */
     size = PA_PAGE_ALIGN(size);
 
+    m->memfd = FALSE;
+    m->fd = -1;
+
     if (!shared) {
         m->id = 0;
         m->size = size;
@@ -197,7 +204,14 @@ void pa_shm_free(pa_shm *m) {
     pa_assert(m->ptr != MAP_FAILED);
 #endif
 
-    if (!m->shared) {
+    if (m->memfd) {
+        if (munmap(m->ptr, PA_PAGE_ALIGN(m->size)) < 0)
+            pa_log("munmap() failed: %s", pa_cstrerror(errno));
+
+        if (m->fd >= 0)
+            pa_close(m->fd);
+
+    } else if (!m->shared) {
 #ifdef MAP_ANONYMOUS
         if (munmap(m->ptr, m->size) < 0)
             pa_log("munmap() failed: %s", pa_cstrerror(errno));
@@ -312,6 +326,8 @@ int pa_shm_attach_ro(pa_shm *m, unsigned id) {
 
     m->do_unlink = FALSE;
     m->shared = TRUE;
+    m->memfd = FALSE;
+    m->fd = -1;
 
     pa_assert_se(pa_close(fd) == 0);
 
@@ -332,6 +348,108 @@ int pa_shm_attach_ro(pa_shm *m, unsigned id) {
 
 #endif /* HAVE_SHM_OPEN */
 
+#ifdef HAVE_MEMFD
+
+int pa_shm_create_memfd(pa_shm *m, size_t size) {
+    char fn[32];
+    int fd;
+
+    pa_assert(m);
+    pa_assert(size > 0);
+    pa_assert(size <= MAX_SHM_SIZE);
+
+    /* Round up to make it page aligned */
+    size = PA_PAGE_ALIGN(size);
+
+    /* The id only needs to be unique among the segments a peer knows
+     * about, there is no name to clash with in /dev/shm */
+    pa_random(&m->id, sizeof(m->id));
+    segment_name(fn, sizeof(fn), m->id);
+
+    if ((fd = (int) syscall(SYS_memfd_create, fn + 1, MFD_CLOEXEC)) < 0) {
+        pa_log("memfd_create() failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    m->size = size;
+
+    if (ftruncate(fd, (off_t) m->size) < 0) {
+        pa_log("ftruncate() failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    if ((m->ptr = mmap(NULL, m->size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, (off_t) 0)) == MAP_FAILED) {
+        pa_log("mmap() failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    m->fd = fd;
+    m->do_unlink = FALSE;
+    m->shared = TRUE;
+    m->memfd = TRUE;
+
+    return 0;
+
+fail:
+    pa_close(fd);
+
+    return -1;
+}
+
+int pa_shm_attach_fd(pa_shm *m, unsigned id, int fd, pa_bool_t writable) {
+    struct stat st;
+
+    pa_assert(m);
+    pa_assert(fd >= 0);
+
+    if (fstat(fd, &st) < 0) {
+        pa_log("fstat() failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    if (st.st_size <= 0 ||
+        st.st_size > (off_t) MAX_SHM_SIZE ||
+        PA_ALIGN((size_t) st.st_size) != (size_t) st.st_size) {
+        pa_log("Invalid shared memory segment size");
+        goto fail;
+    }
+
+    m->id = id;
+    m->size = (size_t) st.st_size;
+
+    if ((m->ptr = mmap(NULL, PA_PAGE_ALIGN(m->size), writable ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, (off_t) 0)) == MAP_FAILED) {
+        pa_log("mmap() failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    m->do_unlink = FALSE;
+    m->shared = TRUE;
+    m->memfd = TRUE;
+    m->fd = -1;
+
+    pa_assert_se(pa_close(fd) == 0);
+
+    return 0;
+
+fail:
+    pa_close(fd);
+
+    return -1;
+}
+
+#else /* HAVE_MEMFD */
+
+int pa_shm_create_memfd(pa_shm *m, size_t size) {
+    return -1;
+}
+
+int pa_shm_attach_fd(pa_shm *m, unsigned id, int fd, pa_bool_t writable) {
+    pa_close(fd);
+    return -1;
+}
+
+#endif /* HAVE_MEMFD */
+
 int pa_shm_cleanup(void) {
 
 #ifdef HAVE_SHM_OPEN
@@ -24,7 +24,20 @@
 
 #include <sys/types.h>
 
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
 #include <pulsecore/macro.h>
+#include <pulsecore/creds.h>
+
+/* memfd segments have no name in /dev/shm. They can only be mapped
+ * by whoever was handed the file descriptor over a unix socket. */
+#if defined(HAVE_CREDS) && defined(SYS_memfd_create)
+#define HAVE_MEMFD 1
+#else
+#undef HAVE_MEMFD
+#endif
 
 typedef struct pa_shm {
     unsigned id;
@@ -32,11 +45,22 @@ typedef struct pa_shm {
     size_t size;
     pa_bool_t do_unlink:1;
     pa_bool_t shared:1;
+    pa_bool_t memfd:1;
+
+    /* Only kept open for memfd segments we created */
+    int fd;
 } pa_shm;
 
 int pa_shm_create_rw(pa_shm *m, size_t size, pa_bool_t shared, mode_t mode);
 int pa_shm_attach_ro(pa_shm *m, unsigned id);
 
+/* Create a shared segment backed by an anonymous memfd. m->fd can be
+ * passed to other processes, which then use pa_shm_attach_fd(). That
+ * call takes over the descriptor, closing it in any case, and maps
+ * the segment read-only unless writable is set. */
+int pa_shm_create_memfd(pa_shm *m, size_t size);
+int pa_shm_attach_fd(pa_shm *m, unsigned id, int fd, pa_bool_t writable);
+
 void pa_shm_punch(pa_shm *m, size_t offset, size_t size);
 
 void pa_shm_free(pa_shm *m);
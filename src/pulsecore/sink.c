@@ -46,7 +46,6 @@
 
 #include "sink.h"
 
-#define MAX_MIX_CHANNELS 32
 #define MIX_BUFFER_LENGTH (PA_PAGE_SIZE)
 #define ABSOLUTE_MIN_LATENCY (500)
 #define ABSOLUTE_MAX_LATENCY (10*PA_USEC_PER_SEC)
@@ -100,6 +99,13 @@ void pa_sink_new_data_set_muted(pa_sink_new_data *data, pa_bool_t mute) {
     data->muted = !!mute;
 }
 
+void pa_sink_new_data_set_float_mixing(pa_sink_new_data *data, pa_bool_t float_mixing) {
+    pa_assert(data);
+
+    data->float_mixing_is_set = TRUE;
+    data->float_mixing = !!float_mixing;
+}
+
 void pa_sink_new_data_set_port(pa_sink_new_data *data, const char *port) {
     pa_assert(data);
 
@@ -217,6 +223,9 @@ pa_sink* pa_sink_new(
     if (!data->muted_is_set)
         data->muted = FALSE;
 
+    if (!data->float_mixing_is_set)
+        data->float_mixing = core->float_mixing;
+
     if (data->card)
         pa_proplist_update(data->proplist, PA_UPDATE_MERGE, data->card->proplist);
 
@@ -297,8 +306,13 @@ pa_sink* pa_sink_new(
 
     s->thread_info.rtpoll = NULL;
     s->thread_info.inputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    s->thread_info.render_inputs = NULL;
+    s->thread_info.mix_info = NULL;
+    s->thread_info.n_render_inputs = s->thread_info.n_render_inputs_allocated = 0;
     s->thread_info.soft_volume =  s->soft_volume;
     s->thread_info.soft_muted = s->muted;
+    s->thread_info.float_mixing = data->float_mixing;
+    s->thread_info.dither_state = 0;
     s->thread_info.state = s->state;
     s->thread_info.rewind_nbytes = 0;
     s->thread_info.rewind_requested = FALSE;
@@ -539,6 +553,9 @@ static void sink_free(pa_object *o) {
 
     pa_hashmap_free(s->thread_info.inputs, NULL, NULL);
 
+    pa_xfree(s->thread_info.render_inputs);
+    pa_xfree(s->thread_info.mix_info);
+
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
 
@@ -736,17 +753,58 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
 }
 
 /* Called from IO thread context */
-static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, unsigned maxinfo) {
-    pa_sink_input *i;
-    unsigned n = 0;
-    void *state = NULL;
+static void render_inputs_add(pa_sink *s, pa_sink_input *i) {
+    pa_sink_assert_ref(s);
+    pa_sink_input_assert_ref(i);
+
+    /* The hashmap owns the reference, this is just another view of it */
+
+    if (s->thread_info.n_render_inputs >= s->thread_info.n_render_inputs_allocated) {
+        unsigned n = PA_MAX(s->thread_info.n_render_inputs_allocated * 2, 8U);
+
+        s->thread_info.render_inputs = pa_xrenew(pa_sink_input*, s->thread_info.render_inputs, n);
+
+        /* The mix info is only used within one render call, so there's
+         * nothing to keep */
+        pa_xfree(s->thread_info.mix_info);
+        s->thread_info.mix_info = pa_xnew(pa_mix_info, n);
+
+        s->thread_info.n_render_inputs_allocated = n;
+    }
+
+    s->thread_info.render_inputs[s->thread_info.n_render_inputs++] = i;
+}
+
+/* Called from IO thread context */
+static void render_inputs_remove(pa_sink *s, pa_sink_input *i) {
+    unsigned k;
+
+    pa_sink_assert_ref(s);
+    pa_sink_input_assert_ref(i);
+
+    for (k = 0; k < s->thread_info.n_render_inputs; k++)
+        if (s->thread_info.render_inputs[k] == i) {
+            /* Keep the order, so that mixing doesn't depend on which
+             * stream went away */
+            memmove(s->thread_info.render_inputs + k,
+                    s->thread_info.render_inputs + k + 1,
+                    (s->thread_info.n_render_inputs - k - 1) * sizeof(pa_sink_input*));
+            s->thread_info.n_render_inputs--;
+            return;
+        }
+}
+
+/* Called from IO thread context */
+static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info) {
+    unsigned k, n = 0;
     size_t mixlength = *length;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
-    pa_assert(info);
 
-    while ((i = pa_hashmap_iterate(s->thread_info.inputs, &state, NULL)) && maxinfo > 0) {
+    for (k = 0; k < s->thread_info.n_render_inputs; k++) {
+        pa_sink_input *i = s->thread_info.render_inputs[k];
+
         pa_sink_input_assert_ref(i);
 
         pa_sink_input_peek(i, *length, &info->chunk, &info->volume);
@@ -754,7 +812,9 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
         if (mixlength == 0 || info->chunk.length < mixlength)
             mixlength = info->chunk.length;
 
-        if (pa_memblock_is_silence(info->chunk.memblock)) {
+        /* Neither silence nor a muted stream contribute anything to
+         * the mix, so we don't even hand them to pa_mix() */
+        if (pa_memblock_is_silence(info->chunk.memblock) || pa_cvolume_is_muted(&info->volume)) {
             pa_memblock_unref(info->chunk.memblock);
             continue;
         }
@@ -766,7 +826,6 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
 
         info++;
         n++;
-        maxinfo--;
     }
 
     if (mixlength > 0)
@@ -775,11 +834,54 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
     return n;
 }
 
+/* Called from IO thread context */
+static pa_bool_t sink_is_muted(pa_sink *s) {
+    return s->thread_info.soft_muted || pa_cvolume_is_muted(&s->thread_info.soft_volume);
+}
+
+/* Called from IO thread context */
+static pa_bool_t single_input_is_muted(pa_sink *s, pa_mix_info *info) {
+    pa_cvolume volume;
+
+    if (sink_is_muted(s))
+        return TRUE;
+
+    pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info->volume);
+    return pa_cvolume_is_muted(&volume);
+}
+
+/* Called from IO thread context */
+static pa_bool_t single_input_is_norm(pa_sink *s, pa_mix_info *info) {
+    pa_cvolume volume;
+
+    if (s->thread_info.soft_muted)
+        return FALSE;
+
+    pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info->volume);
+    return pa_cvolume_is_norm(&volume);
+}
+
+/* Called from IO thread context */
+static size_t mix_inputs(pa_sink *s, pa_mix_info *info, unsigned n, void *data, size_t length) {
+
+    if (s->thread_info.float_mixing)
+        return pa_mix_float(info, n,
+                            data, length,
+                            &s->sample_spec,
+                            &s->thread_info.soft_volume,
+                            s->thread_info.soft_muted,
+                            &s->thread_info.dither_state);
+
+    return pa_mix(info, n,
+                  data, length,
+                  &s->sample_spec,
+                  &s->thread_info.soft_volume,
+                  s->thread_info.soft_muted);
+}
+
 /* Called from IO thread context */
 static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *result) {
-    pa_sink_input *i;
-    void *state;
-    unsigned p = 0;
+    unsigned k, p = 0;
     unsigned n_unreffed = 0;
 
     pa_sink_assert_ref(s);
@@ -788,26 +890,16 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
     pa_assert(result->memblock);
     pa_assert(result->length > 0);
 
-    /* We optimize for the case where the order of the inputs has not changed */
-
-    PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
-        unsigned j;
+    for (k = 0; k < s->thread_info.n_render_inputs; k++) {
+        pa_sink_input *i = s->thread_info.render_inputs[k];
         pa_mix_info* m = NULL;
 
         pa_sink_input_assert_ref(i);
 
-        /* Let's try to find the matching entry info the pa_mix_info array */
-        for (j = 0; j < n; j ++) {
-
-            if (info[p].userdata == i) {
-                m = info + p;
-                break;
-            }
-
-            p++;
-            if (p >= n)
-                p = 0;
-        }
+        /* fill_mix_info() walked the same array, so the non-silent
+         * inputs come in the same order in the pa_mix_info array */
+        if (p < n && info[p].userdata == i)
+            m = info + p++;
 
         /* Drop read data */
         pa_sink_input_drop(i, result->length);
@@ -874,7 +966,7 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
 
 /* Called from IO thread context */
 void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
+    pa_mix_info *info;
     unsigned n;
     size_t block_size_max;
 
@@ -905,7 +997,8 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    info = s->thread_info.mix_info;
+    n = fill_mix_info(s, &length, info);
 
     if (n == 0) {
 
@@ -915,8 +1008,17 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
         if (result->length > length)
             result->length = length;
 
-    } else if (n == 1) {
-        pa_cvolume volume;
+    } else if (sink_is_muted(s) || (n == 1 && single_input_is_muted(s, info))) {
+
+        /* Hand out a block that is flagged as silence, so that
+         * everybody after us can skip it as well */
+        pa_silence_memchunk_get(&s->core->silence_cache,
+                                s->core->mempool,
+                                result,
+                                &s->sample_spec,
+                                length);
+
+    } else if (n == 1 && single_input_is_norm(s, info)) {
 
         *result = info[0].chunk;
         pa_memblock_ref(result->memblock);
@@ -924,29 +1026,16 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
         if (result->length > length)
             result->length = length;
 
-        pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info[0].volume);
-
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume)) {
-            pa_memblock_unref(result->memblock);
-            pa_silence_memchunk_get(&s->core->silence_cache,
-                                    s->core->mempool,
-                                    result,
-                                    &s->sample_spec,
-                                    result->length);
-        } else if (!pa_cvolume_is_norm(&volume)) {
-            pa_memchunk_make_writable(result, 0);
-            pa_volume_memchunk(result, &s->sample_spec, &volume);
-        }
     } else {
         void *ptr;
+
+        /* This also handles a single input that needs a volume
+         * adjustment: pa_mix() scales while copying, which is cheaper
+         * than copying the block first and scaling it in place */
         result->memblock = pa_memblock_new(s->core->mempool, length);
 
         ptr = pa_memblock_acquire(result->memblock);
-        result->length = pa_mix(info, n,
-                                ptr, length,
-                                &s->sample_spec,
-                                &s->thread_info.soft_volume,
-                                s->thread_info.soft_muted);
+        result->length = mix_inputs(s, info, n, ptr, length);
         pa_memblock_release(result->memblock);
 
         result->index = 0;
@@ -959,7 +1048,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
 /* Called from IO thread context */
 void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
+    pa_mix_info *info;
     unsigned n;
     size_t length, block_size_max;
 
@@ -988,51 +1077,33 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    info = s->thread_info.mix_info;
+    n = fill_mix_info(s, &length, info);
 
     if (n == 0) {
         if (target->length > length)
             target->length = length;
 
         pa_silence_memchunk(target, &s->sample_spec);
-    } else if (n == 1) {
-        pa_cvolume volume;
+    } else if (n == 1 && single_input_is_norm(s, info)) {
+        pa_memchunk vchunk;
 
         if (target->length > length)
             target->length = length;
 
-        pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info[0].volume);
-
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume))
-            pa_silence_memchunk(target, &s->sample_spec);
-        else {
-            pa_memchunk vchunk;
-
-            vchunk = info[0].chunk;
-            pa_memblock_ref(vchunk.memblock);
-
-            if (vchunk.length > length)
-                vchunk.length = length;
+        vchunk = info[0].chunk;
 
-            if (!pa_cvolume_is_norm(&volume)) {
-                pa_memchunk_make_writable(&vchunk, 0);
-                pa_volume_memchunk(&vchunk, &s->sample_spec, &volume);
-            }
+        if (vchunk.length > length)
+            vchunk.length = length;
 
-            pa_memchunk_memcpy(target, &vchunk);
-            pa_memblock_unref(vchunk.memblock);
-        }
+        pa_memchunk_memcpy(target, &vchunk);
 
     } else {
         void *ptr;
 
         ptr = pa_memblock_acquire(target->memblock);
 
-        target->length = pa_mix(info, n,
-                                (uint8_t*) ptr + target->index, length,
-                                &s->sample_spec,
-                                &s->thread_info.soft_volume,
-                                s->thread_info.soft_muted);
+        target->length = mix_inputs(s, info, n, (uint8_t*) ptr + target->index, length);
 
         pa_memblock_release(target->memblock);
     }
@@ -1114,6 +1185,78 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
     pa_sink_unref(s);
 }
 
+/* Called from IO thread context */
+pa_bool_t pa_sink_render_is_zero_copy(pa_sink *s) {
+    pa_sink_input *i;
+    pa_cvolume volume;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+
+    if (s->thread_info.state == PA_SINK_SUSPENDED)
+        return FALSE;
+
+    /* Without anything audible we hand out flagged silence */
+    if (s->thread_info.n_render_inputs == 0 || sink_is_muted(s))
+        return TRUE;
+
+    if (s->thread_info.n_render_inputs != 1)
+        return FALSE;
+
+    i = s->thread_info.render_inputs[0];
+
+    /* The render queue of a sink input is always in the sink's sample
+     * spec, so the volume is all that decides whether the sink input's
+     * blocks can be passed through unchanged */
+    pa_sink_input_get_render_volume(i, &volume);
+    pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &volume);
+
+    return pa_cvolume_is_norm(&volume) || pa_cvolume_is_muted(&volume);
+}
+
+/* Called from IO thread context */
+unsigned pa_sink_render_full_chain(pa_sink *s, size_t length, pa_memchunk *chunks, unsigned max_chunks) {
+    unsigned n = 0;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+    pa_assert(PA_SINK_IS_LINKED(s->thread_info.state));
+    pa_assert(length > 0);
+    pa_assert(pa_frame_aligned(length, &s->sample_spec));
+    pa_assert(chunks);
+    pa_assert(max_chunks > 0);
+
+    pa_assert(!s->thread_info.rewind_requested);
+    pa_assert(s->thread_info.rewind_nbytes == 0);
+
+    pa_sink_ref(s);
+
+    /* pa_sink_render() passes the block of a single unity volume input
+     * through as is, so as long as we don't have to stitch the pieces
+     * together nothing gets copied here. Only the last slot is filled
+     * with pa_sink_render_full() so that we always deliver length
+     * bytes. */
+    while (length > 0) {
+
+        if (n + 1 >= max_chunks) {
+            pa_sink_render_full(s, length, &chunks[n++]);
+            break;
+        }
+
+        pa_sink_render(s, length, &chunks[n]);
+
+        pa_assert(chunks[n].length > 0);
+        pa_assert(chunks[n].length <= length);
+
+        length -= chunks[n].length;
+        n++;
+    }
+
+    pa_sink_unref(s);
+
+    return n;
+}
+
 /* Called from main thread */
 pa_usec_t pa_sink_get_latency(pa_sink *s) {
     pa_usec_t usec = 0;
@@ -1754,6 +1897,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
              * PA_SINK_MESSAGE_FINISH_MOVE, too. */
 
             pa_hashmap_put(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index), pa_sink_input_ref(i));
+            render_inputs_add(s, i);
 
             /* Since the caller sleeps in pa_sink_input_put(), we can
              * safely access data outside of thread_info even though
@@ -1830,8 +1974,10 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
                 i->thread_info.sync_next = NULL;
             }
 
-            if (pa_hashmap_remove(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index)))
+            if (pa_hashmap_remove(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index))) {
+                render_inputs_remove(s, i);
                 pa_sink_input_unref(i);
+            }
 
             pa_sink_invalidate_requested_latency(s, TRUE);
             pa_sink_request_rewind(s, (size_t) -1);
@@ -1873,8 +2019,10 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             i->thread_info.attached = FALSE;
 
             /* Let's remove the sink input ...*/
-            if (pa_hashmap_remove(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index)))
+            if (pa_hashmap_remove(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index))) {
+                render_inputs_remove(s, i);
                 pa_sink_input_unref(i);
+            }
 
             pa_sink_invalidate_requested_latency(s, TRUE);
 
@@ -1896,6 +2044,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             pa_assert(!i->thread_info.sync_prev);
 
             pa_hashmap_put(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index), pa_sink_input_ref(i));
+            render_inputs_add(s, i);
 
             pa_assert(!i->thread_info.attached);
             i->thread_info.attached = TRUE;
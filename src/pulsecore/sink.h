@@ -156,11 +156,21 @@ struct pa_sink {
         pa_sink_state_t state;
         pa_hashmap *inputs;
 
+        /* The same inputs as a plain array, plus room for one
+         * pa_mix_info per input, so that rendering is a linear walk */
+        struct pa_sink_input **render_inputs;
+        pa_mix_info *mix_info;
+        unsigned n_render_inputs, n_render_inputs_allocated;
+
         pa_rtpoll *rtpoll;
 
         pa_cvolume soft_volume;
         pa_bool_t soft_muted:1;
 
+        /* Mix in float and quantize only once, see pa_mix_float() */
+        pa_bool_t float_mixing:1;
+        uint32_t dither_state;
+
         /* The requested latency is used for dynamic latency
          * sinks. For fixed latency sinks it is always identical to
          * the fixed_latency. See below. */
@@ -237,11 +247,13 @@ typedef struct pa_sink_new_data {
     pa_channel_map channel_map;
     pa_cvolume volume;
     pa_bool_t muted :1;
+    pa_bool_t float_mixing :1;
 
     pa_bool_t sample_spec_is_set:1;
     pa_bool_t channel_map_is_set:1;
     pa_bool_t volume_is_set:1;
     pa_bool_t muted_is_set:1;
+    pa_bool_t float_mixing_is_set:1;
 
     pa_bool_t namereg_fail:1;
 
@@ -257,6 +269,7 @@ void pa_sink_new_data_set_channel_map(pa_sink_new_data *data, const pa_channel_m
 void pa_sink_new_data_set_volume(pa_sink_new_data *data, const pa_cvolume *volume);
 void pa_sink_new_data_set_muted(pa_sink_new_data *data, pa_bool_t mute);
 void pa_sink_new_data_set_port(pa_sink_new_data *data, const char *port);
+void pa_sink_new_data_set_float_mixing(pa_sink_new_data *data, pa_bool_t float_mixing);
 void pa_sink_new_data_done(pa_sink_new_data *data);
 
 /*** To be called exclusively by the sink driver, from main context */
@@ -334,6 +347,19 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result);
 void pa_sink_render_into(pa_sink*s, pa_memchunk *target);
 void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target);
 
+/* Renders exactly length bytes as a list of at most max_chunks
+ * references, without merging them into one block. Returns the number of
+ * chunks, which the caller needs to unref. */
+unsigned pa_sink_render_full_chain(pa_sink *s, size_t length, pa_memchunk *chunks, unsigned max_chunks);
+
+/* TRUE if the next render will most likely just pass the blocks of a
+ * single sink input on, or hand out silence. Drivers that have to copy
+ * into their own buffer anyway can then use pa_sink_render_full_chain()
+ * instead of mixing into a pa_memblock_new_fixed() wrapper, and fill
+ * their buffer instead of copying when a block is flagged as
+ * silence. */
+pa_bool_t pa_sink_render_is_zero_copy(pa_sink *s);
+
 void pa_sink_process_rewind(pa_sink *s, size_t nbytes);
 
 int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk);
@@ -0,0 +1,370 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/shm.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/core-util.h>
+
+#include "srbchannel.h"
+
+/* Size of the whole segment, the two rings share what the header and
+ * the timing pages leave over */
+#define SRBCHANNEL_SIZE (64*1024)
+
+#define TIMING_PAGES_SIZE (PA_SRBCHANNEL_TIMING_PAGES_MAX * sizeof(pa_timing_page))
+
+/* Everything in here is shared with the other side, which we don't
+ * trust any further than its own data goes */
+struct srbring {
+    pa_atomic_t count;
+    pa_atomic_t want_space;
+};
+
+struct srbheader {
+    struct srbring rings[2];
+    pa_fdsem_data semdata[2];
+    uint32_t capacity;
+};
+
+#define SRBHEADER_SIZE PA_ALIGN(sizeof(struct srbheader))
+
+struct ring {
+    struct srbring *shared;
+    uint8_t *memory;
+    size_t capacity;
+    size_t index;
+};
+
+struct pa_srbchannel {
+    pa_mainloop_api *mainloop;
+    pa_shm memory;
+
+    /* We read from rings[0] and write to rings[1] */
+    struct ring rings[2];
+    pa_fdsem *sem_read, *sem_write;
+
+    /* Behind the rings, up to the end of the segment */
+    pa_timing_page *timing_pages;
+    unsigned n_timing_pages;
+
+    pa_io_event *read_event;
+    pa_defer_event *defer_event;
+
+    pa_srbchannel_cb_t callback;
+    void *userdata;
+};
+
+static size_t ring_read(struct ring *r, void *data, size_t l) {
+    size_t n, k, avail;
+    int count;
+
+    if ((count = pa_atomic_load(&r->shared->count)) <= 0)
+        return 0;
+
+    avail = PA_MIN((size_t) count, r->capacity);
+    n = PA_MIN(l, avail);
+    k = PA_MIN(n, r->capacity - r->index);
+
+    memcpy(data, r->memory + r->index, k);
+    if (k < n)
+        memcpy((uint8_t*) data + k, r->memory, n - k);
+
+    r->index = (r->index + n) % r->capacity;
+    pa_atomic_sub(&r->shared->count, (int) n);
+
+    return n;
+}
+
+static size_t ring_write(struct ring *r, const void *data, size_t l) {
+    size_t n, k;
+    int count;
+
+    count = pa_atomic_load(&r->shared->count);
+    count = PA_CLAMP(count, 0, (int) r->capacity);
+
+    n = PA_MIN(l, r->capacity - (size_t) count);
+    k = PA_MIN(n, r->capacity - r->index);
+
+    if (n <= 0)
+        return 0;
+
+    memcpy(r->memory + r->index, data, k);
+    if (k < n)
+        memcpy(r->memory, (const uint8_t*) data + k, n - k);
+
+    r->index = (r->index + n) % r->capacity;
+    pa_atomic_add(&r->shared->count, (int) n);
+
+    return n;
+}
+
+size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l) {
+    struct ring *r;
+    size_t written = 0;
+
+    pa_assert(sr);
+    pa_assert(data);
+
+    r = &sr->rings[1];
+
+    for (;;) {
+        written += ring_write(r, (const uint8_t*) data + written, l - written);
+
+        if (written >= l)
+            break;
+
+        /* Ask the reader to wake us up when it made room. It might
+         * have done so before it could see the request, hence check
+         * again. */
+        pa_atomic_store(&r->shared->want_space, 1);
+
+        if (pa_atomic_load(&r->shared->count) >= (int) r->capacity)
+            break;
+    }
+
+    if (written > 0)
+        pa_fdsem_post(sr->sem_write);
+
+    return written;
+}
+
+size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l) {
+    struct ring *r;
+    size_t n;
+
+    pa_assert(sr);
+    pa_assert(data);
+
+    r = &sr->rings[0];
+
+    if ((n = ring_read(r, data, l)) > 0)
+        if (pa_atomic_cmpxchg(&r->shared->want_space, 1, 0))
+            pa_fdsem_post(sr->sem_write);
+
+    return n;
+}
+
+static void dispatch(pa_srbchannel *sr) {
+
+    /* Keep going until nothing was signalled while we were busy, so
+     * that we only sleep with the fdsem armed */
+    do {
+        if (sr->callback && !sr->callback(sr, sr->userdata))
+            return;
+    } while (pa_fdsem_before_poll(sr->sem_read) < 0);
+}
+
+static void read_cb(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_srbchannel *sr = userdata;
+
+    pa_assert(sr);
+    pa_assert(sr->read_event == e);
+
+    pa_fdsem_after_poll(sr->sem_read);
+    dispatch(sr);
+}
+
+static void defer_cb(pa_mainloop_api *m, pa_defer_event *e, void *userdata) {
+    pa_srbchannel *sr = userdata;
+
+    pa_assert(sr);
+    pa_assert(sr->defer_event == e);
+
+    m->defer_enable(e, 0);
+    dispatch(sr);
+}
+
+static void setup(pa_srbchannel *sr, pa_mainloop_api *m, struct srbheader *h, size_t capacity, unsigned side) {
+    unsigned i;
+
+    for (i = 0; i < 2; i++) {
+        unsigned k = i == 0 ? side : 1 - side;
+
+        sr->rings[i].shared = &h->rings[k];
+        sr->rings[i].memory = (uint8_t*) h + SRBHEADER_SIZE + k * capacity;
+        sr->rings[i].capacity = capacity;
+        sr->rings[i].index = 0;
+    }
+
+    sr->timing_pages = (pa_timing_page*) ((uint8_t*) h + SRBHEADER_SIZE + 2 * capacity);
+    sr->n_timing_pages = (unsigned) ((sr->memory.size - SRBHEADER_SIZE - 2 * capacity) / sizeof(pa_timing_page));
+
+    sr->mainloop = m;
+    sr->callback = NULL;
+    sr->userdata = NULL;
+
+    /* We're not sleeping yet, the first dispatch arms the fdsem */
+    sr->read_event = m->io_new(m, pa_fdsem_get(sr->sem_read), PA_IO_EVENT_INPUT, read_cb, sr);
+    sr->defer_event = m->defer_new(m, defer_cb, sr);
+}
+
+pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m) {
+    pa_srbchannel *sr;
+    struct srbheader *h;
+    size_t capacity;
+    int fd;
+
+    pa_assert(m);
+
+    sr = pa_xnew0(pa_srbchannel, 1);
+
+    if (pa_shm_create_memfd(&sr->memory, SRBCHANNEL_SIZE) < 0) {
+        pa_xfree(sr);
+        return NULL;
+    }
+
+    h = sr->memory.ptr;
+    capacity = ((sr->memory.size - SRBHEADER_SIZE - TIMING_PAGES_SIZE) / 2) & ~(size_t) 7;
+    h->capacity = (uint32_t) capacity;
+
+    pa_atomic_store(&h->rings[0].count, 0);
+    pa_atomic_store(&h->rings[0].want_space, 0);
+    pa_atomic_store(&h->rings[1].count, 0);
+    pa_atomic_store(&h->rings[1].want_space, 0);
+
+    if (!(sr->sem_read = pa_fdsem_new_shm(&h->semdata[0], &fd)))
+        goto fail;
+
+    if (!(sr->sem_write = pa_fdsem_new_shm(&h->semdata[1], &fd)))
+        goto fail;
+
+    setup(sr, m, h, capacity, 0);
+
+    return sr;
+
+fail:
+    if (sr->sem_read)
+        pa_fdsem_free(sr->sem_read);
+
+    pa_shm_free(&sr->memory);
+    pa_xfree(sr);
+
+    return NULL;
+}
+
+pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel_template *t) {
+    pa_srbchannel *sr;
+    struct srbheader *h;
+    size_t capacity;
+
+    pa_assert(m);
+    pa_assert(t);
+    pa_assert(t->memfd >= 0);
+    pa_assert(t->eventfd[0] >= 0);
+    pa_assert(t->eventfd[1] >= 0);
+
+    sr = pa_xnew0(pa_srbchannel, 1);
+
+    if (pa_shm_attach_fd(&sr->memory, 0, t->memfd, TRUE) < 0) {
+        pa_close(t->eventfd[0]);
+        pa_close(t->eventfd[1]);
+        pa_xfree(sr);
+        return NULL;
+    }
+
+    h = sr->memory.ptr;
+    capacity = h->capacity;
+
+    if (sr->memory.size < SRBHEADER_SIZE ||
+        capacity <= 0 ||
+        capacity > (sr->memory.size - SRBHEADER_SIZE) / 2) {
+        pa_log_warn("Invalid ring buffer segment.");
+        goto fail;
+    }
+
+    if (!(sr->sem_read = pa_fdsem_open_shm(&h->semdata[1], t->eventfd[1])))
+        goto fail;
+    t->eventfd[1] = -1;
+
+    if (!(sr->sem_write = pa_fdsem_open_shm(&h->semdata[0], t->eventfd[0])))
+        goto fail;
+    t->eventfd[0] = -1;
+
+    setup(sr, m, h, capacity, 1);
+
+    return sr;
+
+fail:
+    if (sr->sem_read)
+        pa_fdsem_free(sr->sem_read);
+
+    pa_shm_free(&sr->memory);
+
+    if (t->eventfd[0] >= 0)
+        pa_close(t->eventfd[0]);
+    if (t->eventfd[1] >= 0)
+        pa_close(t->eventfd[1]);
+
+    pa_xfree(sr);
+    return NULL;
+}
+
+void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t) {
+    pa_assert(sr);
+    pa_assert(t);
+    pa_assert(sr->memory.fd >= 0);
+
+    t->memfd = sr->memory.fd;
+    t->eventfd[0] = pa_fdsem_get(sr->sem_read);
+    t->eventfd[1] = pa_fdsem_get(sr->sem_write);
+}
+
+void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback, void *userdata) {
+    pa_assert(sr);
+
+    sr->callback = callback;
+    sr->userdata = userdata;
+
+    /* Pick up whatever arrived before */
+    sr->mainloop->defer_enable(sr->defer_event, 1);
+}
+
+void pa_srbchannel_free(pa_srbchannel *sr) {
+    pa_assert(sr);
+
+    sr->mainloop->io_free(sr->read_event);
+    sr->mainloop->defer_free(sr->defer_event);
+
+    pa_fdsem_free(sr->sem_read);
+    pa_fdsem_free(sr->sem_write);
+
+    pa_shm_free(&sr->memory);
+
+    pa_xfree(sr);
+}
+
+pa_timing_page* pa_srbchannel_get_timing_page(pa_srbchannel *sr, uint32_t idx) {
+    pa_assert(sr);
+
+    if (idx >= sr->n_timing_pages)
+        return NULL;
+
+    return sr->timing_pages + idx;
+}
@@ -0,0 +1,74 @@
+#ifndef foopulsesrbchannelhfoo
+#define foopulsesrbchannelhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <sys/types.h>
+
+#include <pulse/mainloop-api.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/timing-page.h>
+
+/* A bidirectional byte channel made of two lock-free ring buffers in
+ * a memfd segment shared by the two ends of a connection. Each side
+ * sleeps on an eventfd based pa_fdsem in the segment, which the other
+ * side only posts to if it is actually sleeping. One side creates the
+ * channel and passes the three fds of the template to the other
+ * side, which opens it with pa_srbchannel_new_from_template().
+ *
+ * Behind the rings the segment holds a few pa_timing_pages, which
+ * the creating side hands out to its streams. */
+
+#define PA_SRBCHANNEL_TIMING_PAGES_MAX 64
+
+typedef struct pa_srbchannel pa_srbchannel;
+
+typedef struct pa_srbchannel_template {
+    int memfd;
+    int eventfd[2];
+} pa_srbchannel_template;
+
+/* Returns NULL if memfds or eventfds are not available */
+pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m);
+
+/* Takes over the fds of the template, closing them in any case */
+pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel_template *t);
+
+/* The fds stay owned by the channel */
+void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t);
+
+void pa_srbchannel_free(pa_srbchannel *sr);
+
+/* Both return the number of bytes transferred, which is 0 if the
+ * ring is full or empty. In that case the callback is called once
+ * the other side made room or wrote something. */
+size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l);
+size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l);
+
+/* The callback returns FALSE if it freed the channel */
+typedef pa_bool_t (*pa_srbchannel_cb_t)(pa_srbchannel *sr, void *userdata);
+
+void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback, void *userdata);
+
+/* Returns NULL if the segment has no page with that index, which
+ * might have been sent by the other side */
+pa_timing_page* pa_srbchannel_get_timing_page(pa_srbchannel *sr, uint32_t idx);
+
+#endif
@@ -0,0 +1,247 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+
+#include <pulse/rtclock.h>
+#include <pulsecore/random.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/core-util.h>
+
+#include "cpu-arm.h"
+
+#include "sample-util.h"
+
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#include <arm_neon.h>
+
+/* The volume arrays are padded by repeating the channel volumes, so we
+ * can always load a full block of volumes starting at any channel and
+ * only have to advance the channel by the block size modulo channels. */
+#define NEXT_CHANNEL(channel, step, channels)   \
+    do {                                        \
+        channel += step;                        \
+        if (channel >= channels)                \
+            channel -= channels;                \
+    } while (0)
+
+static void
+pa_volume_s16ne_neon (int16_t *samples, int32_t *volumes, unsigned channels, unsigned length)
+{
+    const int32x4_t mask = vdupq_n_s32(0xFFFF);
+    unsigned channel = 0, step = 8 % channels;
+
+    length /= sizeof (int16_t);
+
+    for (; length >= 8; length -= 8) {
+        int16x8_t s;
+        int32x4_t v0, v1, w0, w1, t0, t1;
+
+        s = vld1q_s16(samples);
+        v0 = vld1q_s32(volumes + channel);
+        v1 = vld1q_s32(volumes + channel + 4);
+
+        w0 = vmovl_s16(vget_low_s16(s));
+        w1 = vmovl_s16(vget_high_s16(s));
+
+        /* ((s * lo) >> 16) + (s * hi), like the C version */
+        t0 = vshrq_n_s32(vmulq_s32(w0, vandq_s32(v0, mask)), 16);
+        t1 = vshrq_n_s32(vmulq_s32(w1, vandq_s32(v1, mask)), 16);
+        t0 = vmlaq_s32(t0, w0, vshrq_n_s32(v0, 16));
+        t1 = vmlaq_s32(t1, w1, vshrq_n_s32(v1, 16));
+
+        vst1q_s16(samples, vcombine_s16(vqmovn_s32(t0), vqmovn_s32(t1)));
+
+        samples += 8;
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; length; length--) {
+        int32_t t, hi, lo;
+
+        hi = volumes[channel] >> 16;
+        lo = volumes[channel] & 0xFFFF;
+
+        t = (int32_t)(*samples);
+        t = ((t * lo) >> 16) + (t * hi);
+        t = PA_CLAMP_UNLIKELY(t, -0x8000, 0x7FFF);
+        *samples++ = (int16_t) t;
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static void
+pa_volume_s32ne_neon (int32_t *samples, int32_t *volumes, unsigned channels, unsigned length)
+{
+    unsigned channel = 0, step = 4 % channels;
+
+    length /= sizeof (int32_t);
+
+    for (; length >= 4; length -= 4) {
+        int32x4_t s, v;
+        int64x2_t t0, t1;
+
+        s = vld1q_s32(samples);
+        v = vld1q_s32(volumes + channel);
+
+        t0 = vshrq_n_s64(vmull_s32(vget_low_s32(s), vget_low_s32(v)), 16);
+        t1 = vshrq_n_s64(vmull_s32(vget_high_s32(s), vget_high_s32(v)), 16);
+
+        vst1q_s32(samples, vcombine_s32(vqmovn_s64(t0), vqmovn_s64(t1)));
+
+        samples += 4;
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; length; length--) {
+        int64_t t;
+
+        t = (int64_t)(*samples);
+        t = (t * volumes[channel]) >> 16;
+        t = PA_CLAMP_UNLIKELY(t, -0x80000000LL, 0x7FFFFFFFLL);
+        *samples++ = (int32_t) t;
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static void
+pa_volume_float32ne_neon (float *samples, float *volumes, unsigned channels, unsigned length)
+{
+    unsigned channel = 0, step = 8 % channels;
+
+    length /= sizeof (float);
+
+    for (; length >= 8; length -= 8) {
+        vst1q_f32(samples, vmulq_f32(vld1q_f32(samples), vld1q_f32(volumes + channel)));
+        vst1q_f32(samples + 4, vmulq_f32(vld1q_f32(samples + 4), vld1q_f32(volumes + channel + 4)));
+
+        samples += 8;
+        NEXT_CHANNEL(channel, step, channels);
+    }
+
+    for (; length; length--) {
+        *samples++ *= volumes[channel];
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+#undef RUN_TEST
+
+#ifdef RUN_TEST
+#define CHANNELS 2
+#define SAMPLES 1021
+#define TIMES 1000
+#define PADDING 16
+
+static void run_test_format (pa_sample_format_t format, pa_do_volume_func_t neon_func) {
+    int32_t samples[SAMPLES];
+    int32_t samples_ref[SAMPLES];
+    int32_t samples_orig[SAMPLES];
+    union {
+        int32_t i;
+        float f;
+    } volumes[CHANNELS + PADDING];
+    unsigned length;
+    int i, j, padding;
+    pa_do_volume_func_t func;
+    pa_usec_t start, stop;
+
+    func = pa_get_volume_func (format);
+    length = (unsigned) (SAMPLES * pa_sample_size_of_format (format));
+
+    printf ("checking NEON %s %u\n", pa_sample_format_to_string (format), length);
+
+    pa_random (samples, sizeof (samples));
+    if (format == PA_SAMPLE_FLOAT32NE) {
+        float *f = (float *) samples;
+
+        for (i = 0; i < SAMPLES; i++)
+            f[i] = (float) (samples[i] >> 8) / (float) (1 << 23);
+    }
+    memcpy (samples_ref, samples, sizeof (samples));
+    memcpy (samples_orig, samples, sizeof (samples));
+
+    for (i = 0; i < CHANNELS; i++) {
+        if (format == PA_SAMPLE_FLOAT32NE)
+            volumes[i].f = (float) rand() / (float) RAND_MAX * 2.0f;
+        else
+            volumes[i].i = rand() >> 1;
+    }
+    for (padding = 0; padding < PADDING; padding++, i++)
+        volumes[i] = volumes[padding];
+
+    func (samples_ref, volumes, CHANNELS, length);
+    neon_func (samples, volumes, CHANNELS, length);
+    if (memcmp (samples, samples_ref, length) != 0)
+        printf ("%s: NEON result differs from reference\n", pa_sample_format_to_string (format));
+
+    start = pa_rtclock_now();
+    for (j = 0; j < TIMES; j++) {
+        memcpy (samples, samples_orig, sizeof (samples));
+        neon_func (samples, volumes, CHANNELS, length);
+    }
+    stop = pa_rtclock_now();
+    pa_log_info("NEON: %llu usec.", (long long unsigned int)(stop - start));
+
+    start = pa_rtclock_now();
+    for (j = 0; j < TIMES; j++) {
+        memcpy (samples_ref, samples_orig, sizeof (samples));
+        func (samples_ref, volumes, CHANNELS, length);
+    }
+    stop = pa_rtclock_now();
+    pa_log_info("ref: %llu usec.", (long long unsigned int)(stop - start));
+}
+
+static void run_test (void) {
+    run_test_format (PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_neon);
+    run_test_format (PA_SAMPLE_S32NE, (pa_do_volume_func_t) pa_volume_s32ne_neon);
+    run_test_format (PA_SAMPLE_FLOAT32NE, (pa_do_volume_func_t) pa_volume_float32ne_neon);
+}
+#endif
+
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+
+void pa_volume_func_init_neon (pa_cpu_arm_flag_t flags) {
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#ifdef RUN_TEST
+    run_test ();
+#endif
+
+    if (flags & PA_CPU_ARM_NEON) {
+        pa_log_info("Initialising NEON optimized functions.");
+
+        pa_set_volume_func (PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_neon);
+        pa_set_volume_func (PA_SAMPLE_S32NE, (pa_do_volume_func_t) pa_volume_s32ne_neon);
+        pa_set_volume_func (PA_SAMPLE_FLOAT32NE, (pa_do_volume_func_t) pa_volume_float32ne_neon);
+    }
+
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+}
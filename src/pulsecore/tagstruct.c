@@ -37,6 +37,7 @@
 
 #include <pulsecore/winsock.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/flist.h>
 
 #include "tagstruct.h"
 
@@ -47,29 +48,42 @@ struct pa_tagstruct {
     size_t length, allocated;
     size_t rindex;
 
+    /* When writing, the packet the data is put in, so that it can
+     * be sent without copying */
+    pa_packet *packet;
     pa_bool_t dynamic;
 };
 
+PA_STATIC_FLIST_DECLARE(tagstructs, 0, 32, pa_xfree);
+
 pa_tagstruct *pa_tagstruct_new(const uint8_t* data, size_t length) {
     pa_tagstruct*t;
 
     pa_assert(!data || (data && length));
 
-    t = pa_xnew(pa_tagstruct, 1);
+    if (!(t = pa_flist_pop(PA_STATIC_FLIST_GET(tagstructs))))
+        t = pa_xnew(pa_tagstruct, 1);
+
     t->data = (uint8_t*) data;
     t->allocated = t->length = data ? length : 0;
     t->rindex = 0;
+    t->packet = NULL;
     t->dynamic = !data;
 
     return t;
 }
 
+static void tagstruct_free(pa_tagstruct *t) {
+    if (pa_flist_push(PA_STATIC_FLIST_GET(tagstructs), t) < 0)
+        pa_xfree(t);
+}
+
 void pa_tagstruct_free(pa_tagstruct*t) {
     pa_assert(t);
 
-    if (t->dynamic)
-        pa_xfree(t->data);
-    pa_xfree(t);
+    if (t->packet)
+        pa_packet_unref(t->packet);
+    tagstruct_free(t);
 }
 
 uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l) {
@@ -79,20 +93,47 @@ uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l) {
     pa_assert(t->dynamic);
     pa_assert(l);
 
-    p = t->data;
+    p = t->length > 0 ? pa_xmemdup(t->data, t->length) : NULL;
     *l = t->length;
-    pa_xfree(t);
+    pa_tagstruct_free(t);
+    return p;
+}
+
+pa_packet* pa_tagstruct_free_packet(pa_tagstruct*t) {
+    pa_packet *p;
+
+    pa_assert(t);
+    pa_assert(t->dynamic);
+    pa_assert(t->packet);
+
+    p = t->packet;
+    p->length = t->length;
+    tagstruct_free(t);
     return p;
 }
 
 static void extend(pa_tagstruct*t, size_t l) {
+    pa_packet *p;
+
     pa_assert(t);
     pa_assert(t->dynamic);
 
     if (t->length+l <= t->allocated)
         return;
 
-    t->data = pa_xrealloc(t->data, t->allocated = t->length+l+100);
+    /* Start with a pooled packet, which is large enough for most
+     * commands, and grow by doubling for the info lists */
+    t->allocated = PA_MAX(t->allocated*2, t->length+l);
+    t->allocated = PA_MAX(t->allocated, (size_t) PA_PACKET_POOL_SIZE);
+    p = pa_packet_new(t->allocated);
+
+    if (t->packet) {
+        memcpy(p->data, t->data, t->length);
+        pa_packet_unref(t->packet);
+    }
+
+    t->packet = p;
+    t->data = p->data;
 }
 
 void pa_tagstruct_puts(pa_tagstruct*t, const char *s) {
@@ -45,11 +45,18 @@ static void asyncmsgq_read_cb(pa_mainloop_api*api, pa_io_event* e, int fd, pa_io
     pa_thread_mq *q = userdata;
     pa_asyncmsgq *aq;
 
-    pa_assert(pa_asyncmsgq_read_fd(q->outq) == fd);
     pa_assert(events == PA_IO_EVENT_INPUT);
 
-    pa_asyncmsgq_ref(aq = q->outq);
-    pa_asyncmsgq_write_after_poll(aq);
+    /* The thread side reads the inq, if it runs a main loop too */
+    if (pa_asyncmsgq_read_fd(q->outq) == fd)
+        aq = q->outq;
+    else {
+        pa_assert(pa_asyncmsgq_read_fd(q->inq) == fd);
+        aq = q->inq;
+    }
+
+    pa_asyncmsgq_ref(aq);
+    pa_asyncmsgq_write_after_poll_locked(aq);
 
     for (;;) {
         pa_msgobject *object;
@@ -75,12 +82,19 @@ static void asyncmsgq_read_cb(pa_mainloop_api*api, pa_io_event* e, int fd, pa_io
 
 static void asyncmsgq_write_cb(pa_mainloop_api*api, pa_io_event* e, int fd, pa_io_event_flags_t events, void *userdata) {
     pa_thread_mq *q = userdata;
+    pa_asyncmsgq *aq;
 
-    pa_assert(pa_asyncmsgq_write_fd(q->inq) == fd);
     pa_assert(events == PA_IO_EVENT_INPUT);
 
-    pa_asyncmsgq_write_after_poll(q->inq);
-    pa_asyncmsgq_write_before_poll(q->inq);
+    if (pa_asyncmsgq_write_fd(q->inq) == fd)
+        aq = q->inq;
+    else {
+        pa_assert(pa_asyncmsgq_write_fd(q->outq) == fd);
+        aq = q->outq;
+    }
+
+    pa_asyncmsgq_write_after_poll_locked(aq);
+    pa_asyncmsgq_write_before_poll_locked(aq);
 }
 
 void pa_thread_mq_init(pa_thread_mq *q, pa_mainloop_api *mainloop, pa_rtpoll *rtpoll) {
@@ -94,13 +108,42 @@ void pa_thread_mq_init(pa_thread_mq *q, pa_mainloop_api *mainloop, pa_rtpoll *rt
     pa_assert_se(pa_asyncmsgq_read_before_poll(q->outq) == 0);
     pa_assert_se(q->read_event = mainloop->io_new(mainloop, pa_asyncmsgq_read_fd(q->outq), PA_IO_EVENT_INPUT, asyncmsgq_read_cb, q));
 
-    pa_asyncmsgq_write_before_poll(q->inq);
+    pa_asyncmsgq_write_before_poll_locked(q->inq);
     pa_assert_se(q->write_event = mainloop->io_new(mainloop, pa_asyncmsgq_write_fd(q->inq), PA_IO_EVENT_INPUT, asyncmsgq_write_cb, q));
 
+    q->thread_mainloop = NULL;
+    q->thread_read_event = q->thread_write_event = NULL;
+
     pa_rtpoll_item_new_asyncmsgq_read(rtpoll, PA_RTPOLL_EARLY, q->inq);
     pa_rtpoll_item_new_asyncmsgq_write(rtpoll, PA_RTPOLL_LATE, q->outq);
 }
 
+void pa_thread_mq_init_thread_mainloop(pa_thread_mq *q, pa_mainloop_api *mainloop, pa_mainloop_api *thread_mainloop) {
+    pa_assert(q);
+    pa_assert(mainloop);
+    pa_assert(thread_mainloop);
+
+    q->mainloop = mainloop;
+    pa_assert_se(q->inq = pa_asyncmsgq_new(0));
+    pa_assert_se(q->outq = pa_asyncmsgq_new(0));
+
+    pa_assert_se(pa_asyncmsgq_read_before_poll(q->outq) == 0);
+    pa_assert_se(q->read_event = mainloop->io_new(mainloop, pa_asyncmsgq_read_fd(q->outq), PA_IO_EVENT_INPUT, asyncmsgq_read_cb, q));
+
+    pa_asyncmsgq_write_before_poll_locked(q->inq);
+    pa_assert_se(q->write_event = mainloop->io_new(mainloop, pa_asyncmsgq_write_fd(q->inq), PA_IO_EVENT_INPUT, asyncmsgq_write_cb, q));
+
+    /* The thread's main loop isn't running yet, so we may still touch
+     * it from here */
+    q->thread_mainloop = thread_mainloop;
+
+    pa_assert_se(pa_asyncmsgq_read_before_poll(q->inq) == 0);
+    pa_assert_se(q->thread_read_event = thread_mainloop->io_new(thread_mainloop, pa_asyncmsgq_read_fd(q->inq), PA_IO_EVENT_INPUT, asyncmsgq_read_cb, q));
+
+    pa_asyncmsgq_write_before_poll_locked(q->outq);
+    pa_assert_se(q->thread_write_event = thread_mainloop->io_new(thread_mainloop, pa_asyncmsgq_write_fd(q->outq), PA_IO_EVENT_INPUT, asyncmsgq_write_cb, q));
+}
+
 void pa_thread_mq_done(pa_thread_mq *q) {
     pa_assert(q);
 
@@ -117,6 +160,14 @@ void pa_thread_mq_done(pa_thread_mq *q) {
     q->mainloop->io_free(q->write_event);
     q->read_event = q->write_event = NULL;
 
+    /* The thread is gone by now */
+    if (q->thread_mainloop) {
+        q->thread_mainloop->io_free(q->thread_read_event);
+        q->thread_mainloop->io_free(q->thread_write_event);
+        q->thread_read_event = q->thread_write_event = NULL;
+        q->thread_mainloop = NULL;
+    }
+
     pa_asyncmsgq_unref(q->inq);
     pa_asyncmsgq_unref(q->outq);
     q->inq = q->outq = NULL;
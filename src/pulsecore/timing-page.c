@@ -0,0 +1,77 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/macro.h>
+
+#include "timing-page.h"
+
+/* An update is a handful of stores, so if we collide with the writer
+ * this many times in a row something is wrong on the other side */
+#define READ_TRIES_MAX 16
+
+void pa_timing_page_write(pa_timing_page *p, const pa_timing_data *d) {
+    pa_assert(p);
+    pa_assert(d);
+
+    /* Not every implementation of pa_atomic_inc() has a barrier
+     * after the store, so make sure readers see the odd count before
+     * any of the data. The barrier in the second increment keeps the
+     * data stores before it. */
+    pa_atomic_inc(&p->seq);
+    pa_memory_barrier();
+    memcpy(&p->data, d, sizeof(*d));
+    pa_atomic_inc(&p->seq);
+}
+
+int pa_timing_page_read(pa_timing_page *p, pa_timing_data *d) {
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(d);
+
+    for (i = 0; i < READ_TRIES_MAX; i++) {
+        int seq;
+
+        seq = pa_atomic_load(&p->seq);
+
+        if (seq == 0)
+            return -1;
+
+        if (seq & 1)
+            continue;
+
+        /* pa_atomic_load() only orders what comes before it, so keep
+         * the copy from being done before we read the sequence. The
+         * barrier in the second load orders the copy against it. */
+        pa_memory_barrier();
+
+        memcpy(d, &p->data, sizeof(*d));
+
+        if (pa_atomic_load(&p->seq) == seq)
+            return 0;
+    }
+
+    return -1;
+}
@@ -0,0 +1,62 @@
+#ifndef foopulsetimingpagehfoo
+#define foopulsetimingpagehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+
+/* The timing parameters of a playback stream, as published by the
+ * sink's IO thread in memory shared with the client. The sequence
+ * count is odd while an update is in progress, and readers retry
+ * when it changed under them. Writers never wait for readers. */
+
+typedef struct pa_timing_data {
+    int64_t write_index;
+    int64_t read_index;
+
+    /* Including what the sink input has rendered but the sink not
+     * yet taken */
+    pa_usec_t sink_usec;
+
+    /* pa_rtclock_now() when all of this was current */
+    pa_usec_t timestamp;
+
+    uint64_t underrun_for;
+    uint64_t playing_for;
+    uint32_t playing;
+} pa_timing_data;
+
+typedef struct pa_timing_page {
+    pa_atomic_t seq;
+    pa_timing_data data;
+} pa_timing_page;
+
+/* Called by the only writer of the page */
+void pa_timing_page_write(pa_timing_page *p, const pa_timing_data *d);
+
+/* Returns -1 if nothing was written yet or if we didn't get a
+ * consistent copy after a few tries */
+int pa_timing_page_read(pa_timing_page *p, pa_timing_data *d);
+
+#endif
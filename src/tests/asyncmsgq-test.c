@@ -77,6 +77,8 @@ static void the_thread(void *_q) {
 int main(int argc, char *argv[]) {
     pa_asyncmsgq *q;
     pa_thread *t;
+    pa_bool_t shutdown;
+    unsigned i, n, k;
 
     pa_assert_se(q = pa_asyncmsgq_new(0));
 
@@ -102,6 +104,24 @@ int main(int argc, char *argv[]) {
 
     pa_thread_free(t);
 
+    /* Drain a burst in batches, stopping at the shutdown message */
+    for (i = 0; i < 300; i++)
+        pa_asyncmsgq_post(q, NULL, OPERATION_A, NULL, 0, NULL, NULL);
+
+    pa_asyncmsgq_post(q, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL, NULL);
+    pa_asyncmsgq_post(q, NULL, OPERATION_B, NULL, 0, NULL, NULL);
+
+    n = 0;
+    do {
+        k = pa_asyncmsgq_process_pending(q, &shutdown);
+        pa_assert_se(k > 0);
+        n += k;
+    } while (!shutdown);
+
+    pa_assert_se(n == 301);
+    pa_assert_se(pa_asyncmsgq_process_pending(q, NULL) == 1);
+    pa_assert_se(pa_asyncmsgq_process_pending(q, NULL) == 0);
+
     pa_asyncmsgq_unref(q);
 
     return 0;
@@ -70,6 +70,19 @@ static void consumer(void *_q) {
 int main(int argc, char *argv[]) {
     pa_asyncq *q;
     pa_thread *t1, *t2;
+    unsigned i;
+
+    /* Without a reader the queue has to grow instead of failing */
+    pa_assert_se(q = pa_asyncq_new(0));
+
+    for (i = 0; i < 4096; i++)
+        pa_assert_se(pa_asyncq_push(q, PA_UINT_TO_PTR(i+1), FALSE) == 0);
+
+    for (i = 0; i < 4096; i++)
+        pa_assert_se(pa_asyncq_pop(q, FALSE) == PA_UINT_TO_PTR(i+1));
+
+    pa_assert_se(!pa_asyncq_pop(q, FALSE));
+    pa_asyncq_free(q, NULL);
 
     pa_assert_se(q = pa_asyncq_new(0));
 
@@ -28,6 +28,7 @@
 #include <pulse/util.h>
 #include <pulse/xmalloc.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
@@ -36,6 +37,7 @@
 
 static pa_flist *flist;
 static int quit = 0;
+static pa_atomic_t n_pops = PA_ATOMIC_INIT(0);
 
 static void spin(void) {
     int k;
@@ -54,6 +56,9 @@ static void thread_func(void *data) {
     while (!quit) {
         char *text;
 
+        if (b)
+            pa_atomic_inc(&n_pops);
+
         /* Allocate some memory, if possible take it from the flist */
         if (b && (text = pa_flist_pop(flist)))
             pa_log("%s: popped '%s'", s, text);
@@ -80,22 +85,41 @@ static void thread_func(void *data) {
         pa_xfree(s);
 }
 
-int main(int argc, char* argv[]) {
+static void run(void) {
     pa_thread *threads[THREADS_MAX];
     int i;
 
-    flist = pa_flist_new(0);
+    quit = 0;
 
     for (i = 0; i < THREADS_MAX; i++) {
         threads[i] = pa_thread_new(thread_func, pa_sprintf_malloc("Thread #%i", i+1));
         assert(threads[i]);
     }
 
-    pa_msleep(60000);
+    pa_msleep(30000);
     quit = 1;
 
     for (i = 0; i < THREADS_MAX; i++)
         pa_thread_free(threads[i]);
+}
+
+int main(int argc, char* argv[]) {
+    pa_flist_stat stat;
+
+    flist = pa_flist_new(0);
+    run();
+    pa_flist_free(flist, pa_xfree);
+
+    /* Once more with per-thread magazines. The threads flushed their
+     * magazines and statistics when they exited. */
+    pa_atomic_store(&n_pops, 0);
+    flist = pa_flist_new_cached(0, 8, pa_xfree, "test");
+    run();
+
+    assert(pa_flist_get_stats(&stat, 1) == 1);
+    pa_log("%u hits, %u misses, %u overflows, %u transfers",
+           stat.n_hits, stat.n_misses, stat.n_overflows, stat.n_transfers);
+    assert(stat.n_hits + stat.n_misses == (unsigned) pa_atomic_load(&n_pops));
 
     pa_flist_free(flist, pa_xfree);
 
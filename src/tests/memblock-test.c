@@ -22,11 +22,15 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <pulsecore/memblock.h>
 #include <pulsecore/macro.h>
 #include <pulse/xmalloc.h>
+#include <pulse/mainloop.h>
+
+#define GROW_BLOCKS_MAX 1024
 
 static void release_cb(pa_memimport *i, uint32_t block_id, void *userdata) {
     printf("%s: Imported block %u is released.\n", (char*) userdata, block_id);
@@ -38,6 +42,7 @@ static void revoke_cb(pa_memexport *e, uint32_t block_id, void *userdata) {
 
 static void print_stats(pa_mempool *p, const char *text) {
     const pa_mempool_stat*s = pa_mempool_get_stat(p);
+    unsigned c;
 
     printf("%s = {\n"
            "n_allocated = %u\n"
@@ -62,6 +67,157 @@ static void print_stats(pa_mempool *p, const char *text) {
            (unsigned) pa_atomic_load(&s->exported_size),
            (unsigned) pa_atomic_load(&s->n_too_large_for_pool),
            (unsigned) pa_atomic_load(&s->n_pool_full));
+
+    for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES_MAX; c++) {
+        size_t block_size;
+        unsigned n_blocks;
+
+        pa_mempool_get_size_class(p, c, &block_size, &n_blocks);
+
+        printf("%s: class %u, %u slots of size %lu: %u allocated, %u accumulated, %u full\n",
+               text, c, n_blocks, (unsigned long) block_size,
+               (unsigned) pa_atomic_load(&s->n_allocated_by_class[c]),
+               (unsigned) pa_atomic_load(&s->n_accumulated_by_class[c]),
+               (unsigned) pa_atomic_load(&s->n_full_by_class[c]));
+    }
+}
+
+/* Every block should end up in the smallest class it fits in */
+static void test_size_classes(pa_mempool *p) {
+    const pa_mempool_stat *s = pa_mempool_get_stat(p);
+    pa_memblock *small, *page, *large;
+    size_t block_size;
+    unsigned n_blocks, c;
+
+    pa_mempool_get_size_class(p, 0, &block_size, &n_blocks);
+
+    if (n_blocks <= 0 || block_size >= pa_mempool_block_size_max(p)) {
+        printf("Pool is not split into size classes\n");
+        return;
+    }
+
+    small = pa_memblock_new_pool(p, 2048);
+    page = pa_memblock_new_pool(p, block_size);
+    large = pa_memblock_new_pool(p, pa_mempool_block_size_max(p));
+    pa_assert(small && page && large);
+
+    pa_assert(pa_atomic_load(&s->n_allocated_by_class[0]) == 2);
+    pa_assert(pa_atomic_load(&s->n_allocated_by_class[PA_MEMPOOL_SIZE_CLASSES_MAX-1]) == 1);
+
+    print_stats(p, "Size classes");
+
+    pa_memblock_unref(small);
+    pa_memblock_unref(page);
+    pa_memblock_unref(large);
+
+    for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES_MAX; c++)
+        pa_assert(pa_atomic_load(&s->n_allocated_by_class[c]) == 0);
+}
+
+/* Fill the first segment so that the pool has to grow, and pass a
+ * block from the new segment on to another pool */
+static void test_grow(pa_mempool *a, pa_mempool *b) {
+    const pa_mempool_stat *s = pa_mempool_get_stat(a);
+    pa_memblock *blocks[GROW_BLOCKS_MAX], *mb;
+    pa_memexport *export;
+    pa_memimport *import;
+    uint32_t id, shm_id, first_id;
+    size_t offset, size, pool_size, pool_size_max;
+    unsigned n = 0;
+    char *x;
+    int r;
+
+    pool_size = pa_mempool_get_size(a, &pool_size_max);
+    printf("Pool size %lu of at most %lu\n", (unsigned long) pool_size, (unsigned long) pool_size_max);
+
+    if (pool_size >= pool_size_max) {
+        printf("Pool cannot grow\n");
+        return;
+    }
+
+    while (pa_atomic_load(&s->n_segments) < 2) {
+        pa_assert(n < GROW_BLOCKS_MAX);
+        pa_assert_se(blocks[n++] = pa_memblock_new_pool(a, (size_t) -1));
+    }
+
+    pa_assert(pa_mempool_get_size(a, NULL) > pool_size);
+
+    x = pa_memblock_acquire(blocks[n-1]);
+    snprintf(x, pa_memblock_get_length(blocks[n-1]), "grown");
+    pa_memblock_release(blocks[n-1]);
+
+    pa_assert_se(export = pa_memexport_new(a, revoke_cb, (void*) "A"));
+    pa_assert_se(import = pa_memimport_new(b, release_cb, (void*) "B"));
+
+    pa_mempool_get_shm_id(a, &first_id);
+
+    r = pa_memexport_put(export, blocks[n-1], &id, &shm_id, &offset, &size);
+    pa_assert(r >= 0);
+    pa_assert(shm_id != first_id);
+
+    pa_assert_se(mb = pa_memimport_get(import, id, shm_id, offset, size));
+    x = pa_memblock_acquire(mb);
+    pa_assert(strcmp(x, "grown") == 0);
+    pa_memblock_release(mb);
+    pa_memblock_unref(mb);
+
+    pa_memimport_free(import);
+    pa_memexport_free(export);
+
+    while (n > 0)
+        pa_memblock_unref(blocks[--n]);
+
+    print_stats(a, "Grown");
+}
+
+/* With a main loop attached the pool must not grow while allocating.
+ * Allocations get appended blocks until the main loop added the
+ * segment that was asked for. */
+static void test_grow_from_mainloop(void) {
+    pa_mempool *p;
+    pa_mainloop *m;
+    const pa_mempool_stat *s;
+    pa_memblock *blocks[GROW_BLOCKS_MAX], *mb;
+    size_t pool_size, pool_size_max;
+    unsigned n = 0;
+
+    pa_assert_se(p = pa_mempool_new(FALSE, 0));
+    pa_assert_se(m = pa_mainloop_new());
+    s = pa_mempool_get_stat(p);
+
+    pool_size = pa_mempool_get_size(p, &pool_size_max);
+    if (pool_size >= pool_size_max) {
+        printf("Pool cannot grow\n");
+        goto finish;
+    }
+
+    pa_mempool_set_mainloop(p, pa_mainloop_get_api(m));
+
+    while ((mb = pa_memblock_new_pool(p, (size_t) -1))) {
+        pa_assert(n < GROW_BLOCKS_MAX);
+        blocks[n++] = mb;
+    }
+
+    pa_assert(pa_atomic_load(&s->n_segments) == 1);
+
+    pa_assert_se(mb = pa_memblock_new(p, pa_mempool_block_size_max(p)));
+    pa_assert(pa_atomic_load(&s->n_allocated_by_type[PA_MEMBLOCK_APPENDED]) == 1);
+    pa_memblock_unref(mb);
+
+    while (pa_atomic_load(&s->n_segments) < 2)
+        pa_assert_se(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    pa_assert_se(mb = pa_memblock_new_pool(p, (size_t) -1));
+    pa_memblock_unref(mb);
+
+    while (n > 0)
+        pa_memblock_unref(blocks[--n]);
+
+    print_stats(p, "Grown from main loop");
+
+finish:
+    pa_mempool_free(p);
+    pa_mainloop_free(m);
 }
 
 int main(int argc, char *argv[]) {
@@ -158,6 +314,10 @@ int main(int argc, char *argv[]) {
         pa_memexport_free(export_a);
     }
 
+    test_size_classes(pool_a);
+    test_grow(pool_a, pool_b);
+    test_grow_from_mainloop();
+
     printf("vaccuuming...\n");
 
     pa_mempool_vacuum(pool_a);
@@ -26,8 +26,11 @@
 #include <stdio.h>
 #include <signal.h>
 
+#include <pulse/rtclock.h>
+
 #include <pulsecore/memblockq.h>
 #include <pulsecore/log.h>
+#include <pulsecore/macro.h>
 
 static void dump_chunk(const pa_memchunk *chunk) {
     size_t n;
@@ -69,6 +72,94 @@ static void dump(pa_memblockq *bq) {
     printf("<\n");
 }
 
+/* Two seconds of history of 48kHz S16 stereo, as alsa sinks in
+ * timer-based scheduling mode keep it */
+#define BENCH_REWIND (2*48000*4)
+#define BENCH_CHUNK 64
+#define BENCH_BLOCKS 100000
+#define BENCH_TIMES 10000
+
+/* Fills the history with many small blocks, alternating between two
+ * memblocks so that they cannot be merged */
+static void bench_fill(pa_memblockq *bq, pa_memblock *b[2]) {
+    unsigned i;
+
+    for (i = 0; i < BENCH_BLOCKS; i++) {
+        pa_memchunk c, out;
+
+        c.memblock = b[i % 2];
+        c.index = 0;
+        c.length = BENCH_CHUNK;
+
+        pa_assert_se(pa_memblockq_push(bq, &c) == 0);
+
+        pa_assert_se(pa_memblockq_peek(bq, &out) == 0);
+        pa_assert_se(out.memblock == c.memblock);
+        pa_memblock_unref(out.memblock);
+        pa_memblockq_drop(bq, out.length);
+    }
+}
+
+static void run_benchmark(pa_mempool *p) {
+    pa_memblockq *bq;
+    pa_memblock *b[2];
+    pa_usec_t start, stop;
+    unsigned i;
+
+    b[0] = pa_memblock_new(p, BENCH_CHUNK);
+    b[1] = pa_memblock_new(p, BENCH_CHUNK);
+
+    bq = pa_memblockq_new(0, 4*BENCH_REWIND, 0, 4, 0, 4, BENCH_REWIND, NULL);
+
+    start = pa_rtclock_now();
+    bench_fill(bq, b);
+    stop = pa_rtclock_now();
+    pa_log_info("%u small pushes with %u blocks of history: %llu usec.", BENCH_BLOCKS, pa_memblockq_get_nblocks(bq),
+                (long long unsigned int) (stop - start));
+
+    /* Rewind deep into the history, play a bit and come back, like a
+     * sink does when a new stream shows up */
+    start = pa_rtclock_now();
+    for (i = 0; i < BENCH_TIMES; i++) {
+        size_t l = ((i * 7919) % (BENCH_REWIND / BENCH_CHUNK) + 1) * BENCH_CHUNK;
+        pa_memchunk out;
+
+        pa_memblockq_rewind(bq, l);
+
+        pa_assert_se(pa_memblockq_peek(bq, &out) == 0);
+        pa_assert_se(out.memblock == b[0] || out.memblock == b[1]);
+        pa_memblock_unref(out.memblock);
+
+        pa_memblockq_drop(bq, l);
+    }
+    stop = pa_rtclock_now();
+    pa_log_info("%u deep rewinds: %llu usec.", BENCH_TIMES,
+                (long long unsigned int) (stop - start));
+
+    /* Overwrite the history at random positions, like a client seeking
+     * backwards does */
+    start = pa_rtclock_now();
+    for (i = 0; i < BENCH_TIMES; i++) {
+        int64_t l = (int64_t) (((i * 7919) % (BENCH_REWIND / BENCH_CHUNK) + 1) * BENCH_CHUNK);
+        pa_memchunk c;
+
+        c.memblock = b[i % 2];
+        c.index = 0;
+        c.length = BENCH_CHUNK;
+
+        pa_memblockq_seek(bq, -l, PA_SEEK_RELATIVE, TRUE);
+        pa_assert_se(pa_memblockq_push(bq, &c) == 0);
+        pa_memblockq_seek(bq, 0, PA_SEEK_RELATIVE_END, TRUE);
+    }
+    stop = pa_rtclock_now();
+    pa_log_info("%u overwrites: %llu usec.", BENCH_TIMES,
+                (long long unsigned int) (stop - start));
+
+    pa_memblockq_free(bq);
+    pa_memblock_unref(b[0]);
+    pa_memblock_unref(b[1]);
+}
+
 int main(int argc, char *argv[]) {
     int ret;
 
@@ -174,6 +265,8 @@ int main(int argc, char *argv[]) {
     pa_memblock_unref(chunk3.memblock);
     pa_memblock_unref(chunk4.memblock);
 
+    run_benchmark(p);
+
     pa_mempool_free(p);
 
     return 0;
@@ -25,12 +25,16 @@
 
 #include <pulse/sample.h>
 #include <pulse/volume.h>
+#include <pulse/rtclock.h>
 
 #include <pulsecore/resampler.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/endianmacros.h>
 #include <pulsecore/memblock.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/random.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/cpu-arm.h>
 
 static float swap_float(float a) {
     uint32_t *b = (uint32_t*) &a;
@@ -204,6 +208,105 @@ static pa_memblock* generate_block(pa_mempool *pool, const pa_sample_spec *ss) {
     return r;
 }
 
+#define BENCH_STREAMS 16
+#define BENCH_FRAMES 2048
+#define BENCH_TIMES 100
+
+/* Mixes BENCH_STREAMS streams of random data with both the C reference
+ * mixer and whatever pa_cpu_init_*() installed, checks that the results
+ * are identical and prints the time each took. */
+static void run_mix_benchmark(pa_mempool *pool, pa_sample_format_t format, unsigned channels, pa_do_mix_func_t ref) {
+    pa_sample_spec ss;
+    pa_mix_info m[BENCH_STREAMS];
+    pa_memblock *out_ref, *out;
+    pa_do_mix_func_t func;
+    pa_usec_t start, stop;
+    size_t length;
+    void *d, *d_ref;
+    unsigned i, c, j;
+    uint32_t dither = 0;
+
+    ss.format = format;
+    ss.channels = (uint8_t) channels;
+    ss.rate = 44100;
+
+    func = pa_get_mix_func(format);
+    length = BENCH_FRAMES * pa_frame_size(&ss);
+
+    for (i = 0; i < BENCH_STREAMS; i++) {
+        void *p;
+
+        m[i].chunk.memblock = pa_memblock_new(pool, length);
+        m[i].chunk.index = 0;
+        m[i].chunk.length = length;
+
+        p = pa_memblock_acquire(m[i].chunk.memblock);
+        pa_random(p, length);
+
+        if (format == PA_SAMPLE_FLOAT32NE) {
+            float *f = p;
+
+            for (j = 0; j < BENCH_FRAMES * channels; j++)
+                f[j] = (float) ((int16_t) (((uint32_t*) p)[j])) / 0x8000;
+        }
+
+        pa_memblock_release(m[i].chunk.memblock);
+
+        m[i].volume.channels = (uint8_t) channels;
+        for (c = 0; c < channels; c++)
+            m[i].volume.values[c] = pa_sw_volume_from_linear(0.1 + 0.05 * ((i + c) % 8));
+
+        /* one stream with a silent channel */
+        if (i == 1)
+            m[i].volume.values[0] = PA_VOLUME_MUTED;
+    }
+
+    out_ref = pa_memblock_new(pool, length);
+    out = pa_memblock_new(pool, length);
+
+    d_ref = pa_memblock_acquire(out_ref);
+    d = pa_memblock_acquire(out);
+
+    pa_set_mix_func(format, ref);
+    pa_mix(m, BENCH_STREAMS, d_ref, length, &ss, NULL, FALSE);
+    pa_set_mix_func(format, func);
+    pa_mix(m, BENCH_STREAMS, d, length, &ss, NULL, FALSE);
+
+    pa_assert_se(memcmp(d, d_ref, length) == 0);
+
+    pa_set_mix_func(format, ref);
+    start = pa_rtclock_now();
+    for (j = 0; j < BENCH_TIMES; j++)
+        pa_mix(m, BENCH_STREAMS, d_ref, length, &ss, NULL, FALSE);
+    stop = pa_rtclock_now();
+    pa_log_info("%s, %u channels, %u streams, reference: %llu usec.", pa_sample_format_to_string(format), channels, BENCH_STREAMS,
+                (long long unsigned int) (stop - start));
+
+    pa_set_mix_func(format, func);
+    start = pa_rtclock_now();
+    for (j = 0; j < BENCH_TIMES; j++)
+        pa_mix(m, BENCH_STREAMS, d, length, &ss, NULL, FALSE);
+    stop = pa_rtclock_now();
+    pa_log_info("%s, %u channels, %u streams, optimized: %llu usec.", pa_sample_format_to_string(format), channels, BENCH_STREAMS,
+                (long long unsigned int) (stop - start));
+
+    start = pa_rtclock_now();
+    for (j = 0; j < BENCH_TIMES; j++)
+        pa_mix_float(m, BENCH_STREAMS, d, length, &ss, NULL, FALSE, &dither);
+    stop = pa_rtclock_now();
+    pa_log_info("%s, %u channels, %u streams, float bus: %llu usec.", pa_sample_format_to_string(format), channels, BENCH_STREAMS,
+                (long long unsigned int) (stop - start));
+
+    pa_memblock_release(out_ref);
+    pa_memblock_release(out);
+
+    pa_memblock_unref(out_ref);
+    pa_memblock_unref(out);
+
+    for (i = 0; i < BENCH_STREAMS; i++)
+        pa_memblock_unref(m[i].chunk.memblock);
+}
+
 int main(int argc, char *argv[]) {
     pa_mempool *pool;
     pa_sample_spec a;
@@ -260,11 +363,36 @@ int main(int argc, char *argv[]) {
 
         dump_block(&a, &k);
 
+        /* The same through the float mixing bus, without dither this
+         * should only differ in rounding */
+        ptr = (uint8_t*) pa_memblock_acquire(k.memblock) + k.index;
+        pa_mix_float(m, 2, ptr, k.length, &a, NULL, FALSE, NULL);
+        pa_memblock_release(k.memblock);
+
+        dump_block(&a, &k);
+
         pa_memblock_unref(i.memblock);
         pa_memblock_unref(j.memblock);
         pa_memblock_unref(k.memblock);
     }
 
+    {
+        static const pa_sample_format_t formats[] = { PA_SAMPLE_S16NE, PA_SAMPLE_S32NE, PA_SAMPLE_FLOAT32NE };
+        static const unsigned channels[] = { 1, 2, 6 };
+        pa_do_mix_func_t ref[PA_ELEMENTSOF(formats)];
+        unsigned f, c;
+
+        for (f = 0; f < PA_ELEMENTSOF(formats); f++)
+            ref[f] = pa_get_mix_func(formats[f]);
+
+        pa_cpu_init_x86();
+        pa_cpu_init_arm();
+
+        for (f = 0; f < PA_ELEMENTSOF(formats); f++)
+            for (c = 0; c < PA_ELEMENTSOF(channels); c++)
+                run_mix_benchmark(pool, formats[f], channels[c], ref[f]);
+    }
+
     pa_mempool_free(pool);
 
     return 0;
@@ -9,7 +9,8 @@
 
 int main(int argc, char *argv[]) {
     pa_prioq *q;
-    unsigned i;
+    pa_prioq_item *items[N];
+    unsigned i, last;
 
     srand(0);
 
@@ -38,6 +39,23 @@ int main(int argc, char *argv[]) {
         pa_log("%16u", u);
     }
 
+    /* Remove from the middle, and check that what remains still comes
+     * out in order */
+    for (i = 0; i < N; i++)
+        items[i] = pa_prioq_put(q, PA_UINT_TO_PTR((unsigned) rand()));
+
+    for (i = 0; i < N; i += 3)
+        pa_prioq_remove(q, items[i]);
+
+    pa_assert_se(pa_prioq_size(q) == N - (N+2)/3);
+
+    last = 0;
+    while (!pa_prioq_isempty(q)) {
+        unsigned u = PA_PTR_TO_UINT(pa_prioq_pop(q));
+        pa_assert_se(u >= last);
+        last = u;
+    }
+
     pa_prioq_free(q, NULL, NULL);
 
     return 0;
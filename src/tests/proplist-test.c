@@ -35,6 +35,8 @@ int main(int argc, char*argv[]) {
     char *s, *t, *u, *v;
     const char *text;
     const char *x[] = { "foo", NULL };
+    void *state;
+    unsigned i;
 
     a = pa_proplist_new();
     pa_assert_se(pa_proplist_sets(a, PA_PROP_MEDIA_TITLE, "Brandenburgische Konzerte") == 0);
@@ -92,5 +94,52 @@ int main(int argc, char*argv[]) {
     pa_proplist_free(a);
     pa_modargs_free(ma);
 
+    /* Copies share their properties until one of them is changed */
+    a = pa_proplist_new();
+    pa_assert_se(pa_proplist_sets(a, "test.key", "") == 0);
+    for (i = 0; i < 40; i++) {
+        s = pa_sprintf_malloc("test.key%u", i);
+        pa_assert_se(pa_proplist_setf(a, s, "%u", i) == 0);
+        pa_xfree(s);
+    }
+    pa_assert_se(pa_proplist_sets(a, PA_PROP_APPLICATION_NAME, "test") == 0);
+    pa_assert_se(pa_proplist_size(a) == 42);
+
+    b = pa_proplist_copy(a);
+    pa_assert_se(pa_proplist_unset(b, "test.key0") == 0);
+    pa_assert_se(pa_proplist_sets(b, PA_PROP_APPLICATION_NAME, "copy") == 0);
+
+    pa_assert_se(pa_proplist_size(a) == 42);
+    pa_assert_se(pa_proplist_size(b) == 41);
+    pa_assert_se(pa_streq(pa_proplist_gets(a, "test.key0"), "0"));
+    pa_assert_se(!pa_proplist_gets(b, "test.key0"));
+    pa_assert_se(pa_streq(pa_proplist_gets(a, PA_PROP_APPLICATION_NAME), "test"));
+    pa_assert_se(pa_streq(pa_proplist_gets(b, PA_PROP_APPLICATION_NAME), "copy"));
+    pa_assert_se(pa_streq(pa_proplist_gets(b, "test.key39"), "39"));
+
+    /* Removing keeps the order */
+    state = NULL;
+    pa_assert_se(pa_streq(pa_proplist_iterate(b, &state), "test.key"));
+    pa_assert_se(pa_streq(pa_proplist_iterate(b, &state), "test.key1"));
+
+    pa_proplist_free(a);
+    pa_proplist_free(b);
+
+    /* Values stay valid when the list they came from stops sharing */
+    a = pa_proplist_new();
+    pa_assert_se(pa_proplist_sets(a, PA_PROP_MEDIA_NAME, "Goldbergvariationen") == 0);
+    pa_assert_se(pa_proplist_sets(a, "test.key", "test") == 0);
+
+    b = pa_proplist_copy(a);
+    text = pa_proplist_gets(a, PA_PROP_MEDIA_NAME);
+    s = (char*) pa_proplist_gets(a, "test.key");
+    pa_assert_se(pa_proplist_sets(a, PA_PROP_MEDIA_ROLE, "x") == 0);
+    pa_proplist_free(b);
+    puts(text);
+    pa_assert_se(pa_streq(text, "Goldbergvariationen"));
+    pa_assert_se(pa_streq(s, "test"));
+
+    pa_proplist_free(a);
+
     return 0;
 }
@@ -0,0 +1,454 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pulse/pulseaudio.h>
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+#include <pulsecore/socket-server.h>
+#include <pulsecore/protocol-native.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+/* Runs a daemon core with two sinks in this process, and lets a few
+ * clients play through native protocol connections that are served by
+ * worker threads, while their sink inputs are moved around. */
+#define WORKERS 2
+#define CLIENTS 3
+#define PLAYBACK_BYTES (44100 * 4 / 2)
+#define BLOCK_USEC (20 * PA_USEC_PER_MSEC)
+#define MOVE_USEC (50 * PA_USEC_PER_MSEC)
+
+static const char* const valid_modargs[] = {
+    "auth-anonymous",
+    "auth-cookie-enabled",
+    "max-connections",
+    "workers",
+    NULL
+};
+
+/*** A sink that renders in real time and drops the data ***/
+
+struct test_sink {
+    pa_sink *sink;
+    pa_rtpoll *rtpoll;
+    pa_thread_mq thread_mq;
+    pa_thread *thread;
+    pa_usec_t timestamp;
+};
+
+static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct test_sink *u = PA_SINK(o)->userdata;
+
+    switch (code) {
+        case PA_SINK_MESSAGE_SET_STATE:
+
+            if (PA_PTR_TO_UINT(data) == PA_SINK_RUNNING)
+                u->timestamp = pa_rtclock_now();
+
+            break;
+
+        case PA_SINK_MESSAGE_GET_LATENCY: {
+            pa_usec_t now;
+
+            now = pa_rtclock_now();
+            *((pa_usec_t*) data) = u->timestamp > now ? u->timestamp - now : 0ULL;
+
+            return 0;
+        }
+    }
+
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+static void sink_thread_func(void *userdata) {
+    struct test_sink *u = userdata;
+
+    pa_thread_mq_install(&u->thread_mq);
+
+    u->timestamp = pa_rtclock_now();
+
+    for (;;) {
+        int ret;
+
+        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+
+            if (u->sink->thread_info.rewind_requested)
+                pa_sink_process_rewind(u->sink, 0);
+
+            if (u->timestamp <= pa_rtclock_now()) {
+                pa_memchunk chunk;
+
+                pa_sink_render(u->sink, u->sink->thread_info.max_request, &chunk);
+                u->timestamp += pa_bytes_to_usec(chunk.length, &u->sink->sample_spec);
+                pa_memblock_unref(chunk.memblock);
+            }
+
+            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp);
+        } else
+            pa_rtpoll_set_timer_disabled(u->rtpoll);
+
+        pa_assert_se((ret = pa_rtpoll_run(u->rtpoll, TRUE)) >= 0);
+
+        if (ret == 0)
+            break;
+    }
+}
+
+static void test_sink_init(struct test_sink *u, pa_core *c, const char *name) {
+    pa_sink_new_data data;
+    size_t nbytes;
+
+    u->rtpoll = pa_rtpoll_new();
+    pa_thread_mq_init(&u->thread_mq, c->mainloop, u->rtpoll);
+
+    pa_sink_new_data_init(&data);
+    data.driver = __FILE__;
+    pa_sink_new_data_set_name(&data, name);
+    pa_sink_new_data_set_sample_spec(&data, &c->default_sample_spec);
+    pa_sink_new_data_set_channel_map(&data, &c->default_channel_map);
+    pa_assert_se(u->sink = pa_sink_new(c, &data, PA_SINK_LATENCY));
+    pa_sink_new_data_done(&data);
+
+    u->sink->parent.process_msg = sink_process_msg;
+    u->sink->userdata = u;
+
+    pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
+    pa_sink_set_rtpoll(u->sink, u->rtpoll);
+
+    nbytes = pa_usec_to_bytes(BLOCK_USEC, &u->sink->sample_spec);
+    pa_sink_set_max_rewind(u->sink, 0);
+    pa_sink_set_max_request(u->sink, nbytes);
+    pa_sink_set_fixed_latency(u->sink, BLOCK_USEC);
+
+    pa_assert_se(u->thread = pa_thread_new(sink_thread_func, u));
+
+    pa_sink_put(u->sink);
+}
+
+static void test_sink_done(struct test_sink *u) {
+    pa_sink_unlink(u->sink);
+
+    pa_asyncmsgq_send(u->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(u->thread);
+    pa_thread_mq_done(&u->thread_mq);
+
+    pa_sink_unref(u->sink);
+    pa_rtpoll_free(u->rtpoll);
+}
+
+/*** The clients, each running a main loop in a thread of its own ***/
+
+enum {
+    CLIENT_CONNECTING,
+    CLIENT_PLAYING,
+    CLIENT_DONE,
+    CLIENT_FAILED
+};
+
+struct client {
+    const char *server;
+    pa_mainloop *mainloop;
+    pa_context *context;
+    pa_stream *stream;
+    pa_thread *thread;
+
+    size_t written;
+    pa_bool_t draining;
+
+    pa_atomic_t state;
+};
+
+static void client_finish(struct client *c, int state) {
+    if (pa_atomic_load(&c->state) < CLIENT_DONE)
+        pa_atomic_store(&c->state, state);
+
+    pa_mainloop_quit(c->mainloop, 0);
+}
+
+static void drain_cb(pa_stream *s, int success, void *userdata) {
+    struct client *c = userdata;
+
+    client_finish(c, success ? CLIENT_DONE : CLIENT_FAILED);
+}
+
+static void write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    struct client *c = userdata;
+    uint8_t *d;
+    size_t j;
+
+    if (c->draining)
+        return;
+
+    nbytes = PA_MIN(nbytes, PLAYBACK_BYTES - c->written);
+
+    if (nbytes > 0) {
+        d = pa_xmalloc(nbytes);
+
+        for (j = 0; j < nbytes; j++)
+            d[j] = (uint8_t) (c->written + j);
+
+        pa_assert_se(pa_stream_write(s, d, nbytes, pa_xfree, 0, PA_SEEK_RELATIVE) == 0);
+        c->written += nbytes;
+    }
+
+    if (c->written >= PLAYBACK_BYTES) {
+        c->draining = TRUE;
+        pa_operation_unref(pa_stream_drain(s, drain_cb, c));
+    }
+}
+
+static void stream_state_cb(pa_stream *s, void *userdata) {
+    struct client *c = userdata;
+
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_READY:
+            pa_atomic_cmpxchg(&c->state, CLIENT_CONNECTING, CLIENT_PLAYING);
+            break;
+
+        case PA_STREAM_FAILED:
+            client_finish(c, CLIENT_FAILED);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void context_state_cb(pa_context *ctx, void *userdata) {
+    struct client *c = userdata;
+    pa_sample_spec ss;
+
+    switch (pa_context_get_state(ctx)) {
+        case PA_CONTEXT_READY:
+            ss.format = PA_SAMPLE_S16LE;
+            ss.rate = 44100;
+            ss.channels = 2;
+
+            pa_assert_se(c->stream = pa_stream_new(ctx, "test", &ss, NULL));
+            pa_stream_set_state_callback(c->stream, stream_state_cb, c);
+            pa_stream_set_write_callback(c->stream, write_cb, c);
+            pa_assert_se(pa_stream_connect_playback(c->stream, NULL, NULL, 0, NULL, NULL) == 0);
+            break;
+
+        case PA_CONTEXT_FAILED:
+        case PA_CONTEXT_TERMINATED:
+            client_finish(c, CLIENT_FAILED);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void client_thread_func(void *userdata) {
+    struct client *c = userdata;
+
+    pa_assert_se(c->mainloop = pa_mainloop_new());
+    pa_assert_se(c->context = pa_context_new(pa_mainloop_get_api(c->mainloop), "protocol-native-test"));
+    pa_context_set_state_callback(c->context, context_state_cb, c);
+    pa_assert_se(pa_context_connect(c->context, c->server, PA_CONTEXT_NOAUTOSPAWN, NULL) == 0);
+
+    pa_mainloop_run(c->mainloop, NULL);
+
+    if (c->stream) {
+        pa_stream_disconnect(c->stream);
+        pa_stream_unref(c->stream);
+    }
+
+    pa_context_disconnect(c->context);
+    pa_context_unref(c->context);
+    pa_mainloop_free(c->mainloop);
+}
+
+static void client_start(struct client *c, const char *server) {
+    memset(c, 0, sizeof(*c));
+    c->server = server;
+    pa_atomic_store(&c->state, CLIENT_CONNECTING);
+    pa_assert_se(c->thread = pa_thread_new(client_thread_func, c));
+}
+
+/*** The daemon side ***/
+
+static pa_native_protocol *protocol;
+static pa_native_options *options;
+static struct test_sink sinks[2];
+static unsigned n_moves, n_rescued;
+
+static void on_connection(pa_socket_server *s, pa_iochannel *io, void *userdata) {
+    pa_native_protocol_connect(protocol, io, options);
+}
+
+/* Like module-rescue-streams, takes the sink input that failed to move
+ * to the other sink */
+static pa_hook_result_t move_fail_cb(pa_core *c, pa_sink_input *i, void *userdata) {
+    pa_sink *dest = userdata;
+
+    if (pa_sink_input_finish_move(i, dest, FALSE) < 0)
+        return PA_HOOK_OK;
+
+    n_rescued++;
+    return PA_HOOK_STOP;
+}
+
+static void move_sink_inputs(pa_core *c, pa_bool_t fail) {
+    pa_sink_input *i;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(i, c->sink_inputs, idx) {
+        pa_sink *dest;
+
+        if (!i->sink)
+            continue;
+
+        dest = i->sink == sinks[0].sink ? sinks[1].sink : sinks[0].sink;
+
+        if (fail) {
+            pa_hook_slot *slot;
+
+            /* The move fails, and somebody else picks the sink input
+             * up again */
+            slot = pa_hook_connect(&c->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FAIL], PA_HOOK_NORMAL, (pa_hook_cb_t) move_fail_cb, dest);
+            pa_assert_se(pa_sink_input_start_move(i) == 0);
+            pa_sink_input_fail_move(i);
+            pa_hook_slot_free(slot);
+        } else
+            pa_assert_se(pa_sink_input_move_to(i, dest, FALSE) == 0);
+    }
+}
+
+/* Moves all sink inputs to the other sink every now and then. The
+ * third time the move fails, and the sink inputs are rescued. */
+static void move_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    pa_core *c = userdata;
+
+    move_sink_inputs(c, n_moves == 2);
+    n_moves++;
+
+    pa_core_rttime_restart(c, e, pa_rtclock_now() + MOVE_USEC);
+}
+
+static pa_bool_t clients_in_state(struct client *c, unsigned n, int state) {
+    unsigned k;
+
+    for (k = 0; k < n; k++)
+        if (pa_atomic_load(&c[k].state) < state)
+            return FALSE;
+
+    return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+    pa_mainloop *m;
+    pa_core *c;
+    pa_modargs *ma;
+    pa_socket_server *server;
+    struct client clients[CLIENTS], refused;
+    pa_time_event *e;
+    char *path, *server_string, *args;
+    unsigned k;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_assert_se(m = pa_mainloop_new());
+    pa_assert_se(c = pa_core_new(pa_mainloop_get_api(m), TRUE, 0));
+
+    test_sink_init(&sinks[0], c, "test_sink_a");
+    test_sink_init(&sinks[1], c, "test_sink_b");
+
+    /* One connection more than the clients is refused */
+    args = pa_sprintf_malloc("auth-anonymous=1 auth-cookie-enabled=0 max-connections=%u workers=%u", CLIENTS, WORKERS);
+    pa_assert_se(ma = pa_modargs_new(args, valid_modargs));
+    pa_xfree(args);
+
+    protocol = pa_native_protocol_get(c);
+    options = pa_native_options_new();
+    pa_assert_se(pa_native_options_parse(options, c, ma) >= 0);
+    pa_modargs_free(ma);
+
+    path = pa_sprintf_malloc("/tmp/protocol-native-test-%lu", (unsigned long) getpid());
+    server_string = pa_sprintf_malloc("unix:%s", path);
+    pa_assert_se(server = pa_socket_server_new_unix(c->mainloop, path));
+    pa_socket_server_set_callback(server, on_connection, NULL);
+
+    for (k = 0; k < CLIENTS; k++)
+        client_start(&clients[k], server_string);
+
+    while (!clients_in_state(clients, CLIENTS, CLIENT_PLAYING))
+        pa_assert_se(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    client_start(&refused, server_string);
+
+    e = pa_core_rttime_new(c, pa_rtclock_now() + MOVE_USEC, move_cb, c);
+
+    while (!clients_in_state(clients, CLIENTS, CLIENT_DONE) || !clients_in_state(&refused, 1, CLIENT_DONE))
+        pa_assert_se(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    c->mainloop->time_free(e);
+
+    for (k = 0; k < CLIENTS; k++) {
+        pa_assert_se(pa_atomic_load(&clients[k].state) == CLIENT_DONE);
+        pa_thread_free(clients[k].thread);
+    }
+
+    pa_assert_se(pa_atomic_load(&refused.state) == CLIENT_FAILED);
+    pa_thread_free(refused.thread);
+
+    pa_log_info("%u clients played through %u workers, %u moves, %u sink inputs rescued.", CLIENTS, WORKERS, n_moves, n_rescued);
+    pa_assert_se(n_moves > 2);
+    pa_assert_se(n_rescued > 0);
+
+    /* Let the connections go away */
+    while (pa_idxset_size(c->clients) > 0)
+        pa_assert_se(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    pa_socket_server_unref(server);
+    pa_native_options_unref(options);
+    pa_native_protocol_unref(protocol);
+
+    test_sink_done(&sinks[0]);
+    test_sink_done(&sinks[1]);
+
+    pa_core_unref(c);
+    pa_mainloop_free(m);
+
+    pa_xfree(server_string);
+    pa_xfree(path);
+
+    return 0;
+}
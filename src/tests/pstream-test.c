@@ -0,0 +1,400 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/pstream.h>
+#include <pulsecore/iochannel.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/packet.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/shm.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+/* Every other item is a packet, every third a memblock. Item i goes on
+ * channel i and its bytes are derived from i, so the receiving side
+ * can tell what it got and whether it's in order. */
+#define ITEMS 600
+#define PACKET_LENGTH_MAX 3000
+#define MEMBLOCK_LENGTH_MAX 100000
+#define SHM_LENGTH_MAX 4000
+
+/* The relay moves at most this many bytes at a time */
+#define RELAY_CHUNK_MAX 997
+
+static pa_bool_t is_memblock(unsigned i) {
+    return i % 3 == 2;
+}
+
+static size_t item_length(unsigned i, size_t max) {
+    return 1 + ((i * 2654435761U) >> 8) % max;
+}
+
+static uint8_t item_byte(unsigned i, size_t j) {
+    return (uint8_t) (i * 7 + j);
+}
+
+static void fill(void *d, unsigned i, size_t length) {
+    size_t j;
+
+    for (j = 0; j < length; j++)
+        ((uint8_t*) d)[j] = item_byte(i, j);
+}
+
+static void check(const void *d, unsigned i, size_t offset, size_t length) {
+    size_t j;
+
+    for (j = 0; j < length; j++)
+        pa_assert_se(((const uint8_t*) d)[j] == item_byte(i, offset + j));
+}
+
+struct receiver {
+    unsigned n_items;
+    size_t memblock_length_max;
+
+    unsigned next;
+    size_t received;
+    unsigned n_packets, n_memblocks;
+};
+
+static void next_item(struct receiver *r) {
+    r->next++;
+    r->received = 0;
+}
+
+static void packet_callback(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    struct receiver *r = userdata;
+
+    pa_assert_se(r->next < r->n_items);
+    pa_assert_se(!is_memblock(r->next));
+    pa_assert_se(packet->length == item_length(r->next, PACKET_LENGTH_MAX));
+
+    check(packet->data, r->next, 0, packet->length);
+
+    r->n_packets++;
+    next_item(r);
+}
+
+/* Memblocks that don't go through SHM come in as they are read, in
+ * pieces of any size */
+static void memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    struct receiver *r = userdata;
+    size_t length;
+    void *d;
+
+    pa_assert_se(r->next < r->n_items);
+    pa_assert_se(is_memblock(r->next));
+    pa_assert_se(channel == r->next);
+    pa_assert_se(offset == 0);
+    pa_assert_se(seek == PA_SEEK_RELATIVE);
+    pa_assert_se(chunk->memblock);
+
+    length = item_length(r->next, r->memblock_length_max);
+    pa_assert_se(r->received + chunk->length <= length);
+
+    d = pa_memblock_acquire(chunk->memblock);
+    check((uint8_t*) d + chunk->index, r->next, r->received, chunk->length);
+    pa_memblock_release(chunk->memblock);
+
+    r->received += chunk->length;
+
+    if (r->received >= length) {
+        r->n_memblocks++;
+        next_item(r);
+    }
+}
+
+static void send_items(pa_pstream *p, pa_mempool *pool, unsigned n, size_t memblock_length_max) {
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+
+        if (is_memblock(i)) {
+            pa_memchunk chunk;
+            void *d;
+
+            chunk.length = item_length(i, memblock_length_max);
+            chunk.memblock = pa_memblock_new(pool, chunk.length);
+            chunk.index = 0;
+
+            d = pa_memblock_acquire(chunk.memblock);
+            fill(d, i, chunk.length);
+            pa_memblock_release(chunk.memblock);
+
+            pa_pstream_send_memblock(p, i, 0, PA_SEEK_RELATIVE, &chunk);
+            pa_memblock_unref(chunk.memblock);
+
+        } else {
+            pa_packet *packet;
+
+            packet = pa_packet_new(item_length(i, PACKET_LENGTH_MAX));
+            fill(packet->data, i, packet->length);
+
+            pa_pstream_send_packet(p, packet, NULL);
+            pa_packet_unref(packet);
+        }
+    }
+}
+
+/* Two pstreams talking through a pair of threads that pass on the
+ * bytes in small, odd pieces. The sender sees its writes cut short by
+ * a small socket buffer, the receiver gets its frames split anywhere,
+ * descriptors included. */
+struct relay {
+    int from, to;
+    pa_thread *thread;
+};
+
+struct link {
+    int fds[2][2];
+    struct relay relays[2];
+    pa_pstream *a, *b;
+};
+
+static void relay_func(void *userdata) {
+    struct relay *r = userdata;
+    uint8_t buf[RELAY_CHUNK_MAX];
+    unsigned seed = (unsigned) r->from;
+    ssize_t n, k;
+
+    for (;;) {
+        seed = seed * 1103515245U + 12345U;
+
+        if ((n = recv(r->from, buf, 1 + (seed >> 16) % sizeof(buf), 0)) <= 0)
+            break;
+
+        for (k = 0; k < n;) {
+            ssize_t w;
+
+            if ((w = send(r->to, buf + k, (size_t) (n - k), MSG_NOSIGNAL)) <= 0)
+                return;
+
+            k += w;
+        }
+    }
+}
+
+static void link_new(struct link *l, pa_mainloop_api *api, pa_mempool *pool_a, pa_mempool *pool_b) {
+    int size = 4096;
+    unsigned i;
+
+    pa_assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, l->fds[0]) == 0);
+    pa_assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, l->fds[1]) == 0);
+
+    for (i = 0; i < 2; i++)
+        pa_assert_se(setsockopt(l->fds[i][0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == 0);
+
+    l->a = pa_pstream_new(api, pa_iochannel_new(api, l->fds[0][0], l->fds[0][0]), pool_a);
+    l->b = pa_pstream_new(api, pa_iochannel_new(api, l->fds[1][0], l->fds[1][0]), pool_b);
+
+    l->relays[0].from = l->fds[0][1];
+    l->relays[0].to = l->fds[1][1];
+    l->relays[1].from = l->fds[1][1];
+    l->relays[1].to = l->fds[0][1];
+
+    for (i = 0; i < 2; i++)
+        pa_assert_se(l->relays[i].thread = pa_thread_new(relay_func, &l->relays[i]));
+}
+
+static void link_free(struct link *l) {
+    unsigned i;
+
+    pa_pstream_unlink(l->a);
+    pa_pstream_unref(l->a);
+    pa_pstream_unlink(l->b);
+    pa_pstream_unref(l->b);
+
+    for (i = 0; i < 2; i++)
+        shutdown(l->fds[i][1], SHUT_RDWR);
+
+    for (i = 0; i < 2; i++) {
+        pa_thread_free(l->relays[i].thread);
+        pa_close(l->fds[i][1]);
+    }
+}
+
+static void test_mixed(pa_mainloop *m, pa_mempool *pool) {
+    struct link l;
+    struct receiver r;
+
+    memset(&r, 0, sizeof(r));
+    r.n_items = ITEMS;
+    r.memblock_length_max = MEMBLOCK_LENGTH_MAX;
+
+    link_new(&l, pa_mainloop_get_api(m), pool, pool);
+    pa_pstream_set_recieve_packet_callback(l.b, packet_callback, &r);
+    pa_pstream_set_recieve_memblock_callback(l.b, memblock_callback, &r);
+
+    send_items(l.a, pool, ITEMS, MEMBLOCK_LENGTH_MAX);
+
+    while (r.next < r.n_items)
+        pa_assert_se(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    pa_assert_se(r.n_packets + r.n_memblocks == ITEMS);
+    pa_assert_se(!pa_pstream_is_pending(l.a));
+
+    link_free(&l);
+
+    pa_log_info("%u packets and %u memblocks arrived in order.", r.n_packets, r.n_memblocks);
+}
+
+/* Memblocks go by SHM. The receiver drops each block right away, which
+ * makes its pstream send a SHMRELEASE frame back for it. */
+static void test_shm_release(pa_mainloop *m) {
+    pa_mempool *pool_a, *pool_b;
+    struct link l;
+    struct receiver r;
+    unsigned max_exported = 0;
+
+    if (!(pool_a = pa_mempool_new(TRUE, 0))) {
+        pa_log("No shared memory pool, skipping SHM test.");
+        return;
+    }
+
+    pa_assert_se(pool_b = pa_mempool_new(FALSE, 0));
+
+    memset(&r, 0, sizeof(r));
+    r.n_items = ITEMS;
+    r.memblock_length_max = SHM_LENGTH_MAX;
+
+    link_new(&l, pa_mainloop_get_api(m), pool_a, pool_b);
+    pa_pstream_enable_shm(l.a, TRUE);
+    pa_pstream_enable_shm(l.b, TRUE);
+    pa_pstream_set_recieve_packet_callback(l.b, packet_callback, &r);
+    pa_pstream_set_recieve_memblock_callback(l.b, memblock_callback, &r);
+
+    send_items(l.a, pool_a, ITEMS, SHM_LENGTH_MAX);
+
+    while (r.next < r.n_items || pa_atomic_load(&pa_mempool_get_stat(pool_a)->n_exported) > 0) {
+        max_exported = PA_MAX(max_exported, (unsigned) pa_atomic_load(&pa_mempool_get_stat(pool_a)->n_exported));
+        pa_assert_se(pa_mainloop_iterate(m, 1, NULL) >= 0);
+    }
+
+    /* If nothing was exported the blocks were copied, and we didn't
+     * test anything */
+    pa_assert_se(max_exported > 0);
+    pa_assert_se(r.n_memblocks == ITEMS / 3);
+    pa_assert_se(pa_atomic_load(&pa_mempool_get_stat(pool_b)->n_imported) == 0);
+
+    link_free(&l);
+
+    pa_mempool_free(pool_a);
+    pa_mempool_free(pool_b);
+
+    pa_log_info("All %u SHM blocks were released, up to %u at a time.", r.n_memblocks, max_exported);
+}
+
+/* The sender gets everything out before the receiver looks at its
+ * socket. The packets are written first, without fds, and the memblock
+ * frame carrying the fd of its memfd segment follows in a write of its
+ * own. The receiver then takes all of them, fd included, with a single
+ * recvmsg() into its read buffer and has to hand the fd to the right
+ * frame. */
+static void test_fd_after_buffered_frames(void) {
+#ifdef HAVE_MEMFD
+    pa_mainloop *ma, *mb;
+    pa_mempool *pool_a, *pool_b;
+    pa_pstream *a, *b;
+    struct receiver r;
+    int fds[2];
+
+    if (!(pool_a = pa_mempool_new_memfd(0))) {
+        pa_log("No memfd support, skipping fd test.");
+        return;
+    }
+
+    pa_assert_se(pool_b = pa_mempool_new(FALSE, 0));
+    pa_assert_se(ma = pa_mainloop_new());
+    pa_assert_se(mb = pa_mainloop_new());
+
+    pa_assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    a = pa_pstream_new(pa_mainloop_get_api(ma), pa_iochannel_new(pa_mainloop_get_api(ma), fds[0], fds[0]), pool_a);
+    b = pa_pstream_new(pa_mainloop_get_api(mb), pa_iochannel_new(pa_mainloop_get_api(mb), fds[1], fds[1]), pool_b);
+
+    pa_pstream_enable_shm(a, TRUE);
+    pa_pstream_enable_memfd(a, pool_a);
+    pa_pstream_enable_shm(b, TRUE);
+    pa_pstream_enable_memfd(b, NULL);
+
+    memset(&r, 0, sizeof(r));
+    r.n_items = 3;
+    r.memblock_length_max = SHM_LENGTH_MAX;
+    pa_pstream_set_recieve_packet_callback(b, packet_callback, &r);
+    pa_pstream_set_recieve_memblock_callback(b, memblock_callback, &r);
+
+    /* Items 0 and 1 are packets, item 2 is the memblock */
+    send_items(a, pool_a, r.n_items, SHM_LENGTH_MAX);
+
+    while (pa_pstream_is_pending(a))
+        pa_assert_se(pa_mainloop_iterate(ma, 1, NULL) >= 0);
+
+    while (r.next < r.n_items)
+        pa_assert_se(pa_mainloop_iterate(mb, 1, NULL) >= 0);
+
+    pa_assert_se(r.n_packets == 2);
+    pa_assert_se(r.n_memblocks == 1);
+
+    pa_pstream_unlink(a);
+    pa_pstream_unref(a);
+    pa_pstream_unlink(b);
+    pa_pstream_unref(b);
+
+    pa_mainloop_free(ma);
+    pa_mainloop_free(mb);
+    pa_mempool_free(pool_a);
+    pa_mempool_free(pool_b);
+
+    pa_log_info("The memfd came along with the frames before it.");
+#else
+    pa_log("No memfd support, skipping fd test.");
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    pa_mainloop *m;
+    pa_mempool *pool;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_assert_se(m = pa_mainloop_new());
+    pa_assert_se(pool = pa_mempool_new(FALSE, 0));
+
+    test_mixed(m, pool);
+    test_shm_release(m);
+    test_fd_after_buffered_frames();
+
+    pa_mempool_free(pool);
+    pa_mainloop_free(m);
+
+    return 0;
+}
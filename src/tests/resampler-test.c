@@ -23,15 +23,21 @@
 
 #include <stdio.h>
 
+#include <pulse/rtclock.h>
 #include <pulse/sample.h>
+#include <pulse/timeval.h>
 #include <pulse/volume.h>
 
 #include <pulsecore/resampler.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/endianmacros.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
 #include <pulsecore/sample-util.h>
 
+#define BENCH_SECONDS 60
+
 static void dump_block(const pa_sample_spec *ss, const pa_memchunk *chunk) {
     void *d;
     unsigned i;
@@ -241,13 +247,54 @@ static pa_memblock* generate_block(pa_mempool *pool, const pa_sample_spec *ss) {
     return r;
 }
 
+/* Feed BENCH_SECONDS of audio through a resampler in 20ms blocks, the
+ * way a sink input does */
+static void run_benchmark(pa_mempool *pool, pa_resample_method_t method, const pa_sample_spec *a, const pa_sample_spec *b) {
+    pa_resampler *r;
+    pa_memchunk i, j;
+    pa_usec_t start, stop;
+    unsigned n;
+
+    pa_assert_se(r = pa_resampler_new(pool, a, NULL, b, NULL, method, 0));
+
+    i.length = pa_usec_to_bytes(20 * PA_USEC_PER_MSEC, a);
+    i.memblock = pa_memblock_new(pool, i.length);
+    i.index = 0;
+    pa_silence_memchunk(&i, a);
+
+    start = pa_rtclock_now();
+
+    for (n = 0; n < BENCH_SECONDS * 50; n++) {
+        pa_resampler_run(r, &i, &j);
+
+        if (j.memblock)
+            pa_memblock_unref(j.memblock);
+    }
+
+    stop = pa_rtclock_now();
+
+    pa_log_info("%s %uch %uHz -> %s %uch %uHz: %llu usec for %u seconds.",
+                pa_sample_format_to_string(a->format), a->channels, a->rate,
+                pa_sample_format_to_string(b->format), b->channels, b->rate,
+                (long long unsigned) (stop - start), BENCH_SECONDS);
+
+    pa_memblock_unref(i.memblock);
+    pa_resampler_free(r);
+}
+
 int main(int argc, char *argv[]) {
     pa_mempool *pool;
     pa_sample_spec a, b;
     pa_cvolume v;
+    pa_resample_method_t method = PA_RESAMPLER_AUTO;
 
     pa_log_set_level(PA_LOG_DEBUG);
 
+    if (argc > 1 && (method = pa_parse_resample_method(argv[1])) == PA_RESAMPLER_INVALID) {
+        pa_log("Unknown resample method '%s'.", argv[1]);
+        return 1;
+    }
+
     pa_assert_se(pool = pa_mempool_new(FALSE, 0));
 
     a.channels = b.channels = 1;
@@ -296,6 +343,28 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    /* Throughput for the common conversions of a sink input, with
+     * whatever optimized functions the CPU supports */
+    pa_cpu_init_x86();
+    pa_cpu_init_arm();
+
+    a.format = b.format = PA_SAMPLE_S16NE;
+    a.channels = b.channels = 2;
+    a.rate = 44100;
+    b.rate = 48000;
+    run_benchmark(pool, method, &a, &b);
+
+    a.channels = 1;
+    run_benchmark(pool, method, &a, &b);
+
+    a.rate = 48000;
+    run_benchmark(pool, method, &a, &b);
+
+    a.format = PA_SAMPLE_FLOAT32NE;
+    a.channels = 2;
+    a.rate = 44100;
+    run_benchmark(pool, method, &a, &b);
+
     pa_mempool_free(pool);
 
     return 0;
@@ -23,9 +23,15 @@
 
 #include <signal.h>
 #include <poll.h>
+#include <unistd.h>
+
+#include <pulse/rtclock.h>
 
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/core-rtclock.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
 
 static int before(pa_rtpoll_item *i) {
     pa_log("before");
@@ -41,6 +47,85 @@ static int worker(pa_rtpoll_item *w) {
     return 0;
 }
 
+/* Changes the pollfds between iterations the way the modules do, to
+ * check that the registered fds follow */
+static void pipes(void) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *i;
+    struct pollfd *pollfd;
+    int a[2], b[2];
+    pa_usec_t t;
+    char c = 'x';
+
+    pa_assert_se(pipe(a) == 0);
+    pa_assert_se(pipe(b) == 0);
+
+    p = pa_rtpoll_new();
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = a[0];
+    pollfd->events = POLLIN;
+
+    /* Nothing to read, so the timer has to wake us up */
+    t = pa_rtclock_now();
+    pa_rtpoll_set_timer_relative(p, 20000);
+    pa_assert_se(pa_rtpoll_run(p, TRUE) > 0);
+    pa_assert_se(pa_rtpoll_timer_elapsed(p));
+    pa_assert_se(pa_rtclock_now() - t >= 20000);
+
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pa_assert_se(pollfd->revents == 0);
+
+    /* Readable fd, the timer must not be reported */
+    pa_assert_se(write(a[1], &c, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 1000000);
+    pa_assert_se(pa_rtpoll_run(p, TRUE) > 0);
+    pa_assert_se(!pa_rtpoll_timer_elapsed(p));
+
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pa_assert_se(pollfd->revents & POLLIN);
+
+    /* Switch to another fd, the old one is still readable */
+    pollfd->fd = b[0];
+    pa_rtpoll_set_timer_relative(p, 20000);
+    pa_assert_se(pa_rtpoll_run(p, TRUE) > 0);
+    pa_assert_se(pa_rtpoll_timer_elapsed(p));
+
+    pa_assert_se(write(b[1], &c, 1) == 1);
+    pa_rtpoll_set_timer_disabled(p);
+    pa_assert_se(pa_rtpoll_run(p, TRUE) > 0);
+
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pa_assert_se(pollfd->revents & POLLIN);
+
+    /* No interest in any events, but the fd stays readable */
+    pollfd->events = 0;
+    pa_assert_se(pa_rtpoll_run(p, FALSE) > 0);
+    pa_assert_se(pa_rtpoll_timer_elapsed(p));
+
+    /* Close before freeing the item, as some modules do */
+    pa_close(b[0]);
+    pa_rtpoll_item_free(i);
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = a[0];
+    pollfd->events = POLLIN;
+
+    pa_assert_se(pa_rtpoll_run(p, TRUE) > 0);
+
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pa_assert_se(pollfd->revents & POLLIN);
+
+    pa_rtpoll_item_free(i);
+    pa_rtpoll_free(p);
+
+    pa_close(a[0]);
+    pa_close(a[1]);
+    pa_close(b[1]);
+}
+
 int main(int argc, char *argv[]) {
     pa_rtpoll *p;
     pa_rtpoll_item *i, *w;
@@ -81,5 +166,7 @@ int main(int argc, char *argv[]) {
 
     pa_rtpoll_free(p);
 
+    pipes();
+
     return 0;
 }
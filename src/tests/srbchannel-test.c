@@ -0,0 +1,224 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pulse/mainloop.h>
+#include <pulsecore/srbchannel.h>
+#include <pulsecore/log.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+/* Pushes more data than the rings hold in odd sized pieces through
+ * both directions at once */
+#define TOTAL (1024*1024)
+#define CHUNK 1021
+
+struct side {
+    const char *name;
+    pa_srbchannel *sr;
+    size_t written, read;
+    uint8_t next_write, next_read;
+};
+
+static pa_mainloop *m;
+static struct side sides[2];
+
+static void check_done(void) {
+    if (sides[0].read >= TOTAL && sides[1].read >= TOTAL &&
+        sides[0].written >= TOTAL && sides[1].written >= TOTAL)
+        pa_mainloop_quit(m, 0);
+}
+
+static pa_bool_t callback(pa_srbchannel *sr, void *userdata) {
+    struct side *s = userdata;
+    uint8_t buf[CHUNK];
+    size_t n, i;
+
+    pa_assert(s->sr == sr);
+
+    while (s->read < TOTAL && (n = pa_srbchannel_read(sr, buf, PA_MIN(sizeof(buf), TOTAL - s->read))) > 0) {
+        for (i = 0; i < n; i++)
+            pa_assert_se(buf[i] == s->next_read++);
+
+        s->read += n;
+    }
+
+    while (s->written < TOTAL) {
+        size_t k = PA_MIN(sizeof(buf), TOTAL - s->written);
+        uint8_t b = s->next_write;
+
+        for (i = 0; i < k; i++)
+            buf[i] = b++;
+
+        if ((n = pa_srbchannel_write(sr, buf, k)) <= 0)
+            break;
+
+        s->next_write = (uint8_t) (s->next_write + n);
+        s->written += n;
+    }
+
+    check_done();
+    return TRUE;
+}
+
+/* What one side publishes in a timing page the other side sees */
+static void test_timing_pages(void) {
+    pa_timing_page *w, *r;
+    pa_timing_data d, e;
+
+    pa_assert_se(w = pa_srbchannel_get_timing_page(sides[0].sr, 0));
+    pa_assert_se(r = pa_srbchannel_get_timing_page(sides[1].sr, 0));
+    pa_assert_se(!pa_srbchannel_get_timing_page(sides[1].sr, PA_SRBCHANNEL_TIMING_PAGES_MAX));
+
+    pa_assert_se(pa_timing_page_read(r, &e) < 0);
+
+    memset(&d, 0, sizeof(d));
+    d.write_index = 4711;
+    d.read_index = 42;
+    d.sink_usec = 25000;
+    d.playing = 1;
+    pa_timing_page_write(w, &d);
+
+    pa_assert_se(pa_timing_page_read(r, &e) >= 0);
+    pa_assert_se(memcmp(&d, &e, sizeof(d)) == 0);
+}
+
+/* A writer thread keeps publishing snapshots whose fields all derive
+ * from one counter, so a torn read shows up as a mismatch */
+#define TIMING_UPDATES 200000
+
+static pa_atomic_t writer_done = PA_ATOMIC_INIT(0);
+
+static void fill_timing_data(pa_timing_data *d, uint64_t n) {
+    memset(d, 0, sizeof(*d));
+    d->write_index = (int64_t) n;
+    d->read_index = (int64_t) ~n;
+    d->sink_usec = n * 3;
+    d->timestamp = n * 5;
+    d->underrun_for = n * 7;
+    d->playing_for = n * 11;
+    d->playing = (uint32_t) n;
+}
+
+static void timing_writer(void *userdata) {
+    pa_timing_page *w = userdata;
+    pa_timing_data d;
+    uint64_t n;
+
+    for (n = 1; n <= TIMING_UPDATES; n++) {
+        fill_timing_data(&d, n);
+        pa_timing_page_write(w, &d);
+    }
+
+    pa_atomic_store(&writer_done, 1);
+}
+
+static void test_timing_pages_concurrent(void) {
+    pa_timing_page *w, *r;
+    pa_thread *t;
+    pa_timing_data d, e;
+    unsigned good = 0;
+    int64_t last = 0;
+
+    pa_assert_se(w = pa_srbchannel_get_timing_page(sides[0].sr, 1));
+    pa_assert_se(r = pa_srbchannel_get_timing_page(sides[1].sr, 1));
+
+    pa_assert_se(t = pa_thread_new(timing_writer, w));
+
+    while (!pa_atomic_load(&writer_done)) {
+        if (pa_timing_page_read(r, &d) < 0)
+            continue;
+
+        fill_timing_data(&e, (uint64_t) d.write_index);
+        pa_assert_se(memcmp(&d, &e, sizeof(d)) == 0);
+        pa_assert_se(d.write_index >= last);
+
+        last = d.write_index;
+        good++;
+    }
+
+    pa_thread_free(t);
+
+    pa_assert_se(pa_timing_page_read(r, &d) >= 0);
+    pa_assert_se(d.write_index == TIMING_UPDATES);
+
+    pa_log_info("%u consistent timing page reads", good);
+}
+
+int main(int argc, char *argv[]) {
+    pa_srbchannel_template t;
+    unsigned i;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    m = pa_mainloop_new();
+
+    if (!(sides[0].sr = pa_srbchannel_new(pa_mainloop_get_api(m)))) {
+        pa_log("Ring buffer channels not supported, skipping.");
+        pa_mainloop_free(m);
+        return 0;
+    }
+
+    /* The template hands over the fds, which we still own as the
+     * creating side */
+    pa_srbchannel_export(sides[0].sr, &t);
+    t.memfd = dup(t.memfd);
+    t.eventfd[0] = dup(t.eventfd[0]);
+    t.eventfd[1] = dup(t.eventfd[1]);
+
+    pa_assert_se(sides[1].sr = pa_srbchannel_new_from_template(pa_mainloop_get_api(m), &t));
+
+    sides[0].name = "creator";
+    sides[1].name = "user";
+
+    for (i = 0; i < 2; i++) {
+        sides[i].written = sides[i].read = 0;
+        sides[i].next_write = sides[i].next_read = (uint8_t) (i * 7);
+        pa_srbchannel_set_callback(sides[i].sr, callback, &sides[i]);
+    }
+
+    test_timing_pages();
+    test_timing_pages_concurrent();
+
+    /* Both sides read what the other one wrote */
+    sides[0].next_read = 7;
+    sides[1].next_read = 0;
+
+    pa_mainloop_run(m, NULL);
+
+    for (i = 0; i < 2; i++) {
+        pa_log_info("%s: wrote %lu, read %lu", sides[i].name, (unsigned long) sides[i].written, (unsigned long) sides[i].read);
+        pa_assert_se(sides[i].read == TOTAL);
+        pa_srbchannel_free(sides[i].sr);
+    }
+
+    pa_mainloop_free(m);
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <pulse/rtclock.h>
+
+#include <pulsecore/tagstruct.h>
+#include <pulsecore/packet.h>
+#include <pulsecore/log.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+/* Encodes and decodes something that looks like a sink info reply,
+ * once small enough for a pooled packet and once as a list that has
+ * to grow */
+#define BENCH_TIMES 100000
+#define LIST_ENTRIES 64
+
+static void encode(pa_tagstruct *t, uint32_t idx, const pa_sample_spec *ss, const pa_channel_map *map, const pa_cvolume *v, pa_proplist *p) {
+    pa_tagstruct_putu32(t, idx);
+    pa_tagstruct_puts(t, "alsa_output.pci-0000_00_1b.0.analog-stereo");
+    pa_tagstruct_puts(t, "Built-in Audio Analog Stereo");
+    pa_tagstruct_put_sample_spec(t, ss);
+    pa_tagstruct_put_channel_map(t, map);
+    pa_tagstruct_put_cvolume(t, v);
+    pa_tagstruct_put_boolean(t, FALSE);
+    pa_tagstruct_put_usec(t, 25000);
+    pa_tagstruct_puts(t, NULL);
+    pa_tagstruct_put_proplist(t, p);
+}
+
+static void decode(pa_tagstruct *t, uint32_t idx, const pa_sample_spec *ss, pa_proplist *p) {
+    uint32_t i;
+    const char *name, *description, *driver;
+    pa_sample_spec rss;
+    pa_channel_map rmap;
+    pa_cvolume rv;
+    pa_bool_t mute;
+    pa_usec_t latency;
+
+    pa_assert_se(pa_tagstruct_getu32(t, &i) >= 0);
+    pa_assert_se(pa_tagstruct_gets(t, &name) >= 0);
+    pa_assert_se(pa_tagstruct_gets(t, &description) >= 0);
+    pa_assert_se(pa_tagstruct_get_sample_spec(t, &rss) >= 0);
+    pa_assert_se(pa_tagstruct_get_channel_map(t, &rmap) >= 0);
+    pa_assert_se(pa_tagstruct_get_cvolume(t, &rv) >= 0);
+    pa_assert_se(pa_tagstruct_get_boolean(t, &mute) >= 0);
+    pa_assert_se(pa_tagstruct_get_usec(t, &latency) >= 0);
+    pa_assert_se(pa_tagstruct_gets(t, &driver) >= 0);
+
+    pa_assert_se(i == idx);
+    pa_assert_se(pa_streq(description, "Built-in Audio Analog Stereo"));
+    pa_assert_se(pa_sample_spec_equal(&rss, ss));
+    pa_assert_se(!mute);
+    pa_assert_se(latency == 25000);
+    pa_assert_se(!driver);
+
+    if (p)
+        pa_assert_se(pa_tagstruct_get_proplist(t, p) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+    pa_sample_spec ss;
+    pa_channel_map map;
+    pa_cvolume v;
+    pa_proplist *p, *q;
+    pa_tagstruct *t;
+    pa_packet *packet;
+    pa_usec_t start, stop;
+    unsigned i, j, times;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    times = getenv("MAKE_CHECK") ? BENCH_TIMES / 100 : BENCH_TIMES;
+
+    ss.format = PA_SAMPLE_S16LE;
+    ss.rate = 44100;
+    ss.channels = 2;
+    pa_channel_map_init_stereo(&map);
+    pa_cvolume_set(&v, 2, PA_VOLUME_NORM);
+
+    p = pa_proplist_new();
+    pa_proplist_sets(p, PA_PROP_DEVICE_DESCRIPTION, "Built-in Audio Analog Stereo");
+    pa_proplist_sets(p, PA_PROP_DEVICE_CLASS, "sound");
+    pa_proplist_sets(p, PA_PROP_DEVICE_API, "alsa");
+
+    /* Round trip with the proplist, which has to come out equal */
+    t = pa_tagstruct_new(NULL, 0);
+    encode(t, 0, &ss, &map, &v, p);
+    pa_assert_se(packet = pa_tagstruct_free_packet(t));
+    pa_assert_se(packet->type == PA_PACKET_POOLED);
+
+    q = pa_proplist_new();
+    t = pa_tagstruct_new(packet->data, packet->length);
+    decode(t, 0, &ss, q);
+    pa_assert_se(pa_tagstruct_eof(t));
+    pa_assert_se(pa_proplist_size(q) == 3);
+    pa_assert_se(pa_streq(pa_proplist_gets(q, PA_PROP_DEVICE_API), "alsa"));
+    pa_tagstruct_free(t);
+    pa_proplist_free(q);
+    pa_packet_unref(packet);
+
+    /* Single entries fit into pooled packets */
+    start = pa_rtclock_now();
+    for (i = 0; i < times; i++) {
+        t = pa_tagstruct_new(NULL, 0);
+        encode(t, i, &ss, &map, &v, p);
+        packet = pa_tagstruct_free_packet(t);
+
+        t = pa_tagstruct_new(packet->data, packet->length);
+        decode(t, i, &ss, NULL);
+        pa_tagstruct_free(t);
+        pa_packet_unref(packet);
+    }
+    stop = pa_rtclock_now();
+    pa_log_info("%u single entry round trips: %llu usec.", times,
+                (long long unsigned int) (stop - start));
+
+    /* Lists outgrow them */
+    q = pa_proplist_new();
+    start = pa_rtclock_now();
+    for (i = 0; i < times / LIST_ENTRIES; i++) {
+        t = pa_tagstruct_new(NULL, 0);
+        for (j = 0; j < LIST_ENTRIES; j++)
+            encode(t, j, &ss, &map, &v, p);
+        packet = pa_tagstruct_free_packet(t);
+        pa_assert_se(packet->type == PA_PACKET_APPENDED);
+
+        t = pa_tagstruct_new(packet->data, packet->length);
+        for (j = 0; j < LIST_ENTRIES; j++) {
+            decode(t, j, &ss, q);
+            pa_proplist_clear(q);
+        }
+        pa_assert_se(pa_tagstruct_eof(t));
+        pa_tagstruct_free(t);
+        pa_packet_unref(packet);
+    }
+    stop = pa_rtclock_now();
+    pa_log_info("%u lists of %u entries: %llu usec.", times / LIST_ENTRIES, LIST_ENTRIES,
+                (long long unsigned int) (stop - start));
+
+    pa_proplist_free(q);
+    pa_proplist_free(p);
+
+    return 0;
+}